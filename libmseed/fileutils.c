@@ -83,15 +83,17 @@ int8_t packtypes[9][3] = {
  *
  *********************************************************************/
 
-/* Initialize the global file reading parameters */
-MSFileParam gMSFileParam = {NULL, "", NULL, 0, 0, 0, 0, 0, 0, 0};
+/* Initialize the global file reading parameters, only used by
+ * ms_readmsr(), other routines use caller supplied parameters */
+static MSFileParam gMSFileParam = {NULL, "", NULL, 0, 0, 0, 0, 0, 0, 0, {0}};
 
 /**********************************************************************
  * ms_readmsr:
  *
  * This routine is a simple wrapper for ms_readmsr_main() that uses
  * the global file reading parameters.  This routine is not thread
- * safe and cannot be used to read more than one file at a time.
+ * safe and cannot be used to read more than one file at a time, use
+ * ms_readmsr_r() to read files concurrently.
  *
  * See the comments with ms_readmsr_main() for return values and
  * further description of arguments.
@@ -329,6 +331,14 @@ ms_readmsr_main (MSFileParam **ppmsfp, MSRecord **ppmsr, const char *msfile,
   /* Open the file if needed, redirect to stdin if file is "-" */
   if (msfp->fp == NULL)
   {
+    /* Resolve the unpacking overrides once for all records of the file */
+    if (ms_unpackctx_init (&msfp->unpackctx, verbose))
+    {
+      msr_free (ppmsr);
+
+      return MS_GENERROR;
+    }
+
     /* Store the filename for tracking */
     strncpy (msfp->filename, msfile, sizeof (msfp->filename) - 1);
     msfp->filename[sizeof (msfp->filename) - 1] = '\0';
@@ -546,7 +556,8 @@ ms_readmsr_main (MSFileParam **ppmsfp, MSRecord **ppmsr, const char *msfile,
       if (msfp->packhdroffset && msfp->packhdroffset < (msfp->filepos + MSFPBUFLEN (msfp)))
         parselen = msfp->packhdroffset - msfp->filepos;
 
-      parseval = msr_parse (MSFPREADPTR (msfp), parselen, ppmsr, reclen, dataflag, verbose);
+      parseval = msr_parse_ctx (MSFPREADPTR (msfp), parselen, ppmsr, reclen, dataflag, verbose,
+                                &msfp->unpackctx);
 
       /* Record detected and parsed */
       if (parseval == 0)
@@ -784,6 +795,7 @@ ms_readtraces_selection (MSTraceGroup **ppmstg, const char *msfile,
 {
   MSRecord *msr     = 0;
   MSFileParam *msfp = 0;
+  flag indexed;
   int retcode;
 
   if (!ppmstg)
@@ -798,6 +810,10 @@ ms_readtraces_selection (MSTraceGroup **ppmstg, const char *msfile,
       return MS_GENERROR;
   }
 
+  /* Index the traces while reading unless already indexed */
+  if (!(indexed = ((*ppmstg)->index != NULL)))
+    mst_groupindex (*ppmstg, 1);
+
   /* Loop over the input file */
   while ((retcode = ms_readmsr_main (&msfp, &msr, msfile, reclen, NULL, NULL,
                                      skipnotdata, dataflag, NULL, verbose)) == MS_NOERROR)
@@ -827,6 +843,9 @@ ms_readtraces_selection (MSTraceGroup **ppmstg, const char *msfile,
 
   ms_readmsr_main (&msfp, &msr, NULL, 0, NULL, NULL, 0, 0, NULL, 0);
 
+  if (!indexed)
+    mst_groupindex (*ppmstg, 0);
+
   return retcode;
 } /* End of ms_readtraces_selection() */
 
@@ -907,6 +926,7 @@ ms_readtracelist_selection (MSTraceList **ppmstl, const char *msfile,
 {
   MSRecord *msr     = 0;
   MSFileParam *msfp = 0;
+  flag indexed;
   int retcode;
 
   if (!ppmstl)
@@ -921,6 +941,10 @@ ms_readtracelist_selection (MSTraceList **ppmstl, const char *msfile,
       return MS_GENERROR;
   }
 
+  /* Index the traces while reading unless already indexed */
+  if (!(indexed = ((*ppmstl)->index != NULL)))
+    mstl_index (*ppmstl, 1);
+
   /* Loop over the input file */
   while ((retcode = ms_readmsr_main (&msfp, &msr, msfile, reclen, NULL, NULL,
                                      skipnotdata, dataflag, NULL, verbose)) == MS_NOERROR)
@@ -950,6 +974,9 @@ ms_readtracelist_selection (MSTraceList **ppmstl, const char *msfile,
 
   ms_readmsr_main (&msfp, &msr, NULL, 0, NULL, NULL, 0, 0, NULL, 0);
 
+  if (!indexed)
+    mstl_index (*ppmstl, 0);
+
   return retcode;
 } /* End of ms_readtracelist_selection() */
 
@@ -15,6 +15,10 @@
  * (gswapXa) are much faster than the other versions (gswapX), but the
  * memory *must* be aligned.
  *
+ * The bulk versions (gswapXn) swap arrays of quantities, copying
+ * from a source to a destination which may be the same array, using
+ * SSE2 or AVX2 vector instructions when available at compile time.
+ *
  * Written by Chad Trabant,
  *   IRIS Data Management Center
  *
@@ -23,6 +27,15 @@
 
 #include "libmseed.h"
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define GSWAP_AVX2 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define GSWAP_SSE2 1
+#endif
+
 /* Swap routines that work on any (aligned or not) quantities */
 
 void
@@ -140,3 +153,117 @@ ms_gswap8a (void *data8)
   data4[0] = h1;
   data4[1] = h0;
 }
+
+/* Swap routines that work on arrays of quantities, aligned or not */
+
+void
+ms_gswap2n (void *dest, const void *src, size_t count)
+{
+  uint8_t *out      = dest;
+  const uint8_t *in = src;
+  uint16_t value;
+  size_t idx = 0;
+
+#if defined(GSWAP_AVX2)
+  const __m256i mask = _mm256_setr_epi8 (1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+                                         1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+  for (; idx + 16 <= count; idx += 16)
+  {
+    __m256i v = _mm256_loadu_si256 ((const __m256i *)(in + idx * 2));
+    _mm256_storeu_si256 ((__m256i *)(out + idx * 2), _mm256_shuffle_epi8 (v, mask));
+  }
+#endif
+#if defined(GSWAP_SSE2)
+  for (; idx + 8 <= count; idx += 8)
+  {
+    __m128i v = _mm_loadu_si128 ((const __m128i *)(in + idx * 2));
+    v         = _mm_or_si128 (_mm_slli_epi16 (v, 8), _mm_srli_epi16 (v, 8));
+    _mm_storeu_si128 ((__m128i *)(out + idx * 2), v);
+  }
+#endif
+
+  for (; idx < count; idx++)
+  {
+    memcpy (&value, in + idx * 2, 2);
+    value = (uint16_t)((value >> 8) | (value << 8));
+    memcpy (out + idx * 2, &value, 2);
+  }
+}
+
+void
+ms_gswap4n (void *dest, const void *src, size_t count)
+{
+  uint8_t *out      = dest;
+  const uint8_t *in = src;
+  uint32_t value;
+  size_t idx = 0;
+
+#if defined(GSWAP_AVX2)
+  const __m256i mask = _mm256_setr_epi8 (3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                         3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+  for (; idx + 8 <= count; idx += 8)
+  {
+    __m256i v = _mm256_loadu_si256 ((const __m256i *)(in + idx * 4));
+    _mm256_storeu_si256 ((__m256i *)(out + idx * 4), _mm256_shuffle_epi8 (v, mask));
+  }
+#endif
+#if defined(GSWAP_SSE2)
+  for (; idx + 4 <= count; idx += 4)
+  {
+    __m128i v = _mm_loadu_si128 ((const __m128i *)(in + idx * 4));
+    /* Swap 16-bit halves of each 32-bit word, then bytes of each half */
+    v = _mm_shufflehi_epi16 (_mm_shufflelo_epi16 (v, 0xB1), 0xB1);
+    v = _mm_or_si128 (_mm_slli_epi16 (v, 8), _mm_srli_epi16 (v, 8));
+    _mm_storeu_si128 ((__m128i *)(out + idx * 4), v);
+  }
+#endif
+
+  for (; idx < count; idx++)
+  {
+    memcpy (&value, in + idx * 4, 4);
+    value = (((value >> 24) & 0xff) | ((value & 0xff) << 24) |
+             ((value >> 8) & 0xff00) | ((value & 0xff00) << 8));
+    memcpy (out + idx * 4, &value, 4);
+  }
+}
+
+void
+ms_gswap8n (void *dest, const void *src, size_t count)
+{
+  uint8_t *out      = dest;
+  const uint8_t *in = src;
+  uint32_t h0, h1;
+  size_t idx = 0;
+
+#if defined(GSWAP_AVX2)
+  const __m256i mask = _mm256_setr_epi8 (7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+                                         7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+  for (; idx + 4 <= count; idx += 4)
+  {
+    __m256i v = _mm256_loadu_si256 ((const __m256i *)(in + idx * 8));
+    _mm256_storeu_si256 ((__m256i *)(out + idx * 8), _mm256_shuffle_epi8 (v, mask));
+  }
+#endif
+#if defined(GSWAP_SSE2)
+  for (; idx + 2 <= count; idx += 2)
+  {
+    __m128i v = _mm_loadu_si128 ((const __m128i *)(in + idx * 8));
+    /* Reverse 16-bit words of each 64-bit word, then bytes of each word */
+    v = _mm_shufflehi_epi16 (_mm_shufflelo_epi16 (v, 0x1B), 0x1B);
+    v = _mm_or_si128 (_mm_slli_epi16 (v, 8), _mm_srli_epi16 (v, 8));
+    _mm_storeu_si128 ((__m128i *)(out + idx * 8), v);
+  }
+#endif
+
+  for (; idx < count; idx++)
+  {
+    memcpy (&h0, in + idx * 8, 4);
+    memcpy (&h1, in + idx * 8 + 4, 4);
+    h0 = (((h0 >> 24) & 0xff) | ((h0 & 0xff) << 24) |
+          ((h0 >> 8) & 0xff00) | ((h0 & 0xff00) << 8));
+    h1 = (((h1 >> 24) & 0xff) | ((h1 & 0xff) << 24) |
+          ((h1 >> 8) & 0xff00) | ((h1 & 0xff00) << 8));
+    memcpy (out + idx * 8, &h1, 4);
+    memcpy (out + idx * 8 + 4, &h0, 4);
+  }
+}
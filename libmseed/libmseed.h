@@ -28,8 +28,8 @@
 extern "C" {
 #endif
 
-#define LIBMSEED_VERSION "2.19.6"
-#define LIBMSEED_RELEASE "2018.240"
+#define LIBMSEED_VERSION "3.0.0"
+#define LIBMSEED_RELEASE "2026.289"
 
 /* C99 standard headers */
 #include <stdlib.h>
@@ -461,6 +461,7 @@ typedef struct StreamState_s
   int64_t   packedsamples;           /* Count of packed samples */
   int32_t   lastintsample;           /* Value of last integer sample packed */
   flag      comphistory;             /* Control use of lastintsample for compression history */
+  void     *packcache;               /* Packed header and record buffer, released with free() */
 }
 StreamState;
 
@@ -512,6 +513,8 @@ typedef struct MSTrace_s {
   int64_t         samplecnt;         /* Number of samples in trace coverage */
   void           *datasamples;       /* Data samples, 'numsamples' of type 'sampletype' */
   int64_t         numsamples;        /* Number of data samples in datasamples */
+  int64_t         dataoffset;        /* Unused samples preceding datasamples in its buffer */
+  int64_t         datacapacity;      /* Size of the buffer holding datasamples in samples */
   char            sampletype;        /* Sample type code: a, i, f, d */
   void           *prvtptr;           /* Private pointer for general use, unused by libmseed */
   StreamState    *ststate;           /* Stream processing state information */
@@ -523,9 +526,23 @@ MSTrace;
 typedef struct MSTraceGroup_s {
   int32_t           numtraces;       /* Number of MSTraces in the trace chain */
   struct MSTrace_s *traces;          /* Root of the trace chain */
+  void             *index;           /* Hash index of traces, see mst_groupindex() */
 }
 MSTraceGroup;
 
+/* Search tree node of a trace segment, maintained by mstl_addmsr() */
+typedef struct MSTraceSegTree_s {
+  struct MSTraceSeg_s *parent;       /* Parent segment in the tree */
+  struct MSTraceSeg_s *left;         /* Subtree of segments earlier in the list */
+  struct MSTraceSeg_s *right;        /* Subtree of segments later in the list */
+  uint32_t        priority;          /* Heap priority of the segment */
+  hptime_t        minstart;          /* Earliest start time in the subtree */
+  hptime_t        maxstart;          /* Latest start time in the subtree */
+  hptime_t        minend;            /* Earliest end time in the subtree */
+  hptime_t        maxend;            /* Latest end time in the subtree */
+}
+MSTraceSegTree;
+
 /* Container for a continuous trace segment, linkable */
 typedef struct MSTraceSeg_s {
   hptime_t        starttime;         /* Time of first sample */
@@ -534,10 +551,13 @@ typedef struct MSTraceSeg_s {
   int64_t         samplecnt;         /* Number of samples in trace coverage */
   void           *datasamples;       /* Data samples, 'numsamples' of type 'sampletype'*/
   int64_t         numsamples;        /* Number of data samples in datasamples */
+  int64_t         dataoffset;        /* Unused samples preceding datasamples in its buffer */
+  int64_t         datacapacity;      /* Size of the buffer holding datasamples in samples */
   char            sampletype;        /* Sample type code: a, i, f, d */
   void           *prvtptr;           /* Private pointer for general use, unused by libmseed */
   struct MSTraceSeg_s *prev;         /* Pointer to previous segment */
   struct MSTraceSeg_s *next;         /* Pointer to next segment */
+  MSTraceSegTree  tree;              /* Search tree links of the segment */
 }
 MSTraceSeg;
 
@@ -556,6 +576,8 @@ typedef struct MSTraceID_s {
   int32_t         numsegments;       /* Number of segments for this ID */
   struct MSTraceSeg_s *first;        /* Pointer to first of list of segments */
   struct MSTraceSeg_s *last;         /* Pointer to last of list of segments */
+  struct MSTraceSeg_s *treeroot;     /* Root of search tree of segments */
+  int32_t         treesegments;      /* Number of segments in search tree */
   struct MSTraceID_s *next;          /* Pointer to next trace */
 }
 MSTraceID;
@@ -565,9 +587,42 @@ typedef struct MSTraceList_s {
   int32_t             numtraces;     /* Number of traces in list */
   struct MSTraceID_s *traces;        /* Pointer to list of traces */
   struct MSTraceID_s *last;          /* Pointer to last used trace in list */
+  void               *index;         /* Hash index of traces, see mstl_index() */
 }
 MSTraceList;
 
+/* Identifiers of a trace in a trace table */
+typedef struct MSTraceTableID_s {
+  char            network[11];       /* Network designation, NULL terminated */
+  char            station[11];       /* Station designation, NULL terminated */
+  char            location[11];      /* Location designation, NULL terminated */
+  char            channel[11];       /* Channel designation, NULL terminated */
+  char            dataquality;       /* Data quality indicator */
+  char            type;              /* Trace type code */
+}
+MSTraceTableID;
+
+/* Container for a table of traces, each field in a parallel array
+ * indexed by trace and data samples of all traces in a shared pool */
+typedef struct MSTraceTable_s {
+  int32_t         numtraces;         /* Number of traces in table */
+  int32_t         maxtraces;         /* Number of traces allocated */
+  hptime_t       *starttime;         /* Time of first sample */
+  hptime_t       *endtime;           /* Time of last sample */
+  double         *samprate;          /* Nominal sample rate (Hz) */
+  int64_t        *samplecnt;         /* Number of samples in trace coverage */
+  int64_t        *numsamples;        /* Number of data samples in the pool */
+  int64_t        *dataoffset;        /* Byte offset of data samples in the pool */
+  char           *sampletype;        /* Sample type code: a, i, f, d */
+  MSTraceTableID *id;                /* Trace identifiers */
+  void          **prvtptr;           /* Private pointer for general use, unused by libmseed */
+  StreamState   **ststate;           /* Stream processing state information */
+  char           *datapool;          /* Data samples of all traces */
+  int64_t         datasize;          /* Bytes of the data pool in use */
+  int64_t         datacapacity;      /* Bytes of the data pool allocated */
+}
+MSTraceTable;
+
 /* Data selection structure time window definition containers */
 typedef struct SelectTime_s {
   hptime_t starttime;    /* Earliest data for matching channels */
@@ -584,14 +639,16 @@ typedef struct Selections_s {
 
 
 /* Global variables (defined in pack.c) and macros to set/force
- * pack byte orders */
+ * pack byte orders.  The library only reads these, set them before
+ * packing records in multiple threads. */
 extern flag packheaderbyteorder;
 extern flag packdatabyteorder;
 #define MS_PACKHEADERBYTEORDER(X) (packheaderbyteorder = X);
 #define MS_PACKDATABYTEORDER(X) (packdatabyteorder = X);
 
 /* Global variables (defined in unpack.c) and macros to set/force
- * unpack byte orders */
+ * unpack byte orders.  The library only reads these, set them before
+ * unpacking records in multiple threads. */
 extern flag unpackheaderbyteorder;
 extern flag unpackdatabyteorder;
 #define MS_UNPACKHEADERBYTEORDER(X) (unpackheaderbyteorder = X);
@@ -604,10 +661,33 @@ extern int unpackencodingfallback;
 #define MS_UNPACKENCODINGFORMAT(X) (unpackencodingformat = X);
 #define MS_UNPACKENCODINGFALLBACK(X) (unpackencodingfallback = X);
 
+/* Packing context, the overrides above and debugging flags resolved
+ * once for packing many records, see msr_pack_ctx() */
+typedef struct MSPackContext_s {
+  flag        headerbyteorder;  /* Forced header byte order, -1 if not forced */
+  flag        databyteorder;    /* Forced data byte order, -1 if not forced */
+  flag        encodedebug;      /* Print encoding diagnostics, ENCODE_DEBUG */
+  struct MSLogParam_s *logp;    /* Logging parameters, NULL for the global logging */
+} MSPackContext;
+
+/* Unpacking context, the overrides above and debugging flags resolved
+ * once for unpacking many records, see msr_unpack_ctx() */
+typedef struct MSUnpackContext_s {
+  flag        headerbyteorder;  /* Forced header byte order, -1 if not forced */
+  flag        databyteorder;    /* Forced data byte order, -1 if not forced */
+  int         encodingformat;   /* Forced encoding format, -1 if not forced */
+  int         encodingfallback; /* Encoding format of records without one */
+  flag        decodedebug;      /* Print decoding diagnostics, DECODE_DEBUG */
+  struct MSLogParam_s *logp;    /* Logging parameters, NULL for the global logging */
+} MSUnpackContext;
+
 /* Mini-SEED record related functions */
 extern int           msr_parse (char *record, int recbuflen, MSRecord **ppmsr, int reclen,
 				flag dataflag, flag verbose);
 
+extern int           msr_parse_ctx (char *record, int recbuflen, MSRecord **ppmsr, int reclen,
+				    flag dataflag, flag verbose, MSUnpackContext *ctx);
+
 extern int           msr_parse_selection ( char *recbuf, int recbuflen, int64_t *offset,
 					   MSRecord **ppmsr, int reclen,
 					   Selections *selections, flag dataflag, flag verbose );
@@ -615,13 +695,24 @@ extern int           msr_parse_selection ( char *recbuf, int recbuflen, int64_t
 extern int           msr_unpack (char *record, int reclen, MSRecord **ppmsr,
 				 flag dataflag, flag verbose);
 
+extern int           msr_unpack_ctx (char *record, int reclen, MSRecord **ppmsr,
+				     flag dataflag, flag verbose, MSUnpackContext *ctx);
+
 extern int           msr_pack (MSRecord *msr, void (*record_handler) (char *, int, void *),
 		 	       void *handlerdata, int64_t *packedsamples, flag flush, flag verbose );
 
+extern int           msr_pack_ctx (MSRecord *msr, void (*record_handler) (char *, int, void *),
+				   void *handlerdata, int64_t *packedsamples, flag flush, flag verbose,
+				   MSPackContext *ctx);
+
 extern int           msr_pack_header (MSRecord *msr, flag normalize, flag verbose);
 
 extern int           msr_unpack_data (MSRecord *msr, int swapflag, flag verbose);
 
+extern int           ms_packctx_init (MSPackContext *ctx, flag verbose);
+extern void          ms_packctx_free (MSPackContext *ctx);
+extern int           ms_unpackctx_init (MSUnpackContext *ctx, flag verbose);
+
 extern MSRecord*     msr_init (MSRecord *msr);
 extern void          msr_free (MSRecord **ppmsr);
 extern void          msr_free_blktchain (MSRecord *msr);
@@ -645,8 +736,10 @@ extern int           ms_parse_raw (char *record, int maxreclen, flag details, fl
 /* MSTrace related functions */
 extern MSTrace*      mst_init (MSTrace *mst);
 extern void          mst_free (MSTrace **ppmst);
+extern void          mst_freesamples (MSTrace *mst);
 extern MSTraceGroup* mst_initgroup (MSTraceGroup *mstg);
 extern void          mst_freegroup (MSTraceGroup **ppmstg);
+extern int           mst_groupindex (MSTraceGroup *mstg, flag enable);
 extern MSTrace*      mst_findmatch (MSTrace *startmst, char dataquality,
 				    char *network, char *station, char *location, char *channel);
 extern MSTrace*      mst_findadjacent (MSTraceGroup *mstg, flag *whence, char dataquality,
@@ -673,6 +766,10 @@ extern int           mst_pack (MSTrace *mst, void (*record_handler) (char *, int
 			       void *handlerdata, int reclen, flag encoding, flag byteorder,
 			       int64_t *packedsamples, flag flush, flag verbose,
 			       MSRecord *mstemplate);
+extern int           mst_pack_ctx (MSTrace *mst, void (*record_handler) (char *, int, void *),
+				   void *handlerdata, int reclen, flag encoding, flag byteorder,
+				   int64_t *packedsamples, flag flush, flag verbose,
+				   MSRecord *mstemplate, MSPackContext *ctx);
 extern int           mst_packgroup (MSTraceGroup *mstg, void (*record_handler) (char *, int, void *),
 				    void *handlerdata, int reclen, flag encoding, flag byteorder,
 				    int64_t *packedsamples, flag flush, flag verbose,
@@ -681,6 +778,8 @@ extern int           mst_packgroup (MSTraceGroup *mstg, void (*record_handler) (
 /* MSTraceList related functions */
 extern MSTraceList * mstl_init ( MSTraceList *mstl );
 extern void          mstl_free ( MSTraceList **ppmstl, flag freeprvtptr );
+extern void          mstl_freesamples ( MSTraceSeg *seg );
+extern int           mstl_index ( MSTraceList *mstl, flag enable );
 extern MSTraceSeg *  mstl_addmsr ( MSTraceList *mstl, MSRecord *msr, flag dataquality,
 				   flag autoheal, double timetol, double sampratetol );
 extern int           mstl_convertsamples ( MSTraceSeg *seg, char type, flag truncate );
@@ -690,6 +789,21 @@ extern void          mstl_printsynclist ( MSTraceList *mstl, char *dccid, flag s
 extern void          mstl_printgaplist (MSTraceList *mstl, flag timeformat,
 					double *mingap, double *maxgap);
 
+/* MSTraceTable related functions */
+extern MSTraceTable* mstt_init ( MSTraceTable *mstt );
+extern void          mstt_free ( MSTraceTable **ppmstt );
+extern int           mstt_fromgroup ( MSTraceTable *mstt, MSTraceGroup *mstg );
+extern int           mstt_togroup ( MSTraceTable *mstt, MSTraceGroup *mstg );
+extern int           mstt_heal ( MSTraceTable *mstt, double timetol, double sampratetol );
+extern int           mstt_sort ( MSTraceTable *mstt, flag quality );
+extern char *        mstt_srcname ( MSTraceTable *mstt, int32_t idx, char *srcname, flag quality );
+extern void          mstt_printtracelist ( MSTraceTable *mstt, flag timeformat,
+					   flag details, flag gaps );
+extern int           mstt_pack ( MSTraceTable *mstt, void (*record_handler) (char *, int, void *),
+				 void *handlerdata, int reclen, flag encoding, flag byteorder,
+				 int64_t *packedsamples, flag flush, flag verbose,
+				 MSRecord *mstemplate );
+
 /* Reading Mini-SEED records from files */
 typedef struct MSFileParam_s
 {
@@ -703,6 +817,7 @@ typedef struct MSFileParam_s
   off_t filepos;
   off_t filesize;
   int   recordcount;
+  MSUnpackContext unpackctx;  /* Unpacking context, resolved when the file is opened */
 } MSFileParam;
 
 extern int      ms_readmsr (MSRecord **ppmsr, const char *msfile, int reclen, off_t *fpos, int *last,
@@ -821,6 +936,11 @@ extern void     ms_gswap2a ( void *data2 );
 extern void     ms_gswap4a ( void *data4 );
 extern void     ms_gswap8a ( void *data8 );
 
+/* Generic byte swapping routines for arrays, dest may equal src */
+extern void     ms_gswap2n ( void *dest, const void *src, size_t count );
+extern void     ms_gswap4n ( void *dest, const void *src, size_t count );
+extern void     ms_gswap8n ( void *dest, const void *src, size_t count );
+
 /* Byte swap macro for the BTime struct */
 #define MS_SWAPBTIME(x) \
   ms_gswap2 (x.year);   \
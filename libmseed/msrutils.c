@@ -46,7 +46,11 @@ msr_init (MSRecord *msr)
       msr_free_blktchain (msr);
 
     if (msr->ststate)
+    {
+      if (msr->ststate->packcache)
+        free (msr->ststate->packcache);
       free (msr->ststate);
+    }
   }
 
   if (msr == NULL)
@@ -92,7 +96,11 @@ msr_free (MSRecord **ppmsr)
 
     /* Free stream processing state if present */
     if ((*ppmsr)->ststate)
+    {
+      if ((*ppmsr)->ststate->packcache)
+        free ((*ppmsr)->ststate->packcache);
       free ((*ppmsr)->ststate);
+    }
 
     free (*ppmsr);
 
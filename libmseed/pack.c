@@ -10,6 +10,7 @@
  * modified: 2015.273
  ***************************************************************************/
 
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -19,20 +20,59 @@
 #include "packdata.h"
 
 /* Function(s) internal to this file */
+static int check_environment (flag *headerbyteorder, flag *databyteorder,
+                              flag verbose);
 static int msr_pack_header_raw (MSRecord *msr, char *rawrec, int maxheaderlen,
                                 flag swapflag, flag normalize,
+                                flag databyteorder,
                                 struct blkt_1001_s **blkt1001,
-                                char *srcname, flag verbose);
+                                char *srcname, MSLogParam *logp, flag verbose);
 static int msr_update_header (MSRecord *msr, char *rawrec, flag swapflag,
                               struct blkt_1001_s *blkt1001,
-                              char *srcname, flag verbose);
+                              char *srcname, MSLogParam *logp, flag verbose);
 static int msr_pack_data (void *dest, void *src, int maxsamples, int maxdatabytes,
                           int32_t *lastintsample, flag comphistory,
                           char sampletype, flag encoding, flag swapflag,
-                          char *srcname, flag verbose);
+                          char *srcname, MSPackContext *ctx, flag verbose);
 
-/* Header and data byte order flags controlled by environment variables */
-/* -2 = not checked, -1 = checked but not set, or 0 = LE and 1 = BE */
+static int msr_chainsize (MSRecord *msr);
+static int msr_chainmatch (MSRecord *msr, const char *chain);
+static void msr_chaincopy (MSRecord *msr, char *chain);
+
+/* Header packed by msr_pack_ctx() and the values it was packed from,
+ * cached at StreamState.packcache.  The record buffer and a copy of the
+ * blockette chain follow the struct in the same allocation, so free()
+ * releases all of them. */
+typedef struct PackCache_s
+{
+  int rawreclen;              /* Length of the record buffer */
+  int chaincapacity;          /* Length of the blockette chain buffer */
+  int chainlen;               /* Length of the cached blockette chain */
+  int headerlen;              /* Length of the cached header, 0 if none */
+  int blkt1001offset;         /* Offset to Blockette 1001 in the header, 0 if none */
+  int reclen;
+  int8_t encoding;
+  int8_t byteorder;
+  flag headerswapflag;
+  flag databyteorder;
+  double samprate;
+  char reserved;              /* Fixed section values not set from the MSRecord */
+  uint8_t act_flags;
+  uint8_t io_flags;
+  uint8_t dq_flags;
+  int32_t time_correct;
+  char srcname[50];
+} PackCache;
+
+/* Size of the cache struct rounded to keep the record buffer aligned */
+#define PACKCACHE_SIZE ((sizeof (PackCache) + 15) & ~((size_t)15))
+#define PACKCACHE_RECORD(PC) ((char *)(PC) + PACKCACHE_SIZE)
+#define PACKCACHE_CHAIN(PC) (PACKCACHE_RECORD (PC) + (PC)->rawreclen)
+
+/* Header and data byte order flags forced by the caller, otherwise
+ * controlled by environment variables read on each call.  These are
+ * only read by the library, packing is reentrant.
+ * -2 = not set, use environment, -1 = not forced, or 0 = LE and 1 = BE */
 flag packheaderbyteorder = -2;
 flag packdatabyteorder   = -2;
 
@@ -65,18 +105,60 @@ flag packdatabyteorder   = -2;
  * The defaults are triggered when the the msr->dataquality is 0 or
  * msr->reclen, msr->encoding and msr->byteorder are -1 respectively.
  *
+ * Byte order overrides are read from the global variables or the
+ * environment on each call, use msr_pack_ctx() with a context resolved
+ * once when packing many records.
+ *
  * Returns the number of records created on success and -1 on error.
  ***************************************************************************/
 int
 msr_pack (MSRecord *msr, void (*record_handler) (char *, int, void *),
           void *handlerdata, int64_t *packedsamples, flag flush, flag verbose)
+{
+  MSPackContext ctx;
+  int recordcnt;
+
+  if (ms_packctx_init (&ctx, verbose))
+    return -1;
+
+  recordcnt = msr_pack_ctx (msr, record_handler, handlerdata, packedsamples,
+                            flush, verbose, &ctx);
+
+  ms_packctx_free (&ctx);
+
+  return recordcnt;
+} /* End of msr_pack() */
+
+/***************************************************************************
+ * msr_pack_ctx:
+ *
+ * Pack data into SEED data records as msr_pack() using the byte order
+ * overrides, debugging flag and logging parameters of a context
+ * initialized with ms_packctx_init().
+ *
+ * The packed header and a record buffer are kept in the StreamState of
+ * the MSRecord and reused by later calls while the source name, sample
+ * rate, record length, encoding, byte order, fixed section flags and
+ * time correction and the contents of the blockette chain are
+ * unchanged, only the sequence number, start time, sample count and
+ * Blockette 1001 are updated for each record.  The header is packed
+ * again when any of them differ from the values it was packed from.
+ *
+ * A context may only be used by one thread at a time.
+ *
+ * Returns the number of records created on success and -1 on error.
+ ***************************************************************************/
+int
+msr_pack_ctx (MSRecord *msr, void (*record_handler) (char *, int, void *),
+              void *handlerdata, int64_t *packedsamples, flag flush, flag verbose,
+              MSPackContext *ctx)
 {
   uint16_t *HPnumsamples;
   uint16_t *HPdataoffset;
   struct blkt_1001_s *HPblkt1001 = NULL;
+  PackCache *cache;
 
   char *rawrec;
-  char *envvariable;
   char srcname[50];
 
   flag headerswapflag = 0;
@@ -88,16 +170,17 @@ msr_pack (MSRecord *msr, void (*record_handler) (char *, int, void *),
   int maxdatabytes;
   int maxsamples;
   int recordcnt = 0;
+  int chainlen;
   int packsamples, packoffset;
   int64_t totalpackedsamples;
   hptime_t segstarttime;
 
-  if (!msr)
+  if (!msr || !ctx)
     return -1;
 
   if (!record_handler)
   {
-    ms_log (2, "msr_pack(): record_handler() function pointer not set!\n");
+    ms_log_l (ctx->logp, 2, "msr_pack(): record_handler() function pointer not set!\n");
     return -1;
   }
 
@@ -107,7 +190,7 @@ msr_pack (MSRecord *msr, void (*record_handler) (char *, int, void *),
     msr->ststate = (StreamState *)malloc (sizeof (StreamState));
     if (!msr->ststate)
     {
-      ms_log (2, "msr_pack(): Could not allocate memory for StreamState\n");
+      ms_log_l (ctx->logp, 2, "msr_pack(): Could not allocate memory for StreamState\n");
       return -1;
     }
     memset (msr->ststate, 0, sizeof (StreamState));
@@ -116,69 +199,13 @@ msr_pack (MSRecord *msr, void (*record_handler) (char *, int, void *),
   /* Generate source name for MSRecord */
   if (msr_srcname (msr, srcname, 1) == NULL)
   {
-    ms_log (2, "msr_unpack_data(): Cannot generate srcname\n");
+    ms_log_l (ctx->logp, 2, "msr_unpack_data(): Cannot generate srcname\n");
     return MS_GENERROR;
   }
 
   /* Track original segment start time for new start time calculation */
   segstarttime = msr->starttime;
 
-  /* Read possible environmental variables that force byteorder */
-  if (packheaderbyteorder == -2)
-  {
-    if ((envvariable = getenv ("PACK_HEADER_BYTEORDER")))
-    {
-      if (*envvariable != '0' && *envvariable != '1')
-      {
-        ms_log (2, "Environment variable PACK_HEADER_BYTEORDER must be set to '0' or '1'\n");
-        return -1;
-      }
-      else if (*envvariable == '0')
-      {
-        packheaderbyteorder = 0;
-        if (verbose > 2)
-          ms_log (1, "PACK_HEADER_BYTEORDER=0, packing little-endian header\n");
-      }
-      else
-      {
-        packheaderbyteorder = 1;
-        if (verbose > 2)
-          ms_log (1, "PACK_HEADER_BYTEORDER=1, packing big-endian header\n");
-      }
-    }
-    else
-    {
-      packheaderbyteorder = -1;
-    }
-  }
-  if (packdatabyteorder == -2)
-  {
-    if ((envvariable = getenv ("PACK_DATA_BYTEORDER")))
-    {
-      if (*envvariable != '0' && *envvariable != '1')
-      {
-        ms_log (2, "Environment variable PACK_DATA_BYTEORDER must be set to '0' or '1'\n");
-        return -1;
-      }
-      else if (*envvariable == '0')
-      {
-        packdatabyteorder = 0;
-        if (verbose > 2)
-          ms_log (1, "PACK_DATA_BYTEORDER=0, packing little-endian data samples\n");
-      }
-      else
-      {
-        packdatabyteorder = 1;
-        if (verbose > 2)
-          ms_log (1, "PACK_DATA_BYTEORDER=1, packing big-endian data samples\n");
-      }
-    }
-    else
-    {
-      packdatabyteorder = -1;
-    }
-  }
-
   /* Set default indicator, record length, byte order and encoding if needed */
   if (msr->dataquality == 0)
     msr->dataquality = 'D';
@@ -195,14 +222,14 @@ msr_pack (MSRecord *msr, void (*record_handler) (char *, int, void *),
 
   if (msr->reclen < MINRECLEN || msr->reclen > MAXRECLEN)
   {
-    ms_log (2, "msr_pack(%s): Record length is out of range: %d\n",
+    ms_log_l (ctx->logp, 2, "msr_pack(%s): Record length is out of range: %d\n",
             srcname, msr->reclen);
     return -1;
   }
 
   if (msr->numsamples <= 0)
   {
-    ms_log (2, "msr_pack(%s): No samples to pack\n", srcname);
+    ms_log_l (ctx->logp, 2, "msr_pack(%s): No samples to pack\n", srcname);
     return -1;
   }
 
@@ -210,7 +237,7 @@ msr_pack (MSRecord *msr, void (*record_handler) (char *, int, void *),
 
   if (!samplesize)
   {
-    ms_log (2, "msr_pack(%s): Unknown sample type '%c'\n",
+    ms_log_l (ctx->logp, 2, "msr_pack(%s): Unknown sample type '%c'\n",
             srcname, msr->sampletype);
     return -1;
   }
@@ -218,50 +245,37 @@ msr_pack (MSRecord *msr, void (*record_handler) (char *, int, void *),
   /* Sanity check for msr/quality indicator */
   if (!MS_ISDATAINDICATOR (msr->dataquality))
   {
-    ms_log (2, "msr_pack(%s): Record header & quality indicator unrecognized: '%c'\n",
+    ms_log_l (ctx->logp, 2, "msr_pack(%s): Record header & quality indicator unrecognized: '%c'\n",
             srcname, msr->dataquality);
-    ms_log (2, "msr_pack(%s): Packing failed.\n", srcname);
+    ms_log_l (ctx->logp, 2, "msr_pack(%s): Packing failed.\n", srcname);
     return -1;
   }
 
-  /* Allocate space for data record */
-  rawrec = (char *)malloc (msr->reclen);
-
-  if (rawrec == NULL)
-  {
-    ms_log (2, "msr_pack(%s): Cannot allocate memory\n", srcname);
-    return -1;
-  }
-
-  /* Set header pointers to known offsets into FSDH */
-  HPnumsamples = (uint16_t *)(rawrec + 30);
-  HPdataoffset = (uint16_t *)(rawrec + 44);
-
   /* Check to see if byte swapping is needed */
   if (msr->byteorder != ms_bigendianhost ())
     headerswapflag = dataswapflag = 1;
 
   /* Check if byte order is forced */
-  if (packheaderbyteorder >= 0)
+  if (ctx->headerbyteorder >= 0)
   {
-    headerswapflag = (msr->byteorder != packheaderbyteorder) ? 1 : 0;
+    headerswapflag = (msr->byteorder != ctx->headerbyteorder) ? 1 : 0;
   }
 
-  if (packdatabyteorder >= 0)
+  if (ctx->databyteorder >= 0)
   {
-    dataswapflag = (msr->byteorder != packdatabyteorder) ? 1 : 0;
+    dataswapflag = (msr->byteorder != ctx->databyteorder) ? 1 : 0;
   }
 
   if (verbose > 2)
   {
     if (headerswapflag && dataswapflag)
-      ms_log (1, "%s: Byte swapping needed for packing of header and data samples\n", srcname);
+      ms_log_l (ctx->logp, 1, "%s: Byte swapping needed for packing of header and data samples\n", srcname);
     else if (headerswapflag)
-      ms_log (1, "%s: Byte swapping needed for packing of header\n", srcname);
+      ms_log_l (ctx->logp, 1, "%s: Byte swapping needed for packing of header\n", srcname);
     else if (dataswapflag)
-      ms_log (1, "%s: Byte swapping needed for packing of data samples\n", srcname);
+      ms_log_l (ctx->logp, 1, "%s: Byte swapping needed for packing of data samples\n", srcname);
     else
-      ms_log (1, "%s: Byte swapping NOT needed for packing\n", srcname);
+      ms_log_l (ctx->logp, 1, "%s: Byte swapping NOT needed for packing\n", srcname);
   }
 
   /* Add a blank 1000 Blockette if one is not present, the blockette values
@@ -272,26 +286,108 @@ msr_pack (MSRecord *msr, void (*record_handler) (char *, int, void *),
     memset (&blkt1000, 0, sizeof (struct blkt_1000_s));
 
     if (verbose > 2)
-      ms_log (1, "%s: Adding 1000 Blockette\n", srcname);
+      ms_log_l (ctx->logp, 1, "%s: Adding 1000 Blockette\n", srcname);
 
     if (!msr_addblockette (msr, (char *)&blkt1000, sizeof (struct blkt_1000_s), 1000, 0))
     {
-      ms_log (2, "msr_pack(%s): Error adding 1000 Blockette\n", srcname);
-      free (rawrec);
+      ms_log_l (ctx->logp, 2, "msr_pack(%s): Error adding 1000 Blockette\n", srcname);
       return -1;
     }
   }
 
-  headerlen = msr_pack_header_raw (msr, rawrec, msr->reclen, headerswapflag, 1,
-                                   &HPblkt1001, srcname, verbose);
+  chainlen = msr_chainsize (msr);
+
+  cache = (PackCache *)msr->ststate->packcache;
+
+  /* Reuse the cached header if packed from the same values */
+  if (cache && cache->headerlen > 0 && msr->fsdh &&
+      cache->reclen == msr->reclen &&
+      cache->encoding == msr->encoding &&
+      cache->byteorder == msr->byteorder &&
+      cache->headerswapflag == headerswapflag &&
+      cache->databyteorder == ctx->databyteorder &&
+      cache->samprate == msr->samprate &&
+      cache->reserved == msr->fsdh->reserved &&
+      cache->act_flags == msr->fsdh->act_flags &&
+      cache->io_flags == msr->fsdh->io_flags &&
+      cache->dq_flags == msr->fsdh->dq_flags &&
+      cache->time_correct == msr->fsdh->time_correct &&
+      cache->chainlen == chainlen &&
+      !strcmp (cache->srcname, srcname) &&
+      msr_chainmatch (msr, PACKCACHE_CHAIN (cache)))
+  {
+    if (verbose > 2)
+      ms_log_l (ctx->logp, 1, "%s: Reusing packed header\n", srcname);
+
+    rawrec    = PACKCACHE_RECORD (cache);
+    headerlen = cache->headerlen;
 
-  if (headerlen == -1)
+    if (cache->blkt1001offset)
+      HPblkt1001 = (struct blkt_1001_s *)(rawrec + cache->blkt1001offset);
+
+    msr_update_header (msr, rawrec, headerswapflag, HPblkt1001, srcname,
+                       ctx->logp, verbose);
+  }
+  else
   {
-    ms_log (2, "msr_pack(%s): Error packing header\n", srcname);
-    free (rawrec);
-    return -1;
+    /* Allocate space for the header, data record and blockette chain,
+     * reused between calls */
+    if (!cache || cache->rawreclen < msr->reclen || cache->chaincapacity < chainlen)
+    {
+      cache = (PackCache *)realloc (cache, PACKCACHE_SIZE + msr->reclen + chainlen);
+
+      if (cache == NULL)
+      {
+        ms_log_l (ctx->logp, 2, "msr_pack(%s): Cannot allocate memory\n", srcname);
+        return -1;
+      }
+
+      cache->rawreclen         = msr->reclen;
+      cache->chaincapacity     = chainlen;
+      msr->ststate->packcache = cache;
+    }
+
+    cache->headerlen = 0;
+    rawrec           = PACKCACHE_RECORD (cache);
+
+    headerlen = msr_pack_header_raw (msr, rawrec, msr->reclen, headerswapflag, 1,
+                                     ctx->databyteorder, &HPblkt1001, srcname,
+                                     ctx->logp, verbose);
+
+    if (headerlen == -1)
+    {
+      ms_log_l (ctx->logp, 2, "msr_pack(%s): Error packing header\n", srcname);
+      return -1;
+    }
+
+    /* Record the values the header was packed from, not reused if the
+     * packing changed the length of the blockette chain */
+    if ((chainlen = msr_chainsize (msr)) <= cache->chaincapacity && msr->fsdh)
+    {
+      cache->headerlen    = headerlen;
+      cache->chainlen     = chainlen;
+      cache->reserved     = msr->fsdh->reserved;
+      cache->act_flags    = msr->fsdh->act_flags;
+      cache->io_flags     = msr->fsdh->io_flags;
+      cache->dq_flags     = msr->fsdh->dq_flags;
+      cache->time_correct = msr->fsdh->time_correct;
+      msr_chaincopy (msr, PACKCACHE_CHAIN (cache));
+    }
+
+    cache->blkt1001offset = (HPblkt1001) ? (int)((char *)HPblkt1001 - rawrec) : 0;
+    cache->reclen         = msr->reclen;
+    cache->encoding       = msr->encoding;
+    cache->byteorder      = msr->byteorder;
+    cache->headerswapflag = headerswapflag;
+    cache->databyteorder  = ctx->databyteorder;
+    cache->samprate       = msr->samprate;
+    strcpy (cache->srcname, srcname);
   }
 
+  /* Set header pointers to known offsets into FSDH */
+  HPnumsamples = (uint16_t *)(rawrec + 30);
+  HPdataoffset = (uint16_t *)(rawrec + 44);
+
   /* Determine offset to encoded data */
   if (msr->encoding == DE_STEIM1 || msr->encoding == DE_STEIM2)
   {
@@ -341,12 +437,11 @@ msr_pack (MSRecord *msr, void (*record_handler) (char *, int, void *),
                                  (int)(msr->numsamples - totalpackedsamples), maxdatabytes,
                                  &msr->ststate->lastintsample, msr->ststate->comphistory,
                                  msr->sampletype, msr->encoding, dataswapflag,
-                                 srcname, verbose);
+                                 srcname, ctx, verbose);
 
     if (packsamples < 0)
     {
-      ms_log (2, "msr_pack(%s): Error packing data samples\n", srcname);
-      free (rawrec);
+      ms_log_l (ctx->logp, 2, "msr_pack(%s): Error packing data samples\n", srcname);
       return -1;
     }
 
@@ -358,7 +453,7 @@ msr_pack (MSRecord *msr, void (*record_handler) (char *, int, void *),
       ms_gswap2 (HPnumsamples);
 
     if (verbose > 0)
-      ms_log (1, "%s: Packed %d samples\n", srcname, packsamples);
+      ms_log_l (ctx->logp, 1, "%s: Packed %d samples\n", srcname, packsamples);
 
     /* Send record to handler */
     record_handler (rawrec, msr->reclen, handlerdata);
@@ -373,7 +468,8 @@ msr_pack (MSRecord *msr, void (*record_handler) (char *, int, void *),
     if (msr->samprate > 0)
       msr->starttime = segstarttime + (hptime_t) (totalpackedsamples / msr->samprate * HPTMODULUS + 0.5);
 
-    msr_update_header (msr, rawrec, headerswapflag, HPblkt1001, srcname, verbose);
+    msr_update_header (msr, rawrec, headerswapflag, HPblkt1001, srcname,
+                       ctx->logp, verbose);
 
     recordcnt++;
     msr->ststate->packedrecords++;
@@ -387,12 +483,57 @@ msr_pack (MSRecord *msr, void (*record_handler) (char *, int, void *),
   }
 
   if (verbose > 2)
-    ms_log (1, "%s: Packed %d total samples\n", srcname, totalpackedsamples);
-
-  free (rawrec);
+    ms_log_l (ctx->logp, 1, "%s: Packed %d total samples\n", srcname, totalpackedsamples);
 
   return recordcnt;
-} /* End of msr_pack() */
+} /* End of msr_pack_ctx() */
+
+/***************************************************************************
+ * ms_packctx_init:
+ *
+ * Initialize a packing context for msr_pack_ctx().  The byte order
+ * overrides are resolved from the global variables or the
+ * PACK_HEADER_BYTEORDER and PACK_DATA_BYTEORDER environment variables
+ * and the debugging flag from the ENCODE_DEBUG environment variable.
+ * Logging uses the global parameters unless ctx->logp is set after
+ * initialization.
+ *
+ * Release the context with ms_packctx_free().
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+ms_packctx_init (MSPackContext *ctx, flag verbose)
+{
+  if (!ctx)
+    return -1;
+
+  memset (ctx, 0, sizeof (MSPackContext));
+
+  if (check_environment (&ctx->headerbyteorder, &ctx->databyteorder, verbose))
+    return -1;
+
+  /* Check for encode debugging environment variable */
+  ctx->encodedebug = (getenv ("ENCODE_DEBUG")) ? 1 : 0;
+
+  return 0;
+} /* End of ms_packctx_init() */
+
+/***************************************************************************
+ * ms_packctx_free:
+ *
+ * Release a packing context, the context may be initialized again
+ * with ms_packctx_init().  Record buffers are kept in the StreamState
+ * of each MSRecord, a context currently holds no allocated memory.
+ ***************************************************************************/
+void
+ms_packctx_free (MSPackContext *ctx)
+{
+  if (!ctx)
+    return;
+
+  ctx->logp = NULL;
+} /* End of ms_packctx_free() */
 
 /***************************************************************************
  * msr_pack_header:
@@ -409,7 +550,8 @@ int
 msr_pack_header (MSRecord *msr, flag normalize, flag verbose)
 {
   char srcname[50];
-  char *envvariable;
+  flag headerbyteorder;
+  flag databyteorder;
   flag headerswapflag = 0;
   int headerlen;
   int maxheaderlen;
@@ -424,34 +566,9 @@ msr_pack_header (MSRecord *msr, flag normalize, flag verbose)
     return MS_GENERROR;
   }
 
-  /* Read possible environmental variables that force byteorder */
-  if (packheaderbyteorder == -2)
-  {
-    if ((envvariable = getenv ("PACK_HEADER_BYTEORDER")))
-    {
-      if (*envvariable != '0' && *envvariable != '1')
-      {
-        ms_log (2, "Environment variable PACK_HEADER_BYTEORDER must be set to '0' or '1'\n");
-        return -1;
-      }
-      else if (*envvariable == '0')
-      {
-        packheaderbyteorder = 0;
-        if (verbose > 2)
-          ms_log (1, "PACK_HEADER_BYTEORDER=0, packing little-endian header\n");
-      }
-      else
-      {
-        packheaderbyteorder = 1;
-        if (verbose > 2)
-          ms_log (1, "PACK_HEADER_BYTEORDER=1, packing big-endian header\n");
-      }
-    }
-    else
-    {
-      packheaderbyteorder = -1;
-    }
-  }
+  /* Determine forced byte orders */
+  if (check_environment (&headerbyteorder, &databyteorder, verbose))
+    return -1;
 
   if (msr->reclen < MINRECLEN || msr->reclen > MAXRECLEN)
   {
@@ -481,9 +598,9 @@ msr_pack_header (MSRecord *msr, flag normalize, flag verbose)
     headerswapflag = 1;
 
   /* Check if byte order is forced */
-  if (packheaderbyteorder >= 0)
+  if (headerbyteorder >= 0)
   {
-    headerswapflag = (msr->byteorder != packheaderbyteorder) ? 1 : 0;
+    headerswapflag = (msr->byteorder != headerbyteorder) ? 1 : 0;
   }
 
   if (verbose > 2)
@@ -495,8 +612,8 @@ msr_pack_header (MSRecord *msr, flag normalize, flag verbose)
   }
 
   headerlen = msr_pack_header_raw (msr, msr->record, maxheaderlen,
-                                   headerswapflag, normalize, NULL,
-                                   srcname, verbose);
+                                   headerswapflag, normalize, databyteorder,
+                                   NULL, srcname, NULL, verbose);
 
   return headerlen;
 } /* End of msr_pack_header() */
@@ -505,14 +622,16 @@ msr_pack_header (MSRecord *msr, flag normalize, flag verbose)
  * msr_pack_header_raw:
  *
  * Pack data header/blockettes into the specified SEED data record.
+ * If databyteorder is 0 or 1 the byte order of Blockette 1000 is set
+ * to it.
  *
  * Returns the header length in bytes on success or -1 on error.
  ***************************************************************************/
 static int
 msr_pack_header_raw (MSRecord *msr, char *rawrec, int maxheaderlen,
-                     flag swapflag, flag normalize,
+                     flag swapflag, flag normalize, flag databyteorder,
                      struct blkt_1001_s **blkt1001,
-                     char *srcname, flag verbose)
+                     char *srcname, MSLogParam *logp, flag verbose)
 {
   struct blkt_link_s *cur_blkt;
   struct fsdh_s *fsdh;
@@ -530,7 +649,7 @@ msr_pack_header_raw (MSRecord *msr, char *rawrec, int maxheaderlen,
 
     if (msr->fsdh == NULL)
     {
-      ms_log (2, "msr_pack_header_raw(%s): Cannot allocate memory\n", srcname);
+      ms_log_l (logp, 2, "msr_pack_header_raw(%s): Cannot allocate memory\n", srcname);
       return -1;
     }
   }
@@ -539,23 +658,23 @@ msr_pack_header_raw (MSRecord *msr, char *rawrec, int maxheaderlen,
   if (normalize)
     if (msr_normalize_header (msr, verbose) < 0)
     {
-      ms_log (2, "msr_pack_header_raw(%s): error normalizing header values\n", srcname);
+      ms_log_l (logp, 2, "msr_pack_header_raw(%s): error normalizing header values\n", srcname);
       return -1;
     }
 
   if (verbose > 2)
-    ms_log (1, "%s: Packing fixed section of data header\n", srcname);
+    ms_log_l (logp, 1, "%s: Packing fixed section of data header\n", srcname);
 
   if (maxheaderlen > msr->reclen)
   {
-    ms_log (2, "msr_pack_header_raw(%s): maxheaderlen of %d is beyond record length of %d\n",
+    ms_log_l (logp, 2, "msr_pack_header_raw(%s): maxheaderlen of %d is beyond record length of %d\n",
             srcname, maxheaderlen, msr->reclen);
     return -1;
   }
 
   if (maxheaderlen < (int)sizeof (struct fsdh_s))
   {
-    ms_log (2, "msr_pack_header_raw(%s): maxheaderlen of %d is too small, must be >= %d\n",
+    ms_log_l (logp, 2, "msr_pack_header_raw(%s): maxheaderlen of %d is too small, must be >= %d\n",
             srcname, maxheaderlen, sizeof (struct fsdh_s));
     return -1;
   }
@@ -590,7 +709,7 @@ msr_pack_header_raw (MSRecord *msr, char *rawrec, int maxheaderlen,
     /* Check that the blockette fits */
     if ((offset + 4 + cur_blkt->blktdatalen) > maxheaderlen)
     {
-      ms_log (2, "msr_pack_header_raw(%s): header exceeds maxheaderlen of %d\n",
+      ms_log_l (logp, 2, "msr_pack_header_raw(%s): header exceeds maxheaderlen of %d\n",
               srcname, maxheaderlen);
       break;
     }
@@ -744,7 +863,7 @@ msr_pack_header_raw (MSRecord *msr, char *rawrec, int maxheaderlen,
 
       if (verbose > 0)
       {
-        ms_log (1, "msr_pack_header_raw(%s): WARNING Blockette 405 cannot be fully supported\n",
+        ms_log_l (logp, 1, "msr_pack_header_raw(%s): WARNING Blockette 405 cannot be fully supported\n",
                 srcname);
       }
     }
@@ -770,8 +889,8 @@ msr_pack_header_raw (MSRecord *msr, char *rawrec, int maxheaderlen,
       offset += sizeof (struct blkt_1000_s);
 
       /* This guarantees that the byte order is in sync with msr_pack() */
-      if (packdatabyteorder >= 0)
-        blkt_1000->byteorder = packdatabyteorder;
+      if (databyteorder >= 0)
+        blkt_1000->byteorder = databyteorder;
     }
 
     else if (cur_blkt->blkt_type == 1001)
@@ -827,7 +946,7 @@ msr_pack_header_raw (MSRecord *msr, char *rawrec, int maxheaderlen,
   fsdh->numblockettes = blktcnt;
 
   if (verbose > 2)
-    ms_log (1, "%s: Packed %d blockettes\n", srcname, blktcnt);
+    ms_log_l (logp, 1, "%s: Packed %d blockettes\n", srcname, blktcnt);
 
   return offset;
 } /* End of msr_pack_header_raw() */
@@ -842,24 +961,26 @@ msr_pack_header_raw (MSRecord *msr, char *rawrec, int maxheaderlen,
  ***************************************************************************/
 static int
 msr_update_header (MSRecord *msr, char *rawrec, flag swapflag,
-                   struct blkt_1001_s *blkt1001, char *srcname, flag verbose)
+                   struct blkt_1001_s *blkt1001, char *srcname,
+                   MSLogParam *logp, flag verbose)
 {
   struct fsdh_s *fsdh;
   hptime_t hptimems;
   int8_t usecoffset;
-  char seqnum[7];
+  int seqnum;
+  int idx;
 
   if (!msr || !rawrec)
     return -1;
 
   if (verbose > 2)
-    ms_log (1, "%s: Updating fixed section of data header\n", srcname);
+    ms_log_l (logp, 1, "%s: Updating fixed section of data header\n", srcname);
 
   fsdh = (struct fsdh_s *)rawrec;
 
-  /* Pack values into the fixed section of header */
-  snprintf (seqnum, 7, "%06d", msr->sequence_number);
-  memcpy (fsdh->sequence_number, seqnum, 6);
+  /* Pack sequence number into the fixed section as 6 ASCII digits */
+  for (idx = 5, seqnum = msr->sequence_number; idx >= 0; idx--, seqnum /= 10)
+    fsdh->sequence_number[idx] = (char)('0' + seqnum % 10);
 
   /* Get start time rounded to tenths of milliseconds and microsecond offset */
   ms_hptime2tomsusecoffset (msr->starttime, &hptimems, &usecoffset);
@@ -886,6 +1007,100 @@ msr_update_header (MSRecord *msr, char *rawrec, flag swapflag,
   return 0;
 } /* End of msr_update_header() */
 
+/***************************************************************************
+ * msr_chainsize:
+ *
+ * Determine the length of a copy of the blockette chain of an MSRecord
+ * made by msr_chaincopy(), the type, data length and data of each
+ * blockette.
+ *
+ * Returns the length in bytes.
+ ***************************************************************************/
+static int
+msr_chainsize (MSRecord *msr)
+{
+  BlktLink *cur_blkt;
+  int length = 0;
+
+  for (cur_blkt = msr->blkts; cur_blkt; cur_blkt = cur_blkt->next)
+    length += 2 * sizeof (uint16_t) + cur_blkt->blktdatalen;
+
+  return length;
+} /* End of msr_chainsize() */
+
+/***************************************************************************
+ * msr_chaincopy:
+ *
+ * Copy the blockette chain of an MSRecord to a buffer of at least
+ * msr_chainsize() bytes.
+ ***************************************************************************/
+static void
+msr_chaincopy (MSRecord *msr, char *chain)
+{
+  BlktLink *cur_blkt;
+
+  for (cur_blkt = msr->blkts; cur_blkt; cur_blkt = cur_blkt->next)
+  {
+    memcpy (chain, &cur_blkt->blkt_type, sizeof (uint16_t));
+    memcpy (chain + sizeof (uint16_t), &cur_blkt->blktdatalen, sizeof (uint16_t));
+    chain += 2 * sizeof (uint16_t);
+
+    if (cur_blkt->blktdatalen > 0)
+      memcpy (chain, cur_blkt->blktdata, cur_blkt->blktdatalen);
+    chain += cur_blkt->blktdatalen;
+  }
+} /* End of msr_chaincopy() */
+
+/***************************************************************************
+ * msr_chainmatch:
+ *
+ * Compare the blockette chain of an MSRecord with a copy made by
+ * msr_chaincopy() of the same length.  The microsecond offset of
+ * Blockette 1001 is set for each record and is not compared.
+ *
+ * Returns 1 if the chain matches the copy, otherwise 0.
+ ***************************************************************************/
+static int
+msr_chainmatch (MSRecord *msr, const char *chain)
+{
+  BlktLink *cur_blkt;
+  const char *data;
+  uint16_t value;
+  size_t usec = offsetof (struct blkt_1001_s, usec);
+
+  for (cur_blkt = msr->blkts; cur_blkt; cur_blkt = cur_blkt->next)
+  {
+    memcpy (&value, chain, sizeof (uint16_t));
+    if (value != cur_blkt->blkt_type)
+      return 0;
+
+    memcpy (&value, chain + sizeof (uint16_t), sizeof (uint16_t));
+    if (value != cur_blkt->blktdatalen)
+      return 0;
+
+    chain += 2 * sizeof (uint16_t);
+    data = (const char *)cur_blkt->blktdata;
+
+    if (cur_blkt->blktdatalen == 0)
+      continue;
+
+    if (cur_blkt->blkt_type == 1001 && cur_blkt->blktdatalen > usec)
+    {
+      if (memcmp (chain, data, usec) ||
+          memcmp (chain + usec + 1, data + usec + 1, cur_blkt->blktdatalen - usec - 1))
+        return 0;
+    }
+    else if (memcmp (chain, data, cur_blkt->blktdatalen))
+    {
+      return 0;
+    }
+
+    chain += cur_blkt->blktdatalen;
+  }
+
+  return 1;
+} /* End of msr_chainmatch() */
+
 /************************************************************************
  *  msr_pack_data:
  *
@@ -904,29 +1119,26 @@ msr_update_header (MSRecord *msr, char *rawrec, flag swapflag,
 static int
 msr_pack_data (void *dest, void *src, int maxsamples, int maxdatabytes,
                int32_t *lastintsample, flag comphistory, char sampletype,
-               flag encoding, flag swapflag, char *srcname, flag verbose)
+               flag encoding, flag swapflag, char *srcname,
+               MSPackContext *ctx, flag verbose)
 {
   int nsamples;
   int32_t *intbuff;
   int32_t d0;
 
-  /* Check for encode debugging environment variable */
-  if (getenv ("ENCODE_DEBUG"))
-    encodedebug = 1;
-
   /* Decide if this is a format that we can encode */
   switch (encoding)
   {
   case DE_ASCII:
     if (sampletype != 'a')
     {
-      ms_log (2, "%s: Sample type must be ascii (a) for ASCII text encoding not '%c'\n",
+      ms_log_l (ctx->logp, 2, "%s: Sample type must be ascii (a) for ASCII text encoding not '%c'\n",
               srcname, sampletype);
       return -1;
     }
 
     if (verbose > 1)
-      ms_log (1, "%s: Packing ASCII data\n", srcname);
+      ms_log_l (ctx->logp, 1, "%s: Packing ASCII data\n", srcname);
 
     nsamples = msr_encode_text (src, maxsamples, dest, maxdatabytes);
 
@@ -935,13 +1147,13 @@ msr_pack_data (void *dest, void *src, int maxsamples, int maxdatabytes,
   case DE_INT16:
     if (sampletype != 'i')
     {
-      ms_log (2, "%s: Sample type must be integer (i) for INT16 encoding not '%c'\n",
+      ms_log_l (ctx->logp, 2, "%s: Sample type must be integer (i) for INT16 encoding not '%c'\n",
               srcname, sampletype);
       return -1;
     }
 
     if (verbose > 1)
-      ms_log (1, "%s: Packing INT16 data samples\n", srcname);
+      ms_log_l (ctx->logp, 1, "%s: Packing INT16 data samples\n", srcname);
 
     nsamples = msr_encode_int16 (src, maxsamples, dest, maxdatabytes, swapflag);
 
@@ -950,13 +1162,13 @@ msr_pack_data (void *dest, void *src, int maxsamples, int maxdatabytes,
   case DE_INT32:
     if (sampletype != 'i')
     {
-      ms_log (2, "%s: Sample type must be integer (i) for INT32 encoding not '%c'\n",
+      ms_log_l (ctx->logp, 2, "%s: Sample type must be integer (i) for INT32 encoding not '%c'\n",
               srcname, sampletype);
       return -1;
     }
 
     if (verbose > 1)
-      ms_log (1, "%s: Packing INT32 data samples\n", srcname);
+      ms_log_l (ctx->logp, 1, "%s: Packing INT32 data samples\n", srcname);
 
     nsamples = msr_encode_int32 (src, maxsamples, dest, maxdatabytes, swapflag);
 
@@ -965,13 +1177,13 @@ msr_pack_data (void *dest, void *src, int maxsamples, int maxdatabytes,
   case DE_FLOAT32:
     if (sampletype != 'f')
     {
-      ms_log (2, "%s: Sample type must be float (f) for FLOAT32 encoding not '%c'\n",
+      ms_log_l (ctx->logp, 2, "%s: Sample type must be float (f) for FLOAT32 encoding not '%c'\n",
               srcname, sampletype);
       return -1;
     }
 
     if (verbose > 1)
-      ms_log (1, "%s: Packing FLOAT32 data samples\n", srcname);
+      ms_log_l (ctx->logp, 1, "%s: Packing FLOAT32 data samples\n", srcname);
 
     nsamples = msr_encode_float32 (src, maxsamples, dest, maxdatabytes, swapflag);
 
@@ -980,13 +1192,13 @@ msr_pack_data (void *dest, void *src, int maxsamples, int maxdatabytes,
   case DE_FLOAT64:
     if (sampletype != 'd')
     {
-      ms_log (2, "%s: Sample type must be double (d) for FLOAT64 encoding not '%c'\n",
+      ms_log_l (ctx->logp, 2, "%s: Sample type must be double (d) for FLOAT64 encoding not '%c'\n",
               srcname, sampletype);
       return -1;
     }
 
     if (verbose > 1)
-      ms_log (1, "%s: Packing FLOAT64 data samples\n", srcname);
+      ms_log_l (ctx->logp, 1, "%s: Packing FLOAT64 data samples\n", srcname);
 
     nsamples = msr_encode_float64 (src, maxsamples, dest, maxdatabytes, swapflag);
 
@@ -995,7 +1207,7 @@ msr_pack_data (void *dest, void *src, int maxsamples, int maxdatabytes,
   case DE_STEIM1:
     if (sampletype != 'i')
     {
-      ms_log (2, "%s: Sample type must be integer (i) for Steim1 compression not '%c'\n",
+      ms_log_l (ctx->logp, 2, "%s: Sample type must be integer (i) for Steim1 compression not '%c'\n",
               srcname, sampletype);
       return -1;
     }
@@ -1006,9 +1218,10 @@ msr_pack_data (void *dest, void *src, int maxsamples, int maxdatabytes,
     d0 = (lastintsample && comphistory) ? (intbuff[0] - *lastintsample) : 0;
 
     if (verbose > 1)
-      ms_log (1, "%s: Packing Steim1 data frames\n", srcname);
+      ms_log_l (ctx->logp, 1, "%s: Packing Steim1 data frames\n", srcname);
 
-    nsamples = msr_encode_steim1 (src, maxsamples, dest, maxdatabytes, d0, swapflag);
+    nsamples = msr_encode_steim1 (src, maxsamples, dest, maxdatabytes, d0, swapflag,
+                                  ctx);
 
     /* If a previous sample is supplied update it with the last sample value */
     if (lastintsample && nsamples > 0)
@@ -1019,7 +1232,7 @@ msr_pack_data (void *dest, void *src, int maxsamples, int maxdatabytes,
   case DE_STEIM2:
     if (sampletype != 'i')
     {
-      ms_log (2, "%s: Sample type must be integer (i) for Steim2 compression not '%c'\n",
+      ms_log_l (ctx->logp, 2, "%s: Sample type must be integer (i) for Steim2 compression not '%c'\n",
               srcname, sampletype);
       return -1;
     }
@@ -1030,9 +1243,10 @@ msr_pack_data (void *dest, void *src, int maxsamples, int maxdatabytes,
     d0 = (lastintsample && comphistory) ? (intbuff[0] - *lastintsample) : 0;
 
     if (verbose > 1)
-      ms_log (1, "%s: Packing Steim2 data frames\n", srcname);
+      ms_log_l (ctx->logp, 1, "%s: Packing Steim2 data frames\n", srcname);
 
-    nsamples = msr_encode_steim2 (src, maxsamples, dest, maxdatabytes, d0, srcname, swapflag);
+    nsamples = msr_encode_steim2 (src, maxsamples, dest, maxdatabytes, d0, srcname,
+                                  swapflag, ctx);
 
     /* If a previous sample is supplied update it with the last sample value */
     if (lastintsample && nsamples > 0)
@@ -1041,10 +1255,88 @@ msr_pack_data (void *dest, void *src, int maxsamples, int maxdatabytes,
     break;
 
   default:
-    ms_log (2, "%s: Unable to pack format %d\n", srcname, encoding);
+    ms_log_l (ctx->logp, 2, "%s: Unable to pack format %d\n", srcname, encoding);
 
     return -1;
   }
 
   return nsamples;
 } /* End of msr_pack_data() */
+
+/************************************************************************
+ *  check_environment:
+ *
+ *  Determine the header and data byte orders forced by the global
+ *  variables or, when those are not set, by the PACK_HEADER_BYTEORDER
+ *  and PACK_DATA_BYTEORDER environment variables.  Nothing global is
+ *  modified so concurrent packing in multiple threads is safe.
+ *
+ *  Return 0 on success and -1 on error.
+ ************************************************************************/
+static int
+check_environment (flag *headerbyteorder, flag *databyteorder, flag verbose)
+{
+  char *envvariable;
+
+  *headerbyteorder = packheaderbyteorder;
+  *databyteorder   = packdatabyteorder;
+
+  /* Read possible environmental variables that force byteorder */
+  if (*headerbyteorder == -2)
+  {
+    if ((envvariable = getenv ("PACK_HEADER_BYTEORDER")))
+    {
+      if (*envvariable != '0' && *envvariable != '1')
+      {
+        ms_log (2, "Environment variable PACK_HEADER_BYTEORDER must be set to '0' or '1'\n");
+        return -1;
+      }
+      else if (*envvariable == '0')
+      {
+        *headerbyteorder = 0;
+        if (verbose > 2)
+          ms_log (1, "PACK_HEADER_BYTEORDER=0, packing little-endian header\n");
+      }
+      else
+      {
+        *headerbyteorder = 1;
+        if (verbose > 2)
+          ms_log (1, "PACK_HEADER_BYTEORDER=1, packing big-endian header\n");
+      }
+    }
+    else
+    {
+      *headerbyteorder = -1;
+    }
+  }
+
+  if (*databyteorder == -2)
+  {
+    if ((envvariable = getenv ("PACK_DATA_BYTEORDER")))
+    {
+      if (*envvariable != '0' && *envvariable != '1')
+      {
+        ms_log (2, "Environment variable PACK_DATA_BYTEORDER must be set to '0' or '1'\n");
+        return -1;
+      }
+      else if (*envvariable == '0')
+      {
+        *databyteorder = 0;
+        if (verbose > 2)
+          ms_log (1, "PACK_DATA_BYTEORDER=0, packing little-endian data samples\n");
+      }
+      else
+      {
+        *databyteorder = 1;
+        if (verbose > 2)
+          ms_log (1, "PACK_DATA_BYTEORDER=1, packing big-endian data samples\n");
+      }
+    }
+    else
+    {
+      *databyteorder = -1;
+    }
+  }
+
+  return 0;
+} /* End of check_environment() */
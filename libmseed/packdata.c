@@ -12,9 +12,6 @@
 #include "libmseed.h"
 #include "packdata.h"
 
-/* Control for printing debugging information */
-int encodedebug = 0;
-
 /************************************************************************
  * msr_encode_text:
  *
@@ -106,15 +103,17 @@ msr_encode_int32 (int32_t *input, int samplecount, int32_t *output,
   if (!input || !output || outputlength <= 0)
     return -1;
 
-  for (idx = 0; idx < samplecount && outputlength >= (int)sizeof (int32_t); idx++)
-  {
-    output[idx] = input[idx];
+  /* Determine number of samples that fit in the output buffer */
+  idx = outputlength / (int)sizeof (int32_t);
+  if (idx > samplecount)
+    idx = samplecount;
 
-    if (swapflag)
-      ms_gswap4a (&output[idx]);
+  if (swapflag)
+    ms_gswap4n (output, input, idx);
+  else
+    memcpy (output, input, idx * sizeof (int32_t));
 
-    outputlength -= sizeof (int32_t);
-  }
+  outputlength -= idx * sizeof (int32_t);
 
   if (outputlength)
     memset (&output[idx], 0, outputlength);
@@ -143,15 +142,17 @@ msr_encode_float32 (float *input, int samplecount, float *output,
   if (!input || !output || outputlength <= 0)
     return -1;
 
-  for (idx = 0; idx < samplecount && outputlength >= (int)sizeof (float); idx++)
-  {
-    output[idx] = input[idx];
+  /* Determine number of samples that fit in the output buffer */
+  idx = outputlength / (int)sizeof (float);
+  if (idx > samplecount)
+    idx = samplecount;
 
-    if (swapflag)
-      ms_gswap4a (&output[idx]);
+  if (swapflag)
+    ms_gswap4n (output, input, idx);
+  else
+    memcpy (output, input, idx * sizeof (float));
 
-    outputlength -= sizeof (float);
-  }
+  outputlength -= idx * sizeof (float);
 
   if (outputlength)
     memset (&output[idx], 0, outputlength);
@@ -180,15 +181,17 @@ msr_encode_float64 (double *input, int samplecount, double *output,
   if (!input || !output || outputlength <= 0)
     return -1;
 
-  for (idx = 0; idx < samplecount && outputlength >= (int)sizeof (double); idx++)
-  {
-    output[idx] = input[idx];
+  /* Determine number of samples that fit in the output buffer */
+  idx = outputlength / (int)sizeof (double);
+  if (idx > samplecount)
+    idx = samplecount;
 
-    if (swapflag)
-      ms_gswap8a (&output[idx]);
+  if (swapflag)
+    ms_gswap8n (output, input, idx);
+  else
+    memcpy (output, input, idx * sizeof (double));
 
-    outputlength -= sizeof (double);
-  }
+  outputlength -= idx * sizeof (double);
 
   if (outputlength)
     memset (&output[idx], 0, outputlength);
@@ -229,11 +232,15 @@ msr_encode_float64 (double *input, int samplecount, double *output,
  * sample to the sample previous to it (not available to this
  * function).  It should be set to 0 if this value is not known.
  *
+ * Debugging output and logging are controlled by the packing context,
+ * which may be NULL.
+ *
  * Return number of samples in output buffer on success, -1 on failure.
  ************************************************************************/
 int
 msr_encode_steim1 (int32_t *input, int samplecount, int32_t *output,
-                   int outputlength, int32_t diff0, int swapflag)
+                   int outputlength, int32_t diff0, int swapflag,
+                   MSPackContext *ctx)
 {
   int32_t *frameptr;   /* Frame pointer in output */
   int32_t *Xnp = NULL; /* Reverse integration constant, aka last sample */
@@ -248,6 +255,8 @@ msr_encode_steim1 (int32_t *input, int samplecount, int32_t *output,
   int startnibble;
   int widx;
   int idx;
+  int encodedebug;
+  MSLogParam *logp;
 
   union dword {
     int8_t d8[4];
@@ -261,8 +270,12 @@ msr_encode_steim1 (int32_t *input, int samplecount, int32_t *output,
   if (!input || !output || outputlength <= 0)
     return -1;
 
+  /* Debugging and logging as set in the packing context */
+  encodedebug = (ctx) ? ctx->encodedebug : 0;
+  logp        = (ctx) ? ctx->logp : NULL;
+
   if (encodedebug)
-    ms_log (1, "Encoding Steim1 frames, samples: %d, max frames: %d, swapflag: %d\n",
+    ms_log_l (logp, 1, "Encoding Steim1 frames, samples: %d, max frames: %d, swapflag: %d\n",
             samplecount, maxframes, swapflag);
 
   /* Add first difference to buffers */
@@ -284,7 +297,7 @@ msr_encode_steim1 (int32_t *input, int samplecount, int32_t *output,
       frameptr[1] = input[0];
 
       if (encodedebug)
-        ms_log (1, "Frame %d: X0=%d\n", frameidx, frameptr[1]);
+        ms_log_l (logp, 1, "Frame %d: X0=%d\n", frameidx, frameptr[1]);
 
       if (swapflag)
         ms_gswap4a (&frameptr[1]);
@@ -298,7 +311,7 @@ msr_encode_steim1 (int32_t *input, int samplecount, int32_t *output,
       startnibble = 1; /* Subsequent frames: skip nibbles */
 
       if (encodedebug)
-        ms_log (1, "Frame %d\n", frameidx);
+        ms_log_l (logp, 1, "Frame %d\n", frameidx);
     }
 
     for (widx = startnibble; widx < 16 && outputsamples < samplecount; widx++)
@@ -335,7 +348,7 @@ msr_encode_steim1 (int32_t *input, int samplecount, int32_t *output,
           bitwidth[2] <= 8 && bitwidth[3] <= 8)
       {
         if (encodedebug)
-          ms_log (1, "  W%02d: 01=4x8b  %d  %d  %d  %d\n",
+          ms_log_l (logp, 1, "  W%02d: 01=4x8b  %d  %d  %d  %d\n",
                   widx, diffs[0], diffs[1], diffs[2], diffs[3]);
 
         word->d8[0] = diffs[0];
@@ -353,7 +366,7 @@ msr_encode_steim1 (int32_t *input, int samplecount, int32_t *output,
                bitwidth[0] <= 16 && bitwidth[1] <= 16)
       {
         if (encodedebug)
-          ms_log (1, "  W%02d: 2=2x16b  %d  %d\n", widx, diffs[0], diffs[1]);
+          ms_log_l (logp, 1, "  W%02d: 2=2x16b  %d  %d\n", widx, diffs[0], diffs[1]);
 
         word->d16[0] = diffs[0];
         word->d16[1] = diffs[1];
@@ -373,7 +386,7 @@ msr_encode_steim1 (int32_t *input, int samplecount, int32_t *output,
       else
       {
         if (encodedebug)
-          ms_log (1, "  W%02d: 3=1x32b  %d\n", widx, diffs[0]);
+          ms_log_l (logp, 1, "  W%02d: 3=1x32b  %d\n", widx, diffs[0]);
 
         frameptr[widx] = diffs[0];
 
@@ -419,12 +432,15 @@ msr_encode_steim1 (int32_t *input, int samplecount, int32_t *output,
  * sample to the sample previous to it (not available to this
  * function).  It should be set to 0 if this value is not known.
  *
+ * Debugging output and logging are controlled by the packing context,
+ * which may be NULL.
+ *
  * Return number of samples in output buffer on success, -1 on failure.
  ************************************************************************/
 int
 msr_encode_steim2 (int32_t *input, int samplecount, int32_t *output,
                    int outputlength, int32_t diff0,
-                   char *srcname, int swapflag)
+                   char *srcname, int swapflag, MSPackContext *ctx)
 {
   uint32_t *frameptr;  /* Frame pointer in output */
   int32_t *Xnp = NULL; /* Reverse integration constant, aka last sample */
@@ -439,6 +455,8 @@ msr_encode_steim2 (int32_t *input, int samplecount, int32_t *output,
   int startnibble;
   int widx;
   int idx;
+  int encodedebug;
+  MSLogParam *logp;
 
   union dword {
     int8_t d8[4];
@@ -452,8 +470,12 @@ msr_encode_steim2 (int32_t *input, int samplecount, int32_t *output,
   if (!input || !output || outputlength <= 0)
     return -1;
 
+  /* Debugging and logging as set in the packing context */
+  encodedebug = (ctx) ? ctx->encodedebug : 0;
+  logp        = (ctx) ? ctx->logp : NULL;
+
   if (encodedebug)
-    ms_log (1, "Encoding Steim2 frames, samples: %d, max frames: %d, swapflag: %d\n",
+    ms_log_l (logp, 1, "Encoding Steim2 frames, samples: %d, max frames: %d, swapflag: %d\n",
             samplecount, maxframes, swapflag);
 
   /* Add first difference to buffers */
@@ -475,7 +497,7 @@ msr_encode_steim2 (int32_t *input, int samplecount, int32_t *output,
       frameptr[1] = input[0];
 
       if (encodedebug)
-        ms_log (1, "Frame %d: X0=%d\n", frameidx, frameptr[1]);
+        ms_log_l (logp, 1, "Frame %d: X0=%d\n", frameidx, frameptr[1]);
 
       if (swapflag)
         ms_gswap4a (&frameptr[1]);
@@ -489,7 +511,7 @@ msr_encode_steim2 (int32_t *input, int samplecount, int32_t *output,
       startnibble = 1; /* Subsequent frames: skip nibbles */
 
       if (encodedebug)
-        ms_log (1, "Frame %d\n", frameidx);
+        ms_log_l (logp, 1, "Frame %d\n", frameidx);
     }
 
     for (widx = startnibble; widx < 16 && outputsamples < samplecount; widx++)
@@ -529,7 +551,7 @@ msr_encode_steim2 (int32_t *input, int samplecount, int32_t *output,
           bitwidth[4] <= 4 && bitwidth[5] <= 4 && bitwidth[6] <= 4)
       {
         if (encodedebug)
-          ms_log (1, "  W%02d: 11,10=7x4b  %d  %d  %d  %d  %d  %d  %d\n",
+          ms_log_l (logp, 1, "  W%02d: 11,10=7x4b  %d  %d  %d  %d  %d  %d  %d\n",
                   widx, diffs[0], diffs[1], diffs[2], diffs[3], diffs[4], diffs[5], diffs[6]);
 
         /* Mask the values, shift to proper location and set in word */
@@ -555,7 +577,7 @@ msr_encode_steim2 (int32_t *input, int samplecount, int32_t *output,
                bitwidth[3] <= 5 && bitwidth[4] <= 5 && bitwidth[5] <= 5)
       {
         if (encodedebug)
-          ms_log (1, "  W%02d: 11,01=6x5b  %d  %d  %d  %d  %d  %d\n",
+          ms_log_l (logp, 1, "  W%02d: 11,01=6x5b  %d  %d  %d  %d  %d  %d\n",
                   widx, diffs[0], diffs[1], diffs[2], diffs[3], diffs[4], diffs[5]);
 
         /* Mask the values, shift to proper location and set in word */
@@ -580,7 +602,7 @@ msr_encode_steim2 (int32_t *input, int samplecount, int32_t *output,
                bitwidth[3] <= 6 && bitwidth[4] <= 6)
       {
         if (encodedebug)
-          ms_log (1, "  W%02d: 11,00=5x6b  %d  %d  %d  %d  %d\n",
+          ms_log_l (logp, 1, "  W%02d: 11,00=5x6b  %d  %d  %d  %d  %d\n",
                   widx, diffs[0], diffs[1], diffs[2], diffs[3], diffs[4]);
 
         /* Mask the values, shift to proper location and set in word */
@@ -603,7 +625,7 @@ msr_encode_steim2 (int32_t *input, int samplecount, int32_t *output,
                bitwidth[2] <= 8 && bitwidth[3] <= 8)
       {
         if (encodedebug)
-          ms_log (1, "  W%02d: 01=4x8b  %d  %d  %d  %d\n",
+          ms_log_l (logp, 1, "  W%02d: 01=4x8b  %d  %d  %d  %d\n",
                   widx, diffs[0], diffs[1], diffs[2], diffs[3]);
 
         word = (union dword *)&frameptr[widx];
@@ -623,7 +645,7 @@ msr_encode_steim2 (int32_t *input, int samplecount, int32_t *output,
                bitwidth[0] <= 10 && bitwidth[1] <= 10 && bitwidth[2] <= 10)
       {
         if (encodedebug)
-          ms_log (1, "  W%02d: 10,11=3x10b  %d  %d  %d\n",
+          ms_log_l (logp, 1, "  W%02d: 10,11=3x10b  %d  %d  %d\n",
                   widx, diffs[0], diffs[1], diffs[2]);
 
         /* Mask the values, shift to proper location and set in word */
@@ -644,7 +666,7 @@ msr_encode_steim2 (int32_t *input, int samplecount, int32_t *output,
                bitwidth[0] <= 15 && bitwidth[1] <= 15)
       {
         if (encodedebug)
-          ms_log (1, "  W%02d: 10,10=2x15b  %d  %d\n",
+          ms_log_l (logp, 1, "  W%02d: 10,10=2x15b  %d  %d\n",
                   widx, diffs[0], diffs[1]);
 
         /* Mask the values, shift to proper location and set in word */
@@ -664,7 +686,7 @@ msr_encode_steim2 (int32_t *input, int samplecount, int32_t *output,
                bitwidth[0] <= 30)
       {
         if (encodedebug)
-          ms_log (1, "  W%02d: 10,01=1x30b  %d\n",
+          ms_log_l (logp, 1, "  W%02d: 10,01=1x30b  %d\n",
                   widx, diffs[0]);
 
         /* Mask the value and set in word */
@@ -680,7 +702,7 @@ msr_encode_steim2 (int32_t *input, int samplecount, int32_t *output,
       }
       else
       {
-        ms_log (2, "msr_encode_steim2(%s): Unable to represent difference in <= 30 bits\n",
+        ms_log_l (logp, 2, "msr_encode_steim2(%s): Unable to represent difference in <= 30 bits\n",
                 srcname);
         return -1;
       }
@@ -42,6 +42,23 @@
 int
 msr_parse (char *record, int recbuflen, MSRecord **ppmsr, int reclen,
            flag dataflag, flag verbose)
+{
+  return msr_parse_ctx (record, recbuflen, ppmsr, reclen, dataflag, verbose, NULL);
+} /* End of msr_parse() */
+
+/**********************************************************************
+ * msr_parse_ctx:
+ *
+ * Parse a Mini-SEED record as msr_parse(), unpacking the record with
+ * msr_unpack_ctx() and a context initialized with ms_unpackctx_init()
+ * when parsing many records.  If ctx is NULL a context is initialized
+ * for the record as with msr_unpack().
+ *
+ * Return values: same as msr_parse().
+ *********************************************************************/
+int
+msr_parse_ctx (char *record, int recbuflen, MSRecord **ppmsr, int reclen,
+               flag dataflag, flag verbose, MSUnpackContext *ctx)
 {
   int detlen  = 0;
   int retcode = 0;
@@ -105,7 +122,12 @@ msr_parse (char *record, int recbuflen, MSRecord **ppmsr, int reclen,
   }
 
   /* Unpack record */
-  if ((retcode = msr_unpack (record, reclen, ppmsr, dataflag, verbose)) != MS_NOERROR)
+  if (ctx)
+    retcode = msr_unpack_ctx (record, reclen, ppmsr, dataflag, verbose, ctx);
+  else
+    retcode = msr_unpack (record, reclen, ppmsr, dataflag, verbose);
+
+  if (retcode != MS_NOERROR)
   {
     msr_free (ppmsr);
 
@@ -113,7 +135,7 @@ msr_parse (char *record, int recbuflen, MSRecord **ppmsr, int reclen,
   }
 
   return MS_NOERROR;
-} /* End of msr_parse() */
+} /* End of msr_parse_ctx() */
 
 /**********************************************************************
  * msr_parse_selection:
@@ -146,6 +168,7 @@ msr_parse_selection (char *recbuf, int recbuflen, int64_t *offset,
                      MSRecord **ppmsr, int reclen,
                      Selections *selections, flag dataflag, flag verbose)
 {
+  MSUnpackContext ctx;
   int retval = MS_GENERROR;
   int unpackretval;
   flag dataswapflag  = 0;
@@ -160,9 +183,13 @@ msr_parse_selection (char *recbuf, int recbuflen, int64_t *offset,
   if (!offset)
     return MS_GENERROR;
 
+  /* Resolve the unpacking overrides once for all offsets searched */
+  if (ms_unpackctx_init (&ctx, verbose))
+    return MS_GENERROR;
+
   while (*offset < recbuflen)
   {
-    retval = msr_parse (recbuf + *offset, (int)(recbuflen - *offset), ppmsr, reclen, 0, verbose);
+    retval = msr_parse_ctx (recbuf + *offset, (int)(recbuflen - *offset), ppmsr, reclen, 0, verbose, &ctx);
 
     if (retval)
     {
@@ -0,0 +1,239 @@
+/***************************************************************************
+ * lmtestheal.c
+ *
+ * A program for libmseed trace group healing tests.
+ *
+ * Each record of the input files is made into a separate MSTrace,
+ * with some records added twice or in part to create overlapping
+ * fragments.  The fragments are added to a MSTraceGroup in a shuffled
+ * order, healed with mst_groupheal() and sorted, then the traces are
+ * printed with a checksum of their data samples.  This is repeated
+ * for several shuffle seeds, the result must not depend on the order.
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libmseed.h>
+
+#define MAXFRAGMENTS 4096
+
+static MSTrace *fragments[MAXFRAGMENTS];
+static int numfragments = 0;
+
+static int readfragments (char *file);
+static MSTrace *makefragment (MSRecord *msr, int64_t skip);
+static void healfragments (unsigned int seed);
+static double checksum (MSTrace *mst);
+
+int
+main (int argc, char **argv)
+{
+  unsigned int seed;
+  int idx;
+
+  if (argc < 2)
+  {
+    printf ("Usage: lmtestheal file [file ...]\n");
+    return 1;
+  }
+
+  for (idx = 1; idx < argc; idx++)
+  {
+    if (readfragments (argv[idx]))
+      return 1;
+  }
+
+  for (seed = 1; seed <= 3; seed++)
+    healfragments (seed);
+
+  for (idx = 0; idx < numfragments; idx++)
+    mst_free (&fragments[idx]);
+
+  return 0;
+} /* End of main() */
+
+/***************************************************************************
+ * readfragments:
+ *
+ * Read the records of a file into trace fragments, every fifth record
+ * is also added a second time and every seventh as a fragment of the
+ * second half of its samples.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+readfragments (char *file)
+{
+  MSFileParam *msfp = NULL;
+  MSRecord *msr     = NULL;
+  int records       = 0;
+  int retcode;
+
+  while ((retcode = ms_readmsr_r (&msfp, &msr, file, 0, NULL, NULL, 1, 1, 0)) == MS_NOERROR)
+  {
+    if (numfragments + 3 > MAXFRAGMENTS)
+    {
+      printf ("Too many records in %s\n", file);
+      break;
+    }
+
+    fragments[numfragments++] = makefragment (msr, 0);
+
+    if (records % 5 == 0)
+      fragments[numfragments++] = makefragment (msr, 0);
+
+    if (records % 7 == 0 && msr->numsamples > 1)
+      fragments[numfragments++] = makefragment (msr, msr->numsamples / 2);
+
+    records++;
+  }
+
+  ms_readmsr_r (&msfp, &msr, NULL, 0, NULL, NULL, 0, 0, 0);
+
+  if (retcode != MS_ENDOFFILE)
+  {
+    printf ("Cannot read %s: %s\n", file, ms_errorstr (retcode));
+    return -1;
+  }
+
+  return 0;
+} /* End of readfragments() */
+
+/***************************************************************************
+ * makefragment:
+ *
+ * Create a MSTrace with the samples of a record following the first
+ * skip samples.
+ *
+ * Returns a new MSTrace, exits on error.
+ ***************************************************************************/
+static MSTrace *
+makefragment (MSRecord *msr, int64_t skip)
+{
+  MSTrace *mst;
+  int samplesize = ms_samplesize (msr->sampletype);
+
+  if (!(mst = mst_init (NULL)))
+    exit (1);
+
+  strcpy (mst->network, msr->network);
+  strcpy (mst->station, msr->station);
+  strcpy (mst->location, msr->location);
+  strcpy (mst->channel, msr->channel);
+  mst->dataquality = msr->dataquality;
+  mst->samprate    = msr->samprate;
+  mst->starttime   = msr->starttime + (hptime_t) (skip / msr->samprate * HPTMODULUS + 0.5);
+  mst->endtime     = msr_endtime (msr);
+  mst->samplecnt   = msr->samplecnt - skip;
+  mst->numsamples  = msr->numsamples - skip;
+  mst->sampletype  = msr->sampletype;
+
+  if (!(mst->datasamples = malloc ((size_t) (mst->numsamples * samplesize))))
+    exit (1);
+
+  memcpy (mst->datasamples, (char *)msr->datasamples + skip * samplesize,
+          (size_t) (mst->numsamples * samplesize));
+
+  return mst;
+} /* End of makefragment() */
+
+/***************************************************************************
+ * healfragments:
+ *
+ * Add copies of the fragments to a MSTraceGroup in an order shuffled
+ * with seed, heal and sort the group and print the traces.
+ ***************************************************************************/
+static void
+healfragments (unsigned int seed)
+{
+  MSTraceGroup *mstg;
+  MSTrace *order[MAXFRAGMENTS];
+  MSTrace *mst;
+  MSTrace *swap;
+  char srcname[50];
+  char starttime[30];
+  char endtime[30];
+  unsigned int state = seed;
+  int samplesize;
+  int healed;
+  int idx;
+  int pick;
+
+  /* Shuffle with a fixed generator so the order is the same everywhere */
+  for (idx = 0; idx < numfragments; idx++)
+    order[idx] = fragments[idx];
+
+  for (idx = numfragments - 1; idx > 0; idx--)
+  {
+    state       = state * 1103515245u + 12345u;
+    pick        = (int)((state >> 16) % (unsigned int)(idx + 1));
+    swap        = order[idx];
+    order[idx]  = order[pick];
+    order[pick] = swap;
+  }
+
+  mstg = mst_initgroup (NULL);
+
+  for (idx = 0; idx < numfragments; idx++)
+  {
+    if (!(mst = mst_init (NULL)))
+      exit (1);
+
+    memcpy (mst, order[idx], sizeof (MSTrace));
+    mst->next = NULL;
+
+    samplesize = ms_samplesize (mst->sampletype);
+
+    if (!(mst->datasamples = malloc ((size_t) (mst->numsamples * samplesize))))
+      exit (1);
+
+    memcpy (mst->datasamples, order[idx]->datasamples, (size_t) (mst->numsamples * samplesize));
+
+    mst_addtracetogroup (mstg, mst);
+  }
+
+  healed = mst_groupheal (mstg, -1.0, -1.0);
+  mst_groupsort (mstg, 1);
+
+  printf ("Seed %u: %d fragments, %d healed, %d traces\n",
+          seed, numfragments, healed, mstg->numtraces);
+
+  for (mst = mstg->traces; mst; mst = mst->next)
+  {
+    ms_hptime2seedtimestr (mst->starttime, starttime, 1);
+    ms_hptime2seedtimestr (mst->endtime, endtime, 1);
+
+    printf ("  %-18s %s %s %6lld %6lld %.6g\n", mst_srcname (mst, srcname, 1),
+            starttime, endtime, (long long int)mst->samplecnt,
+            (long long int)mst->numsamples, checksum (mst));
+  }
+
+  mst_freegroup (&mstg);
+} /* End of healfragments() */
+
+/***************************************************************************
+ * checksum:
+ *
+ * Returns the sum of the data samples of a MSTrace weighted by their
+ * position, so that samples out of order change the sum.
+ ***************************************************************************/
+static double
+checksum (MSTrace *mst)
+{
+  double sum = 0.0;
+  int64_t idx;
+
+  for (idx = 0; idx < mst->numsamples; idx++)
+  {
+    if (mst->sampletype == 'i')
+      sum += (double)((int32_t *)mst->datasamples)[idx] * (double)(idx % 97 + 1);
+    else if (mst->sampletype == 'f')
+      sum += (double)((float *)mst->datasamples)[idx] * (double)(idx % 97 + 1);
+    else if (mst->sampletype == 'd')
+      sum += ((double *)mst->datasamples)[idx] * (double)(idx % 97 + 1);
+  }
+
+  return sum;
+} /* End of checksum() */
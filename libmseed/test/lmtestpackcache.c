@@ -0,0 +1,233 @@
+/***************************************************************************
+ * lmtestpackcache.c
+ *
+ * A program for libmseed packed header cache tests.
+ *
+ * Packs the same MSRecord repeatedly, changing one of the values the
+ * cached header is packed from before each pack, and compares the
+ * records with those packed from a copy of the MSRecord without a
+ * cached header.  Reports whether the cached header was reused or
+ * packed again for each change.
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libmseed.h>
+
+#define NUMSAMPLES 400
+
+/* Records packed by one call */
+struct records
+{
+  char *buffer;
+  size_t length;
+  int count;
+};
+
+static int reused = 0;
+
+static int testpack (MSRecord *msr, const char *change);
+static void record_handler (char *record, int reclen, void *handlerdata);
+static void log_handler (char *message);
+
+int
+main (int argc, char **argv)
+{
+  MSRecord *msr = NULL;
+  struct blkt_100_s blkt100;
+  struct blkt_1001_s blkt1001;
+  int32_t samples[NUMSAMPLES];
+  int errors = 0;
+  int idx;
+
+  /* Capture diagnostics to detect reuse of the cached header */
+  ms_loginit (log_handler, NULL, log_handler, NULL);
+
+  for (idx = 0; idx < NUMSAMPLES; idx++)
+    samples[idx] = ((idx * 7919) % 4001) - 2000;
+
+  if (!(msr = msr_init (NULL)))
+  {
+    printf ("Cannot initialize MSRecord\n");
+    return 1;
+  }
+
+  strcpy (msr->network, "XX");
+  strcpy (msr->station, "TEST");
+  strcpy (msr->channel, "LHZ");
+  msr->dataquality = 'D';
+  msr->starttime   = ms_timestr2hptime ("2012-01-01T00:00:00.000125");
+  msr->samprate    = 1.0;
+  msr->reclen      = 512;
+  msr->encoding    = DE_STEIM2;
+  msr->byteorder   = 1;
+  msr->datasamples = samples;
+  msr->numsamples  = NUMSAMPLES;
+  msr->samplecnt   = NUMSAMPLES;
+  msr->sampletype  = 'i';
+
+  memset (&blkt1001, 0, sizeof (struct blkt_1001_s));
+  blkt1001.timing_qual = 100;
+
+  if (!msr_addblockette (msr, (char *)&blkt1001, sizeof (struct blkt_1001_s), 1001, 0))
+  {
+    printf ("Cannot add Blockette 1001\n");
+    return 1;
+  }
+
+  errors += testpack (msr, "initial");
+  errors += testpack (msr, "unchanged");
+
+  msr->reclen = 256;
+  errors += testpack (msr, "record length");
+
+  msr->encoding = DE_STEIM1;
+  errors += testpack (msr, "encoding");
+
+  msr->byteorder = 0;
+  errors += testpack (msr, "byte order");
+
+  msr->samprate = 20.0;
+  errors += testpack (msr, "sample rate");
+
+  msr->fsdh->act_flags = 0x04;
+  errors += testpack (msr, "activity flags");
+
+  msr->fsdh->io_flags = 0x20;
+  errors += testpack (msr, "I/O flags");
+
+  msr->fsdh->dq_flags = 0x10;
+  errors += testpack (msr, "data quality flags");
+
+  msr->fsdh->time_correct = 25;
+  errors += testpack (msr, "time correction");
+
+  msr->Blkt1001->timing_qual = 50;
+  errors += testpack (msr, "blockette 1001 contents");
+
+  memset (&blkt100, 0, sizeof (struct blkt_100_s));
+  blkt100.samprate = 20.0;
+
+  if (!msr_addblockette (msr, (char *)&blkt100, sizeof (struct blkt_100_s), 100, 0))
+  {
+    printf ("Cannot add Blockette 100\n");
+    return 1;
+  }
+  errors += testpack (msr, "blockette added");
+
+  msr->Blkt100->flags = 1;
+  errors += testpack (msr, "blockette 100 flags");
+
+  strcpy (msr->channel, "BHZ");
+  errors += testpack (msr, "channel");
+
+  msr->dataquality = 'Q';
+  errors += testpack (msr, "quality");
+
+  errors += testpack (msr, "unchanged");
+
+  msr->datasamples = NULL;
+  msr_free (&msr);
+
+  return (errors) ? 1 : 0;
+} /* End of main() */
+
+/***************************************************************************
+ * testpack:
+ *
+ * Pack all samples of a MSRecord, using and updating its cached
+ * header, and a copy of the MSRecord with the same stream state but
+ * no cached header and compare the records.
+ *
+ * Returns 0 if the records are identical and 1 otherwise.
+ ***************************************************************************/
+static int
+testpack (MSRecord *msr, const char *change)
+{
+  struct records cached   = {NULL, 0, 0};
+  struct records uncached = {NULL, 0, 0};
+  MSRecord *copy;
+  int mismatch;
+
+  if (!(copy = msr_duplicate (msr, 0)))
+  {
+    printf ("%s: cannot duplicate MSRecord\n", change);
+    return 1;
+  }
+
+  copy->datasamples = msr->datasamples;
+  copy->numsamples  = msr->numsamples;
+  copy->sampletype  = msr->sampletype;
+
+  if (msr->ststate)
+  {
+    if (!(copy->ststate = (StreamState *)malloc (sizeof (StreamState))))
+    {
+      printf ("%s: cannot allocate StreamState\n", change);
+      return 1;
+    }
+
+    memcpy (copy->ststate, msr->ststate, sizeof (StreamState));
+    copy->ststate->packcache = NULL;
+  }
+
+  if (msr_pack (copy, record_handler, &uncached, NULL, 1, 0) < 0)
+    printf ("%s: packing without cache failed\n", change);
+
+  reused = 0;
+  if (msr_pack (msr, record_handler, &cached, NULL, 1, 3) < 0)
+    printf ("%s: packing with cache failed\n", change);
+
+  mismatch = (cached.count != uncached.count || cached.length != uncached.length ||
+              memcmp (cached.buffer, uncached.buffer, cached.length));
+
+  printf ("%-24s %2d records, header %s, %s\n", change, cached.count,
+          (reused) ? "reused" : "packed", (mismatch) ? "MISMATCH" : "identical");
+
+  copy->datasamples = NULL;
+  msr_free (&copy);
+  free (cached.buffer);
+  free (uncached.buffer);
+
+  return (mismatch) ? 1 : 0;
+} /* End of testpack() */
+
+/***************************************************************************
+ * record_handler:
+ *
+ * Append a packed record to a records buffer.
+ ***************************************************************************/
+static void
+record_handler (char *record, int reclen, void *handlerdata)
+{
+  struct records *records = (struct records *)handlerdata;
+  char *buffer;
+
+  if (!(buffer = (char *)realloc (records->buffer, records->length + reclen)))
+  {
+    printf ("Cannot allocate record buffer\n");
+    exit (1);
+  }
+
+  memcpy (buffer + records->length, record, reclen);
+  records->buffer = buffer;
+  records->length += reclen;
+  records->count++;
+} /* End of record_handler() */
+
+/***************************************************************************
+ * log_handler:
+ *
+ * Count reuses of the cached header reported by msr_pack() and print
+ * errors, other diagnostics are ignored.
+ ***************************************************************************/
+static void
+log_handler (char *message)
+{
+  if (strstr (message, "Reusing packed header"))
+    reused++;
+  else if (!strncmp (message, "Error", 5))
+    printf ("%s", message);
+} /* End of log_handler() */
@@ -0,0 +1,97 @@
+/***************************************************************************
+ * lmtestswap.c
+ *
+ * A program for libmseed byte swapping tests.
+ *
+ * Verifies that the bulk swapping routines, ms_gswap2n(), ms_gswap4n()
+ * and ms_gswap8n(), produce the same results as swapping each
+ * quantity individually, for both copying and in-place swapping, for
+ * a range of array lengths and memory alignments.
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libmseed.h>
+
+#define MAXCOUNT 67
+#define MAXOFFSET 8
+
+static int testswap (int size, void (*bulk) (void *, const void *, size_t),
+                     void (*single) (void *));
+
+int
+main (int argc, char **argv)
+{
+  int errors = 0;
+
+  errors += testswap (2, ms_gswap2n, ms_gswap2);
+  errors += testswap (4, ms_gswap4n, ms_gswap4);
+  errors += testswap (8, ms_gswap8n, ms_gswap8);
+
+  return (errors) ? 1 : 0;
+}
+
+/***************************************************************************
+ * testswap:
+ *
+ * Compare bulk swapping of quantities of size bytes with swapping
+ * each quantity individually.
+ *
+ * Returns number of mismatched arrays.
+ ***************************************************************************/
+static int
+testswap (int size, void (*bulk) (void *, const void *, size_t),
+          void (*single) (void *))
+{
+  uint8_t source[MAXCOUNT * 8 + MAXOFFSET];
+  uint8_t expect[MAXCOUNT * 8 + MAXOFFSET];
+  uint8_t result[MAXCOUNT * 8 + MAXOFFSET];
+  int arrays = 0;
+  int errors = 0;
+  int offset;
+  int count;
+  int idx;
+
+  for (idx = 0; idx < (int)sizeof (source); idx++)
+    source[idx] = (uint8_t)(idx * 7 + 3);
+
+  for (offset = 0; offset < MAXOFFSET; offset++)
+  {
+    for (count = 0; count <= MAXCOUNT; count++)
+    {
+      /* Reference by swapping each quantity */
+      memcpy (expect, source, sizeof (source));
+      for (idx = 0; idx < count; idx++)
+        single (expect + offset + idx * size);
+
+      /* Copying swap, bytes outside the array must not change */
+      memcpy (result, source, sizeof (source));
+      memset (result + offset, 0xAA, count * size);
+      bulk (result + offset, source + offset, count);
+
+      if (memcmp (result, expect, sizeof (result)))
+      {
+        printf ("ms_gswap%dn: copy mismatch, offset %d, count %d\n", size, offset, count);
+        errors++;
+      }
+
+      /* In-place swap */
+      memcpy (result, source, sizeof (source));
+      bulk (result + offset, result + offset, count);
+
+      if (memcmp (result, expect, sizeof (result)))
+      {
+        printf ("ms_gswap%dn: in-place mismatch, offset %d, count %d\n", size, offset, count);
+        errors++;
+      }
+
+      arrays++;
+    }
+  }
+
+  printf ("ms_gswap%dn: %d arrays tested, %d errors\n", size, arrays, errors);
+
+  return errors;
+}
@@ -0,0 +1,145 @@
+/***************************************************************************
+ * lmtesttable.c
+ *
+ * A program for libmseed trace table tests.
+ *
+ * The traces of each input file are read into a MSTraceGroup and moved
+ * to the end of a MSTraceTable, then all traces are moved from the
+ * table back to a single group.  The trace lists of the table and of
+ * the resulting group are printed along with that of a group read
+ * directly from all files, and the traces are compared with those of
+ * the group read directly.  The input files must not contain data for
+ * the same source name.
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libmseed.h>
+
+static int comparegroups (MSTraceGroup *mstg1, MSTraceGroup *mstg2);
+
+int
+main (int argc, char **argv)
+{
+  MSTraceTable *mstt  = NULL;
+  MSTraceGroup *orig  = NULL;
+  MSTraceGroup *file  = NULL;
+  MSTraceGroup *moved = NULL;
+  int retcode;
+  int idx;
+
+  if (argc < 2)
+  {
+    printf ("Usage: lmtesttable file [file ...]\n");
+    return 1;
+  }
+
+  if (!(mstt = mstt_init (NULL)) || !(moved = mst_initgroup (NULL)))
+  {
+    printf ("Cannot initialize trace table or group\n");
+    return 1;
+  }
+
+  for (idx = 1; idx < argc; idx++)
+  {
+    if ((retcode = ms_readtraces (&orig, argv[idx], 0, -1.0, -1.0, 1, 0, 1, 0)) != MS_NOERROR ||
+        (retcode = ms_readtraces (&file, argv[idx], 0, -1.0, -1.0, 1, 0, 1, 0)) != MS_NOERROR)
+    {
+      printf ("Cannot read %s: %s\n", argv[idx], ms_errorstr (retcode));
+      return 1;
+    }
+
+    retcode = mstt_fromgroup (mstt, file);
+    printf ("mstt_fromgroup(%s): %d, table has %d traces, group has %d\n",
+            argv[idx], retcode, mstt->numtraces, file->numtraces);
+  }
+
+  printf ("\nGroup read from files:\n");
+  mst_printtracelist (orig, 0, 1, 1);
+
+  printf ("\nTable:\n");
+  mstt_printtracelist (mstt, 0, 1, 1);
+
+  /* Invalid arguments return an error and leave the traces in place */
+  printf ("\nmstt_fromgroup(NULL table): %d, group has %d traces\n",
+          mstt_fromgroup (NULL, orig), orig->numtraces);
+  printf ("mstt_fromgroup(NULL group): %d, table has %d traces\n",
+          mstt_fromgroup (mstt, NULL), mstt->numtraces);
+  printf ("mstt_togroup(NULL table): %d, group has %d traces\n",
+          mstt_togroup (NULL, moved), moved->numtraces);
+  printf ("mstt_togroup(NULL group): %d, table has %d traces\n",
+          mstt_togroup (mstt, NULL), mstt->numtraces);
+
+  retcode = mstt_togroup (mstt, moved);
+  printf ("\nmstt_togroup(): %d, table has %d traces, group has %d\n",
+          retcode, mstt->numtraces, moved->numtraces);
+
+  printf ("\nGroup from table:\n");
+  mst_printtracelist (moved, 0, 1, 1);
+
+  retcode = comparegroups (orig, moved);
+
+  mstt_free (&mstt);
+  mst_freegroup (&orig);
+  mst_freegroup (&file);
+  mst_freegroup (&moved);
+
+  return (retcode) ? 1 : 0;
+} /* End of main() */
+
+/***************************************************************************
+ * comparegroups:
+ *
+ * Compare the traces of two MSTraceGroups in chain order, including
+ * their data samples, and print the result.
+ *
+ * Returns 0 if the groups are identical and 1 otherwise.
+ ***************************************************************************/
+static int
+comparegroups (MSTraceGroup *mstg1, MSTraceGroup *mstg2)
+{
+  MSTrace *mst1 = mstg1->traces;
+  MSTrace *mst2 = mstg2->traces;
+  char srcname[50];
+  int mismatches = 0;
+  int traces     = 0;
+
+  while (mst1 && mst2)
+  {
+    if (strcmp (mst1->network, mst2->network) ||
+        strcmp (mst1->station, mst2->station) ||
+        strcmp (mst1->location, mst2->location) ||
+        strcmp (mst1->channel, mst2->channel) ||
+        mst1->dataquality != mst2->dataquality ||
+        mst1->type != mst2->type ||
+        mst1->starttime != mst2->starttime ||
+        mst1->endtime != mst2->endtime ||
+        mst1->samprate != mst2->samprate ||
+        mst1->samplecnt != mst2->samplecnt ||
+        mst1->numsamples != mst2->numsamples ||
+        mst1->sampletype != mst2->sampletype ||
+        memcmp (mst1->datasamples, mst2->datasamples,
+                (size_t) (mst1->numsamples * ms_samplesize (mst1->sampletype))))
+    {
+      printf ("MISMATCH: %s\n", mst_srcname (mst1, srcname, 1));
+      mismatches++;
+    }
+
+    mst1 = mst1->next;
+    mst2 = mst2->next;
+    traces++;
+  }
+
+  if (mst1 || mst2 || mstg1->numtraces != mstg2->numtraces)
+  {
+    printf ("MISMATCH: %d and %d traces\n", mstg1->numtraces, mstg2->numtraces);
+    mismatches++;
+  }
+
+  printf ("\nRound trip: %d traces compared, %s\n", traces,
+          (mismatches) ? "MISMATCH" : "identical");
+
+  return (mismatches) ? 1 : 0;
+} /* End of comparegroups() */
@@ -14,10 +14,45 @@
 #include <time.h>
 
 #include "libmseed.h"
+#include "traceutils.h"
+
+/* Hash index entry for a MSTraceID, linked into a bucket */
+typedef struct MSTraceListIndexEntry_s {
+  uint32_t   hash;             /* Hash of the source name */
+  int32_t    next;             /* Next entry in the bucket, -1 if last */
+  MSTraceID *id;               /* Indexed trace ID */
+} MSTraceListIndexEntry;
+
+/* Hash index of the trace IDs in a MSTraceList, see mstl_index() */
+typedef struct MSTraceListIndex_s {
+  int32_t  numentries;         /* Number of trace IDs indexed */
+  int32_t  maxentries;         /* Number of entries allocated */
+  int32_t  numbuckets;         /* Number of buckets, a power of 2 */
+  int32_t *buckets;            /* First entry in each bucket, -1 if empty */
+  MSTraceListIndexEntry *entries;
+} MSTraceListIndex;
 
 MSTraceSeg *mstl_msr2seg (MSRecord *msr, hptime_t endtime);
 MSTraceSeg *mstl_addmsrtoseg (MSTraceSeg *seg, MSRecord *msr, hptime_t endtime, flag whence);
 MSTraceSeg *mstl_addsegtoseg (MSTraceSeg *seg1, MSTraceSeg *seg2);
+static uint32_t mstl_hashsrcname (char *srcname);
+static int mstl_indexadd (MSTraceListIndex *index, MSTraceID *id);
+static int mstl_indexbuild (MSTraceList *mstl);
+static MSTraceListIndex *mstl_indexcheck (MSTraceList *mstl);
+static MSTraceID *mstl_indexfind (MSTraceListIndex *index, char *srcname);
+static void mstl_indexfree (MSTraceList *mstl);
+static void mstl_treeupdate (MSTraceSeg *seg);
+static void mstl_treefixup (MSTraceSeg *seg);
+static void mstl_treerotate (MSTraceID *id, MSTraceSeg *seg);
+static void mstl_treeinsert (MSTraceID *id, MSTraceSeg *seg);
+static void mstl_treeremove (MSTraceID *id, MSTraceSeg *seg);
+static void mstl_treebuild (MSTraceID *id);
+static MSTraceSeg *mstl_treefind (MSTraceSeg *node, flag windows,
+                                  hptime_t startlo, hptime_t starthi,
+                                  hptime_t endlo, hptime_t endhi,
+                                  double samprate, double sampratetol,
+                                  MSTraceSeg *exclude);
+static MSTraceSeg *mstl_treefollow (MSTraceSeg *node, hptime_t time);
 
 /***************************************************************************
  * mstl_init:
@@ -88,8 +123,7 @@ mstl_free (MSTraceList **ppmstl, flag freeprvtptr)
           free (seg->prvtptr);
 
         /* Free data array if allocated */
-        if (seg->datasamples)
-          free (seg->datasamples);
+        mstl_freesamples (seg);
 
         free (seg);
         seg = nextseg;
@@ -103,6 +137,8 @@ mstl_free (MSTraceList **ppmstl, flag freeprvtptr)
       id = nextid;
     }
 
+    mstl_indexfree (*ppmstl);
+
     free (*ppmstl);
 
     *ppmstl = NULL;
@@ -111,6 +147,271 @@ mstl_free (MSTraceList **ppmstl, flag freeprvtptr)
   return;
 } /* End of mstl_free() */
 
+/***************************************************************************
+ * mstl_freesamples:
+ *
+ * Free the data samples of a MSTraceSeg and reset the sample count.
+ *
+ * MSTraceSeg.datasamples may not point to the start of its buffer, the
+ * samples of a segment must be released with this routine instead of
+ * free().
+ ***************************************************************************/
+void
+mstl_freesamples (MSTraceSeg *seg)
+{
+  if (!seg)
+    return;
+
+  ms_releasesamples (&seg->datasamples, &seg->numsamples, &seg->dataoffset,
+                     &seg->datacapacity, ms_samplesize (seg->sampletype));
+} /* End of mstl_freesamples() */
+
+/***************************************************************************
+ * mstl_index:
+ *
+ * Build or release a hash index of the trace IDs in a MSTraceList.
+ * If the enable flag is true the index is (re)built from the current
+ * list of trace IDs, otherwise any index is released.
+ *
+ * The index is keyed on the source name of the trace IDs, i.e. the
+ * network, station, location, channel and, if used when adding data,
+ * quality identifiers.  It is used by mstl_addmsr() to find the trace
+ * ID for a record without comparing the source names of all trace
+ * IDs in the list.  The trace IDs are kept in the same order as
+ * without the index, a new trace ID is still placed by a search of
+ * the list.  The index is kept up to date by mstl_addmsr().
+ *
+ * The index is rebuilt when the number of trace IDs in the list no
+ * longer matches the number indexed.  A caller that otherwise changes
+ * the list of trace IDs must rebuild the index by calling this
+ * routine again.
+ *
+ * Return 0 on success and -1 on error.
+ ***************************************************************************/
+int
+mstl_index (MSTraceList *mstl, flag enable)
+{
+  if (!mstl)
+    return -1;
+
+  if (!enable)
+  {
+    mstl_indexfree (mstl);
+    return 0;
+  }
+
+  return mstl_indexbuild (mstl);
+} /* End of mstl_index() */
+
+/***************************************************************************
+ * mstl_hashsrcname:
+ *
+ * Calculate a hash of a source name using the FNV-1a algorithm.
+ *
+ * Return the hash value.
+ ***************************************************************************/
+static uint32_t
+mstl_hashsrcname (char *srcname)
+{
+  uint32_t hash = 2166136261U;
+
+  while (*srcname)
+  {
+    hash ^= (uint8_t)*srcname++;
+    hash *= 16777619U;
+  }
+
+  return hash;
+} /* End of mstl_hashsrcname() */
+
+/***************************************************************************
+ * mstl_indexadd:
+ *
+ * Add a MSTraceID to a trace list index, growing the entries and
+ * doubling the number of buckets as needed to keep the buckets short.
+ *
+ * Return 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+mstl_indexadd (MSTraceListIndex *index, MSTraceID *id)
+{
+  MSTraceListIndexEntry *entries;
+  int32_t *buckets;
+  int32_t numbuckets;
+  int32_t *link;
+  int32_t idx;
+
+  if (index->numentries >= index->maxentries)
+  {
+    idx = (index->maxentries) ? index->maxentries * 2 : 64;
+
+    if (!(entries = (MSTraceListIndexEntry *)realloc (index->entries, idx * sizeof (MSTraceListIndexEntry))))
+      return -1;
+
+    index->entries    = entries;
+    index->maxentries = idx;
+  }
+
+  if (index->numentries >= index->numbuckets)
+  {
+    numbuckets = (index->numbuckets) ? index->numbuckets * 2 : 64;
+
+    if (!(buckets = (int32_t *)realloc (index->buckets, numbuckets * sizeof (int32_t))))
+      return -1;
+
+    index->buckets    = buckets;
+    index->numbuckets = numbuckets;
+
+    for (idx = 0; idx < numbuckets; idx++)
+      buckets[idx] = -1;
+
+    for (idx = 0; idx < index->numentries; idx++)
+    {
+      link = &buckets[index->entries[idx].hash & (numbuckets - 1)];
+
+      index->entries[idx].next = *link;
+      *link                    = idx;
+    }
+  }
+
+  idx = index->numentries++;
+
+  index->entries[idx].hash = mstl_hashsrcname (id->srcname);
+  index->entries[idx].id   = id;
+
+  link = &index->buckets[index->entries[idx].hash & (index->numbuckets - 1)];
+
+  index->entries[idx].next = *link;
+  *link                    = idx;
+
+  return 0;
+} /* End of mstl_indexadd() */
+
+/***************************************************************************
+ * mstl_indexbuild:
+ *
+ * Build the trace ID index of a MSTraceList from the list of trace
+ * IDs, allocating the index if needed.  On error the index is
+ * released.
+ *
+ * Return 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+mstl_indexbuild (MSTraceList *mstl)
+{
+  MSTraceListIndex *index;
+  MSTraceID *id;
+  int32_t idx;
+
+  if (!mstl->index)
+  {
+    if (!(mstl->index = calloc (1, sizeof (MSTraceListIndex))))
+    {
+      ms_log (2, "mstl_index(): Cannot allocate memory\n");
+      return -1;
+    }
+  }
+
+  index = (MSTraceListIndex *)mstl->index;
+
+  index->numentries = 0;
+
+  for (idx = 0; idx < index->numbuckets; idx++)
+    index->buckets[idx] = -1;
+
+  for (id = mstl->traces; id; id = id->next)
+  {
+    if (mstl_indexadd (index, id))
+    {
+      ms_log (2, "mstl_index(): Cannot allocate memory\n");
+      mstl_indexfree (mstl);
+      return -1;
+    }
+  }
+
+  return 0;
+} /* End of mstl_indexbuild() */
+
+/***************************************************************************
+ * mstl_indexcheck:
+ *
+ * Check that the trace ID index of a MSTraceList covers the list and
+ * rebuild it if the number of trace IDs differs.
+ *
+ * Return the index or NULL if the list is not indexed.
+ ***************************************************************************/
+static MSTraceListIndex *
+mstl_indexcheck (MSTraceList *mstl)
+{
+  MSTraceListIndex *index = (MSTraceListIndex *)mstl->index;
+
+  if (!index)
+    return NULL;
+
+  if (index->numentries != mstl->numtraces)
+  {
+    if (mstl_indexbuild (mstl))
+      return NULL;
+  }
+
+  return (MSTraceListIndex *)mstl->index;
+} /* End of mstl_indexcheck() */
+
+/***************************************************************************
+ * mstl_indexfind:
+ *
+ * Find the trace ID with a source name in a trace list index.
+ *
+ * Return a MSTraceID or NULL if not found.
+ ***************************************************************************/
+static MSTraceID *
+mstl_indexfind (MSTraceListIndex *index, char *srcname)
+{
+  MSTraceListIndexEntry *ie;
+  uint32_t hash;
+  int32_t entry;
+
+  if (!index->numbuckets)
+    return NULL;
+
+  hash  = mstl_hashsrcname (srcname);
+  entry = index->buckets[hash & (index->numbuckets - 1)];
+
+  while (entry >= 0)
+  {
+    ie = &index->entries[entry];
+
+    if (ie->hash == hash && !strcmp (ie->id->srcname, srcname))
+      return ie->id;
+
+    entry = ie->next;
+  }
+
+  return NULL;
+} /* End of mstl_indexfind() */
+
+/***************************************************************************
+ * mstl_indexfree:
+ *
+ * Release the trace ID index of a MSTraceList, if any.
+ ***************************************************************************/
+static void
+mstl_indexfree (MSTraceList *mstl)
+{
+  MSTraceListIndex *index = (MSTraceListIndex *)mstl->index;
+
+  if (index)
+  {
+    if (index->entries)
+      free (index->entries);
+    if (index->buckets)
+      free (index->buckets);
+
+    free (index);
+    mstl->index = NULL;
+  }
+} /* End of mstl_indexfree() */
+
 /***************************************************************************
  * mstl_addmsr:
  *
@@ -130,6 +431,17 @@ mstl_free (MSTraceList **ppmstl, flag freeprvtptr)
  * descending alphanumeric order.  MSTraceIDs are always maintained
  * with MSTraceSegs in data time time order.
  *
+ * If the list is indexed, see mstl_index(), the MSTraceID for a
+ * record is found in the index and the list is only searched to
+ * place a new MSTraceID.
+ *
+ * The MSTraceSegs of each MSTraceID are also held in a search tree
+ * in list order, augmented with the range of start and end times in
+ * each subtree, to find adjacent segments and the place for a new
+ * segment without walking the segment list.  The tree is rebuilt
+ * when MSTraceID.numsegments differs from the number of segments in
+ * the tree.
+ *
  * Return a pointer to the MSTraceSeg updated or 0 on error.
  ***************************************************************************/
 MSTraceSeg *
@@ -140,26 +452,29 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
   MSTraceID *searchid = 0;
   MSTraceID *ltid     = 0;
 
+  MSTraceListIndex *index;
+
   MSTraceSeg *seg       = 0;
-  MSTraceSeg *searchseg = 0;
   MSTraceSeg *segbefore = 0;
   MSTraceSeg *segafter  = 0;
   MSTraceSeg *followseg = 0;
 
   hptime_t endtime;
-  hptime_t pregap;
-  hptime_t postgap;
   hptime_t lastgap;
   hptime_t firstgap;
   hptime_t hpdelta;
   hptime_t hptimetol  = 0;
   hptime_t nhptimetol = 0;
+  hptime_t startlo;
+  hptime_t starthi;
+  hptime_t endlo;
+  hptime_t endhi;
 
   char srcname[45];
   char *s1, *s2;
-  flag whence;
   flag lastratecheck;
   flag firstratecheck;
+  flag moved = 0;
   int mag;
   int cmp;
   int ltmag;
@@ -201,10 +516,15 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
     }
     else
     {
+      /* Look up the trace ID in the index if the list is indexed */
+      if ((index = mstl_indexcheck (mstl)))
+        id = mstl_indexfind (index, srcname);
+
       /* Loop through trace ID list searching for a match, simultaneously
          track the source name which is closest but less than the MSRecord
-         to allow for later insertion with sort order. */
-      searchid = mstl->traces;
+         to allow for later insertion with sort order.  A trace ID found
+         in the index needs no search. */
+      searchid = (id) ? NULL : mstl->traces;
       ltcmp    = 0;
       ltmag    = 0;
       while (searchid)
@@ -279,6 +599,10 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
     }
     id->first = id->last = seg;
 
+    mstl_treeinsert (id, seg);
+
+    index = mstl_indexcheck (mstl);
+
     /* Add new MSTraceID to MSTraceList */
     if (!mstl->traces || !ltid)
     {
@@ -292,6 +616,12 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
     }
 
     mstl->numtraces++;
+
+    if (index && mstl_indexadd (index, id))
+    {
+      ms_log (2, "mstl_addmsr(): Error allocating memory for trace index\n");
+      mstl_indexfree (mstl);
+    }
   }
   /* Add data coverage to the matching MSTraceID */
   else
@@ -307,6 +637,10 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
 
     nhptimetol = (hptimetol) ? -hptimetol : 0;
 
+    /* Rebuild the segment tree if the segments were changed elsewhere */
+    if (id->treesegments != id->numsegments || !id->treeroot)
+      mstl_treebuild (id);
+
     /* last/firstgap are negative when the record overlaps the trace
      * segment and positive when there is a time gap. */
 
@@ -344,6 +678,7 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
         return 0;
 
       seg = id->last;
+      mstl_treefixup (seg);
 
       if (endtime > id->latest)
         id->latest = endtime;
@@ -359,6 +694,7 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
       seg->prev      = id->last;
       id->last       = seg;
       id->numsegments++;
+      mstl_treeinsert (id, seg);
 
       if (endtime > id->latest)
         id->latest = endtime;
@@ -374,6 +710,7 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
       seg->next       = id->first;
       id->first       = seg;
       id->numsegments++;
+      mstl_treeinsert (id, seg);
 
       if (msr->starttime < id->earliest)
         id->earliest = msr->starttime;
@@ -385,70 +722,47 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
         return 0;
 
       seg = id->first;
+      mstl_treefixup (seg);
 
       if (msr->starttime < id->earliest)
         id->earliest = msr->starttime;
     }
-    /* Search complete segment list for matches */
+    /* Search the segment tree for matches */
     else
     {
-      searchseg = id->first;
-      segbefore = 0; /* Find segment that record fits before */
-      segafter  = 0; /* Find segment that record fits after */
-      followseg = 0; /* Track segment that record follows in time order */
-      while (searchseg)
+      /* Ranges of end times of segments that the record fits after and
+       * start times of segments that the record fits before, from the
+       * post/pregap tolerances of the record */
+      endlo   = msr->starttime - hpdelta - hptimetol;
+      endhi   = msr->starttime - hpdelta - nhptimetol;
+      startlo = endtime + hpdelta + nhptimetol;
+      starthi = endtime + hpdelta + hptimetol;
+
+      /* Find the first segment in list order that the record fits
+       * before and the first other segment that it fits after, or if
+       * not autohealing only the first segment it fits either way */
+      if (autoheal)
       {
-        if (msr->starttime > searchseg->starttime)
-          followseg = searchseg;
-
-        whence = 0;
-
-        postgap = msr->starttime - searchseg->endtime - hpdelta;
-        if (!segbefore && postgap <= hptimetol && postgap >= nhptimetol)
-          whence = 1;
-
-        pregap = searchseg->starttime - endtime - hpdelta;
-        if (!segafter && pregap <= hptimetol && pregap >= nhptimetol)
-          whence = 2;
-
-        if (!whence)
-        {
-          searchseg = searchseg->next;
-          continue;
-        }
+        segafter  = mstl_treefind (id->treeroot, 1, startlo, starthi, endlo, endhi,
+                                   msr->samprate, sampratetol, NULL);
+        segbefore = mstl_treefind (id->treeroot, 2, startlo, starthi, endlo, endhi,
+                                   msr->samprate, sampratetol, segafter);
+      }
+      else
+      {
+        segafter  = 0;
+        segbefore = mstl_treefind (id->treeroot, 3, startlo, starthi, endlo, endhi,
+                                   msr->samprate, sampratetol, NULL);
 
-        if (sampratetol == -1.0)
-        {
-          if (!MS_ISRATETOLERABLE (msr->samprate, searchseg->samprate))
-          {
-            searchseg = searchseg->next;
-            continue;
-          }
-        }
-        else
+        if (segbefore && segbefore->starttime >= startlo && segbefore->starttime <= starthi)
         {
-          if (ms_dabs (msr->samprate - searchseg->samprate) > sampratetol)
-          {
-            searchseg = searchseg->next;
-            continue;
-          }
+          segafter  = segbefore;
+          segbefore = 0;
         }
+      }
 
-        if (whence == 1)
-          segbefore = searchseg;
-        else
-          segafter = searchseg;
-
-        /* Done searching if not autohealing */
-        if (!autoheal)
-          break;
-
-        /* Done searching if both before and after segments are found */
-        if (segbefore && segafter)
-          break;
-
-        searchseg = searchseg->next;
-      } /* Done looping through segments */
+      /* Find the last segment starting before the record for a new segment */
+      followseg = (segbefore || segafter) ? 0 : mstl_treefollow (id->treeroot, msr->starttime);
 
       /* Add MSRecord coverage to end of segment before */
       if (segbefore)
@@ -458,6 +772,8 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
           return 0;
         }
 
+        mstl_treefixup (segbefore);
+
         /* Merge two segments that now fit if autohealing */
         if (autoheal && segafter && segbefore != segafter)
         {
@@ -471,15 +787,18 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
           if (segafter == id->last)
             id->last = id->last->prev;
 
-          /* Remove segafter from list */
+          /* Remove segafter from list and tree */
           if (segafter->prev)
             segafter->prev->next = segafter->next;
           if (segafter->next)
             segafter->next->prev = segafter->prev;
 
+          mstl_treeremove (id, segafter);
+          mstl_treefixup (segbefore);
+          id->numsegments--;
+
           /* Free data samples, private data and segment structure */
-          if (segafter->datasamples)
-            free (segafter->datasamples);
+          mstl_freesamples (segafter);
 
           if (segafter->prvtptr)
             free (segafter->prvtptr);
@@ -498,6 +817,7 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
         }
 
         seg = segafter;
+        mstl_treefixup (seg);
       }
       /* Add MSRecord coverage to new segment */
       else
@@ -531,6 +851,7 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
         }
 
         id->numsegments++;
+        mstl_treeinsert (id, seg);
       }
 
       /* Track earliest and latest times */
@@ -548,6 +869,7 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
   {
     /* Move segment down list, swap seg and seg->next */
     segafter = seg->next;
+    moved    = 1;
 
     if (seg->prev)
       seg->prev->next = segafter;
@@ -572,6 +894,7 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
   {
     /* Move segment up list, swap seg and seg->prev */
     segbefore = seg->prev;
+    moved     = 1;
 
     if (seg->next)
       seg->next->prev = segbefore;
@@ -592,6 +915,13 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
       id->last = segbefore;
   }
 
+  /* Move a segment sorted into another place in the tree */
+  if (moved)
+  {
+    mstl_treeremove (id, seg);
+    mstl_treeinsert (id, seg);
+  }
+
   /* Set MSTraceID as last accessed */
   mstl->last = id;
 
@@ -638,6 +968,7 @@ mstl_msr2seg (MSRecord *msr, hptime_t endtime)
 
     /* Copy data samples from MSRecord to MSTraceSeg */
     memcpy (seg->datasamples, msr->datasamples, (size_t) (samplesize * msr->numsamples));
+    seg->datacapacity = msr->numsamples;
   }
 
   return seg;
@@ -659,7 +990,6 @@ MSTraceSeg *
 mstl_addmsrtoseg (MSTraceSeg *seg, MSRecord *msr, hptime_t endtime, flag whence)
 {
   int samplesize = 0;
-  void *newdatasamples;
 
   if (!seg || !msr)
     return 0;
@@ -679,14 +1009,22 @@ mstl_addmsrtoseg (MSTraceSeg *seg, MSRecord *msr, hptime_t endtime, flag whence)
       ms_log (2, "mstl_addmsrtoseg(): Unknown sample size for sample type: %c\n", msr->sampletype);
       return 0;
     }
+  }
+
+  if (whence != 1 && whence != 2)
+  {
+    ms_log (2, "mstl_addmsrtoseg(): unrecognized whence value: %d\n", whence);
+    return 0;
+  }
 
-    if (!(newdatasamples = realloc (seg->datasamples, (size_t) ((seg->numsamples + msr->numsamples) * samplesize))))
+  if (msr->datasamples && msr->numsamples > 0)
+  {
+    if (ms_addsamples (&seg->datasamples, &seg->numsamples, &seg->dataoffset,
+                       &seg->datacapacity, samplesize, msr->datasamples, msr->numsamples, whence))
     {
       ms_log (2, "mstl_addmsrtoseg(): Error allocating memory\n");
       return 0;
     }
-
-    seg->datasamples = newdatasamples;
   }
 
   /* Add coverage to end of segment */
@@ -694,39 +1032,12 @@ mstl_addmsrtoseg (MSTraceSeg *seg, MSRecord *msr, hptime_t endtime, flag whence)
   {
     seg->endtime = endtime;
     seg->samplecnt += msr->samplecnt;
-
-    if (msr->datasamples && msr->numsamples > 0)
-    {
-      memcpy ((char *)seg->datasamples + (seg->numsamples * samplesize),
-              msr->datasamples,
-              (size_t) (msr->numsamples * samplesize));
-
-      seg->numsamples += msr->numsamples;
-    }
   }
   /* Add coverage to beginning of segment */
-  else if (whence == 2)
+  else
   {
     seg->starttime = msr->starttime;
     seg->samplecnt += msr->samplecnt;
-
-    if (msr->datasamples && msr->numsamples > 0)
-    {
-      memmove ((char *)seg->datasamples + (msr->numsamples * samplesize),
-               seg->datasamples,
-               (size_t) (seg->numsamples * samplesize));
-
-      memcpy (seg->datasamples,
-              msr->datasamples,
-              (size_t) (msr->numsamples * samplesize));
-
-      seg->numsamples += msr->numsamples;
-    }
-  }
-  else
-  {
-    ms_log (2, "mstl_addmsrtoseg(): unrecognized whence value: %d\n", whence);
-    return 0;
   }
 
   return seg;
@@ -743,7 +1054,6 @@ MSTraceSeg *
 mstl_addsegtoseg (MSTraceSeg *seg1, MSTraceSeg *seg2)
 {
   int samplesize = 0;
-  void *newdatasamples;
 
   if (!seg1 || !seg2)
     return 0;
@@ -764,30 +1074,310 @@ mstl_addsegtoseg (MSTraceSeg *seg1, MSTraceSeg *seg2)
       return 0;
     }
 
-    if (!(newdatasamples = realloc (seg1->datasamples, (size_t) ((seg1->numsamples + seg2->numsamples) * samplesize))))
+    if (ms_addsamples (&seg1->datasamples, &seg1->numsamples, &seg1->dataoffset,
+                       &seg1->datacapacity, samplesize, seg2->datasamples, seg2->numsamples, 1))
     {
       ms_log (2, "mstl_addsegtoseg(): Error allocating memory\n");
       return 0;
     }
-
-    seg1->datasamples = newdatasamples;
   }
 
   /* Add seg2 coverage to end of seg1 */
   seg1->endtime = seg2->endtime;
   seg1->samplecnt += seg2->samplecnt;
 
-  if (seg2->datasamples && seg2->numsamples > 0)
+  return seg1;
+} /* End of mstl_addsegtoseg() */
+
+/***************************************************************************
+ * mstl_treeupdate:
+ *
+ * Update the ranges of start and end times of the subtree of a
+ * segment in the search tree from the segment and its children.
+ ***************************************************************************/
+static void
+mstl_treeupdate (MSTraceSeg *seg)
+{
+  MSTraceSeg *child;
+  int idx;
+
+  seg->tree.minstart = seg->tree.maxstart = seg->starttime;
+  seg->tree.minend = seg->tree.maxend = seg->endtime;
+
+  for (idx = 0; idx < 2; idx++)
   {
-    memcpy ((char *)seg1->datasamples + (seg1->numsamples * samplesize),
-            seg2->datasamples,
-            (size_t) (seg2->numsamples * samplesize));
+    if (!(child = (idx) ? seg->tree.right : seg->tree.left))
+      continue;
+
+    if (child->tree.minstart < seg->tree.minstart)
+      seg->tree.minstart = child->tree.minstart;
+    if (child->tree.maxstart > seg->tree.maxstart)
+      seg->tree.maxstart = child->tree.maxstart;
+    if (child->tree.minend < seg->tree.minend)
+      seg->tree.minend = child->tree.minend;
+    if (child->tree.maxend > seg->tree.maxend)
+      seg->tree.maxend = child->tree.maxend;
+  }
+} /* End of mstl_treeupdate() */
 
-    seg1->numsamples += seg2->numsamples;
+/***************************************************************************
+ * mstl_treefixup:
+ *
+ * Update the time ranges in the search tree from a segment, whose
+ * start or end time changed, to the root.
+ ***************************************************************************/
+static void
+mstl_treefixup (MSTraceSeg *seg)
+{
+  while (seg)
+  {
+    mstl_treeupdate (seg);
+    seg = seg->tree.parent;
   }
+} /* End of mstl_treefixup() */
 
-  return seg1;
-} /* End of mstl_addsegtoseg() */
+/***************************************************************************
+ * mstl_treerotate:
+ *
+ * Rotate a segment above its parent in the search tree, keeping the
+ * list order of the tree.
+ ***************************************************************************/
+static void
+mstl_treerotate (MSTraceID *id, MSTraceSeg *seg)
+{
+  MSTraceSeg *parent = seg->tree.parent;
+  MSTraceSeg *grandparent = parent->tree.parent;
+
+  if (parent->tree.left == seg)
+  {
+    parent->tree.left = seg->tree.right;
+    if (seg->tree.right)
+      seg->tree.right->tree.parent = parent;
+    seg->tree.right = parent;
+  }
+  else
+  {
+    parent->tree.right = seg->tree.left;
+    if (seg->tree.left)
+      seg->tree.left->tree.parent = parent;
+    seg->tree.left = parent;
+  }
+
+  parent->tree.parent = seg;
+  seg->tree.parent    = grandparent;
+
+  if (!grandparent)
+    id->treeroot = seg;
+  else if (grandparent->tree.left == parent)
+    grandparent->tree.left = seg;
+  else
+    grandparent->tree.right = seg;
+
+  mstl_treeupdate (parent);
+  mstl_treeupdate (seg);
+} /* End of mstl_treerotate() */
+
+/***************************************************************************
+ * mstl_treeinsert:
+ *
+ * Insert a segment, already linked into the segment list of a trace
+ * ID, into the search tree at its place in the list.  The tree is a
+ * treap, each segment has a priority derived from its address and
+ * is rotated up until its parent has a higher priority, keeping the
+ * expected depth of the tree logarithmic.
+ ***************************************************************************/
+static void
+mstl_treeinsert (MSTraceID *id, MSTraceSeg *seg)
+{
+  MSTraceSeg *node;
+  uint64_t priority;
+
+  /* Mix the bits of the segment address for a random priority */
+  priority = (uint64_t) (size_t)seg;
+  priority ^= priority >> 33;
+  priority *= 0xff51afd7ed558ccdULL;
+  priority ^= priority >> 33;
+  priority *= 0xc4ceb9fe1a85ec53ULL;
+  priority ^= priority >> 33;
+
+  seg->tree.priority = (uint32_t)priority;
+  seg->tree.parent   = 0;
+  seg->tree.left     = 0;
+  seg->tree.right    = 0;
+
+  /* Link as a leaf next to the segment before it in the list, or as
+   * the leftmost leaf if it is first */
+  if (!id->treeroot)
+  {
+    id->treeroot = seg;
+  }
+  else if (!seg->prev)
+  {
+    for (node = id->treeroot; node->tree.left; node = node->tree.left)
+      ;
+
+    node->tree.left  = seg;
+    seg->tree.parent = node;
+  }
+  else if (!seg->prev->tree.right)
+  {
+    seg->prev->tree.right = seg;
+    seg->tree.parent      = seg->prev;
+  }
+  else
+  {
+    for (node = seg->prev->tree.right; node->tree.left; node = node->tree.left)
+      ;
+
+    node->tree.left  = seg;
+    seg->tree.parent = node;
+  }
+
+  mstl_treefixup (seg);
+
+  while (seg->tree.parent && seg->tree.priority > seg->tree.parent->tree.priority)
+    mstl_treerotate (id, seg);
+
+  id->treesegments++;
+} /* End of mstl_treeinsert() */
+
+/***************************************************************************
+ * mstl_treeremove:
+ *
+ * Remove a segment from the search tree of a trace ID by rotating it
+ * down to a leaf.
+ ***************************************************************************/
+static void
+mstl_treeremove (MSTraceID *id, MSTraceSeg *seg)
+{
+  MSTraceSeg *child;
+  MSTraceSeg *parent;
+
+  while (seg->tree.left || seg->tree.right)
+  {
+    if (!seg->tree.right ||
+        (seg->tree.left && seg->tree.left->tree.priority > seg->tree.right->tree.priority))
+      child = seg->tree.left;
+    else
+      child = seg->tree.right;
+
+    mstl_treerotate (id, child);
+  }
+
+  parent = seg->tree.parent;
+
+  if (!parent)
+    id->treeroot = 0;
+  else if (parent->tree.left == seg)
+    parent->tree.left = 0;
+  else
+    parent->tree.right = 0;
+
+  seg->tree.parent = 0;
+
+  mstl_treefixup (parent);
+
+  id->treesegments--;
+} /* End of mstl_treeremove() */
+
+/***************************************************************************
+ * mstl_treebuild:
+ *
+ * Build the search tree of a trace ID from its segment list.
+ ***************************************************************************/
+static void
+mstl_treebuild (MSTraceID *id)
+{
+  MSTraceSeg *seg;
+
+  id->treeroot     = 0;
+  id->treesegments = 0;
+
+  for (seg = id->first; seg; seg = seg->next)
+    mstl_treeinsert (id, seg);
+} /* End of mstl_treebuild() */
+
+/***************************************************************************
+ * mstl_treefind:
+ *
+ * Find the first segment in list order in the subtree of a search
+ * tree node that starts within startlo to starthi, if windows
+ * includes 1, or ends within endlo to endhi, if windows includes 2,
+ * and has a tolerable sample rate.  Subtrees outside of the time
+ * ranges are skipped.  The exclude segment is never returned.
+ *
+ * Returns the segment found or 0 if none.
+ ***************************************************************************/
+static MSTraceSeg *
+mstl_treefind (MSTraceSeg *node, flag windows,
+               hptime_t startlo, hptime_t starthi,
+               hptime_t endlo, hptime_t endhi,
+               double samprate, double sampratetol,
+               MSTraceSeg *exclude)
+{
+  MSTraceSeg *found;
+  flag startfit;
+  flag endfit;
+
+  if (!node)
+    return 0;
+
+  /* Skip subtrees without start or end times in the ranges */
+  startfit = (windows & 1) && node->tree.maxstart >= startlo && node->tree.minstart <= starthi;
+  endfit   = (windows & 2) && node->tree.maxend >= endlo && node->tree.minend <= endhi;
+
+  if (!startfit && !endfit)
+    return 0;
+
+  if ((found = mstl_treefind (node->tree.left, windows, startlo, starthi, endlo, endhi,
+                              samprate, sampratetol, exclude)))
+    return found;
+
+  startfit = (windows & 1) && node->starttime >= startlo && node->starttime <= starthi;
+  endfit   = (windows & 2) && node->endtime >= endlo && node->endtime <= endhi;
+
+  if ((startfit || endfit) && node != exclude)
+  {
+    if (sampratetol == -1.0)
+    {
+      if (MS_ISRATETOLERABLE (samprate, node->samprate))
+        return node;
+    }
+    else if (!(ms_dabs (samprate - node->samprate) > sampratetol))
+    {
+      return node;
+    }
+  }
+
+  return mstl_treefind (node->tree.right, windows, startlo, starthi, endlo, endhi,
+                        samprate, sampratetol, exclude);
+} /* End of mstl_treefind() */
+
+/***************************************************************************
+ * mstl_treefollow:
+ *
+ * Find the last segment in list order in the subtree of a search
+ * tree node that starts before a time.
+ *
+ * Returns the segment found or 0 if none.
+ ***************************************************************************/
+static MSTraceSeg *
+mstl_treefollow (MSTraceSeg *node, hptime_t time)
+{
+  while (node)
+  {
+    if (node->tree.right && node->tree.right->tree.minstart < time)
+      node = node->tree.right;
+    else if (node->starttime < time)
+      return node;
+    else if (node->tree.left && node->tree.left->tree.minstart < time)
+      node = node->tree.left;
+    else
+      return 0;
+  }
+
+  return 0;
+} /* End of mstl_treefollow() */
 
 /***************************************************************************
  * mstl_convertsamples:
@@ -828,6 +1418,10 @@ mstl_convertsamples (MSTraceSeg *seg, char type, flag truncate)
     return -1;
   }
 
+  /* Free space in front of the samples is released, the sample size may change */
+  ms_compactsamples (&seg->datasamples, &seg->numsamples, &seg->dataoffset,
+                     &seg->datacapacity, ms_samplesize (seg->sampletype));
+
   idata = (int32_t *)seg->datasamples;
   fdata = (float *)seg->datasamples;
   ddata = (double *)seg->datasamples;
@@ -871,6 +1465,8 @@ mstl_convertsamples (MSTraceSeg *seg, char type, flag truncate)
         ms_log (2, "mstl_convertsamples: cannot re-allocate buffer for sample conversion\n");
         return -1;
       }
+
+      seg->datacapacity = seg->numsamples;
     }
 
     seg->sampletype = 'i';
@@ -895,6 +1491,8 @@ mstl_convertsamples (MSTraceSeg *seg, char type, flag truncate)
         ms_log (2, "mstl_convertsamples: cannot re-allocate buffer after sample conversion\n");
         return -1;
       }
+
+      seg->datacapacity = seg->numsamples;
     }
 
     seg->sampletype = 'f';
@@ -924,8 +1522,9 @@ mstl_convertsamples (MSTraceSeg *seg, char type, flag truncate)
       free (fdata);
     }
 
-    seg->datasamples = ddata;
-    seg->sampletype  = 'd';
+    seg->datasamples  = ddata;
+    seg->datacapacity = seg->numsamples;
+    seg->sampletype   = 'd';
   } /* Done converting to 64-bit doubles */
 
   return 0;
@@ -0,0 +1,1315 @@
+/***************************************************************************
+ * tracetable.c:
+ *
+ * Routines to handle TraceTable and related structures.
+ *
+ * A MSTraceTable holds traces in parallel arrays so that the times,
+ * sample rates and counts of all traces are contiguous for sorting,
+ * healing and scanning, the data samples of all traces are held in a
+ * single pool.
+ *
+ * modified: 2026.289
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "libmseed.h"
+
+/* Alignment in bytes of the data samples of each trace in the pool */
+#define MSTT_POOLALIGN 8
+
+/* Sort entry of a trace in a MSTraceTable, see mstt_sort() and mstt_heal() */
+typedef struct MSTraceTableEntry_s {
+  int32_t         row;         /* Trace index in the table */
+  int32_t         position;    /* Original index or position in the sort order */
+  hptime_t        starttime;   /* Time of first sample */
+  hptime_t        endtime;     /* Time of last sample */
+  double          samprate;    /* Nominal sample rate (Hz) */
+  MSTraceTableID *id;          /* Trace identifiers */
+  char            srcname[50]; /* Source name of the trace */
+} MSTraceTableEntry;
+
+static void mstt_release (MSTraceTable *mstt);
+static void mstt_freetrace (MSTraceTable *mstt, int32_t idx);
+static int mstt_grow (MSTraceTable *mstt, int32_t count);
+static int mstt_growdata (MSTraceTable *mstt, int64_t size);
+static int64_t mstt_reservedata (MSTraceTable *mstt, int64_t size);
+static int mstt_addtrace (MSTraceTable *mstt, MSTrace *mst);
+static void mstt_reorder (MSTraceTable *mstt, int32_t *order, int32_t count,
+                          void *buffer);
+static void mstt_permute (void *array, size_t size, int32_t *order,
+                          int32_t count, void *buffer);
+static int mstt_sortentry_cmp (const void *entry1, const void *entry2);
+static int mstt_healentry_cmp (const void *entry1, const void *entry2);
+static int mstt_idcmp (MSTraceTableID *id1, MSTraceTableID *id2);
+static flag mstt_healfit (MSTraceTable *mstt, int32_t cur, int32_t search,
+                          double timetol, double sampratetol);
+static void mstt_healmerge (MSTraceTable *mstt, int32_t cur, int32_t search,
+                            flag whence);
+
+/***************************************************************************
+ * mstt_init:
+ *
+ * Initialize and return a MSTraceTable struct, allocating memory if
+ * needed.  If the supplied MSTraceTable is not NULL any associated
+ * memory it will be freed.
+ *
+ * Returns a pointer to a MSTraceTable struct on success or NULL on error.
+ ***************************************************************************/
+MSTraceTable *
+mstt_init (MSTraceTable *mstt)
+{
+  if (mstt)
+  {
+    mstt_release (mstt);
+  }
+  else
+  {
+    mstt = (MSTraceTable *)malloc (sizeof (MSTraceTable));
+  }
+
+  if (mstt == NULL)
+  {
+    ms_log (2, "mstt_init(): Cannot allocate memory\n");
+    return NULL;
+  }
+
+  memset (mstt, 0, sizeof (MSTraceTable));
+
+  return mstt;
+} /* End of mstt_init() */
+
+/***************************************************************************
+ * mstt_free:
+ *
+ * Free all memory associated with a MSTraceTable struct and set the
+ * pointer to 0.
+ ***************************************************************************/
+void
+mstt_free (MSTraceTable **ppmstt)
+{
+  if (ppmstt && *ppmstt)
+  {
+    mstt_release (*ppmstt);
+
+    free (*ppmstt);
+
+    *ppmstt = 0;
+  }
+} /* End of mstt_free() */
+
+/***************************************************************************
+ * mstt_release:
+ *
+ * Free the arrays, data pool and per trace memory of a MSTraceTable.
+ ***************************************************************************/
+static void
+mstt_release (MSTraceTable *mstt)
+{
+  int32_t idx;
+
+  for (idx = 0; idx < mstt->numtraces; idx++)
+    mstt_freetrace (mstt, idx);
+
+  if (mstt->starttime)
+    free (mstt->starttime);
+  if (mstt->endtime)
+    free (mstt->endtime);
+  if (mstt->samprate)
+    free (mstt->samprate);
+  if (mstt->samplecnt)
+    free (mstt->samplecnt);
+  if (mstt->numsamples)
+    free (mstt->numsamples);
+  if (mstt->dataoffset)
+    free (mstt->dataoffset);
+  if (mstt->sampletype)
+    free (mstt->sampletype);
+  if (mstt->id)
+    free (mstt->id);
+  if (mstt->prvtptr)
+    free (mstt->prvtptr);
+  if (mstt->ststate)
+    free (mstt->ststate);
+  if (mstt->datapool)
+    free (mstt->datapool);
+} /* End of mstt_release() */
+
+/***************************************************************************
+ * mstt_freetrace:
+ *
+ * Free the private memory and stream processing state of a trace in a
+ * MSTraceTable, its samples stay in the data pool.
+ ***************************************************************************/
+static void
+mstt_freetrace (MSTraceTable *mstt, int32_t idx)
+{
+  if (mstt->prvtptr[idx])
+  {
+    free (mstt->prvtptr[idx]);
+    mstt->prvtptr[idx] = 0;
+  }
+
+  if (mstt->ststate[idx])
+  {
+    if (mstt->ststate[idx]->packcache)
+      free (mstt->ststate[idx]->packcache);
+    free (mstt->ststate[idx]);
+    mstt->ststate[idx] = 0;
+  }
+} /* End of mstt_freetrace() */
+
+/***************************************************************************
+ * mstt_grow:
+ *
+ * Grow the arrays of a MSTraceTable geometrically to hold at least
+ * count traces.
+ *
+ * Return 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+mstt_grow (MSTraceTable *mstt, int32_t count)
+{
+  int32_t maxtraces;
+  void *ptr;
+
+  if (count <= mstt->maxtraces)
+    return 0;
+
+  maxtraces = (mstt->maxtraces) ? mstt->maxtraces : 16;
+  while (maxtraces < count)
+    maxtraces *= 2;
+
+#define MSTT_GROWARRAY(FIELD)                                                       \
+  if (!(ptr = realloc (mstt->FIELD, maxtraces * sizeof (*mstt->FIELD))))             \
+  {                                                                                 \
+    ms_log (2, "mstt_grow(): Cannot allocate memory\n");                            \
+    return -1;                                                                      \
+  }                                                                                 \
+  mstt->FIELD = ptr;
+
+  MSTT_GROWARRAY (starttime)
+  MSTT_GROWARRAY (endtime)
+  MSTT_GROWARRAY (samprate)
+  MSTT_GROWARRAY (samplecnt)
+  MSTT_GROWARRAY (numsamples)
+  MSTT_GROWARRAY (dataoffset)
+  MSTT_GROWARRAY (sampletype)
+  MSTT_GROWARRAY (id)
+  MSTT_GROWARRAY (prvtptr)
+  MSTT_GROWARRAY (ststate)
+
+#undef MSTT_GROWARRAY
+
+  mstt->maxtraces = maxtraces;
+
+  return 0;
+} /* End of mstt_grow() */
+
+/***************************************************************************
+ * mstt_growdata:
+ *
+ * Grow the data pool of a MSTraceTable geometrically to hold size more
+ * bytes of data samples after those in use, size must include any
+ * alignment of the samples of more than one trace.
+ *
+ * Return 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+mstt_growdata (MSTraceTable *mstt, int64_t size)
+{
+  int64_t needed = mstt->datasize + size + MSTT_POOLALIGN;
+  int64_t capacity;
+  char *datapool;
+
+  if (needed <= mstt->datacapacity)
+    return 0;
+
+  capacity = (mstt->datacapacity) ? mstt->datacapacity : 4096;
+  while (capacity < needed)
+    capacity *= 2;
+
+  if (!(datapool = (char *)realloc (mstt->datapool, (size_t)capacity)))
+  {
+    ms_log (2, "mstt_growdata(): Cannot allocate memory\n");
+    return -1;
+  }
+
+  mstt->datapool     = datapool;
+  mstt->datacapacity = capacity;
+
+  return 0;
+} /* End of mstt_growdata() */
+
+/***************************************************************************
+ * mstt_reservedata:
+ *
+ * Reserve space for size bytes of data samples at the end of the data
+ * pool of a MSTraceTable, growing the pool if needed.  The reserved
+ * space is aligned for any sample type and added to the bytes in use.
+ *
+ * Return the byte offset of the space in the pool or -1 on error.
+ ***************************************************************************/
+static int64_t
+mstt_reservedata (MSTraceTable *mstt, int64_t size)
+{
+  int64_t offset;
+
+  if (mstt_growdata (mstt, size))
+    return -1;
+
+  offset = (mstt->datasize + MSTT_POOLALIGN - 1) & ~((int64_t)MSTT_POOLALIGN - 1);
+
+  mstt->datasize = offset + size;
+
+  return offset;
+} /* End of mstt_reservedata() */
+
+/***************************************************************************
+ * mstt_addtrace:
+ *
+ * Add a trace to the end of a MSTraceTable, copying the data samples
+ * into the data pool.  The private pointer and stream processing
+ * state are moved from the MSTrace to the table.
+ *
+ * Return 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+mstt_addtrace (MSTraceTable *mstt, MSTrace *mst)
+{
+  MSTraceTableID *id;
+  int32_t idx = mstt->numtraces;
+  int64_t offset = 0;
+  int64_t size;
+
+  if (mstt_grow (mstt, idx + 1))
+    return -1;
+
+  size = (mst->datasamples && mst->numsamples > 0) ? mst->numsamples * ms_samplesize (mst->sampletype) : 0;
+
+  if (size > 0)
+  {
+    if ((offset = mstt_reservedata (mstt, size)) < 0)
+      return -1;
+
+    memcpy (mstt->datapool + offset, mst->datasamples, (size_t)size);
+  }
+
+  id = &mstt->id[idx];
+  strcpy (id->network, mst->network);
+  strcpy (id->station, mst->station);
+  strcpy (id->location, mst->location);
+  strcpy (id->channel, mst->channel);
+  id->dataquality = mst->dataquality;
+  id->type        = mst->type;
+
+  mstt->starttime[idx]  = mst->starttime;
+  mstt->endtime[idx]    = mst->endtime;
+  mstt->samprate[idx]   = mst->samprate;
+  mstt->samplecnt[idx]  = mst->samplecnt;
+  mstt->numsamples[idx] = (size > 0) ? mst->numsamples : 0;
+  mstt->dataoffset[idx] = offset;
+  mstt->sampletype[idx] = mst->sampletype;
+  mstt->prvtptr[idx]    = mst->prvtptr;
+  mstt->ststate[idx]    = mst->ststate;
+
+  mst->prvtptr = 0;
+  mst->ststate = 0;
+
+  mstt->numtraces++;
+
+  return 0;
+} /* End of mstt_addtrace() */
+
+/***************************************************************************
+ * mstt_fromgroup:
+ *
+ * Move the traces of a MSTraceGroup to the end of a MSTraceTable in
+ * chain order.  The data samples are copied into the data pool of
+ * the table, the private pointers and stream processing states are
+ * moved to the table and the group is left empty.
+ *
+ * Returns the number of traces added on success and -1 on error, in
+ * which case the group is unchanged.
+ ***************************************************************************/
+int
+mstt_fromgroup (MSTraceTable *mstt, MSTraceGroup *mstg)
+{
+  MSTrace *mst;
+  int64_t size  = 0;
+  int32_t count = 0;
+
+  if (!mstt || !mstg)
+    return -1;
+
+  /* Allocate all space first so the traces cannot fail to be added */
+  for (mst = mstg->traces; mst; mst = mst->next)
+  {
+    if (mst->datasamples && mst->numsamples > 0)
+      size += mst->numsamples * ms_samplesize (mst->sampletype) + MSTT_POOLALIGN;
+
+    count++;
+  }
+
+  if (mstt_grow (mstt, mstt->numtraces + count) ||
+      mstt_growdata (mstt, size))
+    return -1;
+
+  for (mst = mstg->traces; mst; mst = mst->next)
+    mstt_addtrace (mstt, mst);
+
+  mst_initgroup (mstg);
+
+  return count;
+} /* End of mstt_fromgroup() */
+
+/***************************************************************************
+ * mstt_togroup:
+ *
+ * Move the traces of a MSTraceTable to the end of a MSTraceGroup in
+ * table order.  The data samples of each trace are copied into a new
+ * buffer, the private pointers and stream processing states are moved
+ * to the MSTraces and the table is left empty.
+ *
+ * Returns the number of traces added on success and -1 on error, in
+ * which case the traces added so far remain in the group and the rest
+ * in the table.
+ ***************************************************************************/
+int
+mstt_togroup (MSTraceTable *mstt, MSTraceGroup *mstg)
+{
+  MSTraceTableID *id;
+  MSTrace *mst;
+  int32_t idx;
+  int64_t size;
+
+  if (!mstt || !mstg)
+    return -1;
+
+  for (idx = 0; idx < mstt->numtraces; idx++)
+  {
+    if (!(mst = mst_init (NULL)))
+      break;
+
+    size = mstt->numsamples[idx] * ms_samplesize (mstt->sampletype[idx]);
+
+    if (size > 0)
+    {
+      if (!(mst->datasamples = malloc ((size_t)size)))
+      {
+        ms_log (2, "mstt_togroup(): Cannot allocate memory\n");
+        mst_free (&mst);
+        break;
+      }
+
+      memcpy (mst->datasamples, mstt->datapool + mstt->dataoffset[idx], (size_t)size);
+      mst->numsamples = mstt->numsamples[idx];
+    }
+
+    id = &mstt->id[idx];
+    strcpy (mst->network, id->network);
+    strcpy (mst->station, id->station);
+    strcpy (mst->location, id->location);
+    strcpy (mst->channel, id->channel);
+    mst->dataquality = id->dataquality;
+    mst->type        = id->type;
+
+    mst->starttime  = mstt->starttime[idx];
+    mst->endtime    = mstt->endtime[idx];
+    mst->samprate   = mstt->samprate[idx];
+    mst->samplecnt  = mstt->samplecnt[idx];
+    mst->sampletype = mstt->sampletype[idx];
+    mst->prvtptr    = mstt->prvtptr[idx];
+    mst->ststate    = mstt->ststate[idx];
+
+    mstt->prvtptr[idx] = 0;
+    mstt->ststate[idx] = 0;
+
+    mst_addtracetogroup (mstg, mst);
+  }
+
+  /* Remove the moved traces from the table */
+  if (idx < mstt->numtraces)
+  {
+    memmove (mstt->prvtptr, mstt->prvtptr + idx, (mstt->numtraces - idx) * sizeof (void *));
+    memmove (mstt->ststate, mstt->ststate + idx, (mstt->numtraces - idx) * sizeof (StreamState *));
+    memmove (mstt->starttime, mstt->starttime + idx, (mstt->numtraces - idx) * sizeof (hptime_t));
+    memmove (mstt->endtime, mstt->endtime + idx, (mstt->numtraces - idx) * sizeof (hptime_t));
+    memmove (mstt->samprate, mstt->samprate + idx, (mstt->numtraces - idx) * sizeof (double));
+    memmove (mstt->samplecnt, mstt->samplecnt + idx, (mstt->numtraces - idx) * sizeof (int64_t));
+    memmove (mstt->numsamples, mstt->numsamples + idx, (mstt->numtraces - idx) * sizeof (int64_t));
+    memmove (mstt->dataoffset, mstt->dataoffset + idx, (mstt->numtraces - idx) * sizeof (int64_t));
+    memmove (mstt->sampletype, mstt->sampletype + idx, (mstt->numtraces - idx) * sizeof (char));
+    memmove (mstt->id, mstt->id + idx, (mstt->numtraces - idx) * sizeof (MSTraceTableID));
+
+    mstt->numtraces -= idx;
+
+    return -1;
+  }
+
+  mstt->numtraces = 0;
+  mstt->datasize  = 0;
+
+  return idx;
+} /* End of mstt_togroup() */
+
+/***************************************************************************
+ * mstt_sort:
+ *
+ * Sort the traces of a MSTraceTable in the order of mst_groupsort():
+ * source name, start time, descending end time (longest trace first)
+ * and sample rate.  The order is stable.  Only the table arrays are
+ * reordered, the data samples stay in place in the pool.
+ *
+ * Return 0 on success and -1 on error.
+ ***************************************************************************/
+int
+mstt_sort (MSTraceTable *mstt, flag quality)
+{
+  MSTraceTableEntry *entries;
+  int32_t *order;
+  void *buffer;
+  int32_t idx;
+
+  if (!mstt)
+    return -1;
+
+  if (mstt->numtraces <= 1)
+    return 0;
+
+  entries = (MSTraceTableEntry *)malloc (mstt->numtraces * sizeof (MSTraceTableEntry));
+  order   = (int32_t *)malloc (mstt->numtraces * sizeof (int32_t));
+  buffer  = malloc (mstt->numtraces * sizeof (MSTraceTableID));
+
+  if (!entries || !order || !buffer)
+  {
+    ms_log (2, "mstt_sort(): Cannot allocate memory\n");
+    if (entries)
+      free (entries);
+    if (order)
+      free (order);
+    if (buffer)
+      free (buffer);
+    return -1;
+  }
+
+  for (idx = 0; idx < mstt->numtraces; idx++)
+  {
+    entries[idx].row       = idx;
+    entries[idx].position  = idx;
+    entries[idx].starttime = mstt->starttime[idx];
+    entries[idx].endtime   = mstt->endtime[idx];
+    entries[idx].samprate  = mstt->samprate[idx];
+    entries[idx].id        = &mstt->id[idx];
+    mstt_srcname (mstt, idx, entries[idx].srcname, quality);
+  }
+
+  qsort (entries, mstt->numtraces, sizeof (MSTraceTableEntry), mstt_sortentry_cmp);
+
+  for (idx = 0; idx < mstt->numtraces; idx++)
+    order[idx] = entries[idx].row;
+
+  mstt_reorder (mstt, order, mstt->numtraces, buffer);
+
+  free (entries);
+  free (order);
+  free (buffer);
+
+  return 0;
+} /* End of mstt_sort() */
+
+/***************************************************************************
+ * mstt_reorder:
+ *
+ * Reorder the arrays of a MSTraceTable so that trace idx is the trace
+ * order[idx], keeping only the first count traces of the order.  The
+ * private memory of traces not in the order must be freed before.  The
+ * buffer must hold count MSTraceTableID structures, the largest
+ * elements of the arrays.
+ ***************************************************************************/
+static void
+mstt_reorder (MSTraceTable *mstt, int32_t *order, int32_t count, void *buffer)
+{
+  mstt_permute (mstt->starttime, sizeof (hptime_t), order, count, buffer);
+  mstt_permute (mstt->endtime, sizeof (hptime_t), order, count, buffer);
+  mstt_permute (mstt->samprate, sizeof (double), order, count, buffer);
+  mstt_permute (mstt->samplecnt, sizeof (int64_t), order, count, buffer);
+  mstt_permute (mstt->numsamples, sizeof (int64_t), order, count, buffer);
+  mstt_permute (mstt->dataoffset, sizeof (int64_t), order, count, buffer);
+  mstt_permute (mstt->sampletype, sizeof (char), order, count, buffer);
+  mstt_permute (mstt->id, sizeof (MSTraceTableID), order, count, buffer);
+  mstt_permute (mstt->prvtptr, sizeof (void *), order, count, buffer);
+  mstt_permute (mstt->ststate, sizeof (StreamState *), order, count, buffer);
+
+  mstt->numtraces = count;
+} /* End of mstt_reorder() */
+
+/***************************************************************************
+ * mstt_permute:
+ *
+ * Gather the elements of array of the given size in the order of the
+ * indexes in order using buffer, which must hold count elements, and
+ * copy them back to the start of array.
+ ***************************************************************************/
+static void
+mstt_permute (void *array, size_t size, int32_t *order, int32_t count, void *buffer)
+{
+  int32_t idx;
+
+  for (idx = 0; idx < count; idx++)
+    memcpy ((char *)buffer + idx * size, (char *)array + order[idx] * size, size);
+
+  memcpy (array, buffer, count * size);
+} /* End of mstt_permute() */
+
+/***************************************************************************
+ * mstt_heal:
+ *
+ * Check if traces in a MSTraceTable can be healed, if contiguous
+ * segments belong together they will be merged as done by
+ * mst_groupheal() for a MSTraceGroup.  The table is sorted using
+ * mstt_sort() before healing and the healed traces are left in
+ * sorted order.  Traces with data samples of different types are not
+ * merged.
+ *
+ * The traces are merged in a single sweep by network, station,
+ * location, channel and start time.  The data pool is then rebuilt
+ * with the samples of each healed trace contiguous, which also
+ * releases the space of samples already packed with mstt_pack().
+ *
+ * The time tolerance and sample rate tolerance are used to determine
+ * if the traces are indeed the same.  If timetol is -1.0 the default
+ * tolerance of 1/2 the sample period will be used.  If samprratetol
+ * is -1.0 the default tolerance check of abs(1-sr1/sr2) < 0.0001 is
+ * used (defined in libmseed.h).
+ *
+ * Return number of trace mergings on success otherwise -1 on error.
+ ***************************************************************************/
+int
+mstt_heal (MSTraceTable *mstt, double timetol, double sampratetol)
+{
+  MSTraceTableEntry *entries = 0;
+  MSTraceTableEntry **sweep  = 0;
+  int32_t *active  = 0;
+  int32_t *head    = 0;
+  int32_t *tail    = 0;
+  int32_t *next    = 0;
+  int64_t *origsamples = 0;
+  int64_t *origoffset  = 0;
+  char *datapool = 0;
+  void *buffer   = 0;
+  int32_t count, numactive, match, matchidx;
+  int32_t first, last, idx, jdx, kdx, row, member;
+  int64_t datasize, capacity, size;
+  int mergings = 0;
+  int samplesize;
+  flag whence, matchwhence;
+  double maxdelta, maxtol, delta, gap;
+
+  if (!mstt)
+    return -1;
+
+  if (mstt->numtraces <= 0)
+    return 0;
+
+  /* Sort MSTraceTable before any healing */
+  if (mstt_sort (mstt, 1))
+    return -1;
+
+  count = mstt->numtraces;
+
+  entries     = (MSTraceTableEntry *)malloc (count * sizeof (MSTraceTableEntry));
+  sweep       = (MSTraceTableEntry **)malloc (count * sizeof (MSTraceTableEntry *));
+  active      = (int32_t *)malloc (count * sizeof (int32_t));
+  head        = (int32_t *)malloc (count * sizeof (int32_t));
+  tail        = (int32_t *)malloc (count * sizeof (int32_t));
+  next        = (int32_t *)malloc (count * sizeof (int32_t));
+  origsamples = (int64_t *)malloc (count * sizeof (int64_t));
+  origoffset  = (int64_t *)malloc (count * sizeof (int64_t));
+  buffer      = malloc (count * sizeof (MSTraceTableID));
+
+  /* Allocate the new data pool first, merging does not add samples */
+  capacity = MSTT_POOLALIGN;
+  for (idx = 0; idx < count; idx++)
+    capacity += (mstt->numsamples[idx] * ms_samplesize (mstt->sampletype[idx]) +
+                 MSTT_POOLALIGN - 1) & ~((int64_t)MSTT_POOLALIGN - 1);
+
+  datapool = (char *)malloc ((size_t)capacity);
+
+  if (!entries || !sweep || !active || !head || !tail || !next ||
+      !origsamples || !origoffset || !buffer || !datapool)
+  {
+    ms_log (2, "mstt_heal(): Cannot allocate memory\n");
+    mergings = -1;
+  }
+  else
+  {
+    for (idx = 0; idx < count; idx++)
+    {
+      entries[idx].row       = idx;
+      entries[idx].position  = idx;
+      entries[idx].starttime = mstt->starttime[idx];
+      entries[idx].id        = &mstt->id[idx];
+      sweep[idx]             = &entries[idx];
+
+      /* Each trace starts as a list of its own samples */
+      head[idx]        = idx;
+      tail[idx]        = idx;
+      next[idx]        = -1;
+      origsamples[idx] = mstt->numsamples[idx];
+      origoffset[idx]  = mstt->dataoffset[idx];
+    }
+
+    qsort (sweep, count, sizeof (MSTraceTableEntry *), mstt_healentry_cmp);
+
+    for (first = 0; first < count; first = last)
+    {
+      /* Find the traces with the same identifiers and their longest sample period */
+      maxdelta = 0.0;
+      for (last = first; last < count; last++)
+      {
+        if (mstt_idcmp (sweep[first]->id, sweep[last]->id))
+          break;
+
+        row   = sweep[last]->row;
+        delta = (mstt->samprate[row]) ? (1.0 / mstt->samprate[row]) : 0.0;
+
+        if (delta > maxdelta)
+          maxdelta = delta;
+      }
+
+      /* No trace can fit one ending more than this tolerance before it starts */
+      maxtol = (timetol == -1.0) ? 0.5 * maxdelta : timetol;
+
+      numactive = 0;
+
+      for (idx = first; idx < last; idx++)
+      {
+        row         = sweep[idx]->row;
+        match       = -1;
+        matchidx    = -1;
+        matchwhence = 0;
+
+        for (jdx = kdx = 0; jdx < numactive; jdx++)
+        {
+          /* Retire traces ending too early to fit this or any later trace */
+          gap = ((double)(mstt->starttime[row] - mstt->endtime[active[jdx]]) / HPTMODULUS) - maxdelta;
+
+          if (gap > maxtol)
+            continue;
+
+          active[kdx] = active[jdx];
+
+          /* Merge with the fitting trace earliest in the sorted table */
+          if (match < 0 || active[kdx] < match)
+          {
+            if (active[kdx] < row)
+              whence = mstt_healfit (mstt, active[kdx], row, timetol, sampratetol);
+            else
+              whence = mstt_healfit (mstt, row, active[kdx], timetol, sampratetol);
+
+            if (whence)
+            {
+              match       = active[kdx];
+              matchidx    = kdx;
+              matchwhence = whence;
+            }
+          }
+
+          kdx++;
+        }
+
+        numactive = kdx;
+
+        if (match < 0)
+        {
+          active[numactive++] = row;
+          continue;
+        }
+
+        /* Merge into the trace earlier in the sorted table */
+        if (match < row)
+        {
+          mstt_healmerge (mstt, match, row, matchwhence);
+          member = row;
+          row    = match;
+        }
+        else
+        {
+          mstt_healmerge (mstt, row, match, matchwhence);
+          member             = match;
+          active[matchidx]   = row;
+        }
+
+        /* Join the sample lists, the merged trace has no samples of its own */
+        if (matchwhence == 1)
+        {
+          next[tail[row]] = head[member];
+          tail[row]       = tail[member];
+        }
+        else
+        {
+          next[tail[member]] = head[row];
+          head[row]          = head[member];
+        }
+
+        mstt_freetrace (mstt, member);
+        head[member] = -1;
+
+        mergings++;
+      }
+    }
+
+    /* Rebuild the data pool with the samples of each trace contiguous */
+    datasize = 0;
+
+    for (idx = 0, row = 0; idx < count; idx++)
+    {
+      if (head[idx] < 0)
+        continue;
+
+      samplesize            = ms_samplesize (mstt->sampletype[idx]);
+      mstt->dataoffset[idx] = datasize;
+
+      for (member = head[idx]; member >= 0; member = next[member])
+      {
+        size = origsamples[member] * samplesize;
+
+        if (size > 0)
+        {
+          memcpy (datapool + datasize, mstt->datapool + origoffset[member], (size_t)size);
+          datasize += size;
+        }
+      }
+
+      datasize = (datasize + MSTT_POOLALIGN - 1) & ~((int64_t)MSTT_POOLALIGN - 1);
+
+      active[row++] = idx;
+    }
+
+    if (mstt->datapool)
+      free (mstt->datapool);
+
+    mstt->datapool     = datapool;
+    mstt->datasize     = datasize;
+    mstt->datacapacity = capacity;
+    datapool           = 0;
+
+    /* Remove the merged traces, keeping the sorted order */
+    mstt_reorder (mstt, active, row, buffer);
+  }
+
+  if (entries)
+    free (entries);
+  if (sweep)
+    free (sweep);
+  if (active)
+    free (active);
+  if (head)
+    free (head);
+  if (tail)
+    free (tail);
+  if (next)
+    free (next);
+  if (origsamples)
+    free (origsamples);
+  if (origoffset)
+    free (origoffset);
+  if (buffer)
+    free (buffer);
+  if (datapool)
+    free (datapool);
+
+  return mergings;
+} /* End of mstt_heal() */
+
+/***************************************************************************
+ * mstt_sortentry_cmp:
+ *
+ * Compare two MSTraceTable sort entries for qsort(3) with the criteria
+ * of mst_groupsort(): source name, start time, descending endtime
+ * (longest trace first), sample rate and the original position for a
+ * stable sort.
+ *
+ * Return 1 if entry1 is "greater" than entry2, -1 if it is "lesser".
+ ***************************************************************************/
+static int
+mstt_sortentry_cmp (const void *entry1, const void *entry2)
+{
+  const MSTraceTableEntry *e1 = (const MSTraceTableEntry *)entry1;
+  const MSTraceTableEntry *e2 = (const MSTraceTableEntry *)entry2;
+  int strcmpval;
+
+  if ((strcmpval = strcmp (e1->srcname, e2->srcname)))
+    return (strcmpval > 0) ? 1 : -1;
+
+  if (e1->starttime != e2->starttime)
+    return (e1->starttime > e2->starttime) ? 1 : -1;
+
+  if (e1->endtime != e2->endtime)
+    return (e1->endtime < e2->endtime) ? 1 : -1;
+
+  if (!MS_ISRATETOLERABLE (e1->samprate, e2->samprate))
+    return (e1->samprate > e2->samprate) ? 1 : -1;
+
+  return (e1->position > e2->position) ? 1 : -1;
+} /* End of mstt_sortentry_cmp() */
+
+/***************************************************************************
+ * mstt_healentry_cmp:
+ *
+ * Compare two pointers to MSTraceTable sort entries for qsort(3) in
+ * the order of healing: network, station, location and channel
+ * (ignoring quality), start time and then position in the table.
+ *
+ * Return 1 if entry1 is "greater" than entry2, -1 if it is "lesser".
+ ***************************************************************************/
+static int
+mstt_healentry_cmp (const void *entry1, const void *entry2)
+{
+  const MSTraceTableEntry *e1 = *(MSTraceTableEntry *const *)entry1;
+  const MSTraceTableEntry *e2 = *(MSTraceTableEntry *const *)entry2;
+  int cmpval;
+
+  if ((cmpval = mstt_idcmp (e1->id, e2->id)))
+    return cmpval;
+
+  if (e1->starttime != e2->starttime)
+    return (e1->starttime > e2->starttime) ? 1 : -1;
+
+  return (e1->position > e2->position) ? 1 : -1;
+} /* End of mstt_healentry_cmp() */
+
+/***************************************************************************
+ * mstt_idcmp:
+ *
+ * Compare the network, station, location and channel of two traces.
+ *
+ * Return 0 if they match, otherwise 1 or -1 as strcmp(3).
+ ***************************************************************************/
+static int
+mstt_idcmp (MSTraceTableID *id1, MSTraceTableID *id2)
+{
+  int cmpval;
+
+  if (!(cmpval = strcmp (id1->network, id2->network)) &&
+      !(cmpval = strcmp (id1->station, id2->station)) &&
+      !(cmpval = strcmp (id1->location, id2->location)))
+    cmpval = strcmp (id1->channel, id2->channel);
+
+  return (cmpval > 0) ? 1 : (cmpval < 0) ? -1 : 0;
+} /* End of mstt_idcmp() */
+
+/***************************************************************************
+ * mstt_healfit:
+ *
+ * Check if trace search fits at the end or the beginning of trace cur
+ * within the time and sample rate tolerances of mstt_heal(), the time
+ * tolerance defaults to 1/2 the sample period of cur.  The traces are
+ * expected to have the same identifiers.
+ *
+ * Return 1 if search fits at the end, 2 if it fits at the beginning
+ * and 0 otherwise.
+ ***************************************************************************/
+static flag
+mstt_healfit (MSTraceTable *mstt, int32_t cur, int32_t search,
+              double timetol, double sampratetol)
+{
+  double postgap, pregap, delta;
+
+  /* Samples of different types cannot be joined */
+  if (mstt->numsamples[cur] > 0 && mstt->numsamples[search] > 0 &&
+      mstt->sampletype[cur] != mstt->sampletype[search])
+    return 0;
+
+  /* Perform default samprate tolerance check if requested */
+  if (sampratetol == -1.0)
+  {
+    if (!MS_ISRATETOLERABLE (mstt->samprate[search], mstt->samprate[cur]))
+      return 0;
+  }
+  /* Otherwise check against the specified sample rates tolerance */
+  else if (ms_dabs (mstt->samprate[search] - mstt->samprate[cur]) > sampratetol)
+  {
+    return 0;
+  }
+
+  /* post/pregap are negative when search overlaps cur and positive
+     when there is a time gap. */
+  delta = (mstt->samprate[cur]) ? (1.0 / mstt->samprate[cur]) : 0.0;
+
+  postgap = ((double)(mstt->starttime[search] - mstt->endtime[cur]) / HPTMODULUS) - delta;
+
+  pregap = ((double)(mstt->starttime[cur] - mstt->endtime[search]) / HPTMODULUS) - delta;
+
+  /* Calculate default time tolerance (1/2 sample period) if needed */
+  if (timetol == -1.0)
+    timetol = 0.5 * delta;
+
+  /* Fits right at the end of cur */
+  if (ms_dabs (postgap) <= timetol)
+    return 1;
+
+  /* Fits right at the beginning of cur */
+  if (ms_dabs (pregap) <= timetol)
+    return 2;
+
+  return 0;
+} /* End of mstt_healfit() */
+
+/***************************************************************************
+ * mstt_healmerge:
+ *
+ * Merge the time coverage and sample counts of trace search into trace
+ * cur, at the end if whence is 1 or the beginning if whence is 2.  The
+ * samples themselves are joined when the data pool is rebuilt.
+ ***************************************************************************/
+static void
+mstt_healmerge (MSTraceTable *mstt, int32_t cur, int32_t search, flag whence)
+{
+  if (whence == 1)
+    mstt->endtime[cur] = mstt->endtime[search];
+  else
+    mstt->starttime[cur] = mstt->starttime[search];
+
+  if (mstt->numsamples[search] > 0)
+  {
+    if (mstt->numsamples[cur] <= 0)
+      mstt->sampletype[cur] = mstt->sampletype[search];
+
+    mstt->numsamples[cur] += mstt->numsamples[search];
+    mstt->samplecnt[cur] += mstt->numsamples[search];
+  }
+  else
+  {
+    mstt->samplecnt[cur] += mstt->samplecnt[search];
+  }
+
+  /* If qualities do not match reset the indicator */
+  if (mstt->id[cur].dataquality != mstt->id[search].dataquality)
+    mstt->id[cur].dataquality = 0;
+} /* End of mstt_healmerge() */
+
+/***************************************************************************
+ * mstt_srcname:
+ *
+ * Generate a source name string for a trace in a MSTraceTable in the
+ * format: 'NET_STA_LOC_CHAN' or, if the quality flag is true:
+ * 'NET_STA_LOC_CHAN_QUAL', as done by mst_srcname().  The passed
+ * srcname must have enough room for the resulting string.
+ *
+ * Return a pointer to the resulting string or NULL on error.
+ ***************************************************************************/
+char *
+mstt_srcname (MSTraceTable *mstt, int32_t idx, char *srcname, flag quality)
+{
+  MSTraceTableID *id;
+
+  if (!mstt || !srcname || idx < 0 || idx >= mstt->numtraces)
+    return NULL;
+
+  id = &mstt->id[idx];
+
+  if (quality && id->dataquality)
+    sprintf (srcname, "%s_%s_%s_%s_%c", id->network, id->station,
+             id->location, id->channel, id->dataquality);
+  else
+    sprintf (srcname, "%s_%s_%s_%s", id->network, id->station,
+             id->location, id->channel);
+
+  return srcname;
+} /* End of mstt_srcname() */
+
+/***************************************************************************
+ * mstt_printtracelist:
+ *
+ * Print the traces of a MSTraceTable in the format of
+ * mst_printtracelist(): source name, start time, end time and,
+ * optionally, the gap from the previous trace and details.
+ *
+ * The timeformat flag can either be:
+ * 0 : SEED time format (year, day-of-year, hour, min, sec)
+ * 1 : ISO time format (year, month, day, hour, min, sec)
+ * 2 : Epoch time, seconds since the epoch
+ ***************************************************************************/
+void
+mstt_printtracelist (MSTraceTable *mstt, flag timeformat,
+                     flag details, flag gaps)
+{
+  char srcname[50];
+  char prevsrcname[50];
+  char stime[30];
+  char etime[30];
+  char gapstr[20];
+  flag nogap;
+  double gap;
+  double delta;
+  double prevsamprate;
+  hptime_t prevendtime;
+  int32_t idx;
+
+  if (!mstt)
+    return;
+
+  /* Print out the appropriate header */
+  if (details > 0 && gaps > 0)
+    ms_log (0, "   Source                Start sample             End sample        Gap  Hz  Samples\n");
+  else if (details <= 0 && gaps > 0)
+    ms_log (0, "   Source                Start sample             End sample        Gap\n");
+  else if (details > 0 && gaps <= 0)
+    ms_log (0, "   Source                Start sample             End sample        Hz  Samples\n");
+  else
+    ms_log (0, "   Source                Start sample             End sample\n");
+
+  prevsrcname[0] = '\0';
+  prevsamprate   = -1.0;
+  prevendtime    = 0;
+
+  for (idx = 0; idx < mstt->numtraces; idx++)
+  {
+    mstt_srcname (mstt, idx, srcname, 1);
+
+    /* Create formatted time strings */
+    if (timeformat == 2)
+    {
+      snprintf (stime, sizeof (stime), "%.6f", (double)MS_HPTIME2EPOCH (mstt->starttime[idx]));
+      snprintf (etime, sizeof (etime), "%.6f", (double)MS_HPTIME2EPOCH (mstt->endtime[idx]));
+    }
+    else if (timeformat == 1)
+    {
+      if (ms_hptime2isotimestr (mstt->starttime[idx], stime, 1) == NULL)
+        ms_log (2, "Cannot convert trace start time for %s\n", srcname);
+
+      if (ms_hptime2isotimestr (mstt->endtime[idx], etime, 1) == NULL)
+        ms_log (2, "Cannot convert trace end time for %s\n", srcname);
+    }
+    else
+    {
+      if (ms_hptime2seedtimestr (mstt->starttime[idx], stime, 1) == NULL)
+        ms_log (2, "Cannot convert trace start time for %s\n", srcname);
+
+      if (ms_hptime2seedtimestr (mstt->endtime[idx], etime, 1) == NULL)
+        ms_log (2, "Cannot convert trace end time for %s\n", srcname);
+    }
+
+    /* Print trace info at varying levels */
+    if (gaps > 0)
+    {
+      gap   = 0.0;
+      nogap = 0;
+
+      if (!strcmp (prevsrcname, srcname) && prevsamprate != -1.0 &&
+          MS_ISRATETOLERABLE (prevsamprate, mstt->samprate[idx]))
+        gap = (double)(mstt->starttime[idx] - prevendtime) / HPTMODULUS;
+      else
+        nogap = 1;
+
+      /* Check that any overlap is not larger than the trace coverage */
+      if (gap < 0.0)
+      {
+        delta = (mstt->samprate[idx]) ? (1.0 / mstt->samprate[idx]) : 0.0;
+
+        if ((gap * -1.0) > (((double)(mstt->endtime[idx] - mstt->starttime[idx]) / HPTMODULUS) + delta))
+          gap = -(((double)(mstt->endtime[idx] - mstt->starttime[idx]) / HPTMODULUS) + delta);
+      }
+
+      /* Fix up gap display */
+      if (nogap)
+        snprintf (gapstr, sizeof (gapstr), " == ");
+      else if (gap >= 86400.0 || gap <= -86400.0)
+        snprintf (gapstr, sizeof (gapstr), "%-3.1fd", (gap / 86400));
+      else if (gap >= 3600.0 || gap <= -3600.0)
+        snprintf (gapstr, sizeof (gapstr), "%-3.1fh", (gap / 3600));
+      else if (gap == 0.0)
+        snprintf (gapstr, sizeof (gapstr), "-0  ");
+      else
+        snprintf (gapstr, sizeof (gapstr), "%-4.4g", gap);
+
+      if (details <= 0)
+        ms_log (0, "%-17s %-24s %-24s %-4s\n",
+                srcname, stime, etime, gapstr);
+      else
+        ms_log (0, "%-17s %-24s %-24s %-s %-3.3g %-" PRId64 "\n",
+                srcname, stime, etime, gapstr, mstt->samprate[idx], mstt->samplecnt[idx]);
+    }
+    else if (details > 0 && gaps <= 0)
+      ms_log (0, "%-17s %-24s %-24s %-3.3g %-" PRId64 "\n",
+              srcname, stime, etime, mstt->samprate[idx], mstt->samplecnt[idx]);
+    else
+      ms_log (0, "%-17s %-24s %-24s\n", srcname, stime, etime);
+
+    if (gaps > 0)
+    {
+      strcpy (prevsrcname, srcname);
+      prevsamprate = mstt->samprate[idx];
+      prevendtime  = mstt->endtime[idx];
+    }
+  }
+
+  if (details > 0)
+    ms_log (0, "Total: %d trace segment(s)\n", mstt->numtraces);
+
+} /* End of mstt_printtracelist() */
+
+/***************************************************************************
+ * mstt_pack:
+ *
+ * Pack the data of each trace in a MSTraceTable into Mini-SEED records
+ * as mst_packgroup() does for a MSTraceGroup, see mst_pack() for a
+ * description of the arguments.  The samples are packed from the data
+ * pool, the start time and sample counts of each trace are adjusted
+ * and the packed samples remain in the pool until the table is healed
+ * with mstt_heal().  Traces without data samples are skipped.  Without
+ * a template each trace is packed with a new MSRecord as by mst_pack().
+ *
+ * Returns the number of records created on success and -1 on error.
+ ***************************************************************************/
+int
+mstt_pack (MSTraceTable *mstt, void (*record_handler) (char *, int, void *),
+           void *handlerdata, int reclen, flag encoding, flag byteorder,
+           int64_t *packedsamples, flag flush, flag verbose,
+           MSRecord *mstemplate)
+{
+  MSRecord *msr = 0;
+  char srcname[50];
+  int packedrecords       = 0;
+  int trpackedrecords     = 0;
+  int64_t trpackedsamples = 0;
+  int32_t idx;
+
+  hptime_t preservestarttime   = 0;
+  double preservesamprate      = 0.0;
+  void *preservedatasamples    = 0;
+  int64_t preservenumsamples   = 0;
+  char preservesampletype      = 0;
+  StreamState *preserveststate = 0;
+
+  if (!mstt)
+    return -1;
+
+  if (packedsamples)
+    *packedsamples = 0;
+
+  if (mstemplate)
+  {
+    msr = mstemplate;
+
+    preservestarttime   = msr->starttime;
+    preservesamprate    = msr->samprate;
+    preservedatasamples = msr->datasamples;
+    preservenumsamples  = msr->numsamples;
+    preservesampletype  = msr->sampletype;
+    preserveststate     = msr->ststate;
+  }
+
+  for (idx = 0; idx < mstt->numtraces; idx++)
+  {
+    if (mstt->numsamples[idx] <= 0)
+    {
+      if (verbose > 1)
+        ms_log (1, "No data samples for %s, skipping\n", mstt_srcname (mstt, idx, srcname, 1));
+
+      continue;
+    }
+
+    /* Sample count sanity check */
+    if (mstt->samplecnt[idx] != mstt->numsamples[idx])
+    {
+      ms_log (2, "mstt_pack(): Sample counts do not match, abort\n");
+      packedrecords = -1;
+      break;
+    }
+
+    /* Allocate stream processing state space if needed */
+    if (!mstt->ststate[idx])
+    {
+      if (!(mstt->ststate[idx] = (StreamState *)malloc (sizeof (StreamState))))
+      {
+        ms_log (2, "mstt_pack(): Could not allocate memory for StreamState\n");
+        packedrecords = -1;
+        break;
+      }
+      memset (mstt->ststate[idx], 0, sizeof (StreamState));
+    }
+
+    if (!mstemplate)
+    {
+      if (!(msr = msr_init (NULL)))
+      {
+        ms_log (2, "mstt_pack(): Error initializing msr\n");
+        packedrecords = -1;
+        break;
+      }
+
+      msr->dataquality = 'D';
+      strcpy (msr->network, mstt->id[idx].network);
+      strcpy (msr->station, mstt->id[idx].station);
+      strcpy (msr->location, mstt->id[idx].location);
+      strcpy (msr->channel, mstt->id[idx].channel);
+    }
+
+    /* Setup MSRecord template for packing */
+    msr->reclen    = reclen;
+    msr->encoding  = encoding;
+    msr->byteorder = byteorder;
+
+    msr->starttime   = mstt->starttime[idx];
+    msr->samprate    = mstt->samprate[idx];
+    msr->datasamples = mstt->datapool + mstt->dataoffset[idx];
+    msr->numsamples  = mstt->numsamples[idx];
+    msr->sampletype  = mstt->sampletype[idx];
+    msr->ststate     = mstt->ststate[idx];
+
+    trpackedsamples = 0;
+    trpackedrecords = msr_pack (msr, record_handler, handlerdata, &trpackedsamples, flush, verbose);
+
+    if (verbose > 1 && trpackedrecords != -1)
+      ms_log (1, "Packed %d records for %s trace\n", trpackedrecords, mstt_srcname (mstt, idx, srcname, 1));
+
+    /* Adjust start time, data offset and sample counts of the trace,
+     * the packed samples remain in the pool */
+    if (trpackedsamples > 0)
+    {
+      /* The new start time was calculated by msr_pack */
+      mstt->starttime[idx] = msr->starttime;
+
+      mstt->dataoffset[idx] += trpackedsamples * ms_samplesize (mstt->sampletype[idx]);
+      mstt->samplecnt[idx] -= trpackedsamples;
+      mstt->numsamples[idx] -= trpackedsamples;
+
+      if (packedsamples)
+        *packedsamples += trpackedsamples;
+    }
+
+    if (!mstemplate)
+    {
+      msr->datasamples = 0;
+      msr->ststate     = 0;
+      msr_free (&msr);
+    }
+
+    if (trpackedrecords == -1)
+    {
+      packedrecords = -1;
+      break;
+    }
+
+    packedrecords += trpackedrecords;
+  }
+
+  /* Reinstate preserved values if a template was used */
+  if (mstemplate)
+  {
+    msr->starttime   = preservestarttime;
+    msr->samprate    = preservesamprate;
+    msr->datasamples = preservedatasamples;
+    msr->numsamples  = preservenumsamples;
+    msr->sampletype  = preservesampletype;
+    msr->ststate     = preserveststate;
+  }
+
+  return packedrecords;
+} /* End of mstt_pack() */
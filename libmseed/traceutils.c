@@ -14,8 +14,46 @@
 #include <time.h>
 
 #include "libmseed.h"
-
-static int mst_groupsort_cmp (MSTrace *mst1, MSTrace *mst2, flag quality);
+#include "traceutils.h"
+
+/* Hash index entry for a MSTrace, linked into a bucket in chain order */
+typedef struct MSTraceIndexEntry_s {
+  uint32_t hash;               /* Hash of the trace identifiers */
+  int32_t  next;               /* Next entry in the bucket, -1 if last */
+  MSTrace *mst;                /* Indexed trace */
+} MSTraceIndexEntry;
+
+/* Hash index of the traces in a MSTraceGroup, see mst_groupindex() */
+typedef struct MSTraceIndex_s {
+  int32_t  numentries;         /* Number of traces indexed */
+  int32_t  maxentries;         /* Number of entries allocated */
+  int32_t  numbuckets;         /* Number of buckets, a power of 2 */
+  int32_t *buckets;            /* First entry in each bucket, -1 if empty */
+  MSTraceIndexEntry *entries;  /* Entries in chain order */
+  MSTrace *lasttrace;          /* Last trace of the chain */
+} MSTraceIndex;
+
+/* Sort entry of a MSTrace, see mst_groupsort() and mst_groupheal() */
+typedef struct MSTraceSortEntry_s {
+  MSTrace *mst;                /* Trace, NULL once merged into another */
+  int32_t  position;           /* Position in the trace chain or sort order */
+  char     srcname[50];        /* Source name of the trace */
+} MSTraceSortEntry;
+
+static uint32_t mst_hashid (char *network, char *station, char *location, char *channel);
+static int mst_indexadd (MSTraceIndex *index, MSTrace *mst);
+static int mst_indexbuild (MSTraceGroup *mstg);
+static MSTraceIndex *mst_indexcheck (MSTraceGroup *mstg);
+static MSTrace *mst_indexnext (MSTraceIndex *index, int32_t *entry, uint32_t hash);
+static void mst_indexfree (MSTraceGroup *mstg);
+static MSTraceSortEntry *mst_sortentries (MSTraceGroup *mstg, flag quality, int32_t *count);
+static void mst_relinkentries (MSTraceGroup *mstg, MSTraceSortEntry *entries, int32_t count);
+static int mst_sortentry_cmp (const void *entry1, const void *entry2);
+static int mst_healentry_cmp (const void *entry1, const void *entry2);
+static int mst_healentry_idcmp (MSTrace *mst1, MSTrace *mst2);
+static flag mst_healfit (MSTrace *curtrace, MSTrace *searchtrace,
+                         double timetol, double sampratetol);
+static void mst_healmerge (MSTrace *curtrace, MSTrace *searchtrace, flag whence);
 
 /***************************************************************************
  * mst_init:
@@ -31,14 +69,17 @@ mst_init (MSTrace *mst)
   /* Free datasamples, prvtptr and stream state if present */
   if (mst)
   {
-    if (mst->datasamples)
-      free (mst->datasamples);
+    mst_freesamples (mst);
 
     if (mst->prvtptr)
       free (mst->prvtptr);
 
     if (mst->ststate)
+    {
+      if (mst->ststate->packcache)
+        free (mst->ststate->packcache);
       free (mst->ststate);
+    }
   }
   else
   {
@@ -68,8 +109,7 @@ mst_free (MSTrace **ppmst)
   if (ppmst && *ppmst)
   {
     /* Free datasamples if present */
-    if ((*ppmst)->datasamples)
-      free ((*ppmst)->datasamples);
+    mst_freesamples (*ppmst);
 
     /* Free private memory if present */
     if ((*ppmst)->prvtptr)
@@ -77,7 +117,11 @@ mst_free (MSTrace **ppmst)
 
     /* Free stream processing state if present */
     if ((*ppmst)->ststate)
+    {
+      if ((*ppmst)->ststate->packcache)
+        free ((*ppmst)->ststate->packcache);
       free ((*ppmst)->ststate);
+    }
 
     free (*ppmst);
 
@@ -85,6 +129,25 @@ mst_free (MSTrace **ppmst)
   }
 } /* End of mst_free() */
 
+/***************************************************************************
+ * mst_freesamples:
+ *
+ * Free the data samples of a MSTrace and reset the sample count.
+ *
+ * Packing advances MSTrace.datasamples past the samples packed, so it
+ * may not point to the start of its buffer; the samples of a trace
+ * must be released with this routine instead of free().
+ ***************************************************************************/
+void
+mst_freesamples (MSTrace *mst)
+{
+  if (!mst)
+    return;
+
+  ms_releasesamples (&mst->datasamples, &mst->numsamples, &mst->dataoffset,
+                     &mst->datacapacity, ms_samplesize (mst->sampletype));
+} /* End of mst_freesamples() */
+
 /***************************************************************************
  * mst_initgroup:
  *
@@ -110,6 +173,8 @@ mst_initgroup (MSTraceGroup *mstg)
       mst_free (&mst);
       mst = next;
     }
+
+    mst_indexfree (mstg);
   }
   else
   {
@@ -150,12 +215,280 @@ mst_freegroup (MSTraceGroup **ppmstg)
       mst = next;
     }
 
+    mst_indexfree (*ppmstg);
+
     free (*ppmstg);
 
     *ppmstg = 0;
   }
 } /* End of mst_freegroup() */
 
+/***************************************************************************
+ * mst_groupindex:
+ *
+ * Build or release a hash index of the traces in a MSTraceGroup.  If
+ * the enable flag is true the index is (re)built from the current
+ * trace chain, otherwise any index is released.
+ *
+ * The index is keyed on the network, station, location and channel
+ * identifiers and is used by mst_findadjacent(), and therefore
+ * mst_addmsrtogroup(), to find matching traces without comparing the
+ * identifiers of every trace in the group.  The trace chain and the
+ * trace found are the same as without the index.  The index is kept
+ * up to date by mst_addmsrtogroup(), mst_addtracetogroup(),
+ * mst_groupheal() and mst_groupsort().
+ *
+ * The index is rebuilt when the number of traces in the group no
+ * longer matches the number indexed or traces were linked after the
+ * last indexed trace.  A caller that otherwise changes the trace
+ * chain, or the identifiers of a trace, must rebuild the index by
+ * calling this routine again.
+ *
+ * Return 0 on success and -1 on error.
+ ***************************************************************************/
+int
+mst_groupindex (MSTraceGroup *mstg, flag enable)
+{
+  if (!mstg)
+    return -1;
+
+  if (!enable)
+  {
+    mst_indexfree (mstg);
+    return 0;
+  }
+
+  return mst_indexbuild (mstg);
+} /* End of mst_groupindex() */
+
+/***************************************************************************
+ * mst_hashid:
+ *
+ * Calculate a hash of trace identifiers using the FNV-1a algorithm,
+ * with the identifiers separated by their terminating NULLs.
+ *
+ * Return the hash value.
+ ***************************************************************************/
+static uint32_t
+mst_hashid (char *network, char *station, char *location, char *channel)
+{
+  char *ids[4];
+  uint32_t hash = 2166136261U;
+  int idx;
+  char *cp;
+
+  ids[0] = network;
+  ids[1] = station;
+  ids[2] = location;
+  ids[3] = channel;
+
+  for (idx = 0; idx < 4; idx++)
+  {
+    for (cp = ids[idx];; cp++)
+    {
+      hash ^= (uint8_t)*cp;
+      hash *= 16777619U;
+
+      if (*cp == '\0')
+        break;
+    }
+  }
+
+  return hash;
+} /* End of mst_hashid() */
+
+/***************************************************************************
+ * mst_indexadd:
+ *
+ * Add a MSTrace to the end of a trace index, growing the entries and
+ * doubling the number of buckets as needed to keep the buckets short.
+ * Entries are linked into buckets in the order they are added.
+ *
+ * Return 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+mst_indexadd (MSTraceIndex *index, MSTrace *mst)
+{
+  MSTraceIndexEntry *entries;
+  int32_t *buckets;
+  int32_t numbuckets;
+  int32_t *link;
+  int32_t idx;
+
+  if (index->numentries >= index->maxentries)
+  {
+    idx = (index->maxentries) ? index->maxentries * 2 : 64;
+
+    if (!(entries = (MSTraceIndexEntry *)realloc (index->entries, idx * sizeof (MSTraceIndexEntry))))
+      return -1;
+
+    index->entries    = entries;
+    index->maxentries = idx;
+  }
+
+  /* Rehash into twice as many buckets, entries are linked in reverse
+   * order at the head of each bucket to keep the bucket order */
+  if (index->numentries >= index->numbuckets)
+  {
+    numbuckets = (index->numbuckets) ? index->numbuckets * 2 : 64;
+
+    if (!(buckets = (int32_t *)realloc (index->buckets, numbuckets * sizeof (int32_t))))
+      return -1;
+
+    index->buckets    = buckets;
+    index->numbuckets = numbuckets;
+
+    for (idx = 0; idx < numbuckets; idx++)
+      buckets[idx] = -1;
+
+    for (idx = index->numentries - 1; idx >= 0; idx--)
+    {
+      link = &buckets[index->entries[idx].hash & (numbuckets - 1)];
+
+      index->entries[idx].next = *link;
+      *link                    = idx;
+    }
+  }
+
+  idx = index->numentries++;
+
+  index->entries[idx].hash = mst_hashid (mst->network, mst->station,
+                                         mst->location, mst->channel);
+  index->entries[idx].next = -1;
+  index->entries[idx].mst  = mst;
+
+  /* Link the entry at the end of its bucket */
+  link = &index->buckets[index->entries[idx].hash & (index->numbuckets - 1)];
+  while (*link >= 0)
+    link = &index->entries[*link].next;
+
+  *link = idx;
+
+  index->lasttrace = mst;
+
+  return 0;
+} /* End of mst_indexadd() */
+
+/***************************************************************************
+ * mst_indexbuild:
+ *
+ * Build the trace index of a MSTraceGroup from the trace chain,
+ * allocating the index if needed.  On error the index is released.
+ *
+ * Return 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+mst_indexbuild (MSTraceGroup *mstg)
+{
+  MSTraceIndex *index;
+  MSTrace *mst;
+  int32_t idx;
+
+  if (!mstg->index)
+  {
+    if (!(mstg->index = calloc (1, sizeof (MSTraceIndex))))
+    {
+      ms_log (2, "mst_groupindex(): Cannot allocate memory\n");
+      return -1;
+    }
+  }
+
+  index = (MSTraceIndex *)mstg->index;
+
+  index->numentries = 0;
+  index->lasttrace  = 0;
+
+  for (idx = 0; idx < index->numbuckets; idx++)
+    index->buckets[idx] = -1;
+
+  for (mst = mstg->traces; mst; mst = mst->next)
+  {
+    if (mst_indexadd (index, mst))
+    {
+      ms_log (2, "mst_groupindex(): Cannot allocate memory\n");
+      mst_indexfree (mstg);
+      return -1;
+    }
+  }
+
+  return 0;
+} /* End of mst_indexbuild() */
+
+/***************************************************************************
+ * mst_indexcheck:
+ *
+ * Check that the trace index of a MSTraceGroup covers the trace chain
+ * and rebuild it if the number of traces differs or traces were
+ * linked after the last indexed trace.
+ *
+ * Return the index or NULL if the group is not indexed.
+ ***************************************************************************/
+static MSTraceIndex *
+mst_indexcheck (MSTraceGroup *mstg)
+{
+  MSTraceIndex *index = (MSTraceIndex *)mstg->index;
+
+  if (!index)
+    return NULL;
+
+  if (index->numentries != mstg->numtraces ||
+      (index->lasttrace && index->lasttrace->next) ||
+      (!index->lasttrace && mstg->traces))
+  {
+    if (mst_indexbuild (mstg))
+      return NULL;
+  }
+
+  return (MSTraceIndex *)mstg->index;
+} /* End of mst_indexcheck() */
+
+/***************************************************************************
+ * mst_indexnext:
+ *
+ * Return the trace of the next entry with a hash value in a bucket of
+ * a trace index, starting at the entry at *entry and advancing it.
+ *
+ * Return a MSTrace or NULL when no more entries match.
+ ***************************************************************************/
+static MSTrace *
+mst_indexnext (MSTraceIndex *index, int32_t *entry, uint32_t hash)
+{
+  MSTraceIndexEntry *ie;
+
+  while (*entry >= 0)
+  {
+    ie     = &index->entries[*entry];
+    *entry = ie->next;
+
+    if (ie->hash == hash)
+      return ie->mst;
+  }
+
+  return NULL;
+} /* End of mst_indexnext() */
+
+/***************************************************************************
+ * mst_indexfree:
+ *
+ * Release the trace index of a MSTraceGroup, if any.
+ ***************************************************************************/
+static void
+mst_indexfree (MSTraceGroup *mstg)
+{
+  MSTraceIndex *index = (MSTraceIndex *)mstg->index;
+
+  if (index)
+  {
+    if (index->entries)
+      free (index->entries);
+    if (index->buckets)
+      free (index->buckets);
+
+    free (index);
+    mstg->index = NULL;
+  }
+} /* End of mst_indexfree() */
+
 /***************************************************************************
  * mst_findmatch:
  *
@@ -262,6 +595,9 @@ mst_findmatch (MSTrace *startmst, char dataquality,
  * 1: time span fits at the end of the MSTrace
  * 2: time span fits at the beginning of the MSTrace
  *
+ * If the group is indexed, see mst_groupindex(), only the traces
+ * with matching identifiers are checked.
+ *
  * Return a pointer a matching MSTrace and set the 'whence' flag
  * otherwise 0 if no match found.
  ***************************************************************************/
@@ -272,11 +608,14 @@ mst_findadjacent (MSTraceGroup *mstg, flag *whence, char dataquality,
                   hptime_t starttime, hptime_t endtime, double timetol)
 {
   MSTrace *mst = 0;
+  MSTraceIndex *index;
   hptime_t pregap;
   hptime_t postgap;
   hptime_t hpdelta;
   hptime_t hptimetol  = 0;
   hptime_t nhptimetol = 0;
+  uint32_t hash = 0;
+  int32_t entry = -1;
   int idx;
 
   if (!mstg || !whence || !network || !station || !location || !channel)
@@ -295,9 +634,19 @@ mst_findadjacent (MSTraceGroup *mstg, flag *whence, char dataquality,
 
   nhptimetol = (hptimetol) ? -hptimetol : 0;
 
-  mst = mstg->traces;
+  /* Check only traces with matching identifiers if indexed */
+  if ((index = mst_indexcheck (mstg)))
+  {
+    hash  = mst_hashid (network, station, location, channel);
+    entry = (index->numbuckets) ? index->buckets[hash & (index->numbuckets - 1)] : -1;
+    mst   = mst_indexnext (index, &entry, hash);
+  }
+  else
+  {
+    mst = mstg->traces;
+  }
 
-  while (mst)
+  for (; mst; mst = (index) ? mst_indexnext (index, &entry, hash) : mst->next)
   {
     /* post/pregap are negative when the record overlaps the trace
        * segment and positive when there is a time gap. */
@@ -328,7 +677,6 @@ mst_findadjacent (MSTraceGroup *mstg, flag *whence, char dataquality,
       else
       {
         /* Span does not fit with this Trace */
-        mst = mst->next;
         continue;
       }
     }
@@ -341,14 +689,12 @@ mst_findadjacent (MSTraceGroup *mstg, flag *whence, char dataquality,
       {
         if (!MS_ISRATETOLERABLE (samprate, mst->samprate))
         {
-          mst = mst->next;
           continue;
         }
       }
       /* Otherwise check against the specified sample rate tolerance */
       else if (ms_dabs (samprate - mst->samprate) > sampratetol)
       {
-        mst = mst->next;
         continue;
       }
     }
@@ -356,7 +702,6 @@ mst_findadjacent (MSTraceGroup *mstg, flag *whence, char dataquality,
     /* Compare data qualities */
     if (dataquality && dataquality != mst->dataquality)
     {
-      mst = mst->next;
       continue;
     }
 
@@ -370,7 +715,6 @@ mst_findadjacent (MSTraceGroup *mstg, flag *whence, char dataquality,
     }
     if (network[idx] != '\0' || mst->network[idx] != '\0')
     {
-      mst = mst->next;
       continue;
     }
     /* Compare station */
@@ -383,7 +727,6 @@ mst_findadjacent (MSTraceGroup *mstg, flag *whence, char dataquality,
     }
     if (station[idx] != '\0' || mst->station[idx] != '\0')
     {
-      mst = mst->next;
       continue;
     }
     /* Compare location */
@@ -396,7 +739,6 @@ mst_findadjacent (MSTraceGroup *mstg, flag *whence, char dataquality,
     }
     if (location[idx] != '\0' || mst->location[idx] != '\0')
     {
-      mst = mst->next;
       continue;
     }
     /* Compare channel */
@@ -409,7 +751,6 @@ mst_findadjacent (MSTraceGroup *mstg, flag *whence, char dataquality,
     }
     if (channel[idx] != '\0' || mst->channel[idx] != '\0')
     {
-      mst = mst->next;
       continue;
     }
 
@@ -464,15 +805,6 @@ mst_addmsr (MSTrace *mst, MSRecord *msr, flag whence)
               msr->sampletype, mst->sampletype);
       return -1;
     }
-
-    mst->datasamples = realloc (mst->datasamples,
-                                (size_t) (mst->numsamples * samplesize + msr->numsamples * samplesize));
-
-    if (mst->datasamples == NULL)
-    {
-      ms_log (2, "mst_addmsr(): Cannot allocate memory\n");
-      return -1;
-    }
   }
 
   /* Add samples at end of trace */
@@ -480,11 +812,12 @@ mst_addmsr (MSTrace *mst, MSRecord *msr, flag whence)
   {
     if (msr->datasamples && msr->numsamples >= 0)
     {
-      memcpy ((char *)mst->datasamples + (mst->numsamples * samplesize),
-              msr->datasamples,
-              (size_t) (msr->numsamples * samplesize));
-
-      mst->numsamples += msr->numsamples;
+      if (ms_addsamples (&mst->datasamples, &mst->numsamples, &mst->dataoffset,
+                         &mst->datacapacity, samplesize, msr->datasamples, msr->numsamples, 1))
+      {
+        ms_log (2, "mst_addmsr(): Cannot allocate memory\n");
+        return -1;
+      }
     }
 
     mst->endtime = msr_endtime (msr);
@@ -501,19 +834,12 @@ mst_addmsr (MSTrace *mst, MSRecord *msr, flag whence)
   {
     if (msr->datasamples && msr->numsamples >= 0)
     {
-      /* Move any samples to end of buffer */
-      if (mst->numsamples > 0)
+      if (ms_addsamples (&mst->datasamples, &mst->numsamples, &mst->dataoffset,
+                         &mst->datacapacity, samplesize, msr->datasamples, msr->numsamples, 2))
       {
-        memmove ((char *)mst->datasamples + (msr->numsamples * samplesize),
-                 mst->datasamples,
-                 (size_t) (mst->numsamples * samplesize));
+        ms_log (2, "mst_addmsr(): Cannot allocate memory\n");
+        return -1;
       }
-
-      memcpy (mst->datasamples,
-              msr->datasamples,
-              (size_t) (msr->numsamples * samplesize));
-
-      mst->numsamples += msr->numsamples;
     }
 
     mst->starttime = msr->starttime;
@@ -567,15 +893,6 @@ mst_addspan (MSTrace *mst, hptime_t starttime, hptime_t endtime,
               sampletype, mst->sampletype);
       return -1;
     }
-
-    mst->datasamples = realloc (mst->datasamples,
-                                (size_t) (mst->numsamples * samplesize + numsamples * samplesize));
-
-    if (mst->datasamples == NULL)
-    {
-      ms_log (2, "mst_addspan(): Cannot allocate memory\n");
-      return -1;
-    }
   }
 
   /* Add samples at end of trace */
@@ -583,11 +900,12 @@ mst_addspan (MSTrace *mst, hptime_t starttime, hptime_t endtime,
   {
     if (datasamples && numsamples > 0)
     {
-      memcpy ((char *)mst->datasamples + (mst->numsamples * samplesize),
-              datasamples,
-              (size_t) (numsamples * samplesize));
-
-      mst->numsamples += numsamples;
+      if (ms_addsamples (&mst->datasamples, &mst->numsamples, &mst->dataoffset,
+                         &mst->datacapacity, samplesize, datasamples, numsamples, 1))
+      {
+        ms_log (2, "mst_addspan(): Cannot allocate memory\n");
+        return -1;
+      }
     }
 
     mst->endtime = endtime;
@@ -598,19 +916,12 @@ mst_addspan (MSTrace *mst, hptime_t starttime, hptime_t endtime,
   {
     if (datasamples && numsamples > 0)
     {
-      /* Move any samples to end of buffer */
-      if (mst->numsamples > 0)
+      if (ms_addsamples (&mst->datasamples, &mst->numsamples, &mst->dataoffset,
+                         &mst->datacapacity, samplesize, datasamples, numsamples, 2))
       {
-        memmove ((char *)mst->datasamples + (numsamples * samplesize),
-                 mst->datasamples,
-                 (size_t) (mst->numsamples * samplesize));
+        ms_log (2, "mst_addspan(): Cannot allocate memory\n");
+        return -1;
       }
-
-      memcpy (mst->datasamples,
-              datasamples,
-              (size_t) (numsamples * samplesize));
-
-      mst->numsamples += numsamples;
     }
 
     mst->starttime = starttime;
@@ -623,6 +934,166 @@ mst_addspan (MSTrace *mst, hptime_t starttime, hptime_t endtime,
   return 0;
 } /* End of mst_addspan() */
 
+/***************************************************************************
+ * ms_addsamples:
+ *
+ * Copy count data samples into a sample buffer, at the end if whence
+ * is 1 or at the beginning if whence is 2.  The buffer is described
+ * by the samples, numsamples, dataoffset and datacapacity fields of a
+ * MSTrace or MSTraceSeg.
+ *
+ * The buffer grows geometrically, datacapacity is the size of the
+ * buffer and dataoffset the number of unused samples before the data
+ * samples.  Samples added at the end use the space after the data
+ * samples, if it is too small the buffer is compacted when the unused
+ * samples in front outnumber the data samples and grown by half
+ * otherwise.  Samples added at the beginning use the space in front,
+ * if it is too small the samples are moved to the middle of a buffer
+ * at least twice the size needed.  The cost of adding samples is
+ * linear in the total number of samples.
+ *
+ * Return 0 on success and -1 on error.
+ ***************************************************************************/
+int
+ms_addsamples (void **samples, int64_t *numsamples, int64_t *dataoffset,
+               int64_t *datacapacity, int samplesize,
+               void *datasamples, int64_t count, flag whence)
+{
+  char *buffer   = NULL;
+  char *newbuffer;
+  int64_t capacity = 0;
+  int64_t needed;
+  int64_t headroom;
+
+  if (count <= 0)
+    return 0;
+
+  if (*samples)
+  {
+    buffer   = (char *)*samples - (*dataoffset * samplesize);
+    capacity = *datacapacity;
+
+    /* A buffer not allocated by libmseed holds only the samples */
+    if (capacity < *dataoffset + *numsamples)
+      capacity = *dataoffset + *numsamples;
+  }
+
+  if (whence == 2)
+  {
+    if (*dataoffset < count)
+    {
+      needed = *numsamples + count;
+
+      /* Leave half of the free space in front of the samples */
+      if (capacity < 2 * needed)
+      {
+        if (!(newbuffer = (char *)malloc ((size_t) (2 * needed * samplesize))))
+          return -1;
+
+        headroom = (needed + 1) / 2 + count;
+
+        if (*numsamples > 0)
+          memcpy (newbuffer + (headroom * samplesize), *samples,
+                  (size_t) (*numsamples * samplesize));
+
+        if (buffer)
+          free (buffer);
+
+        buffer   = newbuffer;
+        capacity = 2 * needed;
+      }
+      else
+      {
+        headroom = (capacity - needed + 1) / 2 + count;
+
+        if (*numsamples > 0)
+          memmove (buffer + (headroom * samplesize), *samples,
+                   (size_t) (*numsamples * samplesize));
+      }
+
+      *samples    = buffer + (headroom * samplesize);
+      *dataoffset = headroom;
+    }
+
+    *samples = (char *)*samples - (count * samplesize);
+    *dataoffset -= count;
+
+    memcpy (*samples, datasamples, (size_t) (count * samplesize));
+  }
+  else
+  {
+    if (capacity - *dataoffset - *numsamples < count)
+    {
+      if (*dataoffset > *numsamples)
+        ms_compactsamples (samples, numsamples, dataoffset, datacapacity, samplesize);
+
+      needed = *dataoffset + *numsamples + count;
+
+      if (capacity < needed)
+      {
+        capacity += capacity / 2;
+        if (capacity < needed)
+          capacity = needed;
+
+        if (!(newbuffer = (char *)realloc (buffer, (size_t) (capacity * samplesize))))
+          return -1;
+
+        *samples = newbuffer + (*dataoffset * samplesize);
+      }
+    }
+
+    memcpy ((char *)*samples + (*numsamples * samplesize),
+            datasamples, (size_t) (count * samplesize));
+  }
+
+  *numsamples += count;
+  *datacapacity = capacity;
+
+  return 0;
+} /* End of ms_addsamples() */
+
+/***************************************************************************
+ * ms_compactsamples:
+ *
+ * Move the data samples of a sample buffer to the start of the buffer,
+ * reclaiming the space of samples consumed by mst_pack().
+ ***************************************************************************/
+void
+ms_compactsamples (void **samples, int64_t *numsamples, int64_t *dataoffset,
+                   int64_t *datacapacity, int samplesize)
+{
+  char *buffer;
+
+  if (*dataoffset <= 0 || !*samples)
+    return;
+
+  buffer = (char *)*samples - (*dataoffset * samplesize);
+
+  if (*numsamples > 0)
+    memmove (buffer, *samples, (size_t) (*numsamples * samplesize));
+
+  *samples    = buffer;
+  *dataoffset = 0;
+} /* End of ms_compactsamples() */
+
+/***************************************************************************
+ * ms_releasesamples:
+ *
+ * Free a sample buffer and reset its fields.
+ ***************************************************************************/
+void
+ms_releasesamples (void **samples, int64_t *numsamples, int64_t *dataoffset,
+                   int64_t *datacapacity, int samplesize)
+{
+  if (*samples)
+    free ((char *)*samples - (*dataoffset * samplesize));
+
+  *samples      = 0;
+  *numsamples   = 0;
+  *dataoffset   = 0;
+  *datacapacity = 0;
+} /* End of ms_releasesamples() */
+
 /***************************************************************************
  * mst_addmsrtogroup:
  *
@@ -699,21 +1170,7 @@ mst_addmsrtogroup (MSTraceGroup *mstg, MSRecord *msr, flag dataquality,
     }
 
     /* Link new MSTrace into the end of the chain */
-    if (!mstg->traces)
-    {
-      mstg->traces = mst;
-    }
-    else
-    {
-      MSTrace *lasttrace = mstg->traces;
-
-      while (lasttrace->next)
-        lasttrace = lasttrace->next;
-
-      lasttrace->next = mst;
-    }
-
-    mstg->numtraces++;
+    mst_addtracetogroup (mstg, mst);
   }
 
   return mst;
@@ -723,24 +1180,29 @@ mst_addmsrtogroup (MSTraceGroup *mstg, MSRecord *msr, flag dataquality,
  * mst_addtracetogroup:
  *
  * Add a MSTrace to a MSTraceGroup at the end of the MSTrace chain.
+ * If the group is indexed the trace is added to the index, if that
+ * fails the index is released.
  *
  * Return a pointer to the MSTrace added or 0 on error.
  ***************************************************************************/
 MSTrace *
 mst_addtracetogroup (MSTraceGroup *mstg, MSTrace *mst)
 {
+  MSTraceIndex *index;
   MSTrace *lasttrace;
 
   if (!mstg || !mst)
     return 0;
 
+  index = mst_indexcheck (mstg);
+
   if (!mstg->traces)
   {
     mstg->traces = mst;
   }
   else
   {
-    lasttrace = mstg->traces;
+    lasttrace = (index) ? index->lasttrace : mstg->traces;
 
     while (lasttrace->next)
       lasttrace = lasttrace->next;
@@ -752,6 +1214,12 @@ mst_addtracetogroup (MSTraceGroup *mstg, MSTrace *mst)
 
   mstg->numtraces++;
 
+  if (index && mst_indexadd (index, mst))
+  {
+    ms_log (2, "mst_addtracetogroup(): Cannot allocate memory for trace index\n");
+    mst_indexfree (mstg);
+  }
+
   return mst;
 } /* End of mst_addtracetogroup() */
 
@@ -762,9 +1230,16 @@ mst_addtracetogroup (MSTraceGroup *mstg, MSTrace *mst)
  * belong together they will be merged.  This routine is only useful
  * if the trace group was assembled from segments out of time order
  * (e.g. a file of Mini-SEED records not in time order) but forming
- * contiguous time coverage.  The MSTraceGroup will be sorted using
+ * contiguous time coverage.  The MSTraceGroup will be sorted as by
  * mst_groupsort() before healing.
  *
+ * The traces are sorted once into an array and, in a second order by
+ * network, station, location, channel and start time, merged in a
+ * single sweep.  The sweep keeps the traces that may still be joined
+ * by a later trace; a trace is merged into the one it fits that is
+ * earliest in the sorted group, or that trace is merged into it if
+ * it comes first.  The healed traces are relinked in sorted order.
+ *
  * The time tolerance and sample rate tolerance are used to determine
  * if the traces are indeed the same.  If timetol is -1.0 the default
  * tolerance of 1/2 the sample period will be used.  If samprratetol
@@ -776,161 +1251,148 @@ mst_addtracetogroup (MSTraceGroup *mstg, MSTrace *mst)
 int
 mst_groupheal (MSTraceGroup *mstg, double timetol, double sampratetol)
 {
-  int mergings         = 0;
-  MSTrace *curtrace    = 0;
-  MSTrace *nexttrace   = 0;
-  MSTrace *searchtrace = 0;
-  MSTrace *prevtrace   = 0;
-  int8_t merged        = 0;
-  double postgap, pregap, delta;
+  MSTraceSortEntry *entries  = 0;
+  MSTraceSortEntry **sweep   = 0;
+  MSTraceSortEntry **active  = 0;
+  MSTraceSortEntry *curentry = 0;
+  MSTraceSortEntry *match    = 0;
+  int32_t count, numactive, matchidx;
+  int32_t first, next, idx, jdx, kdx;
+  int mergings = 0;
+  flag whence, matchwhence;
+  double maxdelta, maxtol, delta, gap;
 
   if (!mstg)
     return -1;
 
+  if (!mstg->traces)
+    return 0;
+
   /* Sort MSTraceGroup before any healing */
-  if (mst_groupsort (mstg, 1))
+  if (!(entries = mst_sortentries (mstg, 1, &count)))
     return -1;
 
-  curtrace = mstg->traces;
-
-  while (curtrace)
+  if (!(sweep = (MSTraceSortEntry **)malloc (count * sizeof (MSTraceSortEntry *))) ||
+      !(active = (MSTraceSortEntry **)malloc (count * sizeof (MSTraceSortEntry *))))
   {
-    nexttrace = mstg->traces;
-    prevtrace = mstg->traces;
-
-    while (nexttrace)
-    {
-      searchtrace = nexttrace;
-      nexttrace   = searchtrace->next;
+    ms_log (2, "mst_groupheal(): Cannot allocate memory\n");
+    if (sweep)
+      free (sweep);
+    mst_relinkentries (mstg, entries, count);
+    free (entries);
+    return -1;
+  }
 
-      /* Do not process the same MSTrace we are trying to match */
-      if (searchtrace == curtrace)
-      {
-        prevtrace = searchtrace;
-        continue;
-      }
+  for (idx = 0; idx < count; idx++)
+    sweep[idx] = &entries[idx];
 
-      /* Check if this trace matches the curtrace */
-      if (strcmp (searchtrace->network, curtrace->network) ||
-          strcmp (searchtrace->station, curtrace->station) ||
-          strcmp (searchtrace->location, curtrace->location) ||
-          strcmp (searchtrace->channel, curtrace->channel))
-      {
-        prevtrace = searchtrace;
-        continue;
-      }
+  qsort (sweep, count, sizeof (MSTraceSortEntry *), mst_healentry_cmp);
 
-      /* Perform default samprate tolerance check if requested */
-      if (sampratetol == -1.0)
-      {
-        if (!MS_ISRATETOLERABLE (searchtrace->samprate, curtrace->samprate))
-        {
-          prevtrace = searchtrace;
-          continue;
-        }
-      }
-      /* Otherwise check against the specified sample rates tolerance */
-      else if (ms_dabs (searchtrace->samprate - curtrace->samprate) > sampratetol)
-      {
-        prevtrace = searchtrace;
-        continue;
-      }
+  for (first = 0; first < count; first = next)
+  {
+    /* Find the traces with the same identifiers and their longest sample period */
+    maxdelta = 0.0;
+    for (next = first; next < count; next++)
+    {
+      if (mst_healentry_idcmp (sweep[first]->mst, sweep[next]->mst))
+        break;
 
-      merged = 0;
+      delta = (sweep[next]->mst->samprate) ? (1.0 / sweep[next]->mst->samprate) : 0.0;
 
-      /* post/pregap are negative when searchtrace overlaps curtrace
-         segment and positive when there is a time gap. */
-      delta = (curtrace->samprate) ? (1.0 / curtrace->samprate) : 0.0;
+      if (delta > maxdelta)
+        maxdelta = delta;
+    }
 
-      postgap = ((double)(searchtrace->starttime - curtrace->endtime) / HPTMODULUS) - delta;
+    /* No trace can fit one ending more than this tolerance before it starts */
+    maxtol = (timetol == -1.0) ? 0.5 * maxdelta : timetol;
 
-      pregap = ((double)(curtrace->starttime - searchtrace->endtime) / HPTMODULUS) - delta;
+    numactive = 0;
 
-      /* Calculate default time tolerance (1/2 sample period) if needed */
-      if (timetol == -1.0)
-        timetol = 0.5 * delta;
+    for (idx = first; idx < next; idx++)
+    {
+      curentry    = sweep[idx];
+      match       = 0;
+      matchidx    = -1;
+      matchwhence = 0;
 
-      /* Fits right at the end of curtrace */
-      if (ms_dabs (postgap) <= timetol)
+      for (jdx = kdx = 0; jdx < numactive; jdx++)
       {
-        /* Merge searchtrace with curtrace */
-        mst_addspan (curtrace, searchtrace->starttime, searchtrace->endtime,
-                     searchtrace->datasamples, searchtrace->numsamples,
-                     searchtrace->sampletype, 1);
-
-        /* If no data is present, make sure sample count is updated */
-        if (searchtrace->numsamples <= 0)
-          curtrace->samplecnt += searchtrace->samplecnt;
+        /* Retire traces ending too early to fit this or any later trace */
+        gap = ((double)(curentry->mst->starttime - active[jdx]->mst->endtime) / HPTMODULUS) - maxdelta;
 
-        /* If qualities do not match reset the indicator */
-        if (curtrace->dataquality != searchtrace->dataquality)
-          curtrace->dataquality = 0;
+        if (gap > maxtol)
+          continue;
 
-        merged = 1;
-      }
+        active[kdx] = active[jdx];
 
-      /* Fits right at the beginning of curtrace */
-      else if (ms_dabs (pregap) <= timetol)
-      {
-        /* Merge searchtrace with curtrace */
-        mst_addspan (curtrace, searchtrace->starttime, searchtrace->endtime,
-                     searchtrace->datasamples, searchtrace->numsamples,
-                     searchtrace->sampletype, 2);
+        /* Merge with the fitting trace earliest in the sorted group */
+        if (!match || active[kdx]->position < match->position)
+        {
+          if (active[kdx]->position < curentry->position)
+            whence = mst_healfit (active[kdx]->mst, curentry->mst, timetol, sampratetol);
+          else
+            whence = mst_healfit (curentry->mst, active[kdx]->mst, timetol, sampratetol);
+
+          if (whence)
+          {
+            match       = active[kdx];
+            matchidx    = kdx;
+            matchwhence = whence;
+          }
+        }
 
-        /* If no data is present, make sure sample count is updated */
-        if (searchtrace->numsamples <= 0)
-          curtrace->samplecnt += searchtrace->samplecnt;
+        kdx++;
+      }
 
-        /* If qualities do not match reset the indicator */
-        if (curtrace->dataquality != searchtrace->dataquality)
-          curtrace->dataquality = 0;
+      numactive = kdx;
 
-        merged = 1;
+      if (!match)
+      {
+        active[numactive++] = curentry;
+        continue;
       }
 
-      /* If searchtrace was merged with curtrace remove it from the chain */
-      if (merged)
+      /* Merge into the trace earlier in the sorted group and free the other */
+      if (match->position < curentry->position)
       {
-        /* Re-link trace chain and free searchtrace */
-        if (searchtrace == mstg->traces)
-          mstg->traces = nexttrace;
-        else
-          prevtrace->next = nexttrace;
-
-        mst_free (&searchtrace);
-
-        mstg->numtraces--;
-        mergings++;
+        mst_healmerge (match->mst, curentry->mst, matchwhence);
+        mst_free (&curentry->mst);
       }
       else
       {
-        prevtrace = searchtrace;
+        mst_healmerge (curentry->mst, match->mst, matchwhence);
+        mst_free (&match->mst);
+        active[matchidx] = curentry;
       }
-    }
 
-    curtrace = curtrace->next;
+      mergings++;
+    }
   }
 
+  /* Relink the healed traces in sorted order */
+  mst_relinkentries (mstg, entries, count);
+
+  free (entries);
+  free (sweep);
+  free (active);
+
   return mergings;
 } /* End of mst_groupheal() */
 
 /***************************************************************************
  * mst_groupsort:
  *
- * Sort a MSTraceGroup using a mergesort algorithm.  MSTrace entries
- * are compared using the mst_groupsort_cmp() function.
- *
- * The mergesort implementation was inspired by the listsort function
- * published and copyright 2001 by Simon Tatham.
+ * Sort a MSTraceGroup.  The traces are sorted in an array using
+ * qsort(3) and relinked, the order is stable and MSTrace entries are
+ * compared using the mst_sortentry_cmp() function.
  *
  * Return 0 on success and -1 on error.
  ***************************************************************************/
 int
 mst_groupsort (MSTraceGroup *mstg, flag quality)
 {
-  MSTrace *p, *q, *e, *top, *tail;
-  int nmerges;
-  int insize, psize, qsize, i;
+  MSTraceSortEntry *entries;
+  int32_t count;
 
   if (!mstg)
     return -1;
@@ -938,150 +1400,250 @@ mst_groupsort (MSTraceGroup *mstg, flag quality)
   if (!mstg->traces)
     return 0;
 
-  top    = mstg->traces;
-  insize = 1;
+  if (!(entries = mst_sortentries (mstg, quality, &count)))
+    return -1;
 
-  for (;;)
-  {
-    p    = top;
-    top  = NULL;
-    tail = NULL;
+  mst_relinkentries (mstg, entries, count);
 
-    nmerges = 0; /* count number of merges we do in this pass */
+  free (entries);
 
-    while (p)
-    {
-      nmerges++; /* there exists a merge to be done */
+  return 0;
+} /* End of mst_groupsort() */
 
-      /* step `insize' places along from p */
-      q     = p;
-      psize = 0;
-      for (i = 0; i < insize; i++)
-      {
-        psize++;
-        q = q->next;
-        if (!q)
-          break;
-      }
+/***************************************************************************
+ * mst_sortentries:
+ *
+ * Allocate an array of sort entries for the traces of a MSTraceGroup
+ * and sort it using the mst_sortentry_cmp() function.  The source
+ * names are generated once for each trace, with the quality if
+ * requested, and the position of each entry is set to its place in
+ * the sorted array.  The number of entries is returned in count.
+ *
+ * Return the array on success and NULL on error.
+ ***************************************************************************/
+static MSTraceSortEntry *
+mst_sortentries (MSTraceGroup *mstg, flag quality, int32_t *count)
+{
+  MSTraceSortEntry *entries;
+  MSTrace *mst;
+  int32_t idx;
 
-      /* if q hasn't fallen off end, we have two lists to merge */
-      qsize = insize;
+  *count = 0;
 
-      /* now we have two lists; merge them */
-      while (psize > 0 || (qsize > 0 && q))
-      {
-        /* decide whether next element of merge comes from p or q */
-        if (psize == 0)
-        { /* p is empty; e must come from q. */
-          e = q;
-          q = q->next;
-          qsize--;
-        }
-        else if (qsize == 0 || !q)
-        { /* q is empty; e must come from p. */
-          e = p;
-          p = p->next;
-          psize--;
-        }
-        else if (mst_groupsort_cmp (p, q, quality) <= 0)
-        { /* First element of p is lower (or same), e must come from p. */
-          e = p;
-          p = p->next;
-          psize--;
-        }
-        else
-        { /* First element of q is lower; e must come from q. */
-          e = q;
-          q = q->next;
-          qsize--;
-        }
+  for (mst = mstg->traces; mst; mst = mst->next)
+    (*count)++;
 
-        /* add the next element to the merged list */
-        if (tail)
-          tail->next = e;
-        else
-          top = e;
+  if (!(entries = (MSTraceSortEntry *)malloc (*count * sizeof (MSTraceSortEntry))))
+  {
+    ms_log (2, "mst_groupsort(): Cannot allocate memory\n");
+    return NULL;
+  }
 
-        tail = e;
-      }
+  for (idx = 0, mst = mstg->traces; mst; idx++, mst = mst->next)
+  {
+    entries[idx].mst      = mst;
+    entries[idx].position = idx;
+    mst_srcname (mst, entries[idx].srcname, quality);
+  }
 
-      /* now p has stepped `insize' places along, and q has too */
-      p = q;
-    }
+  qsort (entries, *count, sizeof (MSTraceSortEntry), mst_sortentry_cmp);
 
-    tail->next = NULL;
+  for (idx = 0; idx < *count; idx++)
+    entries[idx].position = idx;
 
-    /* If we have done only one merge, we're finished. */
-    if (nmerges <= 1) /* allow for nmerges==0, the empty list case */
-    {
-      mstg->traces = top;
+  return entries;
+} /* End of mst_sortentries() */
 
-      return 0;
-    }
+/***************************************************************************
+ * mst_relinkentries:
+ *
+ * Relink the trace chain of a MSTraceGroup in the order of an array of
+ * sort entries, skipping entries without a trace, and update the
+ * trace count and any index.
+ ***************************************************************************/
+static void
+mst_relinkentries (MSTraceGroup *mstg, MSTraceSortEntry *entries, int32_t count)
+{
+  MSTrace **link = &mstg->traces;
+  int32_t idx;
 
-    /* Otherwise repeat, merging lists twice the size */
-    insize *= 2;
+  mstg->numtraces = 0;
+
+  for (idx = 0; idx < count; idx++)
+  {
+    if (!entries[idx].mst)
+      continue;
+
+    *link = entries[idx].mst;
+    link  = &entries[idx].mst->next;
+
+    mstg->numtraces++;
   }
-} /* End of mst_groupsort() */
+
+  *link = NULL;
+
+  /* Rebuild any index in the new order */
+  if (mstg->index)
+    mst_indexbuild (mstg);
+} /* End of mst_relinkentries() */
 
 /***************************************************************************
- * mst_groupsort_cmp:
+ * mst_sortentry_cmp:
  *
- * Compare two MSTrace entities for the purposes of sorting a
- * MSTraceGroup.  Criteria for MSTrace comparison are (in order of
- * testing): source name, start time, descending endtime (longest
- * trace first) and sample rate.
+ * Compare two MSTrace sort entries for qsort(3).  Criteria for MSTrace
+ * comparison are (in order of testing): source name, start time,
+ * descending endtime (longest trace first), sample rate and the
+ * original position for a stable sort.
  *
- * Return 1 if mst1 is "greater" than mst2, otherwise return 0.
+ * Return 1 if entry1 is "greater" than entry2, -1 if it is "lesser".
  ***************************************************************************/
 static int
-mst_groupsort_cmp (MSTrace *mst1, MSTrace *mst2, flag quality)
+mst_sortentry_cmp (const void *entry1, const void *entry2)
 {
-  char src1[50], src2[50];
+  const MSTraceSortEntry *e1 = (const MSTraceSortEntry *)entry1;
+  const MSTraceSortEntry *e2 = (const MSTraceSortEntry *)entry2;
   int strcmpval;
 
-  if (!mst1 || !mst2)
-    return -1;
-
-  mst_srcname (mst1, src1, quality);
-  mst_srcname (mst2, src2, quality);
-
-  strcmpval = strcmp (src1, src2);
-
   /* If the source names do not match make sure the "greater" string is 2nd,
    * otherwise, if source names do match, make sure the later start time is 2nd
    * otherwise, if start times match, make sure the earlier end time is 2nd
    * otherwise, if end times match, make sure the highest sample rate is 2nd
+   * otherwise keep the original order
    */
-  if (strcmpval > 0)
+  if ((strcmpval = strcmp (e1->srcname, e2->srcname)))
+    return (strcmpval > 0) ? 1 : -1;
+
+  if (e1->mst->starttime != e2->mst->starttime)
+    return (e1->mst->starttime > e2->mst->starttime) ? 1 : -1;
+
+  if (e1->mst->endtime != e2->mst->endtime)
+    return (e1->mst->endtime < e2->mst->endtime) ? 1 : -1;
+
+  if (!MS_ISRATETOLERABLE (e1->mst->samprate, e2->mst->samprate))
+    return (e1->mst->samprate > e2->mst->samprate) ? 1 : -1;
+
+  return (e1->position > e2->position) ? 1 : -1;
+} /* End of mst_sortentry_cmp() */
+
+/***************************************************************************
+ * mst_healentry_cmp:
+ *
+ * Compare two pointers to MSTrace sort entries for qsort(3) in the
+ * order of healing: network, station, location and channel (ignoring
+ * quality), start time and then position in the sorted group.
+ *
+ * Return 1 if entry1 is "greater" than entry2, -1 if it is "lesser".
+ ***************************************************************************/
+static int
+mst_healentry_cmp (const void *entry1, const void *entry2)
+{
+  const MSTraceSortEntry *e1 = *(MSTraceSortEntry *const *)entry1;
+  const MSTraceSortEntry *e2 = *(MSTraceSortEntry *const *)entry2;
+  int cmpval;
+
+  if ((cmpval = mst_healentry_idcmp (e1->mst, e2->mst)))
+    return cmpval;
+
+  if (e1->mst->starttime != e2->mst->starttime)
+    return (e1->mst->starttime > e2->mst->starttime) ? 1 : -1;
+
+  return (e1->position > e2->position) ? 1 : -1;
+} /* End of mst_healentry_cmp() */
+
+/***************************************************************************
+ * mst_healentry_idcmp:
+ *
+ * Compare the network, station, location and channel of two MSTraces.
+ *
+ * Return 0 if they match, otherwise 1 or -1 as strcmp(3).
+ ***************************************************************************/
+static int
+mst_healentry_idcmp (MSTrace *mst1, MSTrace *mst2)
+{
+  int cmpval;
+
+  if (!(cmpval = strcmp (mst1->network, mst2->network)) &&
+      !(cmpval = strcmp (mst1->station, mst2->station)) &&
+      !(cmpval = strcmp (mst1->location, mst2->location)))
+    cmpval = strcmp (mst1->channel, mst2->channel);
+
+  return (cmpval > 0) ? 1 : (cmpval < 0) ? -1 : 0;
+} /* End of mst_healentry_idcmp() */
+
+/***************************************************************************
+ * mst_healfit:
+ *
+ * Check if searchtrace fits at the end or the beginning of curtrace
+ * within the time and sample rate tolerances of mst_groupheal(), the
+ * time tolerance defaults to 1/2 the sample period of curtrace.  The
+ * traces are expected to have the same identifiers.
+ *
+ * Return 1 if searchtrace fits at the end, 2 if it fits at the
+ * beginning and 0 otherwise.
+ ***************************************************************************/
+static flag
+mst_healfit (MSTrace *curtrace, MSTrace *searchtrace,
+             double timetol, double sampratetol)
+{
+  double postgap, pregap, delta;
+
+  /* Perform default samprate tolerance check if requested */
+  if (sampratetol == -1.0)
   {
-    return 1;
+    if (!MS_ISRATETOLERABLE (searchtrace->samprate, curtrace->samprate))
+      return 0;
   }
-  else if (strcmpval == 0)
+  /* Otherwise check against the specified sample rates tolerance */
+  else if (ms_dabs (searchtrace->samprate - curtrace->samprate) > sampratetol)
   {
-    if (mst1->starttime > mst2->starttime)
-    {
-      return 1;
-    }
-    else if (mst1->starttime == mst2->starttime)
-    {
-      if (mst1->endtime < mst2->endtime)
-      {
-        return 1;
-      }
-      else if (mst1->endtime == mst2->endtime)
-      {
-        if (!MS_ISRATETOLERABLE (mst1->samprate, mst2->samprate) &&
-            mst1->samprate > mst2->samprate)
-        {
-          return 1;
-        }
-      }
-    }
+    return 0;
   }
 
+  /* post/pregap are negative when searchtrace overlaps curtrace
+     segment and positive when there is a time gap. */
+  delta = (curtrace->samprate) ? (1.0 / curtrace->samprate) : 0.0;
+
+  postgap = ((double)(searchtrace->starttime - curtrace->endtime) / HPTMODULUS) - delta;
+
+  pregap = ((double)(curtrace->starttime - searchtrace->endtime) / HPTMODULUS) - delta;
+
+  /* Calculate default time tolerance (1/2 sample period) if needed */
+  if (timetol == -1.0)
+    timetol = 0.5 * delta;
+
+  /* Fits right at the end of curtrace */
+  if (ms_dabs (postgap) <= timetol)
+    return 1;
+
+  /* Fits right at the beginning of curtrace */
+  if (ms_dabs (pregap) <= timetol)
+    return 2;
+
   return 0;
-} /* End of mst_groupsort_cmp() */
+} /* End of mst_healfit() */
+
+/***************************************************************************
+ * mst_healmerge:
+ *
+ * Merge the time coverage and data samples of searchtrace into
+ * curtrace, at the end if whence is 1 or the beginning if whence is 2.
+ ***************************************************************************/
+static void
+mst_healmerge (MSTrace *curtrace, MSTrace *searchtrace, flag whence)
+{
+  /* Merge searchtrace with curtrace */
+  mst_addspan (curtrace, searchtrace->starttime, searchtrace->endtime,
+               searchtrace->datasamples, searchtrace->numsamples,
+               searchtrace->sampletype, whence);
+
+  /* If no data is present, make sure sample count is updated */
+  if (searchtrace->numsamples <= 0)
+    curtrace->samplecnt += searchtrace->samplecnt;
+
+  /* If qualities do not match reset the indicator */
+  if (curtrace->dataquality != searchtrace->dataquality)
+    curtrace->dataquality = 0;
+} /* End of mst_healmerge() */
 
 /***************************************************************************
  * mst_convertsamples:
@@ -1122,6 +1684,10 @@ mst_convertsamples (MSTrace *mst, char type, flag truncate)
     return -1;
   }
 
+  /* Reclaim space of packed samples, the sample size may change */
+  ms_compactsamples (&mst->datasamples, &mst->numsamples, &mst->dataoffset,
+                     &mst->datacapacity, ms_samplesize (mst->sampletype));
+
   idata = (int32_t *)mst->datasamples;
   fdata = (float *)mst->datasamples;
   ddata = (double *)mst->datasamples;
@@ -1165,6 +1731,8 @@ mst_convertsamples (MSTrace *mst, char type, flag truncate)
         ms_log (2, "mst_convertsamples: cannot re-allocate buffer for sample conversion\n");
         return -1;
       }
+
+      mst->datacapacity = mst->numsamples;
     }
 
     mst->sampletype = 'i';
@@ -1189,6 +1757,8 @@ mst_convertsamples (MSTrace *mst, char type, flag truncate)
         ms_log (2, "mst_convertsamples: cannot re-allocate buffer after sample conversion\n");
         return -1;
       }
+
+      mst->datacapacity = mst->numsamples;
     }
 
     mst->sampletype = 'f';
@@ -1218,8 +1788,9 @@ mst_convertsamples (MSTrace *mst, char type, flag truncate)
       free (fdata);
     }
 
-    mst->datasamples = ddata;
-    mst->sampletype  = 'd';
+    mst->datasamples  = ddata;
+    mst->datacapacity = mst->numsamples;
+    mst->sampletype   = 'd';
   } /* Done converting to 64-bit doubles */
 
   return 0;
@@ -1628,6 +2199,12 @@ mst_printgaplist (MSTraceGroup *mstg, flag timeformat,
  * numsamples field will be adjusted (reduced) based on how many
  * samples were packed.
  *
+ * The packed samples are not moved or freed, instead datasamples is
+ * advanced past them and MSTrace.dataoffset counts the unused samples
+ * preceding datasamples in its buffer.  Their space is reused when
+ * samples are added with mst_addmsr() or mst_addspan().  The samples
+ * must be released with mst_freesamples() instead of free().
+ *
  * As each record is filled and finished they are passed to
  * record_handler which expects 1) a char * to the record, 2) the
  * length of the record and 3) a pointer supplied by the original
@@ -1654,12 +2231,34 @@ mst_pack (MSTrace *mst, void (*record_handler) (char *, int, void *),
           int64_t *packedsamples, flag flush, flag verbose,
           MSRecord *mstemplate)
 {
+  return mst_pack_ctx (mst, record_handler, handlerdata, reclen, encoding,
+                       byteorder, packedsamples, flush, verbose, mstemplate,
+                       NULL);
+} /* End of mst_pack() */
+
+
+/***************************************************************************
+ * mst_pack_ctx:
+ *
+ * Pack MSTrace data into Mini-SEED records as mst_pack() does using
+ * the byte order overrides and logging parameters of the supplied
+ * packing context, see msr_pack_ctx().  If ctx is NULL the packing
+ * settings are determined for this call only.
+ *
+ * Returns the number of records created on success and -1 on error.
+ ***************************************************************************/
+int
+mst_pack_ctx (MSTrace *mst, void (*record_handler) (char *, int, void *),
+              void *handlerdata, int reclen, flag encoding, flag byteorder,
+              int64_t *packedsamples, flag flush, flag verbose,
+              MSRecord *mstemplate, MSPackContext *ctx)
+{
+  MSLogParam *logp = (ctx) ? ctx->logp : NULL;
   MSRecord *msr;
   char srcname[50];
   int trpackedrecords     = 0;
   int64_t trpackedsamples = 0;
   int samplesize;
-  int64_t bufsize;
 
   hptime_t preservestarttime   = 0;
   double preservesamprate      = 0.0;
@@ -1677,7 +2276,7 @@ mst_pack (MSTrace *mst, void (*record_handler) (char *, int, void *),
     mst->ststate = (StreamState *)malloc (sizeof (StreamState));
     if (!mst->ststate)
     {
-      ms_log (2, "mst_pack(): Could not allocate memory for StreamState\n");
+      ms_log_l (logp, 2, "mst_pack(): Could not allocate memory for StreamState\n");
       return -1;
     }
     memset (mst->ststate, 0, sizeof (StreamState));
@@ -1700,7 +2299,7 @@ mst_pack (MSTrace *mst, void (*record_handler) (char *, int, void *),
 
     if (msr == NULL)
     {
-      ms_log (2, "mst_pack(): Error initializing msr\n");
+      ms_log_l (logp, 2, "mst_pack(): Error initializing msr\n");
       return -1;
     }
 
@@ -1726,50 +2325,43 @@ mst_pack (MSTrace *mst, void (*record_handler) (char *, int, void *),
   /* Sample count sanity check */
   if (mst->samplecnt != mst->numsamples)
   {
-    ms_log (2, "mst_pack(): Sample counts do not match, abort\n");
+    ms_log_l (logp, 2, "mst_pack(): Sample counts do not match, abort\n");
     return -1;
   }
 
   /* Pack data */
-  trpackedrecords = msr_pack (msr, record_handler, handlerdata, &trpackedsamples, flush, verbose);
+  if (ctx)
+    trpackedrecords = msr_pack_ctx (msr, record_handler, handlerdata, &trpackedsamples, flush, verbose, ctx);
+  else
+    trpackedrecords = msr_pack (msr, record_handler, handlerdata, &trpackedsamples, flush, verbose);
 
   if (verbose > 1)
   {
-    ms_log (1, "Packed %d records for %s trace\n", trpackedrecords, mst_srcname (mst, srcname, 1));
+    ms_log_l (logp, 1, "Packed %d records for %s trace\n", trpackedrecords, mst_srcname (mst, srcname, 1));
   }
 
-  /* Adjust MSTrace start time, data array and sample count */
+  /* Adjust MSTrace start time, data array and sample count, the packed
+   * samples remain in the buffer until reclaimed by mst_addmsr() or
+   * mst_addspan() */
   if (trpackedsamples > 0)
   {
     /* The new start time was calculated my msr_pack */
     mst->starttime = msr->starttime;
 
     samplesize = ms_samplesize (mst->sampletype);
-    bufsize    = (mst->numsamples - trpackedsamples) * samplesize;
 
-    if (bufsize)
+    if (mst->numsamples > trpackedsamples)
     {
-      memmove (mst->datasamples,
-               (char *)mst->datasamples + (trpackedsamples * samplesize),
-               (size_t)bufsize);
-
-      mst->datasamples = realloc (mst->datasamples, (size_t)bufsize);
-
-      if (mst->datasamples == NULL)
-      {
-        ms_log (2, "mst_pack(): Cannot (re)allocate datasamples buffer\n");
-        return -1;
-      }
+      mst->datasamples = (char *)mst->datasamples + (trpackedsamples * samplesize);
+      mst->dataoffset += trpackedsamples;
+      mst->numsamples -= trpackedsamples;
     }
     else
     {
-      if (mst->datasamples)
-        free (mst->datasamples);
-      mst->datasamples = 0;
+      mst_freesamples (mst);
     }
 
     mst->samplecnt -= trpackedsamples;
-    mst->numsamples -= trpackedsamples;
   }
 
   /* Reinstate preserved values if a template was used */
@@ -1793,7 +2385,7 @@ mst_pack (MSTrace *mst, void (*record_handler) (char *, int, void *),
     *packedsamples = trpackedsamples;
 
   return trpackedrecords;
-} /* End of mst_pack() */
+} /* End of mst_pack_ctx() */
 
 /***************************************************************************
  * mst_packgroup:
@@ -0,0 +1,27 @@
+/***************************************************************************
+ * traceutils.h:
+ *
+ * Interface declarations for the trace sample buffer routines in
+ * traceutils.c, shared by the MSTrace and MSTraceSeg routines.
+ ***************************************************************************/
+
+#ifndef TRACEUTILS_H
+#define TRACEUTILS_H 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int ms_addsamples (void **samples, int64_t *numsamples, int64_t *dataoffset,
+                          int64_t *datacapacity, int samplesize,
+                          void *datasamples, int64_t count, flag whence);
+extern void ms_compactsamples (void **samples, int64_t *numsamples, int64_t *dataoffset,
+                               int64_t *datacapacity, int samplesize);
+extern void ms_releasesamples (void **samples, int64_t *numsamples, int64_t *dataoffset,
+                               int64_t *datacapacity, int samplesize);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
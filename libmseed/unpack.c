@@ -23,15 +23,20 @@
 #include "unpackdata.h"
 
 /* Function(s) internal to this file */
-static int check_environment (int verbose);
-
-/* Header and data byte order flags controlled by environment variables */
-/* -2 = not checked, -1 = checked but not set, or 0 = LE and 1 = BE */
+static int msr_unpack_data_main (MSRecord *msr, int swapflag, flag verbose,
+                                 MSUnpackContext *ctx);
+static int check_environment (MSUnpackContext *ctx, int verbose);
+
+/* Header and data byte order flags forced by the caller, otherwise
+ * controlled by environment variables read on each call.  These are
+ * only read by the library, unpacking is reentrant.
+ * -2 = not set, use environment, -1 = not forced, or 0 = LE and 1 = BE */
 flag unpackheaderbyteorder = -2;
 flag unpackdatabyteorder   = -2;
 
-/* Data encoding format/fallback controlled by environment variable */
-/* -2 = not checked, -1 = checked but not set, or = encoding */
+/* Data encoding format/fallback forced by the caller, otherwise
+ * controlled by environment variables read on each call.
+ * -2 = not set, use environment, -1 = not forced, or = encoding */
 int unpackencodingformat   = -2;
 int unpackencodingfallback = -2;
 
@@ -59,6 +64,10 @@ int unpackencodingfallback = -2;
  *
  * If the msr struct is NULL it will be allocated.
  *
+ * Byte order and encoding overrides are read from the global variables
+ * or the environment on each call, use msr_unpack_ctx() with a context
+ * resolved once when unpacking many records.
+ *
  * Returns MS_NOERROR and populates the MSRecord struct at *ppmsr on
  * success, otherwise returns a libmseed error code (listed in
  * libmseed.h).
@@ -66,6 +75,29 @@ int unpackencodingfallback = -2;
 int
 msr_unpack (char *record, int reclen, MSRecord **ppmsr,
             flag dataflag, flag verbose)
+{
+  MSUnpackContext ctx;
+
+  if (ms_unpackctx_init (&ctx, verbose))
+    return MS_GENERROR;
+
+  return msr_unpack_ctx (record, reclen, ppmsr, dataflag, verbose, &ctx);
+} /* End of msr_unpack() */
+
+/***************************************************************************
+ * msr_unpack_ctx:
+ *
+ * Unpack a SEED data record as msr_unpack() using the byte order and
+ * encoding overrides, debugging flag and logging parameters of a
+ * context initialized with ms_unpackctx_init().
+ *
+ * Returns MS_NOERROR and populates the MSRecord struct at *ppmsr on
+ * success, otherwise returns a libmseed error code (listed in
+ * libmseed.h).
+ ***************************************************************************/
+int
+msr_unpack_ctx (char *record, int reclen, MSRecord **ppmsr,
+                flag dataflag, flag verbose, MSUnpackContext *ctx)
 {
   flag headerswapflag = 0;
   flag dataswapflag   = 0;
@@ -83,9 +115,15 @@ msr_unpack (char *record, int reclen, MSRecord **ppmsr,
   uint32_t blkt_length;
   int blkt_count = 0;
 
+  if (!ctx)
+  {
+    ms_log (2, "msr_unpack_ctx(): ctx argument cannot be NULL\n");
+    return MS_GENERROR;
+  }
+
   if (!ppmsr)
   {
-    ms_log (2, "msr_unpack(): ppmsr argument cannot be NULL\n");
+    ms_log_l (ctx->logp, 2, "msr_unpack(): ppmsr argument cannot be NULL\n");
     return MS_GENERROR;
   }
 
@@ -93,8 +131,8 @@ msr_unpack (char *record, int reclen, MSRecord **ppmsr,
   if (!MS_ISVALIDHEADER (record))
   {
     ms_recsrcname (record, srcname, 1);
-    ms_log (2, "msr_unpack(%s) Record header & quality indicator unrecognized: '%c'\n", srcname);
-    ms_log (2, "msr_unpack(%s) This is not a valid Mini-SEED record\n", srcname);
+    ms_log_l (ctx->logp, 2, "msr_unpack(%s) Record header & quality indicator unrecognized: '%c'\n", srcname);
+    ms_log_l (ctx->logp, 2, "msr_unpack(%s) This is not a valid Mini-SEED record\n", srcname);
 
     return MS_NOTSEED;
   }
@@ -103,7 +141,7 @@ msr_unpack (char *record, int reclen, MSRecord **ppmsr,
   if (reclen < MINRECLEN || reclen > MAXRECLEN)
   {
     ms_recsrcname (record, srcname, 1);
-    ms_log (2, "msr_unpack(%s): Record length is out of range: %d\n", srcname, reclen);
+    ms_log_l (ctx->logp, 2, "msr_unpack(%s): Record length is out of range: %d\n", srcname, reclen);
     return MS_OUTOFRANGE;
   }
 
@@ -118,20 +156,12 @@ msr_unpack (char *record, int reclen, MSRecord **ppmsr,
   msr->record = record;
   msr->reclen = reclen;
 
-  /* Check environment variables if necessary */
-  if (unpackheaderbyteorder == -2 ||
-      unpackdatabyteorder == -2 ||
-      unpackencodingformat == -2 ||
-      unpackencodingfallback == -2)
-    if (check_environment (verbose))
-      return MS_GENERROR;
-
   /* Allocate and copy fixed section of data header */
   msr->fsdh = realloc (msr->fsdh, sizeof (struct fsdh_s));
 
   if (msr->fsdh == NULL)
   {
-    ms_log (2, "msr_unpack(): Cannot allocate memory\n");
+    ms_log_l (ctx->logp, 2, "msr_unpack(): Cannot allocate memory\n");
     return MS_GENERROR;
   }
 
@@ -142,14 +172,14 @@ msr_unpack (char *record, int reclen, MSRecord **ppmsr,
     headerswapflag = dataswapflag = 1;
 
   /* Check if byte order is forced */
-  if (unpackheaderbyteorder >= 0)
+  if (ctx->headerbyteorder >= 0)
   {
-    headerswapflag = (ms_bigendianhost () != unpackheaderbyteorder) ? 1 : 0;
+    headerswapflag = (ms_bigendianhost () != ctx->headerbyteorder) ? 1 : 0;
   }
 
-  if (unpackdatabyteorder >= 0)
+  if (ctx->databyteorder >= 0)
   {
-    dataswapflag = (ms_bigendianhost () != unpackdatabyteorder) ? 1 : 0;
+    dataswapflag = (ms_bigendianhost () != ctx->databyteorder) ? 1 : 0;
   }
 
   /* Swap byte order? */
@@ -178,7 +208,7 @@ msr_unpack (char *record, int reclen, MSRecord **ppmsr,
   /* Generate source name for MSRecord */
   if (msr_srcname (msr, srcname, 1) == NULL)
   {
-    ms_log (2, "msr_unpack(): Cannot generate srcname\n");
+    ms_log_l (ctx->logp, 2, "msr_unpack(): Cannot generate srcname\n");
     return MS_GENERROR;
   }
 
@@ -186,9 +216,9 @@ msr_unpack (char *record, int reclen, MSRecord **ppmsr,
   if (verbose > 2)
   {
     if (headerswapflag)
-      ms_log (1, "%s: Byte swapping needed for unpacking of header\n", srcname);
+      ms_log_l (ctx->logp, 1, "%s: Byte swapping needed for unpacking of header\n", srcname);
     else
-      ms_log (1, "%s: Byte swapping NOT needed for unpacking of header\n", srcname);
+      ms_log_l (ctx->logp, 1, "%s: Byte swapping NOT needed for unpacking of header\n", srcname);
   }
 
   /* Traverse the blockettes */
@@ -217,7 +247,7 @@ msr_unpack (char *record, int reclen, MSRecord **ppmsr,
 
     if (blkt_length == 0)
     {
-      ms_log (2, "msr_unpack(%s): Unknown blockette length for type %d\n",
+      ms_log_l (ctx->logp, 2, "msr_unpack(%s): Unknown blockette length for type %d\n",
               srcname, blkt_type);
       break;
     }
@@ -225,7 +255,7 @@ msr_unpack (char *record, int reclen, MSRecord **ppmsr,
     /* Make sure blockette is contained within the msrecord buffer */
     if ((int)(blkt_offset - 4 + blkt_length) > reclen)
     {
-      ms_log (2, "msr_unpack(%s): Blockette %d extends beyond record size, truncated?\n",
+      ms_log_l (ctx->logp, 2, "msr_unpack(%s): Blockette %d extends beyond record size, truncated?\n",
               srcname, blkt_type);
       break;
     }
@@ -464,7 +494,7 @@ msr_unpack (char *record, int reclen, MSRecord **ppmsr,
 
       if (verbose > 0)
       {
-        ms_log (1, "msr_unpack(%s): WARNING Blockette 405 cannot be fully supported\n",
+        ms_log_l (ctx->logp, 1, "msr_unpack(%s): WARNING Blockette 405 cannot be fully supported\n",
                 srcname);
       }
     }
@@ -513,7 +543,7 @@ msr_unpack (char *record, int reclen, MSRecord **ppmsr,
       /* Compare against the specified length */
       if (msr->reclen != reclen && verbose)
       {
-        ms_log (2, "msr_unpack(%s): Record length in Blockette 1000 (%d) != specified length (%d)\n",
+        ms_log_l (ctx->logp, 2, "msr_unpack(%s): Record length in Blockette 1000 (%d) != specified length (%d)\n",
                 srcname, msr->reclen, reclen);
       }
 
@@ -583,7 +613,7 @@ msr_unpack (char *record, int reclen, MSRecord **ppmsr,
     /* Check that the next blockette offset is beyond the current blockette */
     if (next_blkt && next_blkt < (blkt_offset + blkt_length - 4))
     {
-      ms_log (2, "msr_unpack(%s): Offset to next blockette (%d) is within current blockette ending at byte %d\n",
+      ms_log_l (ctx->logp, 2, "msr_unpack(%s): Offset to next blockette (%d) is within current blockette ending at byte %d\n",
               srcname, next_blkt, (blkt_offset + blkt_length - 4));
 
       blkt_offset = 0;
@@ -591,7 +621,7 @@ msr_unpack (char *record, int reclen, MSRecord **ppmsr,
     /* Check that the offset is within record length */
     else if (next_blkt && next_blkt > reclen)
     {
-      ms_log (2, "msr_unpack(%s): Offset to next blockette (%d) from type %d is beyond record length\n",
+      ms_log_l (ctx->logp, 2, "msr_unpack(%s): Offset to next blockette (%d) from type %d is beyond record length\n",
               srcname, next_blkt, blkt_type);
 
       blkt_offset = 0;
@@ -609,21 +639,21 @@ msr_unpack (char *record, int reclen, MSRecord **ppmsr,
   {
     if (verbose > 1)
     {
-      ms_log (1, "%s: Warning: No Blockette 1000 found\n", srcname);
+      ms_log_l (ctx->logp, 1, "%s: Warning: No Blockette 1000 found\n", srcname);
     }
   }
 
   /* Check that the data offset is after the blockette chain */
   if (blkt_link && msr->fsdh->numsamples && msr->fsdh->data_offset < (blkt_link->blktoffset + blkt_link->blktdatalen + 4))
   {
-    ms_log (1, "%s: Warning: Data offset in fixed header (%d) is within the blockette chain ending at %d\n",
+    ms_log_l (ctx->logp, 1, "%s: Warning: Data offset in fixed header (%d) is within the blockette chain ending at %d\n",
             srcname, msr->fsdh->data_offset, (blkt_link->blktoffset + blkt_link->blktdatalen + 4));
   }
 
   /* Check that the blockette count matches the number parsed */
   if (msr->fsdh->numblockettes != blkt_count)
   {
-    ms_log (1, "%s: Warning: Number of blockettes in fixed header (%d) does not match the number parsed (%d)\n",
+    ms_log_l (ctx->logp, 1, "%s: Warning: Number of blockettes in fixed header (%d) does not match the number parsed (%d)\n",
             srcname, msr->fsdh->numblockettes, blkt_count);
   }
 
@@ -632,22 +662,22 @@ msr_unpack (char *record, int reclen, MSRecord **ppmsr,
   msr->samprate  = msr_samprate (msr);
 
   /* Set MSRecord->byteorder if data byte order is forced */
-  if (unpackdatabyteorder >= 0)
+  if (ctx->databyteorder >= 0)
   {
-    msr->byteorder = unpackdatabyteorder;
+    msr->byteorder = ctx->databyteorder;
   }
 
   /* Check if encoding format is forced */
-  if (unpackencodingformat >= 0)
+  if (ctx->encodingformat >= 0)
   {
-    msr->encoding = unpackencodingformat;
+    msr->encoding = ctx->encodingformat;
   }
 
   /* Use encoding format fallback if defined and no encoding is set,
      also make sure the byteorder is set by default to big endian */
-  if (unpackencodingfallback >= 0 && msr->encoding == -1)
+  if (ctx->encodingfallback >= 0 && msr->encoding == -1)
   {
-    msr->encoding = unpackencodingfallback;
+    msr->encoding = ctx->encodingfallback;
 
     if (msr->byteorder == -1)
     {
@@ -664,7 +694,7 @@ msr_unpack (char *record, int reclen, MSRecord **ppmsr,
     /* Determine byte order of the data and set the dswapflag as
        needed; if no Blkt1000 or UNPACK_DATA_BYTEORDER environment
        variable setting assume the order is the same as the header */
-    if (msr->Blkt1000 != 0 && unpackdatabyteorder < 0)
+    if (msr->Blkt1000 != 0 && ctx->databyteorder < 0)
     {
       dswapflag = 0;
 
@@ -675,17 +705,17 @@ msr_unpack (char *record, int reclen, MSRecord **ppmsr,
       else if (!bigendianhost && msr->byteorder > 0)
         dswapflag = 1;
     }
-    else if (unpackdatabyteorder >= 0)
+    else if (ctx->databyteorder >= 0)
     {
       dswapflag = dataswapflag;
     }
 
     if (verbose > 2 && dswapflag)
-      ms_log (1, "%s: Byte swapping needed for unpacking of data samples\n", srcname);
+      ms_log_l (ctx->logp, 1, "%s: Byte swapping needed for unpacking of data samples\n", srcname);
     else if (verbose > 2)
-      ms_log (1, "%s: Byte swapping NOT needed for unpacking of data samples\n", srcname);
+      ms_log_l (ctx->logp, 1, "%s: Byte swapping NOT needed for unpacking of data samples\n", srcname);
 
-    retval = msr_unpack_data (msr, dswapflag, verbose);
+    retval = msr_unpack_data_main (msr, dswapflag, verbose, ctx);
 
     if (retval < 0)
       return retval;
@@ -702,7 +732,7 @@ msr_unpack (char *record, int reclen, MSRecord **ppmsr,
   }
 
   return MS_NOERROR;
-} /* End of msr_unpack() */
+} /* End of msr_unpack_ctx() */
 
 /************************************************************************
  *  msr_unpack_data:
@@ -717,6 +747,27 @@ msr_unpack (char *record, int reclen, MSRecord **ppmsr,
  ************************************************************************/
 int
 msr_unpack_data (MSRecord *msr, int swapflag, flag verbose)
+{
+  MSUnpackContext ctx;
+
+  /* Only the debugging flag and logging are used to decode samples */
+  memset (&ctx, 0, sizeof (MSUnpackContext));
+  ctx.decodedebug = (getenv ("DECODE_DEBUG")) ? 1 : 0;
+
+  return msr_unpack_data_main (msr, swapflag, verbose, &ctx);
+} /* End of msr_unpack_data() */
+
+/************************************************************************
+ *  msr_unpack_data_main:
+ *
+ *  Unpack Mini-SEED data samples as msr_unpack_data() using the
+ *  debugging flag and logging parameters of an unpacking context.
+ *
+ *  Return number of samples unpacked or negative libmseed error code.
+ ************************************************************************/
+static int
+msr_unpack_data_main (MSRecord *msr, int swapflag, flag verbose,
+                      MSUnpackContext *ctx)
 {
   int datasize;       /* byte size of data samples in record */
   int nsamples;       /* number of samples unpacked	     */
@@ -728,26 +779,22 @@ msr_unpack_data (MSRecord *msr, int swapflag, flag verbose)
   if (!msr)
     return MS_GENERROR;
 
-  /* Check for decode debugging environment variable */
-  if (getenv ("DECODE_DEBUG"))
-    decodedebug = 1;
-
   /* Generate source name for MSRecord */
   if (msr_srcname (msr, srcname, 1) == NULL)
   {
-    ms_log (2, "msr_unpack(): Cannot generate srcname\n");
+    ms_log_l (ctx->logp, 2, "msr_unpack(): Cannot generate srcname\n");
     return MS_GENERROR;
   }
 
   /* Sanity record length */
   if (msr->reclen == -1)
   {
-    ms_log (2, "msr_unpack_data(%s): Record size unknown\n", srcname);
+    ms_log_l (ctx->logp, 2, "msr_unpack_data(%s): Record size unknown\n", srcname);
     return MS_NOTSEED;
   }
   else if (msr->reclen < MINRECLEN || msr->reclen > MAXRECLEN)
   {
-    ms_log (2, "msr_unpack_data(%s): Unsupported record length: %d\n",
+    ms_log_l (ctx->logp, 2, "msr_unpack_data(%s): Unsupported record length: %d\n",
             srcname, msr->reclen);
     return MS_OUTOFRANGE;
   }
@@ -755,7 +802,7 @@ msr_unpack_data (MSRecord *msr, int swapflag, flag verbose)
   /* Sanity check data offset before creating a pointer based on the value */
   if (msr->fsdh->data_offset < 48 || msr->fsdh->data_offset >= msr->reclen)
   {
-    ms_log (2, "msr_unpack_data(%s): data offset value is not valid: %d\n",
+    ms_log_l (ctx->logp, 2, "msr_unpack_data(%s): data offset value is not valid: %d\n",
             srcname, msr->fsdh->data_offset);
     return MS_GENERROR;
   }
@@ -799,7 +846,7 @@ msr_unpack_data (MSRecord *msr, int swapflag, flag verbose)
 
     if (msr->datasamples == NULL)
     {
-      ms_log (2, "msr_unpack_data(%s): Cannot (re)allocate memory\n", srcname);
+      ms_log_l (ctx->logp, 2, "msr_unpack_data(%s): Cannot (re)allocate memory\n", srcname);
       return MS_GENERROR;
     }
   }
@@ -812,14 +859,14 @@ msr_unpack_data (MSRecord *msr, int swapflag, flag verbose)
   }
 
   if (verbose > 2)
-    ms_log (1, "%s: Unpacking %" PRId64 " samples\n", srcname, msr->samplecnt);
+    ms_log_l (ctx->logp, 1, "%s: Unpacking %" PRId64 " samples\n", srcname, msr->samplecnt);
 
   /* Decode data samples according to encoding */
   switch (msr->encoding)
   {
   case DE_ASCII:
     if (verbose > 1)
-      ms_log (1, "%s: Found ASCII data\n", srcname);
+      ms_log_l (ctx->logp, 1, "%s: Found ASCII data\n", srcname);
 
     nsamples = (int)msr->samplecnt;
     if (nsamples > 0)
@@ -835,7 +882,7 @@ msr_unpack_data (MSRecord *msr, int swapflag, flag verbose)
 
   case DE_INT16:
     if (verbose > 1)
-      ms_log (1, "%s: Unpacking INT16 data samples\n", srcname);
+      ms_log_l (ctx->logp, 1, "%s: Unpacking INT16 data samples\n", srcname);
 
     nsamples = msr_decode_int16 ((int16_t *)dbuf, (int)msr->samplecnt,
                                  msr->datasamples, unpacksize, swapflag);
@@ -845,7 +892,7 @@ msr_unpack_data (MSRecord *msr, int swapflag, flag verbose)
 
   case DE_INT32:
     if (verbose > 1)
-      ms_log (1, "%s: Unpacking INT32 data samples\n", srcname);
+      ms_log_l (ctx->logp, 1, "%s: Unpacking INT32 data samples\n", srcname);
 
     nsamples = msr_decode_int32 ((int32_t *)dbuf, (int)msr->samplecnt,
                                  msr->datasamples, unpacksize, swapflag);
@@ -855,7 +902,7 @@ msr_unpack_data (MSRecord *msr, int swapflag, flag verbose)
 
   case DE_FLOAT32:
     if (verbose > 1)
-      ms_log (1, "%s: Unpacking FLOAT32 data samples\n", srcname);
+      ms_log_l (ctx->logp, 1, "%s: Unpacking FLOAT32 data samples\n", srcname);
 
     nsamples = msr_decode_float32 ((float *)dbuf, (int)msr->samplecnt,
                                    msr->datasamples, unpacksize, swapflag);
@@ -865,7 +912,7 @@ msr_unpack_data (MSRecord *msr, int swapflag, flag verbose)
 
   case DE_FLOAT64:
     if (verbose > 1)
-      ms_log (1, "%s: Unpacking FLOAT64 data samples\n", srcname);
+      ms_log_l (ctx->logp, 1, "%s: Unpacking FLOAT64 data samples\n", srcname);
 
     nsamples = msr_decode_float64 ((double *)dbuf, (int)msr->samplecnt,
                                    msr->datasamples, unpacksize, swapflag);
@@ -875,10 +922,11 @@ msr_unpack_data (MSRecord *msr, int swapflag, flag verbose)
 
   case DE_STEIM1:
     if (verbose > 1)
-      ms_log (1, "%s: Unpacking Steim1 data frames\n", srcname);
+      ms_log_l (ctx->logp, 1, "%s: Unpacking Steim1 data frames\n", srcname);
 
     nsamples = msr_decode_steim1 ((int32_t *)dbuf, datasize, (int)msr->samplecnt,
-                                  msr->datasamples, unpacksize, srcname, swapflag);
+                                  msr->datasamples, unpacksize, srcname, swapflag,
+                                  ctx);
 
     if (nsamples < 0)
       return MS_GENERROR;
@@ -888,10 +936,11 @@ msr_unpack_data (MSRecord *msr, int swapflag, flag verbose)
 
   case DE_STEIM2:
     if (verbose > 1)
-      ms_log (1, "%s: Unpacking Steim2 data frames\n", srcname);
+      ms_log_l (ctx->logp, 1, "%s: Unpacking Steim2 data frames\n", srcname);
 
     nsamples = msr_decode_steim2 ((int32_t *)dbuf, datasize, (int)msr->samplecnt,
-                                  msr->datasamples, unpacksize, srcname, swapflag);
+                                  msr->datasamples, unpacksize, srcname, swapflag,
+                                  ctx);
 
     if (nsamples < 0)
       return MS_GENERROR;
@@ -905,25 +954,26 @@ msr_unpack_data (MSRecord *msr, int swapflag, flag verbose)
     if (verbose > 1)
     {
       if (msr->encoding == DE_GEOSCOPE24)
-        ms_log (1, "%s: Unpacking GEOSCOPE 24bit integer data samples\n",
+        ms_log_l (ctx->logp, 1, "%s: Unpacking GEOSCOPE 24bit integer data samples\n",
                 srcname);
       if (msr->encoding == DE_GEOSCOPE163)
-        ms_log (1, "%s: Unpacking GEOSCOPE 16bit gain ranged/3bit exponent data samples\n",
+        ms_log_l (ctx->logp, 1, "%s: Unpacking GEOSCOPE 16bit gain ranged/3bit exponent data samples\n",
                 srcname);
       if (msr->encoding == DE_GEOSCOPE164)
-        ms_log (1, "%s: Unpacking GEOSCOPE 16bit gain ranged/4bit exponent data samples\n",
+        ms_log_l (ctx->logp, 1, "%s: Unpacking GEOSCOPE 16bit gain ranged/4bit exponent data samples\n",
                 srcname);
     }
 
     nsamples = msr_decode_geoscope ((char *)dbuf, (int)msr->samplecnt, msr->datasamples,
-                                    unpacksize, msr->encoding, srcname, swapflag);
+                                    unpacksize, msr->encoding, srcname, swapflag,
+                                    ctx);
 
     msr->sampletype = 'f';
     break;
 
   case DE_CDSN:
     if (verbose > 1)
-      ms_log (1, "%s: Unpacking CDSN encoded data samples\n", srcname);
+      ms_log_l (ctx->logp, 1, "%s: Unpacking CDSN encoded data samples\n", srcname);
 
     nsamples = msr_decode_cdsn ((int16_t *)dbuf, (int)msr->samplecnt, msr->datasamples,
                                 unpacksize, swapflag);
@@ -933,17 +983,17 @@ msr_unpack_data (MSRecord *msr, int swapflag, flag verbose)
 
   case DE_SRO:
     if (verbose > 1)
-      ms_log (1, "%s: Unpacking SRO encoded data samples\n", srcname);
+      ms_log_l (ctx->logp, 1, "%s: Unpacking SRO encoded data samples\n", srcname);
 
     nsamples = msr_decode_sro ((int16_t *)dbuf, (int)msr->samplecnt, msr->datasamples,
-                               unpacksize, srcname, swapflag);
+                               unpacksize, srcname, swapflag, ctx);
 
     msr->sampletype = 'i';
     break;
 
   case DE_DWWSSN:
     if (verbose > 1)
-      ms_log (1, "%s: Unpacking DWWSSN encoded data samples\n", srcname);
+      ms_log_l (ctx->logp, 1, "%s: Unpacking DWWSSN encoded data samples\n", srcname);
 
     nsamples = msr_decode_dwwssn ((int16_t *)dbuf, (int)msr->samplecnt, msr->datasamples,
                                   unpacksize, swapflag);
@@ -952,7 +1002,7 @@ msr_unpack_data (MSRecord *msr, int swapflag, flag verbose)
     break;
 
   default:
-    ms_log (2, "%s: Unsupported encoding format %d (%s)\n",
+    ms_log_l (ctx->logp, 2, "%s: Unsupported encoding format %d (%s)\n",
             srcname, msr->encoding, (char *)ms_encodingstr (msr->encoding));
 
     return MS_UNKNOWNFORMAT;
@@ -960,28 +1010,66 @@ msr_unpack_data (MSRecord *msr, int swapflag, flag verbose)
 
   if (nsamples != msr->samplecnt)
   {
-    ms_log (2, "msr_unpack_data(%s): only decoded %d samples of %d expected\n",
+    ms_log_l (ctx->logp, 2, "msr_unpack_data(%s): only decoded %d samples of %d expected\n",
             srcname, nsamples, msr->samplecnt);
     return MS_GENERROR;
   }
 
   return nsamples;
-} /* End of msr_unpack_data() */
+} /* End of msr_unpack_data_main() */
+
+/************************************************************************
+ *  ms_unpackctx_init:
+ *
+ *  Initialize an unpacking context for msr_unpack_ctx().  The byte
+ *  order and encoding overrides are resolved from the global variables
+ *  or the UNPACK_* environment variables and the debugging flag from
+ *  the DECODE_DEBUG environment variable.  Logging uses the global
+ *  parameters unless ctx->logp is set after initialization.
+ *
+ *  The context holds no allocated memory and needs no release.
+ *
+ *  Return 0 on success and -1 on error.
+ ************************************************************************/
+int
+ms_unpackctx_init (MSUnpackContext *ctx, flag verbose)
+{
+  if (!ctx)
+    return -1;
+
+  memset (ctx, 0, sizeof (MSUnpackContext));
+
+  if (check_environment (ctx, verbose))
+    return -1;
+
+  /* Check for decode debugging environment variable */
+  ctx->decodedebug = (getenv ("DECODE_DEBUG")) ? 1 : 0;
+
+  return 0;
+} /* End of ms_unpackctx_init() */
 
 /************************************************************************
  *  check_environment:
  *
- *  Check environment variables and set global variables appropriately.
+ *  Determine the byte orders and encodings forced by the global
+ *  variables or, when those are not set, by environment variables,
+ *  and store them in an unpacking context.  Nothing global is
+ *  modified so concurrent unpacking in multiple threads is safe.
  *
  *  Return 0 on success and -1 on error.
  ************************************************************************/
 static int
-check_environment (int verbose)
+check_environment (MSUnpackContext *ctx, int verbose)
 {
   char *envvariable;
 
+  ctx->headerbyteorder  = unpackheaderbyteorder;
+  ctx->databyteorder    = unpackdatabyteorder;
+  ctx->encodingformat   = unpackencodingformat;
+  ctx->encodingfallback = unpackencodingfallback;
+
   /* Read possible environmental variables that force byteorder */
-  if (unpackheaderbyteorder == -2)
+  if (ctx->headerbyteorder == -2)
   {
     if ((envvariable = getenv ("UNPACK_HEADER_BYTEORDER")))
     {
@@ -992,24 +1080,24 @@ check_environment (int verbose)
       }
       else if (*envvariable == '0')
       {
-        unpackheaderbyteorder = 0;
+        ctx->headerbyteorder = 0;
         if (verbose > 2)
           ms_log (1, "UNPACK_HEADER_BYTEORDER=0, unpacking little-endian header\n");
       }
       else
       {
-        unpackheaderbyteorder = 1;
+        ctx->headerbyteorder = 1;
         if (verbose > 2)
           ms_log (1, "UNPACK_HEADER_BYTEORDER=1, unpacking big-endian header\n");
       }
     }
     else
     {
-      unpackheaderbyteorder = -1;
+      ctx->headerbyteorder = -1;
     }
   }
 
-  if (unpackdatabyteorder == -2)
+  if (ctx->databyteorder == -2)
   {
     if ((envvariable = getenv ("UNPACK_DATA_BYTEORDER")))
     {
@@ -1020,64 +1108,64 @@ check_environment (int verbose)
       }
       else if (*envvariable == '0')
       {
-        unpackdatabyteorder = 0;
+        ctx->databyteorder = 0;
         if (verbose > 2)
           ms_log (1, "UNPACK_DATA_BYTEORDER=0, unpacking little-endian data samples\n");
       }
       else
       {
-        unpackdatabyteorder = 1;
+        ctx->databyteorder = 1;
         if (verbose > 2)
           ms_log (1, "UNPACK_DATA_BYTEORDER=1, unpacking big-endian data samples\n");
       }
     }
     else
     {
-      unpackdatabyteorder = -1;
+      ctx->databyteorder = -1;
     }
   }
 
   /* Read possible environmental variable that forces encoding format */
-  if (unpackencodingformat == -2)
+  if (ctx->encodingformat == -2)
   {
     if ((envvariable = getenv ("UNPACK_DATA_FORMAT")))
     {
-      unpackencodingformat = (int)strtol (envvariable, NULL, 10);
+      ctx->encodingformat = (int)strtol (envvariable, NULL, 10);
 
-      if (unpackencodingformat < 0 || unpackencodingformat > 33)
+      if (ctx->encodingformat < 0 || ctx->encodingformat > 33)
       {
-        ms_log (2, "Environment variable UNPACK_DATA_FORMAT set to invalid value: '%d'\n", unpackencodingformat);
+        ms_log (2, "Environment variable UNPACK_DATA_FORMAT set to invalid value: '%d'\n", ctx->encodingformat);
         return -1;
       }
       else if (verbose > 2)
-        ms_log (1, "UNPACK_DATA_FORMAT, unpacking data in encoding format %d\n", unpackencodingformat);
+        ms_log (1, "UNPACK_DATA_FORMAT, unpacking data in encoding format %d\n", ctx->encodingformat);
     }
     else
     {
-      unpackencodingformat = -1;
+      ctx->encodingformat = -1;
     }
   }
 
   /* Read possible environmental variable to be used as a fallback encoding format */
-  if (unpackencodingfallback == -2)
+  if (ctx->encodingfallback == -2)
   {
     if ((envvariable = getenv ("UNPACK_DATA_FORMAT_FALLBACK")))
     {
-      unpackencodingfallback = (int)strtol (envvariable, NULL, 10);
+      ctx->encodingfallback = (int)strtol (envvariable, NULL, 10);
 
-      if (unpackencodingfallback < 0 || unpackencodingfallback > 33)
+      if (ctx->encodingfallback < 0 || ctx->encodingfallback > 33)
       {
         ms_log (2, "Environment variable UNPACK_DATA_FORMAT_FALLBACK set to invalid value: '%d'\n",
-                unpackencodingfallback);
+                ctx->encodingfallback);
         return -1;
       }
       else if (verbose > 2)
         ms_log (1, "UNPACK_DATA_FORMAT_FALLBACK, fallback data unpacking encoding format %d\n",
-                unpackencodingfallback);
+                ctx->encodingfallback);
     }
     else
     {
-      unpackencodingfallback = 10; /* Default fallback is Steim-1 encoding */
+      ctx->encodingfallback = 10; /* Default fallback is Steim-1 encoding */
     }
   }
 
@@ -13,9 +13,6 @@
 #include "libmseed.h"
 #include "unpackdata.h"
 
-/* Control for printing debugging information */
-int decodedebug = 0;
-
 /* Extract bit range.  Byte order agnostic & defined when used with unsigned values */
 #define EXTRACTBITRANGE(VALUE, STARTBIT, LENGTH) ((VALUE >> STARTBIT) & ((1U << LENGTH) - 1))
 
@@ -72,7 +69,6 @@ int
 msr_decode_int32 (int32_t *input, int samplecount, int32_t *output,
                   int outputlength, int swapflag)
 {
-  int32_t sample;
   int idx;
 
   if (samplecount <= 0)
@@ -81,17 +77,15 @@ msr_decode_int32 (int32_t *input, int samplecount, int32_t *output,
   if (!input || !output || outputlength <= 0)
     return -1;
 
-  for (idx = 0; idx < samplecount && outputlength >= (int)sizeof (int32_t); idx++)
-  {
-    sample = input[idx];
-
-    if (swapflag)
-      ms_gswap4a (&sample);
+  /* Determine number of samples that fit in the output buffer */
+  idx = outputlength / (int)sizeof (int32_t);
+  if (idx > samplecount)
+    idx = samplecount;
 
-    output[idx] = sample;
-
-    outputlength -= sizeof (int32_t);
-  }
+  if (swapflag)
+    ms_gswap4n (output, input, idx);
+  else
+    memcpy (output, input, idx * sizeof (int32_t));
 
   return idx;
 } /* End of msr_decode_int32() */
@@ -108,7 +102,6 @@ int
 msr_decode_float32 (float *input, int samplecount, float *output,
                     int outputlength, int swapflag)
 {
-  float sample;
   int idx;
 
   if (samplecount <= 0)
@@ -117,17 +110,15 @@ msr_decode_float32 (float *input, int samplecount, float *output,
   if (!input || !output || outputlength <= 0)
     return -1;
 
-  for (idx = 0; idx < samplecount && outputlength >= (int)sizeof (float); idx++)
-  {
-    memcpy (&sample, &input[idx], sizeof (float));
+  /* Determine number of samples that fit in the output buffer */
+  idx = outputlength / (int)sizeof (float);
+  if (idx > samplecount)
+    idx = samplecount;
 
-    if (swapflag)
-      ms_gswap4a (&sample);
-
-    output[idx] = sample;
-
-    outputlength -= sizeof (float);
-  }
+  if (swapflag)
+    ms_gswap4n (output, input, idx);
+  else
+    memcpy (output, input, idx * sizeof (float));
 
   return idx;
 } /* End of msr_decode_float32() */
@@ -144,7 +135,6 @@ int
 msr_decode_float64 (double *input, int samplecount, double *output,
                     int outputlength, int swapflag)
 {
-  double sample;
   int idx;
 
   if (samplecount <= 0)
@@ -153,17 +143,15 @@ msr_decode_float64 (double *input, int samplecount, double *output,
   if (!input || !output || outputlength <= 0)
     return -1;
 
-  for (idx = 0; idx < samplecount && outputlength >= (int)sizeof (double); idx++)
-  {
-    memcpy (&sample, &input[idx], sizeof (double));
-
-    if (swapflag)
-      ms_gswap8a (&sample);
-
-    output[idx] = sample;
+  /* Determine number of samples that fit in the output buffer */
+  idx = outputlength / (int)sizeof (double);
+  if (idx > samplecount)
+    idx = samplecount;
 
-    outputlength -= sizeof (double);
-  }
+  if (swapflag)
+    ms_gswap8n (output, input, idx);
+  else
+    memcpy (output, input, idx * sizeof (double));
 
   return idx;
 } /* End of msr_decode_float64() */
@@ -172,14 +160,15 @@ msr_decode_float64 (double *input, int samplecount, double *output,
  * msr_decode_steim1:
  *
  * Decode Steim1 encoded miniSEED data and place in supplied buffer
- * as 32-bit integers.
+ * as 32-bit integers.  Debugging output and logging are controlled by
+ * the unpacking context, which may be NULL.
  *
  * Return number of samples in output buffer on success, -1 on error.
  ************************************************************************/
 int
 msr_decode_steim1 (int32_t *input, int inputlength, int samplecount,
                    int32_t *output, int outputlength, char *srcname,
-                   int swapflag)
+                   int swapflag, MSUnpackContext *ctx)
 {
   int32_t *outputptr = output; /* Pointer to next output sample location */
   uint32_t frame[16];          /* Frame, 16 x 32-bit quantities = 64 bytes */
@@ -192,6 +181,8 @@ msr_decode_steim1 (int32_t *input, int inputlength, int samplecount,
   int widx;
   int diffcount;
   int idx;
+  int decodedebug;
+  MSLogParam *logp;
 
   union dword {
     int8_t d8[4];
@@ -205,8 +196,12 @@ msr_decode_steim1 (int32_t *input, int inputlength, int samplecount,
   if (!input || !output || outputlength <= 0 || maxframes <= 0)
     return -1;
 
+  /* Debugging and logging as set in the unpacking context */
+  decodedebug = (ctx) ? ctx->decodedebug : 0;
+  logp        = (ctx) ? ctx->logp : NULL;
+
   if (decodedebug)
-    ms_log (1, "Decoding %d Steim1 frames, swapflag: %d, srcname: %s\n",
+    ms_log_l (logp, 1, "Decoding %d Steim1 frames, swapflag: %d, srcname: %s\n",
             maxframes, swapflag, (srcname) ? srcname : "");
 
   for (frameidx = 0; frameidx < maxframes && samplecount > 0; frameidx++)
@@ -230,14 +225,14 @@ msr_decode_steim1 (int32_t *input, int inputlength, int samplecount,
       startnibble = 3; /* First frame: skip nibbles, X0, and Xn */
 
       if (decodedebug)
-        ms_log (1, "Frame %d: X0=%d  Xn=%d\n", frameidx, X0, Xn);
+        ms_log_l (logp, 1, "Frame %d: X0=%d  Xn=%d\n", frameidx, X0, Xn);
     }
     else
     {
       startnibble = 1; /* Subsequent frames: skip nibbles */
 
       if (decodedebug)
-        ms_log (1, "Frame %d\n", frameidx);
+        ms_log_l (logp, 1, "Frame %d\n", frameidx);
     }
 
     /* Swap 32-bit word containing the nibbles */
@@ -257,14 +252,14 @@ msr_decode_steim1 (int32_t *input, int inputlength, int samplecount,
       {
       case 0: /* 00: Special flag, no differences */
         if (decodedebug)
-          ms_log (1, "  W%02d: 00=special\n", widx);
+          ms_log_l (logp, 1, "  W%02d: 00=special\n", widx);
         break;
 
       case 1: /* 01: Four 1-byte differences */
         diffcount = 4;
 
         if (decodedebug)
-          ms_log (1, "  W%02d: 01=4x8b  %d  %d  %d  %d\n",
+          ms_log_l (logp, 1, "  W%02d: 01=4x8b  %d  %d  %d  %d\n",
                   widx, word->d8[0], word->d8[1], word->d8[2], word->d8[3]);
         break;
 
@@ -278,7 +273,7 @@ msr_decode_steim1 (int32_t *input, int inputlength, int samplecount,
         }
 
         if (decodedebug)
-          ms_log (1, "  W%02d: 10=2x16b  %d  %d\n", widx, word->d16[0], word->d16[1]);
+          ms_log_l (logp, 1, "  W%02d: 10=2x16b  %d  %d\n", widx, word->d16[0], word->d16[1]);
         break;
 
       case 3: /* 11: One 4-byte difference */
@@ -287,7 +282,7 @@ msr_decode_steim1 (int32_t *input, int inputlength, int samplecount,
           ms_gswap4a (&word->d32);
 
         if (decodedebug)
-          ms_log (1, "  W%02d: 11=1x32b  %d\n", widx, word->d32);
+          ms_log_l (logp, 1, "  W%02d: 11=1x32b  %d\n", widx, word->d32);
         break;
       } /* Done with decoding 32-bit word based on nibble */
 
@@ -314,7 +309,7 @@ msr_decode_steim1 (int32_t *input, int inputlength, int samplecount,
   /* Check data integrity by comparing last sample to Xn (reverse integration constant) */
   if (outputptr != output && *(outputptr - 1) != Xn)
   {
-    ms_log (1, "%s: Warning: Data integrity check for Steim1 failed, Last sample=%d, Xn=%d\n",
+    ms_log_l (logp, 1, "%s: Warning: Data integrity check for Steim1 failed, Last sample=%d, Xn=%d\n",
             srcname, *(outputptr - 1), Xn);
   }
 
@@ -325,14 +320,15 @@ msr_decode_steim1 (int32_t *input, int inputlength, int samplecount,
  * msr_decode_steim2:
  *
  * Decode Steim2 encoded miniSEED data and place in supplied buffer
- * as 32-bit integers.
+ * as 32-bit integers.  Debugging output and logging are controlled by
+ * the unpacking context, which may be NULL.
  *
  * Return number of samples in output buffer on success, -1 on error.
  ************************************************************************/
 int
 msr_decode_steim2 (int32_t *input, int inputlength, int samplecount,
                    int32_t *output, int outputlength, char *srcname,
-                   int swapflag)
+                   int swapflag, MSUnpackContext *ctx)
 {
   int32_t *outputptr = output; /* Pointer to next output sample location */
   uint32_t frame[16];          /* Frame, 16 x 32-bit quantities = 64 bytes */
@@ -348,6 +344,8 @@ msr_decode_steim2 (int32_t *input, int inputlength, int samplecount,
   int diffcount;
   int dnib;
   int idx;
+  int decodedebug;
+  MSLogParam *logp;
 
   union dword {
     int8_t d8[4];
@@ -360,8 +358,12 @@ msr_decode_steim2 (int32_t *input, int inputlength, int samplecount,
   if (!input || !output || outputlength <= 0 || maxframes <= 0)
     return -1;
 
+  /* Debugging and logging as set in the unpacking context */
+  decodedebug = (ctx) ? ctx->decodedebug : 0;
+  logp        = (ctx) ? ctx->logp : NULL;
+
   if (decodedebug)
-    ms_log (1, "Decoding %d Steim2 frames, swapflag: %d, srcname: %s\n",
+    ms_log_l (logp, 1, "Decoding %d Steim2 frames, swapflag: %d, srcname: %s\n",
             maxframes, swapflag, (srcname) ? srcname : "");
 
   for (frameidx = 0; frameidx < maxframes && samplecount > 0; frameidx++)
@@ -385,14 +387,14 @@ msr_decode_steim2 (int32_t *input, int inputlength, int samplecount,
       startnibble = 3; /* First frame: skip nibbles, X0, and Xn */
 
       if (decodedebug)
-        ms_log (1, "Frame %d: X0=%d  Xn=%d\n", frameidx, X0, Xn);
+        ms_log_l (logp, 1, "Frame %d: X0=%d  Xn=%d\n", frameidx, X0, Xn);
     }
     else
     {
       startnibble = 1; /* Subsequent frames: skip nibbles */
 
       if (decodedebug)
-        ms_log (1, "Frame %d\n", frameidx);
+        ms_log_l (logp, 1, "Frame %d\n", frameidx);
     }
 
     /* Swap 32-bit word containing the nibbles */
@@ -410,7 +412,7 @@ msr_decode_steim2 (int32_t *input, int inputlength, int samplecount,
       {
       case 0: /* nibble=00: Special flag, no differences */
         if (decodedebug)
-          ms_log (1, "  W%02d: 00=special\n", widx);
+          ms_log_l (logp, 1, "  W%02d: 00=special\n", widx);
 
         break;
       case 1: /* nibble=01: Four 1-byte differences */
@@ -423,7 +425,7 @@ msr_decode_steim2 (int32_t *input, int inputlength, int samplecount,
         }
 
         if (decodedebug)
-          ms_log (1, "  W%02d: 01=4x8b  %d  %d  %d  %d\n", widx, diff[0], diff[1], diff[2], diff[3]);
+          ms_log_l (logp, 1, "  W%02d: 01=4x8b  %d  %d  %d  %d\n", widx, diff[0], diff[1], diff[2], diff[3]);
         break;
 
       case 2: /* nibble=10: Must consult dnib, the high order two bits */
@@ -434,7 +436,7 @@ msr_decode_steim2 (int32_t *input, int inputlength, int samplecount,
         switch (dnib)
         {
         case 0: /* nibble=10, dnib=00: Error, undefined value */
-          ms_log (2, "%s: Impossible Steim2 dnib=00 for nibble=10\n", srcname);
+          ms_log_l (logp, 2, "%s: Impossible Steim2 dnib=00 for nibble=10\n", srcname);
 
           return -1;
           break;
@@ -446,7 +448,7 @@ msr_decode_steim2 (int32_t *input, int inputlength, int samplecount,
           diff[0]   = (diff[0] ^ semask) - semask;
 
           if (decodedebug)
-            ms_log (1, "  W%02d: 10,01=1x30b  %d\n", widx, diff[0]);
+            ms_log_l (logp, 1, "  W%02d: 10,01=1x30b  %d\n", widx, diff[0]);
           break;
 
         case 2: /* nibble=10, dnib=10: Two 15-bit differences */
@@ -459,7 +461,7 @@ msr_decode_steim2 (int32_t *input, int inputlength, int samplecount,
           }
 
           if (decodedebug)
-            ms_log (1, "  W%02d: 10,10=2x15b  %d  %d\n", widx, diff[0], diff[1]);
+            ms_log_l (logp, 1, "  W%02d: 10,10=2x15b  %d  %d\n", widx, diff[0], diff[1]);
           break;
 
         case 3: /* nibble=10, dnib=11: Three 10-bit differences */
@@ -472,7 +474,7 @@ msr_decode_steim2 (int32_t *input, int inputlength, int samplecount,
           }
 
           if (decodedebug)
-            ms_log (1, "  W%02d: 10,11=3x10b  %d  %d  %d\n", widx, diff[0], diff[1], diff[2]);
+            ms_log_l (logp, 1, "  W%02d: 10,11=3x10b  %d  %d  %d\n", widx, diff[0], diff[1], diff[2]);
           break;
         }
 
@@ -495,7 +497,7 @@ msr_decode_steim2 (int32_t *input, int inputlength, int samplecount,
           }
 
           if (decodedebug)
-            ms_log (1, "  W%02d: 11,00=5x6b  %d  %d  %d  %d  %d\n",
+            ms_log_l (logp, 1, "  W%02d: 11,00=5x6b  %d  %d  %d  %d  %d\n",
                     widx, diff[0], diff[1], diff[2], diff[3], diff[4]);
           break;
 
@@ -509,7 +511,7 @@ msr_decode_steim2 (int32_t *input, int inputlength, int samplecount,
           }
 
           if (decodedebug)
-            ms_log (1, "  W%02d: 11,01=6x5b  %d  %d  %d  %d  %d  %d\n",
+            ms_log_l (logp, 1, "  W%02d: 11,01=6x5b  %d  %d  %d  %d  %d  %d\n",
                     widx, diff[0], diff[1], diff[2], diff[3], diff[4], diff[5]);
           break;
 
@@ -523,12 +525,12 @@ msr_decode_steim2 (int32_t *input, int inputlength, int samplecount,
           }
 
           if (decodedebug)
-            ms_log (1, "  W%02d: 11,10=7x4b  %d  %d  %d  %d  %d  %d  %d\n",
+            ms_log_l (logp, 1, "  W%02d: 11,10=7x4b  %d  %d  %d  %d  %d  %d  %d\n",
                     widx, diff[0], diff[1], diff[2], diff[3], diff[4], diff[5], diff[6]);
           break;
 
         case 3: /* nibble=11, dnib=11: Error, undefined value */
-          ms_log (2, "%s: Impossible Steim2 dnib=11 for nibble=11\n", srcname);
+          ms_log_l (logp, 2, "%s: Impossible Steim2 dnib=11 for nibble=11\n", srcname);
 
           return -1;
           break;
@@ -556,7 +558,7 @@ msr_decode_steim2 (int32_t *input, int inputlength, int samplecount,
   /* Check data integrity by comparing last sample to Xn (reverse integration constant) */
   if (outputptr != output && *(outputptr - 1) != Xn)
   {
-    ms_log (1, "%s: Warning: Data integrity check for Steim2 failed, Last sample=%d, Xn=%d\n",
+    ms_log_l (logp, 1, "%s: Warning: Data integrity check for Steim2 failed, Last sample=%d, Xn=%d\n",
             srcname, *(outputptr - 1), Xn);
   }
 
@@ -580,7 +582,7 @@ msr_decode_steim2 (int32_t *input, int inputlength, int samplecount,
 int
 msr_decode_geoscope (char *input, int samplecount, float *output,
                      int outputlength, int encoding,
-                     char *srcname, int swapflag)
+                     char *srcname, int swapflag, MSUnpackContext *ctx)
 {
   int idx = 0;
   int mantissa;  /* mantissa from SEED data */
@@ -607,7 +609,7 @@ msr_decode_geoscope (char *input, int samplecount, float *output,
       encoding != DE_GEOSCOPE163 &&
       encoding != DE_GEOSCOPE164)
   {
-    ms_log (2, "msr_decode_geoscope(%s): unrecognized GEOSCOPE encoding: %d\n",
+    ms_log_l ((ctx) ? ctx->logp : NULL, 2, "msr_decode_geoscope(%s): unrecognized GEOSCOPE encoding: %d\n",
             srcname, encoding);
     return -1;
   }
@@ -821,7 +823,8 @@ msr_decode_cdsn (int16_t *input, int samplecount, int32_t *output,
  ************************************************************************/
 int
 msr_decode_sro (int16_t *input, int samplecount, int32_t *output,
-                int outputlength, char *srcname, int swapflag)
+                int outputlength, char *srcname, int swapflag,
+                MSUnpackContext *ctx)
 {
   int32_t idx = 0;
   int32_t mantissa;   /* mantissa */
@@ -859,7 +862,7 @@ msr_decode_sro (int16_t *input, int samplecount, int32_t *output,
 
     if (exponent < 0 || exponent > 10)
     {
-      ms_log (2, "msr_decode_sro(%s): SRO gain ranging exponent out of range: %d\n",
+      ms_log_l ((ctx) ? ctx->logp : NULL, 2, "msr_decode_sro(%s): SRO gain ranging exponent out of range: %d\n",
               srcname, exponent);
       return MS_GENERROR;
     }
@@ -14,9 +14,6 @@
 extern "C" {
 #endif
 
-/* Control for printing debugging information, declared in unpackdata.c */
-extern int decodedebug;
-
 extern int msr_decode_int16 (int16_t *input, int samplecount, int32_t *output,
                              int outputlength, int swapflag);
 extern int msr_decode_int32 (int32_t *input, int samplecount, int32_t *output,
@@ -27,17 +24,18 @@ extern int msr_decode_float64 (double *input, int samplecount, double *output,
                                int outputlength, int swapflag);
 extern int msr_decode_steim1 (int32_t *input, int inputlength, int samplecount,
                               int32_t *output, int outputlength, char *srcname,
-                              int swapflag);
+                              int swapflag, MSUnpackContext *ctx);
 extern int msr_decode_steim2 (int32_t *input, int inputlength, int samplecount,
                               int32_t *output, int outputlength, char *srcname,
-                              int swapflag);
+                              int swapflag, MSUnpackContext *ctx);
 extern int msr_decode_geoscope (char *input, int samplecount, float *output,
                                 int outputlength, int encoding, char *srcname,
-                                int swapflag);
+                                int swapflag, MSUnpackContext *ctx);
 extern int msr_decode_cdsn (int16_t *input, int samplecount, int32_t *output,
                             int outputlength, int swapflag);
 extern int msr_decode_sro (int16_t *input, int samplecount, int32_t *output,
-                           int outputlength, char *srcname, int swapflag);
+                           int outputlength, char *srcname, int swapflag,
+                           MSUnpackContext *ctx);
 extern int msr_decode_dwwssn (int16_t *input, int samplecount, int32_t *output,
                               int outputlength, int swapflag);
 
@@ -19,11 +19,20 @@ INCS = -I..\libmseed
 
 all: $(BIN)
 
-$(BIN):	sac2mseed.obj
-	wlink $(lflags) name $(BIN) file {sac2mseed.obj}
+OBJS = sac2mseed.obj libsac2mseed.obj outwriter.obj prefetch.obj spscqueue.obj uring.obj walker.obj watch.obj
+
+$(BIN):	$(OBJS)
+	wlink $(lflags) name $(BIN) file {$(OBJS)}
 
 # Source dependencies:
-sac2mseed.obj:	sac2mseed.c
+sac2mseed.obj:	sac2mseed.c sac2mseed.h libsac2mseed.h outwriter.h prefetch.h walker.h watch.h
+libsac2mseed.obj:	libsac2mseed.c libsac2mseed.h
+outwriter.obj:	outwriter.c sac2mseed.h outwriter.h spscqueue.h
+prefetch.obj:	prefetch.c sac2mseed.h prefetch.h spscqueue.h uring.h walker.h
+spscqueue.obj:	spscqueue.c sac2mseed.h spscqueue.h
+uring.obj:	uring.c sac2mseed.h uring.h
+walker.obj:	walker.c sac2mseed.h walker.h
+watch.obj:	watch.c sac2mseed.h walker.h watch.h
 
 # How to compile sources:
 .c.obj:
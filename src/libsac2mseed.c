@@ -0,0 +1,1749 @@
+/***************************************************************************
+ * libsac2mseed.c
+ *
+ * SAC to miniSEED conversion library, see libsac2mseed.h.
+ *
+ * SAC files are parsed from memory buffers, autodetecting the format
+ * dialect (ALPHA, binary, big or little endian), and the data samples
+ * are scaled and packed into records using a record template for each
+ * trace of a conversion context.
+ ***************************************************************************/
+
+#include <float.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libsac2mseed.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define S2M_SSE2 1
+#endif
+
+/* Large ALPHA data sections are parsed by multiple threads */
+#if !defined(LMP_WIN)
+#include <pthread.h>
+#include <unistd.h>
+#define S2M_THREADS 1
+#endif
+
+/* Minimum size of, and maximum number of, ALPHA data section chunks
+ * parsed by separate threads */
+#define ALPHACHUNK (4 * 1024 * 1024)
+#define ALPHAMAXCHUNKS 64
+
+/* A range of lines in the data section of a SAC ALPHA file */
+struct alphachunk
+{
+  const char *start;        /* Start of first line */
+  const char *end;          /* End of last line */
+  float *data;              /* Data sample array */
+  int datacnt;              /* Number of samples expected in the file */
+  int64_t dataidx;          /* Index of the first sample in the chunk */
+  int linecnt;              /* Line number of the first line */
+  int lines;                /* Number of complete lines parsed */
+  flag complete;            /* All expected samples have been parsed */
+  const char *next;         /* Start of the line following the completing line */
+  int errorline;            /* Line number of a parsing failure, 0 if none */
+};
+
+static void logprintf (S2MContext *ctx, const char *format, ...);
+static int readbinaryheader (S2MContext *ctx, S2MSacData *data, struct SACHeader *sh,
+                             int *format, int *swapflag, const char *name);
+static int readbinarydata (S2MContext *ctx, S2MSacData *data, const char *name);
+static int readalphaheader (const char *buffer, const char *end,
+                            const char **datastart, struct SACHeader *sh);
+static int readalphadata (const char *buffer, const char *end, float *data,
+                          int datacnt, int workers);
+static void *parsealphachunk (void *arg);
+static int parsealphaline (const char *line, const char *end, float *values,
+                           int maxvalues);
+static int parsefloat (const char **cpp, const char *end, float *value);
+static void copyline (char *dest, size_t size, const char *line, const char *end);
+static const char *nextline (const char *line, const char *end,
+                             const char **lineend);
+static int swapsacheader (struct SACHeader *sh);
+
+/***************************************************************************
+ * s2m_initparams:
+ *
+ * Initialize conversion parameters to the defaults: Steim-2 encoded
+ * 4096-byte big endian records, autodetected input format and
+ * autoscaling of samples.
+ ***************************************************************************/
+void
+s2m_initparams (S2MParams *params)
+{
+  if (!params)
+    return;
+
+  memset (params, 0, sizeof (S2MParams));
+
+  params->packreclen = -1;
+  params->encoding   = DE_STEIM2;
+  params->byteorder  = -1;
+  params->workers    = 1;
+} /* End of s2m_initparams() */
+
+/***************************************************************************
+ * s2m_init:
+ *
+ * Create a conversion context with a copy of the parameters, or the
+ * defaults if params is NULL, and an empty trace group.  Packed
+ * records are passed to record_handler along with handlerdata.
+ *
+ * Returns a new context on success, and NULL on failure
+ ***************************************************************************/
+S2MContext *
+s2m_init (const S2MParams *params, void (*record_handler) (char *, int, void *),
+          void *handlerdata)
+{
+  S2MContext *ctx;
+
+  if (!(ctx = (S2MContext *)calloc (1, sizeof (S2MContext))))
+    return NULL;
+
+  if (params)
+    ctx->params = *params;
+  else
+    s2m_initparams (&ctx->params);
+
+  if (ctx->params.workers < 1)
+    ctx->params.workers = 1;
+
+  if (!(ctx->mstg = mst_initgroup (NULL)))
+  {
+    free (ctx);
+    return NULL;
+  }
+
+  /* Index the traces, merging may collect traces of many channels */
+  if (mst_groupindex (ctx->mstg, 1))
+  {
+    mst_freegroup (&ctx->mstg);
+    free (ctx);
+    return NULL;
+  }
+
+  if (ms_packctx_init (&ctx->packctx, ctx->params.verbose - 2))
+  {
+    mst_freegroup (&ctx->mstg);
+    free (ctx);
+    return NULL;
+  }
+
+  ctx->record_handler = record_handler;
+  ctx->handlerdata    = handlerdata;
+
+  return ctx;
+} /* End of s2m_init() */
+
+/***************************************************************************
+ * s2m_free:
+ *
+ * Release a conversion context, including the traces and record
+ * templates.  Samples remaining in the traces are not packed.
+ ***************************************************************************/
+void
+s2m_free (S2MContext **ppctx)
+{
+  MSTrace *mst;
+
+  if (!ppctx || !*ppctx)
+    return;
+
+  if ((*ppctx)->mstg)
+  {
+    /* Record templates are not released by mst_freegroup() */
+    for (mst = (*ppctx)->mstg->traces; mst; mst = mst->next)
+    {
+      if (mst->prvtptr)
+        msr_free ((MSRecord **)&mst->prvtptr);
+    }
+
+    mst_freegroup (&(*ppctx)->mstg);
+  }
+
+  ms_packctx_free (&(*ppctx)->packctx);
+
+  free (*ppctx);
+  *ppctx = NULL;
+} /* End of s2m_free() */
+
+/***************************************************************************
+ * s2m_convert:
+ *
+ * Convert the contents of a SAC file in buffer to records passed to
+ * the record handler of the context.  The data are added to the
+ * matching trace of the context, continuing the record sequence
+ * numbers of earlier conversions, and all traces are packed and
+ * flushed.  The name is only used to identify the input in messages.
+ *
+ * Returns number of records packed on success, and -1 on failure
+ ***************************************************************************/
+int64_t
+s2m_convert (S2MContext *ctx, const char *buffer, size_t length,
+             const char *name)
+{
+  struct SACHeader sh;
+  MSRecord *msr = 0;
+  MSTrace *mst;
+  int64_t packed;
+  int64_t records = 0;
+
+  if (!ctx || !buffer)
+    return -1;
+
+  if (s2m_sac2msr (ctx, buffer, length, name, &sh, &msr))
+    return -1;
+
+  if (!(mst = mst_addmsrtogroup (ctx->mstg, msr, 0, -1.0, -1.0)))
+  {
+    logprintf (ctx, "[%s] Error adding samples to MSTraceGroup\n", name);
+    msr_free (&msr);
+    return -1;
+  }
+
+  /* Create an MSRecord template for the MSTrace by copying the holder */
+  if (!mst->prvtptr && !(mst->prvtptr = s2m_createtemplate (ctx, msr)))
+  {
+    logprintf (ctx, "[%s] Error duplicate MSRecord for template\n", name);
+    msr_free (&msr);
+    return -1;
+  }
+
+  msr_free (&msr);
+
+  for (mst = ctx->mstg->traces; mst; mst = mst->next)
+  {
+    if ((packed = s2m_packtrace (ctx, mst, 1)) < 0)
+      return -1;
+
+    records += packed;
+  }
+
+  return records;
+} /* End of s2m_convert() */
+
+/***************************************************************************
+ * s2m_sac2msr:
+ *
+ * Parse the contents of a SAC file in buffer, scale the data samples as
+ * needed and populate a new MSRecord as a holder for the input details
+ * and data samples.  The MSRecord owns the data samples, which do not
+ * reference the buffer, and must be free'd by the caller.
+ *
+ * The context is not modified, separate threads may convert with the
+ * same context.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+int
+s2m_sac2msr (S2MContext *ctx, const char *buffer, size_t length,
+             const char *name, struct SACHeader *sh, MSRecord **ppmsr)
+{
+  MSRecord *msr = 0;
+
+  S2MSacData sd;
+  float *fdata      = 0;
+  int32_t *idata    = 0;
+  int64_t overflows = 0;
+  flag converted    = 0;
+  int encoding;
+  int datacnt;
+  long long int scaling;
+
+  if (!ctx || !sh || !ppmsr)
+    return -1;
+
+  encoding = ctx->params.encoding;
+  scaling  = ctx->params.datascaling;
+
+  memset (&sd, 0, sizeof (S2MSacData));
+
+  /* Parse SAC contents into a header structure and data buffer */
+  if ((datacnt = s2m_parseheader (ctx, &sd, buffer, length, sh, name)) < 0 ||
+      s2m_readdata (ctx, &sd, name))
+  {
+    logprintf (ctx, "Error parsing %s\n", name);
+
+    s2m_freedata (&sd);
+    return -1;
+  }
+
+  fdata = sd.samples;
+
+  if (!(msr = msr_init (msr)))
+  {
+    logprintf (ctx, "Cannot initialize MSRecord strcture\n");
+    s2m_freedata (&sd);
+    return -1;
+  }
+
+  if (encoding != 4)
+  {
+    if (!(idata = (int32_t *)malloc (datacnt * sizeof (int32_t))))
+    {
+      logprintf (ctx, "[%s] Cannot allocate memory for data samples\n", name);
+      s2m_freedata (&sd);
+      msr_free (&msr);
+      return -1;
+    }
+  }
+
+  /* Determine autoscaling */
+  if (scaling == 0 && encoding != 4)
+  {
+    float datamin = 0.0, datamax = 0.0;
+    int fractional = 0;
+
+    /* Determine data sample minimum and maximum
+     * Detect if scaling by 1 will result in truncation (fractional=1)
+     * The samples are converted to integers unscaled in the same pass,
+     * which is the final conversion when scaling by 1 */
+    overflows = s2m_scansamples (fdata, idata, datacnt, &datamin, &datamax, &fractional, 0);
+
+    scaling   = s2m_autoscale (ctx, datamin, datamax, fractional);
+    converted = !fractional;
+  }
+
+  /* Populate MSRecord structure with header details */
+  s2m_populatemsr (ctx, msr, sh);
+
+  msr->samplecnt = msr->numsamples = datacnt;
+
+  /* Data sample type and sample array */
+  if (encoding == 4)
+  {
+    /* Samples referencing the contents are copied, the record owns its samples */
+    if (sd.inplace)
+    {
+      if (!(fdata = (float *)malloc (datacnt * sizeof (float))))
+      {
+        logprintf (ctx, "[%s] Cannot allocate memory for data samples\n", name);
+        s2m_freedata (&sd);
+        msr_free (&msr);
+        return -1;
+      }
+
+      memcpy (fdata, sd.samples, datacnt * sizeof (float));
+    }
+    else
+    {
+      sd.samples = 0;
+    }
+
+    s2m_freedata (&sd);
+
+    msr->sampletype  = 'f';
+    msr->datasamples = fdata;
+  }
+  else
+  {
+    /* Create an array of scaled integers */
+    if (ctx->params.verbose)
+      logprintf (ctx, "[%s] Creating integer data scaled by: %lld\n", name, scaling);
+
+    if (!converted)
+      overflows = s2m_scalesamples (fdata, idata, datacnt, (float)scaling);
+
+    if (overflows)
+      logprintf (ctx, "[%s] WARNING %lld sample(s) outside of 32-bit integer range after scaling\n",
+                 name, (long long int)overflows);
+
+    s2m_freedata (&sd);
+
+    msr->sampletype  = 'i';
+    msr->datasamples = idata;
+  }
+
+  if (ctx->params.verbose >= 1)
+  {
+    logprintf (ctx, "[%s] %lld samps @ %.6f Hz for N: '%s', S: '%s', L: '%s', C: '%s'\n",
+               name, (long long int)msr->numsamples, msr->samprate,
+               msr->network, msr->station, msr->location, msr->channel);
+  }
+
+  *ppmsr = msr;
+
+  return 0;
+} /* End of s2m_sac2msr() */
+
+/***************************************************************************
+ * s2m_detectformat:
+ *
+ * Determine the format of SAC contents starting with buffer, if the
+ * first 4 characters are spaces the contents are assumed to be ALPHA
+ * SAC and otherwise binary SAC.  A known format is returned as is.
+ *
+ * Returns the format as described for s2m_parseheader(), and -1 if
+ * the buffer is too short.
+ ***************************************************************************/
+int
+s2m_detectformat (const char *buffer, size_t length, int format)
+{
+  if (format != 0)
+    return format;
+
+  if (!buffer || length < 4)
+    return -1;
+
+  if (buffer[0] == ' ' && buffer[1] == ' ' && buffer[2] == ' ' && buffer[3] == ' ')
+    return 1;
+
+  return 2; /* Byte order detection is done when reading the header */
+} /* End of s2m_detectformat() */
+
+/***************************************************************************
+ * s2m_parseheader:
+ *
+ * Parse the header of the SAC contents in buffer, autodetecting format
+ * dialect (ALPHA, binary, big or little endian) unless specified by
+ * the sacformat parameter, and leave the data section ready to be read
+ * by s2m_readdata() or in blocks by s2m_readblock().  The buffer must
+ * remain valid until the data have been read.
+ *
+ * For binary SAC the buffer may contain only the header, in which case
+ * the data must be read by the caller.
+ *
+ * The sacformat parameter is interpreted as:
+ * 0 : Unknown, detection needed
+ * 1 : ALPHA
+ * 2 : Binary, byte order detection needed
+ * 3 : Binary, little endian
+ * 4 : Binary, big endian
+ *
+ * Returns number of data samples in file or -1 on failure.
+ ***************************************************************************/
+int
+s2m_parseheader (S2MContext *ctx, S2MSacData *data, const char *buffer,
+                 size_t length, struct SACHeader *sh, const char *name)
+{
+  const char *alphadata = 0;
+  int swapflag = 0;
+  int verbose;
+  int format;
+  int rv;
+
+  /* Argument sanity */
+  if (!ctx || !sh || !data)
+    return -1;
+
+  memset (data, 0, sizeof (S2MSacData));
+
+  if (!buffer || length < 4)
+    return -1;
+
+  verbose        = ctx->params.verbose;
+  format         = s2m_detectformat (buffer, length, ctx->params.sacformat);
+  data->contents = buffer;
+  data->length   = length;
+
+  /* Read the header */
+  if (format == 1) /* Process SAC ALPHA header */
+  {
+    if ((rv = readalphaheader (buffer, buffer + length, &alphadata, sh)))
+    {
+      logprintf (ctx, "[%s] Error parsing SAC ALPHA header at line %d\n",
+                 name, rv);
+      return -1;
+    }
+  }
+  else if (format >= 2 && format <= 4) /* Process SAC binary header */
+  {
+    if (readbinaryheader (ctx, data, sh, &format, &swapflag, name))
+    {
+      logprintf (ctx, "[%s] Error parsing SAC header\n", name);
+      return -1;
+    }
+  }
+  else
+  {
+    logprintf (ctx, "[%s] Unrecognized format value: %d\n", name, format);
+    return -1;
+  }
+
+  /* Fix up underspecified year values by adding 1900 */
+  if (sh->nzyear >= 0 && sh->nzyear <= 200)
+  {
+    if (verbose)
+      logprintf (ctx, "[%s] Adding 1900 to underspecified year value (%d)\n", name, sh->nzyear);
+
+    sh->nzyear += 1900;
+  }
+
+  /* Sanity check the start time */
+  if (sh->nzyear < 1900 || sh->nzyear > 3000 ||
+      sh->nzjday < 1 || sh->nzjday > 366 ||
+      sh->nzhour < 0 || sh->nzhour > 23 ||
+      sh->nzmin < 0 || sh->nzmin > 59 ||
+      sh->nzsec < 0 || sh->nzsec > 60 ||
+      sh->nzmsec < 0 || sh->nzmsec > 999999)
+  {
+    logprintf (ctx, "[%s] Unrecognized format (not SAC?)\n", name);
+    return -1;
+  }
+
+  if (verbose)
+  {
+    if (format == 1)
+      logprintf (ctx, "[%s] Reading SAC ALPHA format\n", name);
+    if (format == 3)
+      logprintf (ctx, "[%s] Reading SAC binary format (little-endian)\n", name);
+    if (format == 4)
+      logprintf (ctx, "[%s] Reading SAC binary format (big-endian)\n", name);
+  }
+
+  if (verbose > 2)
+    logprintf (ctx, "[%s] SAC header version number: %d\n", name, sh->nvhdr);
+
+  if (sh->nvhdr != 6)
+  {
+    logprintf (ctx, "[%s] ERROR SAC header version (%d) not supported\n",
+               name, sh->nvhdr);
+    return -1;
+  }
+
+  if (sh->npts <= 0)
+  {
+    logprintf (ctx, "[%s] No data, number of samples: %d\n", name, sh->npts);
+    return -1;
+  }
+
+  if (sh->iftype != ITIME)
+  {
+    logprintf (ctx, "[%s] Data is not time series (IFTYPE=%d), cannot convert other types\n",
+               name, sh->iftype);
+    return -1;
+  }
+
+  if (!sh->leven)
+  {
+    logprintf (ctx, "[%s] Data is not evenly spaced (LEVEN not true), cannot convert\n", name);
+    return -1;
+  }
+
+  data->format    = format;
+  data->swapflag  = swapflag;
+  data->datacnt   = sh->npts;
+  data->alphadata = alphadata;
+  data->alphanext = alphadata;
+  data->alphaline = 31; /* Data samples start on line 31 */
+
+  return sh->npts;
+} /* End of s2m_parseheader() */
+
+/***************************************************************************
+ * s2m_readdata:
+ *
+ * Read all data samples of SAC contents, following the header parsed
+ * by s2m_parseheader(), into the sample array of data in host byte
+ * order.  For binary SAC, if no byte swapping is needed, the sample
+ * array references the contents directly.  Otherwise the sample array
+ * is allocated by this routine.  In all cases the samples must be
+ * released by the caller with s2m_freedata().
+ *
+ * Returns 0 on sucess or -1 on failure.
+ ***************************************************************************/
+int
+s2m_readdata (S2MContext *ctx, S2MSacData *data, const char *name)
+{
+  int rv;
+
+  if (!ctx || !data || !data->contents)
+    return -1;
+
+  if (data->format == 1) /* Process SAC ALPHA data */
+  {
+    if (!(data->samples = (float *)malloc (sizeof (float) * data->datacnt)))
+    {
+      logprintf (ctx, "[%s] Cannot allocate memory for data samples\n", name);
+      return -1;
+    }
+
+    if ((rv = readalphadata (data->alphadata, data->contents + data->length,
+                             data->samples, data->datacnt, ctx->params.workers)))
+    {
+      logprintf (ctx, "[%s] Error parsing SAC ALPHA data at line %d\n",
+                 name, rv);
+      return -1;
+    }
+  }
+  else /* Process SAC binary data */
+  {
+    if (readbinarydata (ctx, data, name))
+    {
+      logprintf (ctx, "[%s] Error reading SAC data samples\n", name);
+      return -1;
+    }
+  }
+
+  return 0;
+} /* End of s2m_readdata() */
+
+/***************************************************************************
+ * s2m_readblock:
+ *
+ * Read the next count data samples of SAC contents, following the
+ * header parsed by s2m_parseheader(), into a block array in host byte
+ * order.  For ALPHA files count must be a multiple of 5 unless the
+ * block ends at the last sample, so that blocks start on a new line.
+ *
+ * Returns 0 on sucess or -1 on failure.
+ ***************************************************************************/
+int
+s2m_readblock (S2MContext *ctx, S2MSacData *data, float *block,
+               int count, const char *name)
+{
+  struct alphachunk chunk;
+  const char *samples;
+  int available;
+
+  if (!ctx || !data || !data->contents || !block)
+    return -1;
+
+  if (count <= 0 || data->dataidx + count > data->datacnt)
+    return -1;
+
+  if (data->format == 1)
+  {
+    chunk.start     = data->alphanext;
+    chunk.end       = data->contents + data->length;
+    chunk.data      = block;
+    chunk.datacnt   = count;
+    chunk.dataidx   = 0;
+    chunk.linecnt   = data->alphaline;
+    chunk.lines     = 0;
+    chunk.complete  = 0;
+    chunk.next      = 0;
+    chunk.errorline = 0;
+
+    parsealphachunk (&chunk);
+
+    if (!chunk.complete)
+    {
+      logprintf (ctx, "[%s] Error parsing SAC ALPHA data at line %d\n", name,
+                 (chunk.errorline) ? chunk.errorline : chunk.linecnt + chunk.lines);
+      return -1;
+    }
+
+    data->alphanext = chunk.next;
+    data->alphaline = chunk.linecnt + chunk.lines + 1;
+  }
+  else
+  {
+    available = (int)((data->length - sizeof (struct SACHeader)) / sizeof (float));
+
+    if (data->dataidx + count > available)
+    {
+      logprintf (ctx, "[%s] Only read %d of %d expected data samples\n",
+                 name, available, data->datacnt);
+      logprintf (ctx, "[%s] Error reading SAC data samples\n", name);
+      return -1;
+    }
+
+    samples = data->contents + sizeof (struct SACHeader) + (size_t)data->dataidx * sizeof (float);
+
+    if (data->swapflag)
+      ms_gswap4n (block, samples, count);
+    else
+      memcpy (block, samples, count * sizeof (float));
+  }
+
+  data->dataidx += count;
+
+  return 0;
+} /* End of s2m_readblock() */
+
+/***************************************************************************
+ * s2m_rewind:
+ *
+ * Reset reading of data samples in blocks to the first sample.
+ ***************************************************************************/
+void
+s2m_rewind (S2MSacData *data)
+{
+  if (!data)
+    return;
+
+  data->alphanext = data->alphadata;
+  data->alphaline = 31;
+  data->dataidx   = 0;
+} /* End of s2m_rewind() */
+
+/***************************************************************************
+ * s2m_freedata:
+ *
+ * Release the data samples, if allocated, populated by s2m_readdata().
+ * The contents are owned by the caller and not released.
+ ***************************************************************************/
+void
+s2m_freedata (S2MSacData *data)
+{
+  if (!data)
+    return;
+
+  if (data->samples && !data->inplace)
+    free (data->samples);
+
+  memset (data, 0, sizeof (S2MSacData));
+} /* End of s2m_freedata() */
+
+/***************************************************************************
+ * s2m_packtrace:
+ *
+ * Pack a single trace using the per-MSTrace template, passing records
+ * to the record handler of the context.  Unless flush is true samples
+ * that do not fill a complete record are left in the trace.
+ *
+ * Returns number of records packed on success, and -1 on failure
+ ***************************************************************************/
+int64_t
+s2m_packtrace (S2MContext *ctx, MSTrace *mst, flag flush)
+{
+  int64_t trpackedsamples = 0;
+  int64_t trpackedrecords = 0;
+
+  if (!ctx || !mst)
+    return -1;
+
+  if (mst->numsamples <= 0)
+    return 0;
+
+  trpackedrecords = mst_pack_ctx (mst, ctx->record_handler, ctx->handlerdata,
+                                  ctx->params.packreclen, ctx->params.encoding,
+                                  ctx->params.byteorder, &trpackedsamples, flush,
+                                  ctx->params.verbose - 2, (MSRecord *)mst->prvtptr,
+                                  &ctx->packctx);
+
+  if (trpackedrecords < 0)
+  {
+    logprintf (ctx, "Error packing data\n");
+    return -1;
+  }
+
+  ctx->packedrecords += trpackedrecords;
+  ctx->packedsamples += trpackedsamples;
+
+  return trpackedrecords;
+} /* End of s2m_packtrace() */
+
+/***************************************************************************
+ * s2m_populatemsr:
+ *
+ * Populate the source name, start time and sample rate of an MSRecord
+ * from a SAC header and any codes overriding the header in the
+ * parameters.
+ ***************************************************************************/
+void
+s2m_populatemsr (S2MContext *ctx, MSRecord *msr, struct SACHeader *sh)
+{
+  if (strncmp (SUNDEF, sh->knetwk, 8))
+    ms_strncpclean (msr->network, sh->knetwk, 2);
+  if (strncmp (SUNDEF, sh->kstnm, 8))
+    ms_strncpclean (msr->station, sh->kstnm, 5);
+  if (strncmp (SUNDEF, sh->khole, 8))
+    ms_strncpclean (msr->location, sh->khole, 2);
+  if (strncmp (SUNDEF, sh->kcmpnm, 8))
+    ms_strncpclean (msr->channel, sh->kcmpnm, 3);
+
+  if (ctx->params.forcenet)
+    ms_strncpclean (msr->network, ctx->params.forcenet, 2);
+
+  if (ctx->params.forcesta)
+    ms_strncpclean (msr->station, ctx->params.forcesta, 5);
+
+  if (ctx->params.forceloc)
+    ms_strncpclean (msr->location, ctx->params.forceloc, 2);
+
+  if (ctx->params.forcechan)
+  {
+    const char *forcechan = ctx->params.forcechan;
+    int idx = 0;
+    while (forcechan[idx] && idx < (sizeof (msr->channel) - 1))
+    {
+      if (forcechan[idx] != '.')
+        msr->channel[idx] = forcechan[idx];
+      idx++;
+    }
+    msr->channel[idx] = '\0';
+  }
+
+  msr->starttime = ms_time2hptime (sh->nzyear, sh->nzjday, sh->nzhour, sh->nzmin, sh->nzsec, sh->nzmsec * 1000);
+
+  /* Adjust for Begin ('B' SAC variable) time offset */
+  if (sh->b != FUNDEF)
+    msr->starttime += (double)sh->b * HPTMODULUS;
+
+  /* Calculate sample rate from interval(period) rounding to nearest 0.000001 Hz */
+  msr->samprate = (double)((int)((1 / sh->delta) * 100000 + 0.5)) / 100000;
+} /* End of s2m_populatemsr() */
+
+/***************************************************************************
+ * s2m_autoscale:
+ *
+ * Determine the factor that scales the largest sample to 6 digits when
+ * the samples have fractional parts, warning if the smallest sample
+ * would then lose most of its precision.
+ *
+ * Returns the scaling factor.
+ ***************************************************************************/
+long long int
+s2m_autoscale (S2MContext *ctx, float datamin, float datamax, int fractional)
+{
+  long long int scaling = 1;
+
+  if (fractional)
+  {
+    for (scaling = 1; abs ((int32_t)(datamax * scaling)) < 100000; scaling *= 10)
+    {
+    }
+
+    if (abs ((int32_t)(datamin * scaling)) < 10)
+      logprintf (ctx, "WARNING Large sample value range (%g/%g), autoscaling might be a bad idea\n",
+               datamax, datamin);
+  }
+
+  return scaling;
+} /* End of s2m_autoscale() */
+
+/***************************************************************************
+ * s2m_scansamples:
+ *
+ * Determine the minimum and maximum of an array of float samples and
+ * if any sample after the first has a positive fractional part larger
+ * than 0.000001, while converting the samples to integers without
+ * scaling.  The results are identical to testing and truncating each
+ * sample individually, vector instructions are used when available.
+ *
+ * If continued is true the scan continues from the datamin, datamax
+ * and fractional results of a previous block of samples and the first
+ * sample is tested like any other.
+ *
+ * Returns the number of samples outside of the 32-bit integer range.
+ ***************************************************************************/
+int64_t
+s2m_scansamples (const float *fdata, int32_t *idata, int datacnt,
+             float *datamin, float *datamax, int *fractional,
+             flag continued)
+{
+  /* Largest float that is not greater than 0.000001 */
+  const float threshold = (float)0.000001;
+  float minimum;
+  float maximum;
+  float sample;
+  int64_t overflows = 0;
+  int frac          = 0;
+  int idx           = 0;
+
+  if (datacnt <= 0)
+    return 0;
+
+  if (continued)
+  {
+    minimum = *datamin;
+    maximum = *datamax;
+    frac    = *fractional;
+  }
+  else
+  {
+    minimum = maximum = fdata[0];
+    idata[0]          = (int32_t)fdata[0];
+    if (!(fdata[0] >= -2147483648.0f && fdata[0] < 2147483648.0f))
+      overflows++;
+
+    idx = 1;
+  }
+
+#if defined(S2M_SSE2)
+  if (datacnt - idx >= 4)
+  {
+    float startmin = minimum;
+    float startmax = maximum;
+    int startidx   = idx;
+    __m128 vmin    = _mm_set1_ps (minimum);
+    __m128 vmax    = _mm_set1_ps (maximum);
+    __m128 vthresh = _mm_set1_ps (threshold);
+    __m128 vlow    = _mm_set1_ps (-2147483648.0f);
+    __m128 vhigh   = _mm_set1_ps (2147483648.0f);
+    __m128 vfrac   = _mm_setzero_ps ();
+    __m128i vover  = _mm_setzero_si128 ();
+    float lanes[4];
+    int32_t counts[4];
+    int lane;
+
+    for (; idx + 4 <= datacnt; idx += 4)
+    {
+      __m128 v  = _mm_loadu_ps (fdata + idx);
+      __m128i t = _mm_cvttps_epi32 (v);
+
+      /* Operand order keeps the current value when a sample is NaN */
+      vmin = _mm_min_ps (v, vmin);
+      vmax = _mm_max_ps (v, vmax);
+
+      vfrac = _mm_or_ps (vfrac, _mm_cmpgt_ps (_mm_sub_ps (v, _mm_cvtepi32_ps (t)), vthresh));
+
+      /* Subtracting the all-ones comparison mask counts out of range samples */
+      vover = _mm_sub_epi32 (vover, _mm_castps_si128 (_mm_or_ps (_mm_cmpnge_ps (v, vlow),
+                                                                 _mm_cmpnlt_ps (v, vhigh))));
+
+      _mm_storeu_si128 ((__m128i *)(idata + idx), t);
+    }
+
+    _mm_storeu_ps (lanes, vmin);
+    for (lane = 0; lane < 4; lane++)
+      if (lanes[lane] < minimum)
+        minimum = lanes[lane];
+
+    _mm_storeu_ps (lanes, vmax);
+    for (lane = 0; lane < 4; lane++)
+      if (lanes[lane] > maximum)
+        maximum = lanes[lane];
+
+    _mm_storeu_si128 ((__m128i *)counts, vover);
+    for (lane = 0; lane < 4; lane++)
+      overflows += (uint32_t)counts[lane];
+
+    if (_mm_movemask_ps (vfrac))
+      frac = 1;
+
+    /* The sign of a zero extreme depends on the order of comparisons,
+     * determine it as a sequential scan would */
+    if (minimum == 0.0f || maximum == 0.0f)
+    {
+      int scanidx;
+
+      minimum = startmin;
+      maximum = startmax;
+      for (scanidx = startidx; scanidx < idx; scanidx++)
+      {
+        if (fdata[scanidx] < minimum)
+          minimum = fdata[scanidx];
+        if (fdata[scanidx] > maximum)
+          maximum = fdata[scanidx];
+      }
+    }
+  }
+#endif
+
+  for (; idx < datacnt; idx++)
+  {
+    sample = fdata[idx];
+
+    if (sample < minimum)
+      minimum = sample;
+    if (sample > maximum)
+      maximum = sample;
+
+    idata[idx] = (int32_t)sample;
+
+    if (!frac)
+      if (sample - (int)sample > 0.000001)
+        frac = 1;
+
+    if (!(sample >= -2147483648.0f && sample < 2147483648.0f))
+      overflows++;
+  }
+
+  *datamin    = minimum;
+  *datamax    = maximum;
+  *fractional = frac;
+
+  return overflows;
+} /* End of s2m_scansamples() */
+
+/***************************************************************************
+ * s2m_scalesamples:
+ *
+ * Convert an array of float samples to integers after multiplying by
+ * a scale factor, vector instructions are used when available.
+ *
+ * Returns the number of samples outside of the 32-bit integer range.
+ ***************************************************************************/
+int64_t
+s2m_scalesamples (const float *fdata, int32_t *idata, int datacnt, float scale)
+{
+  int64_t overflows = 0;
+  float sample;
+  int idx = 0;
+
+#if defined(S2M_SSE2)
+  if (datacnt >= 4)
+  {
+    __m128 vscale = _mm_set1_ps (scale);
+    __m128 vlow   = _mm_set1_ps (-2147483648.0f);
+    __m128 vhigh  = _mm_set1_ps (2147483648.0f);
+    __m128i vover = _mm_setzero_si128 ();
+    int32_t counts[4];
+    int lane;
+
+    for (; idx + 4 <= datacnt; idx += 4)
+    {
+      __m128 v = _mm_mul_ps (_mm_loadu_ps (fdata + idx), vscale);
+
+      vover = _mm_sub_epi32 (vover, _mm_castps_si128 (_mm_or_ps (_mm_cmpnge_ps (v, vlow),
+                                                                 _mm_cmpnlt_ps (v, vhigh))));
+
+      _mm_storeu_si128 ((__m128i *)(idata + idx), _mm_cvttps_epi32 (v));
+    }
+
+    _mm_storeu_si128 ((__m128i *)counts, vover);
+    for (lane = 0; lane < 4; lane++)
+      overflows += (uint32_t)counts[lane];
+  }
+#endif
+
+  for (; idx < datacnt; idx++)
+  {
+    sample     = fdata[idx] * scale;
+    idata[idx] = (int32_t)sample;
+
+    if (!(sample >= -2147483648.0f && sample < 2147483648.0f))
+      overflows++;
+  }
+
+  return overflows;
+} /* End of s2m_scalesamples() */
+
+/***************************************************************************
+ * s2m_createtemplate:
+ *
+ * Create an MSRecord template for packing a trace by duplicating the
+ * input holder and adding blockettes 1000, 1001 and, if requested,
+ * 100.
+ *
+ * Returns a new MSRecord on success, and NULL on failure
+ ***************************************************************************/
+MSRecord *
+s2m_createtemplate (S2MContext *ctx, MSRecord *msr)
+{
+  MSRecord *mstemplate;
+  struct blkt_1000_s Blkt1000;
+  struct blkt_1001_s Blkt1001;
+  struct blkt_100_s Blkt100;
+
+  if (!(mstemplate = msr_duplicate (msr, 0)))
+    return NULL;
+
+  /* Add blockettes 1000 & 1001 to template */
+  memset (&Blkt1000, 0, sizeof (struct blkt_1000_s));
+  msr_addblockette (mstemplate, (char *)&Blkt1000,
+                    sizeof (struct blkt_1001_s), 1000, 0);
+  memset (&Blkt1001, 0, sizeof (struct blkt_1001_s));
+  msr_addblockette (mstemplate, (char *)&Blkt1001,
+                    sizeof (struct blkt_1001_s), 1001, 0);
+
+  /* Add blockette 100 to template if requested */
+  if (ctx->params.srateblkt)
+  {
+    memset (&Blkt100, 0, sizeof (struct blkt_100_s));
+    Blkt100.samprate = (float)msr->samprate;
+    msr_addblockette (mstemplate, (char *)&Blkt100,
+                      sizeof (struct blkt_100_s), 100, 0);
+  }
+
+  return mstemplate;
+} /* End of s2m_createtemplate() */
+
+/***************************************************************************
+ * readbinaryheader:
+ *
+ * Copy a binary header from SAC contents and parse into a SAC header
+ * struct.  Also determines byte order and sets the swap flag unless
+ * already dictated by the format.
+ *
+ * Returns 0 on sucess or -1 on failure.
+ ***************************************************************************/
+static int
+readbinaryheader (S2MContext *ctx, S2MSacData *data, struct SACHeader *sh,
+                  int *format, int *swapflag, const char *name)
+{
+  int bigendianhost;
+  int32_t hdrver;
+
+  if (data->length < sizeof (struct SACHeader))
+  {
+    logprintf (ctx, "[%s] Could not read SAC header from file\n", name);
+    return -1;
+  }
+
+  memcpy (sh, data->contents, sizeof (struct SACHeader));
+
+  /* Determine if host is big-endian */
+  bigendianhost = ms_bigendianhost ();
+
+  *swapflag = 0;
+
+  /* Test byte order using the header version if unknown */
+  /* Also set the swapflag appropriately */
+  if (*format == 2)
+  {
+    memcpy (&hdrver, &sh->nvhdr, 4);
+    if (hdrver < 1 || hdrver > 10)
+    {
+      ms_gswap4 (&hdrver);
+      if (hdrver < 1 || hdrver > 10)
+      {
+        logprintf (ctx, "[%s] Cannot determine byte order (not SAC?)\n", name);
+        return -1;
+      }
+
+      *format   = (bigendianhost) ? 3 : 4;
+      *swapflag = 1;
+    }
+    else
+    {
+      *format = (bigendianhost) ? 4 : 3;
+    }
+  }
+  else if (*format == 3 && bigendianhost)
+    *swapflag = 1;
+  else if (*format == 4 && !bigendianhost)
+    *swapflag = 1;
+
+  if (ctx->params.verbose > 1)
+  {
+    if (*swapflag)
+      logprintf (ctx, "[%s] Byte swapping required\n", name);
+    else
+      logprintf (ctx, "[%s] Byte swapping NOT required\n", name);
+  }
+
+  /* Byte swap all values in header */
+  if (*swapflag)
+    swapsacheader (sh);
+
+  return 0;
+} /* End of readbinaryheader() */
+
+/***************************************************************************
+ * readbinarydata:
+ *
+ * Read binary data samples from SAC contents into the sample array.
+ * When no swapping is needed and the samples are aligned the sample
+ * array references the contents, otherwise an array of datacnt floats
+ * is allocated.
+ *
+ * Returns 0 on sucess or -1 on failure.
+ ***************************************************************************/
+static int
+readbinarydata (S2MContext *ctx, S2MSacData *data, const char *name)
+{
+  const char *samples = data->contents + sizeof (struct SACHeader);
+  int samplesread;
+
+  samplesread = (int)((data->length - sizeof (struct SACHeader)) / sizeof (float));
+
+  if (samplesread < data->datacnt)
+  {
+    logprintf (ctx, "[%s] Only read %d of %d expected data samples\n",
+               name, samplesread, data->datacnt);
+    return -1;
+  }
+
+  /* Reference the samples in place when no swapping is needed */
+  if (!data->swapflag && (uintptr_t)samples % sizeof (float) == 0)
+  {
+    data->samples = (float *)samples;
+    data->inplace = 1;
+    return 0;
+  }
+
+  if (!(data->samples = (float *)malloc (sizeof (float) * data->datacnt)))
+  {
+    logprintf (ctx, "[%s] Cannot allocate memory for data samples\n", name);
+    return -1;
+  }
+
+  /* Swap samples from the contents directly into the array */
+  if (data->swapflag)
+    ms_gswap4n (data->samples, samples, data->datacnt);
+  else
+    memcpy (data->samples, samples, sizeof (float) * data->datacnt);
+
+  return 0;
+} /* End of readbinarydata() */
+
+/***************************************************************************
+ * readalphaheader:
+ *
+ * Parse an alphanumeric header from a buffer containing the contents
+ * of a SAC ALPHA file into a SAC header struct.  The start of the
+ * data section following the header is returned in datastart.
+ *
+ * Returns 0 on sucess or a positive number indicating line number of
+ * parsing failure.
+ ***************************************************************************/
+static int
+readalphaheader (const char *buffer, const char *end,
+                 const char **datastart, struct SACHeader *sh)
+{
+  char line[1025];
+  const char *lp = buffer;
+  const char *lineend;
+  const char *next;
+  int linecnt = 1; /* The header starts at line 1 */
+  int lineidx;
+  int count;
+  int hvidx = 0;
+  char *cp;
+
+  if (!buffer || !sh)
+    return -1;
+
+  /* The first 14 lines x 5 values are floats */
+  for (lineidx = 0; lineidx < 14; lineidx++)
+  {
+    if (!(next = nextline (lp, end, &lineend)))
+      return linecnt;
+
+    count = parsealphaline (lp, lineend, (float *)sh + hvidx, 5);
+
+    if (count != 5)
+      return linecnt;
+
+    hvidx += 5;
+    linecnt++;
+    lp = next;
+  }
+
+  /* The next 8 lines x 5 values are integers */
+  for (lineidx = 0; lineidx < 8; lineidx++)
+  {
+    if (!(next = nextline (lp, end, &lineend)))
+      return linecnt;
+
+    copyline (line, sizeof (line), lp, next);
+
+    count = sscanf (line, " %d %d %d %d %d ", (int32_t *)sh + hvidx,
+                    (int32_t *)sh + hvidx + 1, (int32_t *)sh + hvidx + 2,
+                    (int32_t *)sh + hvidx + 3, (int32_t *)sh + hvidx + 4);
+
+    if (count != 5)
+      return linecnt;
+
+    hvidx += 5;
+    linecnt++;
+    lp = next;
+  }
+
+  /* Set pointer to start of string variables */
+  cp = (char *)sh + (hvidx * 4);
+
+  /* The next 8 lines each contain 24 bytes of string data */
+  for (lineidx = 0; lineidx < 8; lineidx++)
+  {
+    memset (line, 0, sizeof (line));
+    if (!(next = nextline (lp, end, &lineend)))
+      return linecnt;
+
+    copyline (line, sizeof (line), lp, next);
+
+    memcpy (cp, line, 24);
+    cp += 24;
+
+    linecnt++;
+    lp = next;
+  }
+
+  *datastart = lp;
+
+  /* Make sure each of the 23 string variables are left justified */
+  cp = (char *)sh + (hvidx * 4);
+  for (count = 0; count < 24; count++)
+  {
+    int ridx, widx, width;
+    char *fcp;
+
+    /* Each string variable is 8 characters with one exception */
+    if (count != 1)
+    {
+      width = 8;
+    }
+    else
+    {
+      width = 16;
+      count++;
+    }
+
+    /* Pointer to field */
+    fcp = cp + (count * 8);
+
+    /* Find first character that is not a space */
+    ridx = 0;
+    while (*(fcp + ridx) == ' ')
+      ridx++;
+
+    /* Remove any leading spaces */
+    if (ridx > 0)
+    {
+      for (widx = 0; widx < width; widx++, ridx++)
+      {
+        if (ridx < width)
+          *(fcp + widx) = *(fcp + ridx);
+        else
+          *(fcp + widx) = ' ';
+      }
+    }
+  }
+
+  return 0;
+} /* End of readalphaheader() */
+
+/***************************************************************************
+ * readalphadata:
+ *
+ * Parse alphanumeric data from a buffer starting at the data section
+ * of a SAC ALPHA file into an array, the array must already be
+ * allocated with datacnt floats.
+ *
+ * Large data sections are split at line boundaries into chunks that
+ * are parsed by separate threads, using the CPUs not used by the
+ * number of concurrent conversions given in workers.  As every line
+ * except the last must contain 5 values the line number and first
+ * sample index of each chunk are known by counting lines.
+ *
+ * Returns 0 on sucess or a positive number indicating line number of
+ * parsing failure.
+ ***************************************************************************/
+static int
+readalphadata (const char *buffer, const char *end, float *data, int datacnt,
+               int workers)
+{
+  struct alphachunk chunks[ALPHAMAXCHUNKS];
+  const char *cp = buffer;
+  const char *chunkend;
+  const char *eol;
+  int64_t dataidx = 0;
+  int linecnt     = 31; /* Data samples start on line 31 */
+  int chunkcnt    = 1;
+  int idx;
+
+#if defined(S2M_THREADS)
+  pthread_t threads[ALPHAMAXCHUNKS];
+  flag started[ALPHAMAXCHUNKS];
+  long cpus;
+#endif
+
+  if (!buffer || !data || !datacnt)
+    return -1;
+
+#if defined(S2M_THREADS)
+  /* Use the CPUs not already used by conversion workers */
+  if ((end - buffer) >= 2 * ALPHACHUNK && (cpus = sysconf (_SC_NPROCESSORS_ONLN)) > workers)
+  {
+    chunkcnt = (int)(cpus / workers);
+
+    if (chunkcnt > (end - buffer) / ALPHACHUNK)
+      chunkcnt = (int)((end - buffer) / ALPHACHUNK);
+    if (chunkcnt > ALPHAMAXCHUNKS)
+      chunkcnt = ALPHAMAXCHUNKS;
+  }
+#endif
+
+  /* Divide the data section into chunks ending at line boundaries */
+  for (idx = 0; idx < chunkcnt; idx++)
+  {
+    if (idx == chunkcnt - 1)
+    {
+      chunkend = end;
+    }
+    else
+    {
+      chunkend = buffer + ((end - buffer) / chunkcnt) * (idx + 1);
+
+      if (chunkend < cp)
+        chunkend = cp;
+
+      eol      = memchr (chunkend, '\n', end - chunkend);
+      chunkend = (eol) ? eol + 1 : end;
+    }
+
+    chunks[idx].start     = cp;
+    chunks[idx].end       = chunkend;
+    chunks[idx].data      = data;
+    chunks[idx].datacnt   = datacnt;
+    chunks[idx].dataidx   = dataidx;
+    chunks[idx].linecnt   = linecnt;
+    chunks[idx].lines     = 0;
+    chunks[idx].complete  = 0;
+    chunks[idx].next      = 0;
+    chunks[idx].errorline = 0;
+
+    /* Count lines to determine the start of the next chunk */
+    if (idx < chunkcnt - 1)
+    {
+      for (eol = cp; (eol = memchr (eol, '\n', chunkend - eol)); eol++)
+      {
+        linecnt++;
+        dataidx += 5;
+      }
+    }
+
+    cp = chunkend;
+  }
+
+#if defined(S2M_THREADS)
+  /* Parse all but the first chunk in separate threads */
+  for (idx = 1; idx < chunkcnt; idx++)
+    started[idx] = (pthread_create (&threads[idx], NULL, parsealphachunk, &chunks[idx]) == 0);
+
+  parsealphachunk (&chunks[0]);
+
+  for (idx = 1; idx < chunkcnt; idx++)
+  {
+    if (started[idx])
+      pthread_join (threads[idx], NULL);
+    else
+      parsealphachunk (&chunks[idx]);
+  }
+#else
+  parsealphachunk (&chunks[0]);
+#endif
+
+  /* The first chunk that completes or fails determines the result */
+  for (idx = 0; idx < chunkcnt; idx++)
+  {
+    if (chunks[idx].complete)
+      return 0;
+
+    if (chunks[idx].errorline)
+      return chunks[idx].errorline;
+  }
+
+  /* End of data reached before all samples were parsed */
+  return chunks[chunkcnt - 1].linecnt + chunks[chunkcnt - 1].lines;
+} /* End of readalphadata() */
+
+/***************************************************************************
+ * parsealphachunk:
+ *
+ * Parse a chunk of lines from the data section of a SAC ALPHA file
+ * into the data array.  Parsing stops when all expected samples are
+ * parsed, a line fails to parse or the end of the chunk is reached.
+ *
+ * Returns NULL, the results are set in the chunk.
+ ***************************************************************************/
+static void *
+parsealphachunk (void *arg)
+{
+  struct alphachunk *chunk = (struct alphachunk *)arg;
+  const char *lp           = chunk->start;
+  const char *lineend;
+  const char *next;
+  int64_t dataidx = chunk->dataidx;
+  int maxvalues;
+  int count;
+
+  /* Each data line should contain 5 floats unless the last */
+  while (dataidx < chunk->datacnt &&
+         (next = nextline (lp, chunk->end, &lineend)))
+  {
+    maxvalues = (chunk->datacnt - dataidx < 5) ? (int)(chunk->datacnt - dataidx) : 5;
+
+    count = parsealphaline (lp, lineend, chunk->data + dataidx, maxvalues);
+
+    if (dataidx + count >= chunk->datacnt)
+    {
+      chunk->complete = 1;
+      chunk->next     = next;
+      break;
+    }
+    else if (count != 5)
+    {
+      chunk->errorline = chunk->linecnt + chunk->lines;
+      break;
+    }
+
+    dataidx += 5;
+    chunk->lines++;
+    lp = next;
+  }
+
+  return NULL;
+} /* End of parsealphachunk() */
+
+/***************************************************************************
+ * parsealphaline:
+ *
+ * Parse up to maxvalues (at most 5) white space separated floats from
+ * a line, with the same results as sscanf(" %f %f %f %f %f ").
+ * Common decimal values are converted directly, any other line is
+ * parsed with sscanf().
+ *
+ * Returns number of values parsed.
+ ***************************************************************************/
+static int
+parsealphaline (const char *line, const char *end, float *values,
+                int maxvalues)
+{
+  char buffer[1025];
+  float fallback[5];
+  const char *cp = line;
+  int count      = 0;
+
+  while (count < maxvalues)
+  {
+    while (cp < end && (*cp == ' ' || (*cp >= '\t' && *cp <= '\r')))
+      cp++;
+
+    if (cp >= end)
+      return count;
+
+    if (parsefloat (&cp, end, &values[count]))
+      break;
+
+    count++;
+  }
+
+  if (count == maxvalues)
+    return count;
+
+  /* Parse lines with values not handled above using sscanf() */
+  copyline (buffer, sizeof (buffer), line, end);
+
+  count = sscanf (buffer, " %f %f %f %f %f ", &fallback[0], &fallback[1],
+                  &fallback[2], &fallback[3], &fallback[4]);
+
+  if (count < 0)
+    count = 0;
+  if (count > maxvalues)
+    count = maxvalues;
+
+  memcpy (values, fallback, count * sizeof (float));
+
+  return count;
+} /* End of parsealphaline() */
+
+/***************************************************************************
+ * parsefloat:
+ *
+ * Convert a decimal value of the form [+-]digits[.digits][e[+-]digits]
+ * followed by white space or the end of the line to a float.  Values
+ * with a mantissa up to 2^53 and an exponent within 10^22 are
+ * converted exactly to a double and rounded to float, unless the double
+ * lies exactly between two floats where the rounding could differ.
+ * Other values are converted with strtof().
+ *
+ * Returns 0 on sucess and -1 if the value is not in the expected form.
+ ***************************************************************************/
+static int
+parsefloat (const char **cpp, const char *end, float *value)
+{
+  static const double powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7,
+                                  1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14,
+                                  1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+  char token[64];
+  const char *cp    = *cpp;
+  const char *start = cp;
+  uint64_t mantissa = 0;
+  uint64_t bits;
+  double dvalue;
+  int digits      = 0;
+  int anydigits   = 0;
+  int exponent    = 0;
+  int expvalue    = 0;
+  int negative    = 0;
+  int expnegative = 0;
+  int exact       = 0;
+
+  if (cp < end && (*cp == '-' || *cp == '+'))
+    negative = (*cp++ == '-');
+
+  /* Integer digits, leading zeros are not significant */
+  for (; cp < end && *cp >= '0' && *cp <= '9'; cp++)
+  {
+    anydigits = 1;
+
+    if (mantissa || *cp != '0')
+    {
+      if (++digits > 19)
+        return -1;
+
+      mantissa = mantissa * 10 + (*cp - '0');
+    }
+  }
+
+  /* Fraction digits */
+  if (cp < end && *cp == '.')
+  {
+    for (cp++; cp < end && *cp >= '0' && *cp <= '9'; cp++)
+    {
+      anydigits = 1;
+
+      if (mantissa || *cp != '0')
+      {
+        if (++digits > 19)
+          return -1;
+
+        mantissa = mantissa * 10 + (*cp - '0');
+      }
+
+      exponent--;
+    }
+  }
+
+  if (!anydigits)
+    return -1;
+
+  /* Exponent */
+  if (cp < end && (*cp == 'e' || *cp == 'E'))
+  {
+    cp++;
+
+    if (cp < end && (*cp == '-' || *cp == '+'))
+      expnegative = (*cp++ == '-');
+
+    if (cp >= end || *cp < '0' || *cp > '9')
+      return -1;
+
+    for (; cp < end && *cp >= '0' && *cp <= '9'; cp++)
+      if (expvalue < 10000)
+        expvalue = expvalue * 10 + (*cp - '0');
+
+    exponent += (expnegative) ? -expvalue : expvalue;
+  }
+
+  /* Value must be followed by white space or end of line */
+  if (cp < end && !(*cp == ' ' || (*cp >= '\t' && *cp <= '\r')))
+    return -1;
+
+  *cpp = cp;
+
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+  /* Both the mantissa and power of 10 are exact doubles, the result
+   * of a single multiplication or division is correctly rounded */
+  if (mantissa == 0)
+  {
+    dvalue = 0.0;
+    exact  = 1;
+  }
+  else if (mantissa <= ((uint64_t)1 << 53) && exponent >= -22 && exponent <= 22)
+  {
+    dvalue = (exponent < 0) ? (double)mantissa / powers[-exponent]
+                            : (double)mantissa * powers[exponent];
+
+    /* Values exactly half way between floats are double rounded */
+    memcpy (&bits, &dvalue, sizeof (bits));
+    exact = (dvalue >= FLT_MIN && dvalue <= FLT_MAX &&
+             (bits & 0x1FFFFFFF) != 0x10000000);
+  }
+
+  if (exact)
+  {
+    *value = (negative) ? -(float)dvalue : (float)dvalue;
+    return 0;
+  }
+#endif
+
+  if ((size_t)(cp - start) >= sizeof (token))
+    return -1;
+
+  memcpy (token, start, cp - start);
+  token[cp - start] = '\0';
+
+  *value = strtof (token, NULL);
+
+  return 0;
+} /* End of parsefloat() */
+
+/***************************************************************************
+ * nextline:
+ *
+ * Find the end of the line starting at line and the start of the
+ * following line, the end of the line is set to the newline or the end
+ * of the buffer if there is no newline.
+ *
+ * Returns the start of the following line or NULL if line is at the
+ * end of the buffer.
+ ***************************************************************************/
+static const char *
+nextline (const char *line, const char *end, const char **lineend)
+{
+  const char *eol;
+
+  if (line >= end)
+    return NULL;
+
+  if ((eol = memchr (line, '\n', end - line)))
+  {
+    *lineend = eol;
+    return eol + 1;
+  }
+
+  *lineend = end;
+  return end;
+} /* End of nextline() */
+
+/***************************************************************************
+ * copyline:
+ *
+ * Copy a line to a NULL terminated string, truncating lines that do
+ * not fit.
+ ***************************************************************************/
+static void
+copyline (char *dest, size_t size, const char *line, const char *end)
+{
+  size_t length = end - line;
+
+  if (length > size - 1)
+    length = size - 1;
+
+  memcpy (dest, line, length);
+  dest[length] = '\0';
+} /* End of copyline() */
+
+/***************************************************************************
+ * swapsacheader:
+ *
+ * Byte swap all multi-byte quantities (floats and ints) in SAC header
+ * struct.
+ *
+ * Returns 0 on sucess and -1 on failure.
+ ***************************************************************************/
+static int
+swapsacheader (struct SACHeader *sh)
+{
+  int32_t *ip;
+  int idx;
+
+  if (!sh)
+    return -1;
+
+  for (idx = 0; idx < (NUMFLOATHDR + NUMINTHDR); idx++)
+  {
+    ip = (int32_t *)sh + idx;
+    ms_gswap4 (ip);
+  }
+
+  return 0;
+} /* End of swapsacheader() */
+
+/***************************************************************************
+ * logprintf:
+ *
+ * Print a diagnostic message with the log handler of the context or,
+ * if none is set, to standard error.
+ ***************************************************************************/
+static void
+logprintf (S2MContext *ctx, const char *format, ...)
+{
+  char message[4096];
+  va_list varlist;
+
+  va_start (varlist, format);
+
+  if (ctx && ctx->log_print)
+  {
+    vsnprintf (message, sizeof (message), format, varlist);
+    ctx->log_print (message, ctx->logdata);
+  }
+  else
+  {
+    vfprintf (stderr, format, varlist);
+  }
+
+  va_end (varlist);
+} /* End of logprintf() */
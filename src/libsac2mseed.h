@@ -0,0 +1,114 @@
+/***************************************************************************
+ * libsac2mseed.h
+ *
+ * Interface of the SAC to miniSEED conversion library.
+ *
+ * All conversion state is held in an S2MContext, there is no global
+ * state and no file I/O.  SAC files are parsed from memory buffers and
+ * packed records are passed to the record handler of the context.
+ * Diagnostic messages are passed to the log handler of the context or,
+ * if none is set, printed to standard error.
+ *
+ * Only waveform data with NVHD = 6 is supported.
+ ***************************************************************************/
+
+#ifndef LIBSAC2MSEED_H
+#define LIBSAC2MSEED_H 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <libmseed.h>
+
+#include "sacformat.h"
+
+#define LIBSAC2MSEED_VERSION "1.14"
+
+/* Conversion parameters, initialize with s2m_initparams() */
+typedef struct S2MParams_s
+{
+  int packreclen;             /* Record length, -1 for the libmseed default */
+  int encoding;               /* Data encoding format, DE_* */
+  int byteorder;              /* Record byte order, -1 for the libmseed default */
+  int sacformat;              /* Input format, see s2m_parseheader() */
+  long long int datascaling;  /* Scaling factor for integer output, 0 to autoscale */
+  flag srateblkt;             /* Add blockette 100 with the sample rate to records */
+  const char *forcenet;       /* Network code overriding the header, if set */
+  const char *forcesta;       /* Station code overriding the header, if set */
+  const char *forceloc;       /* Location ID overriding the header, if set */
+  const char *forcechan;      /* Channel overriding the header, '.' retains a character */
+  int workers;                /* Number of conversions run concurrently by the caller */
+  int verbose;                /* Verbosity level of diagnostic messages */
+} S2MParams;
+
+/* Conversion context, create with s2m_init() and release with s2m_free() */
+typedef struct S2MContext_s
+{
+  S2MParams params;           /* Conversion parameters */
+  MSTraceGroup *mstg;         /* Traces being packed, each with a record template */
+  void (*record_handler) (char *record, int reclen, void *handlerdata);
+  void *handlerdata;          /* Caller data passed to record_handler */
+  void (*log_print) (const char *message, void *logdata);
+  void *logdata;              /* Caller data passed to log_print */
+  int64_t packedsamples;      /* Number of samples packed */
+  int64_t packedrecords;      /* Number of records packed */
+  MSPackContext packctx;      /* Packing settings resolved once */
+} S2MContext;
+
+/* A SAC file parsed from a memory buffer */
+typedef struct S2MSacData_s
+{
+  float *samples;             /* Data samples in host byte order */
+  flag inplace;               /* Samples reference the contents, not allocated */
+  const char *contents;       /* File contents, owned by the caller */
+  size_t length;              /* Length of the file contents */
+  int format;                 /* Input format, as detected by s2m_parseheader() */
+  int swapflag;               /* Binary samples need byte swapping */
+  int datacnt;                /* Number of samples in the file */
+  int dataidx;                /* Number of samples read in blocks */
+  const char *alphadata;      /* Start of the ALPHA data section */
+  const char *alphanext;      /* Next ALPHA data line to read in blocks */
+  int alphaline;              /* Line number of the next ALPHA data line */
+} S2MSacData;
+
+/* Context management */
+extern void s2m_initparams (S2MParams *params);
+extern S2MContext *s2m_init (const S2MParams *params,
+                             void (*record_handler) (char *, int, void *),
+                             void *handlerdata);
+extern void s2m_free (S2MContext **ppctx);
+
+/* Conversion of complete SAC files */
+extern int64_t s2m_convert (S2MContext *ctx, const char *buffer, size_t length,
+                            const char *name);
+extern int s2m_sac2msr (S2MContext *ctx, const char *buffer, size_t length,
+                        const char *name, struct SACHeader *sh, MSRecord **ppmsr);
+
+/* Parsing of SAC files */
+extern int s2m_detectformat (const char *buffer, size_t length, int format);
+extern int s2m_parseheader (S2MContext *ctx, S2MSacData *data, const char *buffer,
+                            size_t length, struct SACHeader *sh, const char *name);
+extern int s2m_readdata (S2MContext *ctx, S2MSacData *data, const char *name);
+extern int s2m_readblock (S2MContext *ctx, S2MSacData *data, float *block,
+                          int count, const char *name);
+extern void s2m_rewind (S2MSacData *data);
+extern void s2m_freedata (S2MSacData *data);
+
+/* Scaling, record population and packing */
+extern int64_t s2m_scansamples (const float *fdata, int32_t *idata, int datacnt,
+                                float *datamin, float *datamax, int *fractional,
+                                flag continued);
+extern int64_t s2m_scalesamples (const float *fdata, int32_t *idata, int datacnt,
+                                 float scale);
+extern long long int s2m_autoscale (S2MContext *ctx, float datamin, float datamax,
+                                    int fractional);
+extern void s2m_populatemsr (S2MContext *ctx, MSRecord *msr, struct SACHeader *sh);
+extern MSRecord *s2m_createtemplate (S2MContext *ctx, MSRecord *msr);
+extern int64_t s2m_packtrace (S2MContext *ctx, MSTrace *mst, flag flush);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBSAC2MSEED_H */
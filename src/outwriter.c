@@ -0,0 +1,454 @@
+/***************************************************************************
+ * outwriter.c
+ *
+ * Write-behind output of packed records, see outwriter.h.
+ ***************************************************************************/
+
+/* Declare syncfs() */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "sac2mseed.h"
+
+#if defined(S2M_THREADS)
+#include "outwriter.h"
+#include "spscqueue.h"
+
+/* A buffer of records for an output file */
+struct outbuffer
+{
+  char *data;               /* Page aligned buffer of records */
+  size_t length;            /* Length of records in buffer */
+  FILE *fp;                 /* Output file for the records */
+  flag close;               /* Close the file after writing */
+  flag sync;                /* Synchronize the file before closing */
+};
+
+/* Maximum number of file systems synchronized once when the writer
+ * stops, output on further file systems is synchronized with sync() */
+#define SYNCMAXFS 8
+
+/* Write-behind output state, buffers are filled in turn by the main
+ * thread and written in the same order by the writer thread */
+struct outwriter
+{
+  struct outbuffer buffers[OUTBUFCOUNT];
+  size_t bufsize;           /* Size of each buffer */
+  struct spscqueue queue;   /* Buffers filled and waiting to be written */
+  int fill;                 /* Index of the buffer being filled */
+  int next;                 /* Index of the next buffer to write */
+  int error;                /* errno of the first failure, 0 if none, atomic */
+  int syncfd[SYNCMAXFS];    /* A descriptor on each file system written */
+  dev_t syncdev[SYNCMAXFS]; /* Device of each file system written */
+  int synccount;            /* Number of file systems written */
+  flag syncall;             /* Synchronize all file systems */
+  pthread_t thread;
+};
+
+static int syncwriter (void);
+static void submitbuffer (void);
+static void keepsyncfd (int fd);
+static void *writerthread (void *arg);
+
+static struct outwriter *writer = 0;
+
+/***************************************************************************
+ * startwriter:
+ *
+ * Allocate the write-behind output buffers of bufsize bytes each and
+ * start the writer thread.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+int
+startwriter (size_t bufsize)
+{
+  long pagesize = sysconf (_SC_PAGESIZE);
+  int idx;
+  int rv;
+
+  if (pagesize <= 0)
+    pagesize = 4096;
+
+  /* Round buffer size to whole pages */
+  bufsize = (bufsize + pagesize - 1) / pagesize * pagesize;
+
+  if (!(writer = (struct outwriter *)calloc (1, sizeof (struct outwriter))))
+  {
+    fprintf (stderr, "Cannot allocate memory for output buffers\n");
+    return -1;
+  }
+
+  writer->bufsize = bufsize;
+
+  for (idx = 0; idx < OUTBUFCOUNT; idx++)
+  {
+    if (posix_memalign ((void **)&writer->buffers[idx].data, (size_t)pagesize, bufsize))
+    {
+      fprintf (stderr, "Cannot allocate memory for output buffers\n");
+      writer->buffers[idx].data = 0;
+      goto failure;
+    }
+  }
+
+  if (initqueue (&writer->queue, OUTBUFCOUNT))
+    goto failure;
+
+  if ((rv = pthread_create (&writer->thread, NULL, writerthread, NULL)))
+  {
+    fprintf (stderr, "Cannot create output writer thread: %s\n", strerror (rv));
+    destroyqueue (&writer->queue);
+    goto failure;
+  }
+
+  if (verbose > 1)
+    fprintf (stderr, "Writing output through %d buffers of %lu bytes\n",
+             OUTBUFCOUNT, (unsigned long)bufsize);
+
+  return 0;
+
+failure:
+  for (idx = 0; idx < OUTBUFCOUNT; idx++)
+    free (writer->buffers[idx].data);
+
+  free (writer);
+  writer = 0;
+
+  return -1;
+} /* End of startwriter() */
+
+/***************************************************************************
+ * stopwriter:
+ *
+ * Queue any partially filled buffer, wait for the writer thread to
+ * write all queued buffers, synchronize the closed output files to
+ * storage and release the writer.
+ *
+ * Returns 0 on success, and -1 if any write failed
+ ***************************************************************************/
+int
+stopwriter (void)
+{
+  int error;
+  int idx;
+
+  if (!writer)
+    return 0;
+
+  if (writer->buffers[writer->fill].length > 0)
+    submitbuffer ();
+
+  closequeue (&writer->queue);
+
+  pthread_join (writer->thread, NULL);
+
+  error = writer->error;
+
+  if (error && !outputerror)
+    fprintf (stderr, "Error writing to output file: %s\n", strerror (error));
+
+  if (syncwriter ())
+    error = 1;
+
+  for (idx = 0; idx < OUTBUFCOUNT; idx++)
+    free (writer->buffers[idx].data);
+
+  destroyqueue (&writer->queue);
+  free (writer);
+  writer = 0;
+
+  return (error) ? -1 : 0;
+} /* End of stopwriter() */
+
+/***************************************************************************
+ * writeractive:
+ *
+ * Determine if the write-behind writer is running.
+ *
+ * Returns 1 if the writer is running, otherwise 0
+ ***************************************************************************/
+int
+writeractive (void)
+{
+  return (writer) ? 1 : 0;
+} /* End of writeractive() */
+
+/***************************************************************************
+ * writebuffered:
+ *
+ * Copy records for an output file to the buffer being filled, which is
+ * queued for the writer thread when full or when records for a
+ * different file are written.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+int
+writebuffered (FILE *fp, const char *data, size_t length)
+{
+  struct outbuffer *ob;
+  size_t count;
+
+  while (length > 0)
+  {
+    ob = &writer->buffers[writer->fill];
+
+    if (ob->length > 0 && ob->fp != fp)
+    {
+      submitbuffer ();
+      ob = &writer->buffers[writer->fill];
+    }
+
+    count = writer->bufsize - ob->length;
+    if (count > length)
+      count = length;
+
+    memcpy (ob->data + ob->length, data, count);
+    ob->length += count;
+    ob->fp = fp;
+    data += count;
+    length -= count;
+
+    if (ob->length == writer->bufsize)
+      submitbuffer ();
+  }
+
+  return (outputerror) ? -1 : 0;
+} /* End of writebuffered() */
+
+/***************************************************************************
+ * closebuffered:
+ *
+ * Queue an output file to be closed by the writer thread after all of
+ * its records are written.  With sync the file is synchronized to
+ * storage before it is closed, otherwise once the writer stops.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+int
+closebuffered (FILE *fp, flag sync)
+{
+  struct outbuffer *ob;
+
+  ob = &writer->buffers[writer->fill];
+
+  if (ob->length > 0 && ob->fp != fp)
+  {
+    submitbuffer ();
+    ob = &writer->buffers[writer->fill];
+  }
+
+  ob->fp    = fp;
+  ob->close = 1;
+  ob->sync  = sync;
+  submitbuffer ();
+
+  return (outputerror) ? -1 : 0;
+} /* End of closebuffered() */
+
+/***************************************************************************
+ * drainwriter:
+ *
+ * Queue any partially filled buffer and wait until the writer thread
+ * has written all queued buffers.
+ *
+ * Returns 0 on success, and -1 if any write failed
+ ***************************************************************************/
+int
+drainwriter (void)
+{
+  int error;
+
+  if (writer->buffers[writer->fill].length > 0)
+    submitbuffer ();
+
+  waitspace (&writer->queue, 0);
+
+  error = __atomic_load_n (&writer->error, __ATOMIC_SEQ_CST);
+
+  if (error && !outputerror)
+  {
+    fprintf (stderr, "Error writing to output file: %s\n", strerror (error));
+    outputerror = 1;
+  }
+
+  return (outputerror) ? -1 : 0;
+} /* End of drainwriter() */
+
+/***************************************************************************
+ * syncwriter:
+ *
+ * Synchronize the file systems of output files closed by the writer
+ * thread, once for each file system instead of once for each file.
+ * Only called after the writer thread has finished.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+syncwriter (void)
+{
+  int rv = 0;
+  int idx;
+
+  for (idx = 0; idx < writer->synccount; idx++)
+  {
+#if defined(__linux__)
+    if (!writer->syncall && !rv && syncfs (writer->syncfd[idx]))
+    {
+      fprintf (stderr, "Error synchronizing output files: %s\n", strerror (errno));
+      rv = -1;
+    }
+#endif
+    close (writer->syncfd[idx]);
+  }
+
+  if (writer->syncall)
+    sync ();
+
+  writer->synccount = 0;
+  writer->syncall   = 0;
+
+  return rv;
+} /* End of syncwriter() */
+
+/***************************************************************************
+ * submitbuffer:
+ *
+ * Queue the buffer being filled for the writer thread and advance to
+ * the next buffer, waiting only if all buffers are queued.  The first
+ * write error reported by the writer thread is reported here.
+ ***************************************************************************/
+static void
+submitbuffer (void)
+{
+  struct outbuffer *ob;
+  int error;
+
+  pushqueue (&writer->queue);
+  writer->fill = (writer->fill + 1) % OUTBUFCOUNT;
+
+  waitspace (&writer->queue, OUTBUFCOUNT - 1);
+
+  error = __atomic_load_n (&writer->error, __ATOMIC_SEQ_CST);
+
+  if (error && !outputerror)
+  {
+    fprintf (stderr, "Error writing to output file: %s\n", strerror (error));
+    outputerror = 1;
+  }
+
+  ob         = &writer->buffers[writer->fill];
+  ob->length = 0;
+  ob->fp     = 0;
+  ob->close  = 0;
+  ob->sync   = 0;
+} /* End of submitbuffer() */
+
+/***************************************************************************
+ * keepsyncfd:
+ *
+ * Keep a duplicate of an output file descriptor if it is the first
+ * regular file written on its file system, for syncwriter().  Without
+ * syncfs() or when too many file systems are written all file systems
+ * are synchronized instead.
+ ***************************************************************************/
+static void
+keepsyncfd (int fd)
+{
+  struct stat st;
+#if defined(__linux__)
+  int idx;
+#endif
+
+  if (writer->syncall || fstat (fd, &st) || !S_ISREG (st.st_mode))
+    return;
+
+#if defined(__linux__)
+  for (idx = 0; idx < writer->synccount; idx++)
+  {
+    if (writer->syncdev[idx] == st.st_dev)
+      return;
+  }
+
+  if (writer->synccount < SYNCMAXFS &&
+      (writer->syncfd[writer->synccount] = dup (fd)) >= 0)
+  {
+    writer->syncdev[writer->synccount++] = st.st_dev;
+    return;
+  }
+#endif
+
+  writer->syncall = 1;
+} /* End of keepsyncfd() */
+
+/***************************************************************************
+ * writerthread:
+ *
+ * Write queued buffers in order, closing output files as requested.
+ * A descriptor for the file system of each closed file is kept for
+ * synchronizing once when the writer stops.  After a failure no
+ * further records are written but files are still closed.
+ *
+ * Returns NULL.
+ ***************************************************************************/
+static void *
+writerthread (void *arg)
+{
+  struct outbuffer *ob;
+  size_t offset;
+  ssize_t written;
+  int error = 0;
+  int fd;
+
+  while (!waitqueue (&writer->queue))
+  {
+    ob = &writer->buffers[writer->next];
+
+    fd = (ob->fp) ? fileno (ob->fp) : -1;
+
+    for (offset = 0; !error && offset < ob->length; offset += written)
+    {
+      if ((written = write (fd, ob->data + offset, ob->length - offset)) < 0)
+      {
+        if (errno == EINTR)
+          written = 0;
+        else
+          error = errno;
+      }
+    }
+
+    if (ob->close && ob->fp)
+    {
+      /* Files that cannot be synchronized, e.g. pipes, are only closed */
+      if (ob->sync)
+      {
+        if (!error && fsync (fd) && errno != EINVAL && errno != EROFS && errno != ENOTSUP)
+          error = errno;
+      }
+      else if (!error)
+      {
+        keepsyncfd (fd);
+      }
+
+      if (fclose (ob->fp) && !error)
+        error = errno;
+    }
+
+    /* Only this thread sets the error */
+    if (error && !writer->error)
+      __atomic_store_n (&writer->error, error, __ATOMIC_SEQ_CST);
+
+    writer->next = (writer->next + 1) % OUTBUFCOUNT;
+    popqueue (&writer->queue);
+  }
+
+  return NULL;
+} /* End of writerthread() */
+#endif /* S2M_THREADS */
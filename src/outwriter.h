@@ -0,0 +1,31 @@
+/***************************************************************************
+ * outwriter.h
+ *
+ * Write-behind output of packed records.
+ *
+ * Records are copied into a set of output buffers filled in turn by
+ * the converting thread and written, in the same order, by a writer
+ * thread.  Output files handed to the writer are closed by the writer
+ * thread and synchronized to storage once, for each file system, when
+ * the writer stops.
+ ***************************************************************************/
+
+#ifndef OUTWRITER_H
+#define OUTWRITER_H 1
+
+#include <stdio.h>
+
+#include <libmseed.h>
+
+/* Number of write-behind output buffers, filled in turn while the
+ * writer thread writes those already filled */
+#define OUTBUFCOUNT 4
+
+extern int startwriter (size_t bufsize);
+extern int stopwriter (void);
+extern int writeractive (void);
+extern int writebuffered (FILE *fp, const char *data, size_t length);
+extern int closebuffered (FILE *fp, flag sync);
+extern int drainwriter (void);
+
+#endif /* OUTWRITER_H */
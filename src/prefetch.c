@@ -0,0 +1,430 @@
+/***************************************************************************
+ * prefetch.c
+ *
+ * Reading of input files ahead of conversion, see prefetch.h.
+ ***************************************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "prefetch.h"
+
+#if defined(S2M_THREADS)
+#include "spscqueue.h"
+#include "uring.h"
+#include "walker.h"
+
+/* Maximum number of input files opened and read in a batch */
+#define READBATCH 32
+
+/* Largest input file read into memory by the reader, larger files are
+ * mapped */
+#define READMAXSIZE (4 * 1024 * 1024)
+
+/* An input file read ahead of conversion */
+struct inputslot
+{
+  char *sacfile;            /* Input file path */
+  struct sacdata data;      /* Mapped contents, no buffer if not read ahead */
+};
+
+/* Read-ahead input state, slots are filled in list order by the reader
+ * thread and converted in the same order by the main thread */
+struct inreader
+{
+  struct inputslot *slots;  /* Ring of input files */
+  struct spscqueue queue;   /* Slots read and waiting to be converted */
+  int fill;                 /* Index of the next slot to fill */
+  int next;                 /* Index of the next slot to convert */
+  int stop;                 /* Stop reading, set by the main thread, atomic */
+  pthread_t thread;
+#if defined(S2M_URING)
+  struct uring ring;        /* Batched open, stat and read of input files */
+#endif
+};
+
+static void *readerthread (void *arg);
+static void readbatch (struct inreader *reader, char **files, int count);
+
+/***************************************************************************
+ * convertprefetched:
+ *
+ * Convert all input files in list order while a reader thread reads
+ * the next slotcount files into memory ahead of conversion.  With the
+ * writer thread writing output the reading, conversion and writing of
+ * files overlap.  The stages are connected by single-producer,
+ * single-consumer queues.  Files that cannot be read ahead are read
+ * when converted, as without reading ahead.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+int
+convertprefetched (int slotcount)
+{
+  struct inreader reader;
+  struct inputslot *slot;
+  int rv;
+
+  memset (&reader, 0, sizeof (struct inreader));
+
+  if (!(reader.slots = (struct inputslot *)calloc (slotcount, sizeof (struct inputslot))))
+  {
+    fprintf (stderr, "Cannot allocate memory for reading input\n");
+    return -1;
+  }
+
+  if (initqueue (&reader.queue, slotcount))
+  {
+    free (reader.slots);
+    return -1;
+  }
+
+#if defined(S2M_URING)
+  /* Kernels without io_uring, or where it is not permitted, are read
+   * with plain system calls */
+  if (uringsetup (&reader.ring, 2 * READBATCH))
+  {
+    if (verbose > 1)
+      fprintf (stderr, "Reading input without io_uring (%s)\n", strerror (errno));
+
+    reader.ring.fd = -1;
+  }
+  else if (verbose > 1)
+  {
+    fprintf (stderr, "Reading input in batches with io_uring\n");
+  }
+#endif
+
+  if ((rv = pthread_create (&reader.thread, NULL, readerthread, &reader)))
+  {
+    fprintf (stderr, "Cannot create input reader thread: %s\n", strerror (rv));
+    exit (1);
+  }
+
+  if (verbose > 1)
+    fprintf (stderr, "Reading up to %d input files ahead\n", slotcount);
+
+  /* Convert in list order, after a failure to write output only
+   * release the files read ahead until the reader stops */
+  while (!waitqueue (&reader.queue))
+  {
+    slot = &reader.slots[reader.next];
+
+    if (!outputerror)
+    {
+      convertinput (slot->sacfile, &slot->data);
+
+      /* Stop converting when output cannot be written */
+      if (outputerror)
+        __atomic_store_n (&reader.stop, 1, __ATOMIC_SEQ_CST);
+    }
+
+    freesacdata (&slot->data);
+
+    reader.next = (reader.next + 1) % slotcount;
+    popqueue (&reader.queue);
+  }
+
+  pthread_join (reader.thread, NULL);
+
+#if defined(S2M_URING)
+  uringclose (&reader.ring);
+#endif
+
+  destroyqueue (&reader.queue);
+  free (reader.slots);
+
+  return 0;
+} /* End of convertprefetched() */
+
+/***************************************************************************
+ * readerthread:
+ *
+ * Reader thread, read the input files in list order into the free
+ * slots of the queue, so that the disk reads are done while earlier
+ * files are converted.  Files are read in batches of as many files as
+ * there are free slots and files listed.
+ *
+ * Returns NULL.
+ ***************************************************************************/
+static void *
+readerthread (void *arg)
+{
+  struct inreader *reader = (struct inreader *)arg;
+  char *files[READBATCH];
+  unsigned int space;
+  int64_t index = 0;
+  flag end      = 0;
+  int count;
+  int idx;
+
+  while (!__atomic_load_n (&reader->stop, __ATOMIC_SEQ_CST) &&
+         (files[0] = nextfile (index)))
+  {
+    index++;
+
+    waitspace (&reader->queue, reader->queue.size - 1);
+
+    /* Extend the batch with files already listed, up to the free slots */
+    space = reader->queue.size - (reader->queue.tail -
+                                  __atomic_load_n (&reader->queue.head, __ATOMIC_SEQ_CST));
+
+    for (count = 1; count < READBATCH && count < (int)space; count++, index++)
+      if (!(files[count] = followfile (index, &end)))
+        break;
+
+    readbatch (reader, files, count);
+
+    for (idx = 0; idx < count; idx++)
+    {
+      pushqueue (&reader->queue);
+      reader->fill = (reader->fill + 1) % reader->queue.size;
+    }
+  }
+
+  closequeue (&reader->queue);
+
+  return NULL;
+} /* End of readerthread() */
+
+/***************************************************************************
+ * readbatch:
+ *
+ * Read a batch of input files into the slots following the fill index.
+ * All files are opened and their sizes determined first, then files up
+ * to READMAXSIZE are read into allocated buffers and larger files are
+ * mapped with their pages faulted into memory.
+ *
+ * With io_uring each step is submitted for the whole batch at once,
+ * opening and determining the size with one system call and reading
+ * and closing with another.  Otherwise the kernel is advised that all
+ * files of the batch will be needed before reading them in turn, so
+ * their readahead overlaps.
+ *
+ * Files that cannot be read are left without contents, errors are
+ * reported when the file is read again for conversion.
+ ***************************************************************************/
+static void
+readbatch (struct inreader *reader, char **files, int count)
+{
+  struct sacdata *data[READBATCH];
+  int64_t sizes[READBATCH];
+  int fds[READBATCH];
+  long pagesize = sysconf (_SC_PAGESIZE);
+#if !defined(MAP_POPULATE)
+  volatile unsigned char touched = 0;
+#endif
+  size_t offset;
+  ssize_t readlen;
+  void *map;
+  int idx;
+
+#if defined(S2M_URING)
+  struct statx stx[READBATCH];
+  int32_t results[2 * READBATCH];
+  unsigned int submitted;
+  struct io_uring_sqe *sqe;
+#endif
+  struct stat st;
+
+  if (pagesize <= 0)
+    pagesize = 4096;
+
+  for (idx = 0; idx < count; idx++)
+  {
+    reader->slots[(reader->fill + idx) % reader->queue.size].sacfile = files[idx];
+    data[idx] = &reader->slots[(reader->fill + idx) % reader->queue.size].data;
+    memset (data[idx], 0, sizeof (struct sacdata));
+  }
+
+  /* Open all files and determine the sizes of regular files */
+#if defined(S2M_URING)
+  if (reader->ring.fd >= 0)
+  {
+    for (idx = 0; idx < count; idx++)
+    {
+      results[2 * idx]     = URINGNORESULT;
+      results[2 * idx + 1] = URINGNORESULT;
+
+      sqe             = uringsqe (&reader->ring, IORING_OP_OPENAT, AT_FDCWD, 2 * idx);
+      sqe->addr       = (uint64_t)(uintptr_t)files[idx];
+      sqe->open_flags = O_RDONLY | O_CLOEXEC;
+
+      sqe              = uringsqe (&reader->ring, IORING_OP_STATX, AT_FDCWD, 2 * idx + 1);
+      sqe->addr        = (uint64_t)(uintptr_t)files[idx];
+      sqe->len         = STATX_TYPE | STATX_SIZE;
+      sqe->off         = (uint64_t)(uintptr_t)&stx[idx];
+      sqe->statx_flags = 0;
+    }
+
+    /* After a failure of the ring the batch is left unread, the files
+     * are read when converted */
+    if (uringrun (&reader->ring, 2 * count, results))
+    {
+      for (idx = 0; idx < count; idx++)
+        if (results[2 * idx] >= 0)
+          close (results[2 * idx]);
+
+      return;
+    }
+
+    for (idx = 0; idx < count; idx++)
+    {
+      fds[idx]   = results[2 * idx];
+      sizes[idx] = (results[2 * idx + 1] == 0 && S_ISREG (stx[idx].stx_mode))
+                     ? (int64_t)stx[idx].stx_size
+                     : -1;
+    }
+  }
+  else
+#endif
+  {
+    for (idx = 0; idx < count; idx++)
+    {
+      sizes[idx] = -1;
+
+      if ((fds[idx] = open (files[idx], O_RDONLY)) < 0)
+        continue;
+
+      if (!fstat (fds[idx], &st) && S_ISREG (st.st_mode))
+      {
+        sizes[idx] = (int64_t)st.st_size;
+#if defined(POSIX_FADV_WILLNEED)
+        posix_fadvise (fds[idx], 0, 0, POSIX_FADV_WILLNEED);
+#endif
+      }
+    }
+  }
+
+  /* Map large files, allocate buffers for the others */
+  for (idx = 0; idx < count; idx++)
+  {
+    if (fds[idx] < 0 || sizes[idx] < (int64_t)sizeof (struct SACHeader))
+      continue;
+
+    if (sizes[idx] > READMAXSIZE)
+    {
+      if ((uint64_t)sizes[idx] > (size_t)-1)
+        continue;
+
+      /* Fault the pages in here instead of during conversion */
+#if defined(MAP_POPULATE)
+      map = mmap (NULL, (size_t)sizes[idx], PROT_READ, MAP_PRIVATE | MAP_POPULATE, fds[idx], 0);
+
+      if (map == MAP_FAILED)
+        continue;
+#else
+      map = mmap (NULL, (size_t)sizes[idx], PROT_READ, MAP_PRIVATE, fds[idx], 0);
+
+      if (map == MAP_FAILED)
+        continue;
+
+      posix_madvise (map, (size_t)sizes[idx], POSIX_MADV_WILLNEED);
+
+      for (offset = 0; offset < (size_t)sizes[idx]; offset += pagesize)
+        touched += ((unsigned char *)map)[offset];
+#endif
+
+      data[idx]->buffer = map;
+      data[idx]->length = (size_t)sizes[idx];
+      data[idx]->mapped = 1;
+    }
+    else
+    {
+      data[idx]->buffer = (char *)malloc ((size_t)sizes[idx]);
+    }
+  }
+
+  /* Read the allocated buffers and close all files */
+#if defined(S2M_URING)
+  if (reader->ring.fd >= 0)
+  {
+    submitted = 0;
+
+    for (idx = 0; idx < count; idx++)
+    {
+      results[2 * idx]     = URINGNORESULT;
+      results[2 * idx + 1] = URINGNORESULT;
+
+      if (fds[idx] < 0)
+        continue;
+
+      /* The close follows the read even if the read fails */
+      if (data[idx]->buffer && !data[idx]->mapped)
+      {
+        sqe        = uringsqe (&reader->ring, IORING_OP_READ, fds[idx], 2 * idx);
+        sqe->addr  = (uint64_t)(uintptr_t)data[idx]->buffer;
+        sqe->len   = (uint32_t)sizes[idx];
+        sqe->off   = 0;
+        sqe->flags = IOSQE_IO_HARDLINK;
+        submitted++;
+      }
+
+      uringsqe (&reader->ring, IORING_OP_CLOSE, fds[idx], 2 * idx + 1);
+      submitted++;
+    }
+
+    /* Files not read after a failure of the ring are read when
+     * converted, files not closed are closed here */
+    if (uringrun (&reader->ring, submitted, results))
+    {
+      for (idx = 0; idx < count; idx++)
+        if (fds[idx] >= 0 && results[2 * idx + 1] == URINGNORESULT)
+          close (fds[idx]);
+    }
+
+    for (idx = 0; idx < count; idx++)
+    {
+      if (data[idx]->buffer && !data[idx]->mapped)
+      {
+        if (results[2 * idx] == sizes[idx])
+        {
+          data[idx]->length = (size_t)sizes[idx];
+        }
+        else
+        {
+          free (data[idx]->buffer);
+          data[idx]->buffer = 0;
+        }
+      }
+    }
+
+    return;
+  }
+#endif
+
+  for (idx = 0; idx < count; idx++)
+  {
+    if (fds[idx] < 0)
+      continue;
+
+    if (data[idx]->buffer && !data[idx]->mapped)
+    {
+      for (offset = 0; offset < (size_t)sizes[idx]; offset += readlen)
+      {
+        readlen = pread (fds[idx], data[idx]->buffer + offset, (size_t)sizes[idx] - offset, offset);
+
+        if (readlen < 0 && errno == EINTR)
+          readlen = 0;
+        else if (readlen <= 0)
+          break;
+      }
+
+      if (offset == (size_t)sizes[idx])
+      {
+        data[idx]->length = offset;
+      }
+      else
+      {
+        free (data[idx]->buffer);
+        data[idx]->buffer = 0;
+      }
+    }
+
+    close (fds[idx]);
+  }
+} /* End of readbatch() */
+#endif /* S2M_THREADS */
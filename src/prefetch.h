@@ -0,0 +1,23 @@
+/***************************************************************************
+ * prefetch.h
+ *
+ * Reading of input files ahead of conversion.
+ *
+ * A reader thread reads the next input files of the file list into
+ * memory, in batches, while the main thread converts them in list
+ * order.
+ ***************************************************************************/
+
+#ifndef PREFETCH_H
+#define PREFETCH_H 1
+
+#include "sac2mseed.h"
+
+/* Default number of input files read ahead of conversion */
+#define PREFETCHFILES 16
+
+#if defined(S2M_THREADS)
+extern int convertprefetched (int slotcount);
+#endif
+
+#endif /* PREFETCH_H */
@@ -11,6 +11,7 @@
 
 #include <ctype.h>
 #include <errno.h>
+#include <float.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -18,44 +19,171 @@
 
 #include <libmseed.h>
 
-#include "sacformat.h"
+#include "libsac2mseed.h"
+#include "sac2mseed.h"
 
-#define VERSION "1.13"
+#if defined(S2M_THREADS)
+#include "outwriter.h"
+#endif
+#include "prefetch.h"
+#include "walker.h"
+#include "watch.h"
+
+#define VERSION "1.14"
 #define PACKAGE "sac2mseed"
 
 #if defined(LWP_WIN)
 #define strtoull _strtoui64
 #endif
 
-struct listnode
+/* Archive directories are created with mkdir(), inputs checked with stat() */
+#if defined(LMP_WIN)
+#include <direct.h>
+#define mkdir(path, mode) _mkdir (path)
+#endif
+#include <sys/stat.h>
+#include <sys/types.h>
+
+/* A block of the string arena holding the paths of a path list */
+struct arenablock
+{
+  struct arenablock *prev;  /* Previously filled block */
+  size_t used;              /* Bytes of data used */
+  size_t size;              /* Bytes of data allocated */
+  char data[1];
+};
+
+#define ARENABLOCKSIZE 1048576
+
+/* Sort key of an input for sorting by source name and start time */
+struct sourcekey
+{
+  char *path;               /* Input file path */
+  char source[50];          /* Source name, NET_STA_LOC_CHAN */
+  hptime_t starttime;       /* Start time, HPTERROR if unknown */
+};
+
+/* Input sort orders */
+#define SORT_NONE   0
+#define SORT_PATH   1 /* By path */
+#define SORT_SOURCE 2 /* By network, station, location, channel and start time */
+
+/* Maximum number of open SDS archive files, the least recently used
+ * file is closed when another is needed */
+#define SDSMAXOPEN 50
+
+/* An open SDS archive day file */
+struct sdsentry
+{
+  char path[1024];          /* File path */
+  FILE *fp;                 /* Open file, appending */
+  uint64_t lastuse;         /* Sequence of last use, for LRU replacement */
+};
+
+/* Results of checking an input against the manifest */
+#define MANIFEST_CHANGED 0 /* Input must be converted */
+#define MANIFEST_SAME    1 /* Input is unchanged */
+#define MANIFEST_TOUCHED 2 /* Contents unchanged, modification time changed */
+
+/* Initial value of FNV-1a hashes */
+#define FNVBASIS UINT64_C (14695981039346656037)
+
+/* A manifest entry recording the conversion of an input file */
+struct manifestentry
+{
+  int64_t size;             /* Size of input file */
+  int64_t mtime;            /* Modification time of input file */
+  uint64_t hash;            /* Hash of input file contents */
+  char *path;               /* Input file path */
+  char *output;             /* Output file or archive */
+  char *options;            /* Conversion options */
+  struct manifestentry *next; /* Next entry in hash chain or pending list */
+};
+
+/* Conversion job states for parallel operation */
+#define JOB_FREE   0
+#define JOB_ACTIVE 1
+#define JOB_DONE   2
+
+/* A single input file conversion for parallel operation */
+struct convjob
 {
-  char *key;
-  char *data;
-  struct listnode *next;
+  int64_t index;            /* Position of the input in the file list */
+  char *sacfile;            /* Input file name */
+  int status;               /* Job state, JOB_* */
+  int rv;                   /* Result, 0 on success and -1 on failure */
+  struct SACHeader sh;      /* SAC header of the input */
+  MSRecord *msr;            /* Holder of the input details */
+  MSTrace *mst;             /* Private trace used for packing */
+  MSRecord *mstemplate;     /* Private copy of the record template */
+  MSTrace *grouptrace;      /* Trace in the shared group, tracks sequence numbers */
+  int32_t numtraces;        /* Number of traces in the group after this input */
+  char *records;            /* Buffer of packed records */
+  size_t recbytes;          /* Length of packed records in buffer */
+  size_t recalloc;          /* Allocated length of buffer */
+  int reclen;               /* Length of each packed record */
+  int64_t packedsamples;    /* Number of samples packed */
+  int64_t packedrecords;    /* Number of records packed, -1 on error */
+  int skipped;              /* Input unchanged in the manifest, MANIFEST_* */
+  struct manifestentry mentry; /* Manifest details of the input */
 };
 
 static void packtraces (flag flush);
-static int sac2group (char *sacfile, MSTraceGroup *mstg);
-static int parsesac (FILE *ifp, struct SACHeader *sh, float **data, int format,
-                     int verbose, char *sacfile);
-static int readbinaryheader (FILE *ifp, struct SACHeader *sh, int *format,
-                             int *swapflag, int verbose, char *sacfile);
-static int readbinarydata (FILE *ifp, float *data, int datacnt,
-                           int swapflag, int verbose, char *sacfile);
-static int readalphaheader (FILE *ifp, struct SACHeader *sh);
-static int readalphadata (FILE *ifp, float *data, int datacnt);
-static int swapsacheader (struct SACHeader *sh);
+static int64_t packtrace (MSTrace *mst, flag flush);
+static void flushgaps (MSRecord *msr);
+static hptime_t nextmidnight (hptime_t time);
+static int64_t daysplit (hptime_t starttime, double samprate, int64_t index);
+static int sac2group (char *sacfile, MSTraceGroup *mstg, struct sacdata *loaded);
+static int sac2msr (char *sacfile, struct SACHeader *sh, MSRecord **ppmsr,
+                    struct sacdata *loaded);
+static int sac2stream (char *sacfile, MSTraceGroup *mstg);
+static int scalestream (FILE *ifp, struct sacdata *sd, float *fblock, int32_t *iblock,
+                        int blocksize, long long int *scaling, flag *converted,
+                        int64_t *overflows, char *sacfile);
+static FILE *openoutput (char *sacfile);
+static int writeoutput (FILE *fp, const char *data, size_t length);
+static int sdsoutput (char *record, int reclen);
+static FILE *sdsfile (MSTrace *mst);
+static int makedirs (char *path);
+static void closesds (void);
+static int loadmanifest (void);
+static int checkmanifest (char *sacfile, struct manifestentry *entry);
+static void recordmanifest (struct manifestentry *entry);
+static void writemanifest (struct manifestentry *entry);
+static void flushmanifest (void);
+static void addmanifest (struct manifestentry *entry);
+static uint64_t hashbytes (uint64_t hash, const void *data, size_t length);
+static int hashfile (char *path, uint64_t *hash);
+#if defined(S2M_THREADS)
+static int convertparallel (int workers);
+static void *convworker (void *arg);
+static int jointrace (struct convjob *job);
+static void writejob (struct convjob *job);
+static void jobrecord_handler (char *record, int reclen, void *handlerdata);
+#endif
+static int parsesacheader (FILE *ifp, struct SACHeader *sh, struct sacdata *data,
+                           char *sacfile);
+static int readsacblock (FILE *ifp, struct sacdata *data, float *block,
+                         int count, char *sacfile);
+static int rewindsacdata (FILE *ifp, struct sacdata *data, char *sacfile);
+static int loadsacfile (FILE *ifp, struct sacdata *data, char *sacfile);
+#if defined(S2M_MMAP)
+static int mapsacfile (FILE *ifp, struct sacdata *data);
+#endif
 static int writemetadata (struct SACHeader *sh, char *network, char *station,
                           char *location, char *channel, hptime_t starttime,
                           int expanded);
 static int parameter_proc (int argcount, char **argvec);
 static char *getoptval (int argcount, char **argvec, int argopt);
 static int readlistfile (char *listfile);
-static void addnode (struct listnode **listroot, char *key, char *data);
+static int sortinputs (void);
+static int comparesources (const void *a, const void *b);
+static void quietlog (const char *message, void *logdata);
+static void freepaths (struct pathlist *list);
 static void record_handler (char *record, int reclen, void *handlerdata);
 static void usage (void);
 
-static int verbose               = 0;
+int verbose                      = 0;
 static int packreclen            = -1;
 static int encoding              = 11;
 static int byteorder             = -1;
@@ -66,32 +194,83 @@ static char *forcenet            = 0;
 static char *forcesta            = 0;
 static char *forceloc            = 0;
 static char *forcechan           = 0;
-static char *outputfile          = 0;
-static FILE *ofp                 = 0;
+char *outputfile                 = 0;
+FILE *ofp                        = 0;
 static char *metafile            = 0;
 static FILE *mfp                 = 0;
 static long long int datascaling = 0;
-
-/* A list of input files */
-struct listnode *filelist = 0;
-
-static MSTraceGroup *mstg = 0;
+static int workers               = 1;
+static int blocksamples          = 0;
+static int outbufsize            = 8;
+static int prefetchfiles         = PREFETCHFILES;
+static flag mergetraces          = 0;
+flag recursive                   = 0;
+char *fileglob                   = 0;
+static char *manifestfile        = 0;
+static FILE *manfp               = 0;
+char *sdsdir                     = 0;
+static MSTrace *sdstrace         = 0;
+static FILE *sdsfp               = 0;
+struct pathlist spoollist        = {0};
+char *donedir                    = 0;
+flag spooling                    = 0;
+static int sortorder             = SORT_NONE;
+flag outputerror                 = 0;
+
+/* The list of input files */
+struct pathlist filelist = {0};
+
+static S2MContext *s2mctx = 0;
+MSTraceGroup *mstg        = 0;
 
 static int packedtraces      = 0;
-static int64_t packedsamples = 0;
-static int64_t packedrecords = 0;
+static int64_t skippedinputs = 0;
 
 int
 main (int argc, char **argv)
 {
-  struct listnode *flp;
+  char *sacfile;
+  int64_t index;
+  int rv = 0;
 
   /* Process given parameters (command line and parameter file) */
   if (parameter_proc (argc, argv) < 0)
     return -1;
 
-  /* Init MSTraceGroup */
-  mstg = mst_initgroup (mstg);
+  /* Init conversion context with the MSTraceGroup */
+  if (!(s2mctx = s2m_init (NULL, &record_handler, 0)))
+  {
+    fprintf (stderr, "Cannot initialize conversion context\n");
+    return -1;
+  }
+
+  s2mctx->params.packreclen  = packreclen;
+  s2mctx->params.encoding    = encoding;
+  s2mctx->params.byteorder   = byteorder;
+  s2mctx->params.sacformat   = sacformat;
+  s2mctx->params.datascaling = datascaling;
+  s2mctx->params.srateblkt   = srateblkt;
+  s2mctx->params.forcenet    = forcenet;
+  s2mctx->params.forcesta    = forcesta;
+  s2mctx->params.forceloc    = forceloc;
+  s2mctx->params.forcechan   = forcechan;
+  s2mctx->params.workers     = workers;
+  s2mctx->params.verbose     = verbose;
+
+  mstg = s2mctx->mstg;
+
+#if defined(S2M_WATCH)
+  /* Start watching spool directories, before any threads are started
+   * so that all threads block the signals stopping the watch */
+  if (spoollist.count && startwatch ())
+    return -1;
+#endif
+
+#if defined(S2M_THREADS)
+  /* Start the write-behind output writer */
+  if (outbufsize > 0 && startwriter ((size_t)outbufsize * 1024 * 1024 / OUTBUFCOUNT))
+    return -1;
+#endif
 
   /* Open the output file if specified */
   if (outputfile)
@@ -123,31 +302,143 @@ main (int argc, char **argv)
     }
   }
 
+  /* Read the manifest of converted inputs */
+  if (manifestfile && loadmanifest ())
+    return -1;
+
+#if defined(S2M_THREADS)
+  /* Start listing input directories */
+  if (startwalk ())
+    return -1;
+#endif
+
+  /* Sort the complete list of inputs if requested */
+  if (sortorder && sortinputs ())
+    return -1;
+
   /* Read input SAC files into MSTraceGroup */
-  flp = filelist;
-  while (flp != 0)
+#if defined(S2M_THREADS)
+  if (workers > 1)
   {
-    if (verbose)
-      fprintf (stderr, "Reading %s\n", flp->data);
-
-    sac2group (flp->data, mstg);
+    if (convertparallel (workers))
+      return -1;
+  }
+  else if (prefetchfiles > 0 && !blocksamples)
+  {
+    if (convertprefetched (prefetchfiles))
+      return -1;
+  }
+  else
+#endif
+  {
+    index = 0;
+    while ((sacfile = nextfile (index++)))
+    {
+      convertinput (sacfile, NULL);
 
-    flp = flp->next;
+      /* Stop converting when output cannot be written */
+      if (outputerror)
+        break;
+    }
   }
 
+#if defined(S2M_WATCH)
+  /* Convert files arriving in spool directories until stopped */
+  if (spoollist.count && !outputerror && watchspool ())
+    rv = -1;
+#endif
+
+  /* Flush traces merged across input files */
+  if (mergetraces)
+    packtraces (1);
+
+  if (manifestfile && !outputerror)
+    flushmanifest ();
+
+  if (manifestfile)
+    fprintf (stderr, "Skipped %lld unchanged input(s)\n", (long long int)skippedinputs);
+
   fprintf (stderr, "Packed %d trace(s) of %lld samples into %lld records\n",
-           packedtraces, (long long int)packedsamples, (long long int)packedrecords);
+           packedtraces, (long long int)s2mctx->packedsamples,
+           (long long int)s2mctx->packedrecords);
 
   /* Make sure everything is cleaned up */
   if (ofp)
-    fclose (ofp);
+    closeoutput (ofp);
+
+  if (sdsdir)
+    closesds ();
+
+  if (manfp)
+    closeoutput (manfp);
+
+#if defined(S2M_THREADS)
+  stopwalk ();
+
+  if (stopwriter ())
+    outputerror = 1;
+#endif
 
   if (mfp)
     fclose (mfp);
 
-  return 0;
+  freepaths (&filelist);
+  freepaths (&spoollist);
+
+  s2m_free (&s2mctx);
+
+  return (outputerror) ? -1 : rv;
 } /* End of main() */
 
+/***************************************************************************
+ * convertinput:
+ *
+ * Convert a single input file, unless unchanged since recorded in the
+ * manifest.  The contents of the file may already be loaded, they are
+ * released in any case.
+ *
+ * Returns 0 on success or when skipped, and -1 on failure
+ ***************************************************************************/
+int
+convertinput (char *sacfile, struct sacdata *loaded)
+{
+  struct manifestentry mentry;
+  int changed = MANIFEST_CHANGED;
+  int rv;
+
+  /* Skip inputs unchanged since recorded in the manifest */
+  if (manifestfile)
+    changed = checkmanifest (sacfile, &mentry);
+
+  if (changed != MANIFEST_CHANGED)
+  {
+    if (verbose)
+      fprintf (stderr, "Skipping unchanged %s\n", sacfile);
+
+    if (changed == MANIFEST_TOUCHED)
+      recordmanifest (&mentry);
+
+    freesacdata (loaded);
+    skippedinputs++;
+    return 0;
+  }
+
+  if (verbose)
+    fprintf (stderr, "Reading %s\n", sacfile);
+
+  if (blocksamples)
+    rv = sac2stream (sacfile, mstg);
+  else
+    rv = sac2group (sacfile, mstg, loaded);
+
+  freesacdata (loaded);
+
+  if (manifestfile && !rv && !outputerror)
+    recordmanifest (&mentry);
+
+  return rv;
+} /* End of convertinput() */
+
 /***************************************************************************
  * packtraces:
  *
@@ -159,257 +450,231 @@ static void
 packtraces (flag flush)
 {
   MSTrace *mst;
-  int64_t trpackedsamples = 0;
-  int64_t trpackedrecords = 0;
 
   mst = mstg->traces;
   while (mst)
   {
-
-    if (mst->numsamples <= 0)
-    {
-      mst = mst->next;
-      continue;
-    }
-
-    trpackedrecords = mst_pack (mst, &record_handler, 0, packreclen, encoding, byteorder,
-                                &trpackedsamples, flush, verbose - 2, (MSRecord *)mst->prvtptr);
-
-    if (trpackedrecords < 0)
-    {
-      fprintf (stderr, "Error packing data\n");
-    }
-    else
-    {
-      packedrecords += trpackedrecords;
-      packedsamples += trpackedsamples;
-    }
+    packtrace (mst, flush);
 
     mst = mst->next;
   }
 } /* End of packtraces() */
 
 /***************************************************************************
- * sac2group:
- * Read a SAC file and add data samples to a MSTraceGroup.  As the SAC
- * data is read in a MSRecord struct is used as a holder for the input
- * information.
+ * packtrace:
  *
- * Returns 0 on success, and -1 on failure
+ * Pack a single trace using its MSTrace template.  For archive output
+ * the trace is noted for sdsoutput(), traces packed for an archive
+ * never span a day boundary so all records of the trace are written to
+ * the day file of its first sample.
+ *
+ * Returns number of records packed on success, and -1 on failure
  ***************************************************************************/
-static int
-sac2group (char *sacfile, MSTraceGroup *mstg)
+static int64_t
+packtrace (MSTrace *mst, flag flush)
 {
-  FILE *ifp     = 0;
-  MSRecord *msr = 0;
-  MSTrace *mst;
-  struct blkt_1000_s Blkt1000;
-  struct blkt_1001_s Blkt1001;
-  struct blkt_100_s Blkt100;
-
-  struct SACHeader sh;
-  float *fdata   = 0;
-  int32_t *idata = 0;
-  int dataidx;
-  int datacnt;
-  long long int scaling = datascaling;
-
-  /* Open input file */
-  if ((ifp = fopen (sacfile, "rb")) == NULL)
-  {
-    fprintf (stderr, "Cannot open input file: %s (%s)\n",
-             sacfile, strerror (errno));
-    return -1;
-  }
-
-  /* Parse input SAC file into a header structure and data buffer */
-  if ((datacnt = parsesac (ifp, &sh, &fdata, sacformat, verbose, sacfile)) < 0)
-  {
-    fprintf (stderr, "Error parsing %s\n", sacfile);
-
-    return -1;
-  }
+  int64_t records;
 
-  /* Open output file if needed */
-  if (!ofp)
-  {
-    char mseedoutputfile[1024];
-    int namelen;
-    strncpy (mseedoutputfile, sacfile, sizeof (mseedoutputfile) - 6);
-    namelen = strlen (sacfile);
+  sdstrace = mst;
+  sdsfp    = 0;
 
-    /* Truncate file name if .sac is at the end */
-    if (namelen > 4)
-      if ((*(mseedoutputfile + namelen - 1) == 'c' || *(mseedoutputfile + namelen - 1) == 'C') &&
-          (*(mseedoutputfile + namelen - 2) == 'a' || *(mseedoutputfile + namelen - 2) == 'A') &&
-          (*(mseedoutputfile + namelen - 3) == 's' || *(mseedoutputfile + namelen - 3) == 'S') &&
-          (*(mseedoutputfile + namelen - 4) == '.'))
+  records = s2m_packtrace (s2mctx, mst, flush);
 
-      {
-        *(mseedoutputfile + namelen - 4) = '\0';
-      }
+  sdstrace = 0;
+  sdsfp    = 0;
 
-    /* Add .mseed to the file name */
-    strcat (mseedoutputfile, ".mseed");
+  return records;
+} /* End of packtrace() */
 
-    if ((ofp = fopen (mseedoutputfile, "wb")) == NULL)
-    {
-      fprintf (stderr, "Cannot open output file: %s (%s)\n",
-               mseedoutputfile, strerror (errno));
-      return -1;
-    }
-  }
+/***************************************************************************
+ * flushgaps:
+ *
+ * Flush the traces of the same channel as a record holder, packing any
+ * samples that remain after packing without flushing, unless the
+ * record continues one of the traces on the same day.  This is used
+ * when merging traces across input files, where traces are flushed
+ * only at gaps and, for archive output, day boundaries.
+ ***************************************************************************/
+static void
+flushgaps (MSRecord *msr)
+{
+  MSTrace *mst;
+  hptime_t endtime;
+  flag whence = 0;
+
+  /* Archive day files also require a flush when the input starts a new day */
+  if ((endtime = msr_endtime (msr)) != HPTERROR &&
+      (mst = mst_findadjacent (mstg, &whence, 0, msr->network, msr->station,
+                               msr->location, msr->channel, msr->samprate, -1.0,
+                               msr->starttime, endtime, -1.0)) &&
+      whence == 1 &&
+      !(sdsdir && mst->numsamples > 0 &&
+        nextmidnight (mst->starttime) != nextmidnight (msr->starttime)))
+    return;
 
-  if (!(msr = msr_init (msr)))
+  for (mst = mstg->traces; mst; mst = mst->next)
   {
-    fprintf (stderr, "Cannot initialize MSRecord strcture\n");
-    return -1;
+    if (mst->numsamples > 0 &&
+        !strcmp (mst->network, msr->network) &&
+        !strcmp (mst->station, msr->station) &&
+        !strcmp (mst->location, msr->location) &&
+        !strcmp (mst->channel, msr->channel))
+      packtrace (mst, 1);
   }
+} /* End of flushgaps() */
 
-  /* Determine autoscaling */
-  if (scaling == 0 && encoding != 4)
-  {
-    float datamin, datamax;
-    int fractional;
-    long long int autoscale;
+/***************************************************************************
+ * nextmidnight:
+ *
+ * Returns the first day boundary (midnight UTC) after a time.
+ ***************************************************************************/
+static hptime_t
+nextmidnight (hptime_t time)
+{
+  hptime_t day = (hptime_t)86400 * HPTMODULUS;
+  hptime_t days;
 
-    /* Determine data sample minimum and maximum
-       * Detect if scaling by 1 will result in truncation (fractional=1) */
-    datamin = datamax = *fdata;
-    fractional        = 0;
-    for (dataidx = 1; dataidx < datacnt; dataidx++)
-    {
-      if (*(fdata + dataidx) < datamin)
-        datamin = *(fdata + dataidx);
-      if (*(fdata + dataidx) > datamax)
-        datamax = *(fdata + dataidx);
+  /* Floor division for times before the epoch */
+  days = time / day;
+  if (time % day < 0)
+    days--;
 
-      if (!fractional)
-        if (*(fdata + dataidx) - (int)*(fdata + dataidx) > 0.000001)
-          fractional = 1;
-    }
+  return (days + 1) * day;
+} /* End of nextmidnight() */
 
-    autoscale = 1;
+/***************************************************************************
+ * daysplit:
+ *
+ * Determine the index of the first sample on the day following the
+ * day of the sample at index, for samples starting at starttime.
+ * Sample times are calculated as they are for packed records.
+ *
+ * Returns the sample index.
+ ***************************************************************************/
+static int64_t
+daysplit (hptime_t starttime, double samprate, int64_t index)
+{
+  hptime_t midnight;
+  int64_t split;
 
-    if (fractional)
-    {
-      for (autoscale = 1; abs ((int32_t)(datamax * autoscale)) < 100000; autoscale *= 10)
-      {
-      }
+  if (samprate <= 0.0)
+    return INT64_MAX;
 
-      if (abs ((int32_t)(datamin * autoscale)) < 10)
-        fprintf (stderr, "WARNING Large sample value range (%g/%g), autoscaling might be a bad idea\n",
-                 datamax, datamin);
-    }
+  midnight = nextmidnight (starttime + (hptime_t)(index / samprate * HPTMODULUS + 0.5));
+  split    = (int64_t)((double)(midnight - starttime) / HPTMODULUS * samprate);
 
-    scaling = autoscale;
-  }
+  if (split <= index)
+    split = index + 1;
 
-  /* Populate MSRecord structure with header details */
-  if (strncmp (SUNDEF, sh.knetwk, 8))
-    ms_strncpclean (msr->network, sh.knetwk, 2);
-  if (strncmp (SUNDEF, sh.kstnm, 8))
-    ms_strncpclean (msr->station, sh.kstnm, 5);
-  if (strncmp (SUNDEF, sh.khole, 8))
-    ms_strncpclean (msr->location, sh.khole, 2);
-  if (strncmp (SUNDEF, sh.kcmpnm, 8))
-    ms_strncpclean (msr->channel, sh.kcmpnm, 3);
+  while (starttime + (hptime_t)(split / samprate * HPTMODULUS + 0.5) < midnight)
+    split++;
 
-  if (forcenet)
-    ms_strncpclean (msr->network, forcenet, 2);
+  while (split - 1 > index &&
+         starttime + (hptime_t)((split - 1) / samprate * HPTMODULUS + 0.5) >= midnight)
+    split--;
 
-  if (forcesta)
-    ms_strncpclean (msr->station, forcesta, 5);
+  return split;
+} /* End of daysplit() */
 
-  if (forceloc)
-    ms_strncpclean (msr->location, forceloc, 2);
+/***************************************************************************
+ * sac2group:
+ * Read a SAC file and add data samples to a MSTraceGroup.  As the SAC
+ * data is read in a MSRecord struct is used as a holder for the input
+ * information.  If not NULL, loaded holds the contents of the file
+ * already mapped and is released.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+sac2group (char *sacfile, MSTraceGroup *mstg, struct sacdata *loaded)
+{
+  MSRecord *msr = 0;
+  MSTrace *mst;
+  struct SACHeader sh;
+  void *datasamples;
+  hptime_t starttime;
+  int64_t numsamples;
+  int64_t offset;
+  int64_t count;
+  int64_t split;
+  int samplesize;
+
+  /* Parse input SAC file into a header structure and MSRecord holder */
+  if (sac2msr (sacfile, &sh, &msr, loaded))
+    return -1;
 
-  if (forcechan)
+  /* Open output file if needed */
+  if (!ofp && !sdsdir)
   {
-    int idx = 0;
-    while (forcechan[idx] && idx < (sizeof (msr->channel) - 1))
+    if ((ofp = openoutput (sacfile)) == NULL)
     {
-      if (forcechan[idx] != '.')
-        msr->channel[idx] = forcechan[idx];
-      idx++;
+      msr_free (&msr);
+      return -1;
     }
-    msr->channel[idx] = '\0';
   }
 
-  msr->starttime = ms_time2hptime (sh.nzyear, sh.nzjday, sh.nzhour, sh.nzmin, sh.nzsec, sh.nzmsec * 1000);
-
-  /* Adjust for Begin ('B' SAC variable) time offset */
-  if (sh.b != FUNDEF)
-    msr->starttime += (double)sh.b * HPTMODULUS;
+  /* Add the samples in pieces that do not span a day boundary when
+   * writing to an archive, otherwise as a single piece */
+  datasamples = msr->datasamples;
+  numsamples  = msr->numsamples;
+  starttime   = msr->starttime;
+  samplesize  = ms_samplesize (msr->sampletype);
 
-  /* Calculate sample rate from interval(period) rounding to nearest 0.000001 Hz */
-  msr->samprate = (double)((int)((1 / sh.delta) * 100000 + 0.5)) / 100000;
-
-  msr->samplecnt = msr->numsamples = datacnt;
-
-  /* Data sample type and sample array */
-  if (encoding == 4)
-  {
-    msr->sampletype  = 'f';
-    msr->datasamples = fdata;
-  }
-  else
+  for (offset = 0; offset < numsamples; offset += count)
   {
-    /* Create an array of scaled integers */
-    idata = (int32_t *)malloc (datacnt * sizeof (int32_t));
-
-    if (verbose)
-      fprintf (stderr, "[%s] Creating integer data scaled by: %lld\n", sacfile, scaling);
+    count = numsamples - offset;
 
-    for (dataidx = 0; dataidx < datacnt; dataidx++)
-      *(idata + dataidx) = (int32_t)(*(fdata + dataidx) * scaling);
+    if (sdsdir && (split = daysplit (starttime, msr->samprate, offset)) < numsamples)
+      count = split - offset;
 
-    msr->sampletype  = 'i';
-    msr->datasamples = idata;
-  }
+    msr->datasamples = (char *)datasamples + offset * samplesize;
+    msr->numsamples  = count;
+    msr->samplecnt   = count;
 
-  if (verbose >= 1)
-  {
-    fprintf (stderr, "[%s] %lld samps @ %.6f Hz for N: '%s', S: '%s', L: '%s', C: '%s'\n",
-             sacfile, (long long int)msr->numsamples, msr->samprate,
-             msr->network, msr->station, msr->location, msr->channel);
-  }
+    if (offset > 0)
+      msr->starttime = starttime + (hptime_t)(offset / msr->samprate * HPTMODULUS + 0.5);
 
-  if (!(mst = mst_addmsrtogroup (mstg, msr, 0, -1.0, -1.0)))
-  {
-    fprintf (stderr, "[%s] Error adding samples to MSTraceGroup\n", sacfile);
-  }
+    /* Flush merged traces of the channel unless continued by the input */
+    if (mergetraces)
+      flushgaps (msr);
 
-  /* Create an MSRecord template for the MSTrace by copying the current holder */
-  if (!mst->prvtptr)
-  {
-    mst->prvtptr = msr_duplicate (msr, 0);
+    if (!(mst = mst_addmsrtogroup (mstg, msr, 0, -1.0, -1.0)))
+    {
+      fprintf (stderr, "[%s] Error adding samples to MSTraceGroup\n", sacfile);
+      break;
+    }
 
+    /* Create an MSRecord template for the MSTrace by copying the current holder */
     if (!mst->prvtptr)
     {
-      fprintf (stderr, "[%s] Error duplicate MSRecord for template\n", sacfile);
-      return -1;
+      mst->prvtptr = s2m_createtemplate (s2mctx, msr);
+
+      if (!mst->prvtptr)
+      {
+        fprintf (stderr, "[%s] Error duplicate MSRecord for template\n", sacfile);
+        break;
+      }
     }
 
-    /* Add blockettes 1000 & 1001 to template */
-    memset (&Blkt1000, 0, sizeof (struct blkt_1000_s));
-    msr_addblockette ((MSRecord *)mst->prvtptr, (char *)&Blkt1000,
-                      sizeof (struct blkt_1001_s), 1000, 0);
-    memset (&Blkt1001, 0, sizeof (struct blkt_1001_s));
-    msr_addblockette ((MSRecord *)mst->prvtptr, (char *)&Blkt1001,
-                      sizeof (struct blkt_1001_s), 1001, 0);
+    /* Pack complete records, only flushing at gaps and day boundaries
+     * when merging traces */
+    if (mergetraces)
+      packtrace (mst, (offset + count < numsamples));
+    else
+      packtraces (1);
+  }
 
-    /* Add blockette 100 to template if requested */
-    if (srateblkt)
-    {
-      memset (&Blkt100, 0, sizeof (struct blkt_100_s));
-      Blkt100.samprate = (float)msr->samprate;
-      msr_addblockette ((MSRecord *)mst->prvtptr, (char *)&Blkt100,
-                        sizeof (struct blkt_100_s), 100, 0);
-    }
+  msr->datasamples = datasamples;
+  msr->numsamples  = numsamples;
+  msr->samplecnt   = numsamples;
+  msr->starttime   = starttime;
+
+  if (offset < numsamples)
+  {
+    msr_free (&msr);
+    return -1;
   }
 
-  packtraces (1);
   packedtraces += mstg->numtraces;
 
   /* Write metadata to file if requested */
@@ -428,22 +693,12 @@ sac2group (char *sacfile, MSTraceGroup *mstg)
   }
 
   /* Cleanup */
-  fclose (ifp);
-
   if (ofp && !outputfile)
   {
-    fclose (ofp);
+    closeoutput (ofp);
     ofp = 0;
   }
 
-  if (fdata)
-    free (fdata);
-
-  if (idata)
-    free (idata);
-
-  msr->datasamples = 0;
-
   if (msr)
     msr_free (&msr);
 
@@ -451,461 +706,1947 @@ sac2group (char *sacfile, MSTraceGroup *mstg)
 } /* End of sac2group() */
 
 /***************************************************************************
- * parsesac:
- *
- * Parse a SAC file, autodetecting format dialect (ALPHA,
- * binary, big or little endian).  Results will be placed in the
- * supplied SAC header struct and data (float sample array in host
- * byte order).  The data array will be allocated by this routine and
- * must be free'd by the caller.  The data array will contain the
- * number of samples indicated in the SAC header (sh->npts).
- *
- * The format argument is interpreted as:
- * 0 : Unknown, detection needed
- * 1 : ALPHA
- * 2 : Binary, byte order detection needed
- * 3 : Binary, little endian
- * 4 : Binary, big endian
+ * sac2msr:
  *
- * Returns number of data samples in file or -1 on failure.
+ * Read a SAC file and convert it with s2m_sac2msr(), populating a new
+ * MSRecord as a holder for the input details and scaled data samples.
+ * The MSRecord owns the data samples and must be free'd by the caller.
+ *
+ * Returns 0 on success, and -1 on failure
  ***************************************************************************/
 static int
-parsesac (FILE *ifp, struct SACHeader *sh, float **data, int format,
-          int verbose, char *sacfile)
+sac2msr (char *sacfile, struct SACHeader *sh, MSRecord **ppmsr,
+         struct sacdata *loaded)
 {
-  char fourc[4];
-  int swapflag = 0;
+  FILE *ifp = 0;
+  struct sacdata sd;
   int rv;
 
-  /* Argument sanity */
-  if (!ifp || !sh || !data)
-    return -1;
-
-  /* Read the first 4 characters */
-  if (fread (&fourc, 4, 1, ifp) < 1)
-    return -1;
-
-  /* Determine if the file is ALPHA or binary SAC,
-   * if the first 4 characters are spaces assume ALPHA SAC */
-  if (format == 0)
+  /* Use contents already loaded, ownership moves here */
+  if (loaded && loaded->buffer)
   {
-    if (fourc[0] == ' ' && fourc[1] == ' ' && fourc[2] == ' ' && fourc[3] == ' ')
-      format = 1;
-    else
-      format = 2; /* Byte order detection will occur below */
-  }
+    sd = *loaded;
+    memset (loaded, 0, sizeof (struct sacdata));
 
-  /* Rewind the file position pointer to the beginning */
-  rewind (ifp);
+    rv = s2m_sac2msr (s2mctx, sd.buffer, sd.length, sacfile, sh, ppmsr);
 
-  /* Read the header */
-  if (format == 1) /* Process SAC ALPHA header */
-  {
-    if ((rv = readalphaheader (ifp, sh)))
-    {
-      fprintf (stderr, "[%s] Error parsing SAC ALPHA header at line %d\n",
-               sacfile, rv);
-      return -1;
-    }
-  }
-  else if (format >= 2 && format <= 4) /* Process SAC binary header */
-  {
-    if (readbinaryheader (ifp, sh, &format, &swapflag, verbose, sacfile))
-    {
-      fprintf (stderr, "[%s] Error parsing SAC header\n", sacfile);
-      return -1;
-    }
+    freesacdata (&sd);
+
+    return rv;
   }
-  else
+
+  /* Open input file */
+  if ((ifp = fopen (sacfile, "rb")) == NULL)
   {
-    fprintf (stderr, "[%s] Unrecognized format value: %d\n", sacfile, format);
+    fprintf (stderr, "Cannot open input file: %s (%s)\n",
+             sacfile, strerror (errno));
     return -1;
   }
 
-  /* Fix up underspecified year values by adding 1900 */
-  if (sh->nzyear >= 0 && sh->nzyear <= 200)
-  {
-    if (verbose)
-      fprintf (stderr, "[%s] Adding 1900 to underspecified year value (%d)\n", sacfile, sh->nzyear);
-
-    sh->nzyear += 1900;
-  }
+  /* Map or read the file contents */
+  memset (&sd, 0, sizeof (struct sacdata));
 
-  /* Sanity check the start time */
-  if (sh->nzyear < 1900 || sh->nzyear > 3000 ||
-      sh->nzjday < 1 || sh->nzjday > 366 ||
-      sh->nzhour < 0 || sh->nzhour > 23 ||
-      sh->nzmin < 0 || sh->nzmin > 59 ||
-      sh->nzsec < 0 || sh->nzsec > 60 ||
-      sh->nzmsec < 0 || sh->nzmsec > 999999)
+  if (loadsacfile (ifp, &sd, sacfile))
   {
-    fprintf (stderr, "[%s] Unrecognized format (not SAC?)\n", sacfile);
+    fprintf (stderr, "Error parsing %s\n", sacfile);
+
+    fclose (ifp);
     return -1;
   }
 
-  if (verbose)
-  {
-    if (format == 1)
-      fprintf (stderr, "[%s] Reading SAC ALPHA format\n", sacfile);
-    if (format == 3)
-      fprintf (stderr, "[%s] Reading SAC binary format (little-endian)\n", sacfile);
-    if (format == 4)
-      fprintf (stderr, "[%s] Reading SAC binary format (big-endian)\n", sacfile);
+  fclose (ifp);
+
+  rv = s2m_sac2msr (s2mctx, sd.buffer, sd.length, sacfile, sh, ppmsr);
+
+  freesacdata (&sd);
+
+  return rv;
+} /* End of sac2msr() */
+
+/***************************************************************************
+ * sac2stream:
+ *
+ * Read a SAC file in blocks of samples and add each block to a
+ * MSTraceGroup, packing complete records as soon as they are
+ * available.  Compression history is retained in the trace between
+ * blocks and the trace is flushed after the last block, producing the
+ * same records as sac2group() while only holding a block of samples
+ * and a partial record in memory.  Record start times may differ by a
+ * microsecond when the sample period is not a whole number of
+ * microseconds.
+ *
+ * When autoscaling, the data samples are read twice, first to
+ * determine the scaling factor and then to convert them.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+sac2stream (char *sacfile, MSTraceGroup *mstg)
+{
+  FILE *ifp     = 0;
+  MSRecord *msr = 0;
+  MSTrace *mst  = 0;
+  struct SACHeader sh;
+  struct sacdata sd;
+  float *fblock     = 0;
+  int32_t *iblock   = 0;
+  void *block       = 0;
+  int64_t overflows = 0;
+  StreamState prevstate;
+  hptime_t prevstart = 0;
+  hptime_t prevend   = 0;
+  hptime_t starttime;
+  hptime_t endtime;
+  flag newtrace  = 0;
+  flag converted = 0;
+  flag whence    = 0;
+  int64_t pending;
+  int64_t split = 0;
+  flag flush;
+  int samplesize;
+  int blocksize;
+  int datacnt;
+  int offset;
+  int piece;
+  int count;
+  int idx;
+  int rv                = 0;
+  long long int scaling = datascaling;
+
+  /* Open input file */
+  if ((ifp = fopen (sacfile, "rb")) == NULL)
+  {
+    fprintf (stderr, "Cannot open input file: %s (%s)\n",
+             sacfile, strerror (errno));
+    return -1;
+  }
+
+  /* Parse input SAC file header, leaving the data to be read in blocks */
+  if ((datacnt = parsesacheader (ifp, &sh, &sd, sacfile)) < 0)
+  {
+    fprintf (stderr, "Error parsing %s\n", sacfile);
+
+    fclose (ifp);
+    freesacdata (&sd);
+    return -1;
+  }
+
+  blocksize = (datacnt < blocksamples) ? datacnt : blocksamples;
+
+  if (!(msr = msr_init (msr)))
+  {
+    fprintf (stderr, "Cannot initialize MSRecord strcture\n");
+    rv = -1;
+  }
+  else if (!(fblock = (float *)malloc (blocksize * sizeof (float))) ||
+           (encoding != 4 && !(iblock = (int32_t *)malloc (blocksize * sizeof (int32_t)))))
+  {
+    fprintf (stderr, "[%s] Cannot allocate memory for data samples\n", sacfile);
+    rv = -1;
+  }
+
+  /* Determine autoscaling */
+  if (!rv && scaling == 0 && encoding != 4)
+  {
+    if (scalestream (ifp, &sd, fblock, iblock, blocksize, &scaling, &converted,
+                     &overflows, sacfile))
+    {
+      fprintf (stderr, "Error parsing %s\n", sacfile);
+      rv = -1;
+    }
+  }
+
+  /* Open output file if needed */
+  if (!rv && !ofp && !sdsdir)
+  {
+    if ((ofp = openoutput (sacfile)) == NULL)
+      rv = -1;
+  }
+
+  /* Find the trace continued by the file or create a new trace, samples
+   * are added per block */
+  if (!rv)
+  {
+    s2m_populatemsr (s2mctx, msr, &sh);
+
+    msr->samplecnt  = datacnt;
+    msr->sampletype = (encoding == 4) ? 'f' : 'i';
+
+    /* Flush merged traces of the channel unless continued by the input */
+    if (mergetraces)
+      flushgaps (msr);
+
+    if ((endtime = msr_endtime (msr)) == HPTERROR)
+    {
+      fprintf (stderr, "[%s] Error calculating end time\n", sacfile);
+      rv = -1;
+    }
+    else if ((mst = mst_findadjacent (mstg, &whence, 0, msr->network, msr->station,
+                                      msr->location, msr->channel, msr->samprate, -1.0,
+                                      msr->starttime, endtime, -1.0)))
+    {
+      /* Retain the state of the trace to restore on failure */
+      prevstart = mst->starttime;
+      prevend   = mst->endtime;
+      if (mst->ststate)
+        prevstate = *mst->ststate;
+      else
+        memset (&prevstate, 0, sizeof (StreamState));
+
+      if (whence == 2)
+        mst->starttime = msr->starttime;
+      else
+        mst->endtime = endtime;
+    }
+    else if ((mst = mst_init (NULL)))
+    {
+      newtrace = 1;
+
+      strncpy (mst->network, msr->network, sizeof (mst->network));
+      strncpy (mst->station, msr->station, sizeof (mst->station));
+      strncpy (mst->location, msr->location, sizeof (mst->location));
+      strncpy (mst->channel, msr->channel, sizeof (mst->channel));
+
+      mst->starttime  = msr->starttime;
+      mst->endtime    = endtime;
+      mst->samprate   = msr->samprate;
+      mst->sampletype = msr->sampletype;
+    }
+    else
+    {
+      fprintf (stderr, "[%s] Error adding samples to MSTraceGroup\n", sacfile);
+      rv = -1;
+    }
+
+    if (!rv && !mst->prvtptr && !(mst->prvtptr = s2m_createtemplate (s2mctx, msr)))
+    {
+      fprintf (stderr, "[%s] Error duplicate MSRecord for template\n", sacfile);
+      rv = -1;
+    }
+
+    if (!rv && encoding != 4 && verbose)
+      fprintf (stderr, "[%s] Creating integer data scaled by: %lld\n", sacfile, scaling);
+  }
+
+  if (!rv)
+  {
+    starttime  = mst->starttime;
+    endtime    = mst->endtime;
+    pending    = mst->numsamples;
+    samplesize = ms_samplesize (mst->sampletype);
+
+    if (sdsdir)
+      split = daysplit (starttime, mst->samprate, pending);
+
+    if (!converted)
+      overflows = 0;
+
+    for (idx = 0; idx < datacnt; idx += count)
+    {
+      count = (datacnt - idx < blocksize) ? datacnt - idx : blocksize;
+
+      /* A single block read while autoscaling is still loaded */
+      if (sd.sac.dataidx == idx && readsacblock (ifp, &sd, fblock, count, sacfile))
+      {
+        fprintf (stderr, "Error parsing %s\n", sacfile);
+        rv = -1;
+        break;
+      }
+
+      if (encoding == 4)
+      {
+        block = fblock;
+      }
+      else
+      {
+        if (!converted)
+          overflows += s2m_scalesamples (fblock, iblock, count, (float)scaling);
+
+        block = iblock;
+      }
+
+      /* Add the block in pieces that do not span a day boundary when
+       * writing to an archive, otherwise as a single piece */
+      for (offset = 0; offset < count; offset += piece)
+      {
+        piece = count - offset;
+        flush = (idx + count >= datacnt && !mergetraces);
+
+        if (sdsdir && split <= pending + idx + count)
+        {
+          piece = (int)(split - pending - idx - offset);
+          flush = 1;
+        }
+
+        if (mst_addspan (mst, 0, endtime, (char *)block + offset * samplesize,
+                         piece, mst->sampletype, 1))
+        {
+          fprintf (stderr, "[%s] Error adding samples to MSTraceGroup\n", sacfile);
+          rv = -1;
+          break;
+        }
+
+        if (packtrace (mst, flush) < 0)
+        {
+          rv = -1;
+          break;
+        }
+
+        /* Set the start of the remaining samples relative to the start of the
+         * trace, avoiding accumulation of rounding errors between blocks */
+        if (mst->samprate > 0.0)
+          mst->starttime = starttime + (hptime_t)((pending + idx + offset + piece - mst->numsamples) / mst->samprate * HPTMODULUS + 0.5);
+
+        if (sdsdir && split <= pending + idx + offset + piece)
+          split = daysplit (starttime, mst->samprate, split);
+      }
+
+      if (rv)
+        break;
+    }
+  }
+
+  if (!rv)
+  {
+    if (newtrace)
+      mst_addtracetogroup (mstg, mst);
+
+    if (overflows)
+      fprintf (stderr, "[%s] WARNING %lld sample(s) outside of 32-bit integer range after scaling\n",
+               sacfile, (long long int)overflows);
+
+    if (verbose >= 1)
+    {
+      fprintf (stderr, "[%s] %lld samps @ %.6f Hz for N: '%s', S: '%s', L: '%s', C: '%s'\n",
+               sacfile, (long long int)datacnt, msr->samprate,
+               msr->network, msr->station, msr->location, msr->channel);
+    }
+
+    packedtraces += mstg->numtraces;
+  }
+  else if (mst && mergetraces)
+  {
+    /* Samples of prior inputs may remain, flush the samples added and end
+     * the trace at the last sample packed */
+    packtrace (mst, 1);
+
+    if (mst->samprate > 0.0)
+      mst->endtime = mst->starttime - (hptime_t)(HPTMODULUS / mst->samprate);
+
+    if (newtrace)
+      mst_addtracetogroup (mstg, mst);
+  }
+  else if (mst && newtrace)
+  {
+    /* Release a new trace, records already written are not retracted */
+    if (mst->prvtptr)
+      msr_free ((MSRecord **)&mst->prvtptr);
+
+    mst_free (&mst);
+  }
+  else if (mst)
+  {
+    /* Restore an existing trace, records already written are not retracted */
+    mst_freesamples (mst);
+
+    mst->samplecnt = 0;
+    mst->starttime = prevstart;
+    mst->endtime   = prevend;
+
+    /* The packed header cache is kept, it may have been reallocated */
+    if (mst->ststate)
+    {
+      prevstate.packcache = mst->ststate->packcache;
+      *mst->ststate       = prevstate;
+    }
+  }
+
+  /* Write metadata to file if requested */
+  if (!rv && mfp)
+  {
+    if (verbose)
+      fprintf (stderr, "[%s] Writing metadata to %s\n", sacfile, metafile);
+
+    if (writemetadata (&sh, msr->network, msr->station, msr->location, msr->channel,
+                       msr->starttime, expmeta))
+    {
+      fprintf (stderr, "Error writing metadata to file '%s'\n", metafile);
+      rv = -1;
+    }
+  }
+
+  /* Cleanup */
+  if (ofp && !outputfile)
+  {
+    closeoutput (ofp);
+    ofp = 0;
+  }
+
+  fclose (ifp);
+  freesacdata (&sd);
+
+  if (fblock)
+    free (fblock);
+  if (iblock)
+    free (iblock);
+  if (msr)
+    msr_free (&msr);
+
+  return rv;
+} /* End of sac2stream() */
+
+/***************************************************************************
+ * scalestream:
+ *
+ * Determine the autoscaling factor of a SAC file read in blocks by
+ * scanning all data samples.  If all samples fit in a single block they
+ * remain loaded and, if no scaling is needed, converted in iblock with
+ * converted set.  Otherwise the data are rewound to be read again.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+scalestream (FILE *ifp, struct sacdata *sd, float *fblock, int32_t *iblock,
+             int blocksize, long long int *scaling, flag *converted,
+             int64_t *overflows, char *sacfile)
+{
+  float datamin  = 0.0;
+  float datamax  = 0.0;
+  int fractional = 0;
+  int count;
+  int idx;
+
+  for (idx = 0; idx < sd->sac.datacnt; idx += count)
+  {
+    count = (sd->sac.datacnt - idx < blocksize) ? sd->sac.datacnt - idx : blocksize;
+
+    if (readsacblock (ifp, sd, fblock, count, sacfile))
+      return -1;
+
+    *overflows += s2m_scansamples (fblock, iblock, count, &datamin, &datamax, &fractional, (idx > 0));
+  }
+
+  *scaling = s2m_autoscale (s2mctx, datamin, datamax, fractional);
+
+  if (sd->sac.datacnt > blocksize)
+    return rewindsacdata (ifp, sd, sacfile);
+
+  *converted = !fractional;
+
+  return 0;
+} /* End of scalestream() */
+
+/***************************************************************************
+ * openoutput:
+ *
+ * Open an output file for the records converted from a single input
+ * file.  The output file name is the input file name with a ".sac"
+ * extension (if any) replaced with ".mseed".
+ *
+ * Returns an open FILE on success, and NULL on failure
+ ***************************************************************************/
+static FILE *
+openoutput (char *sacfile)
+{
+  FILE *fp;
+  char mseedoutputfile[1024];
+
+  if (outputname (sacfile, mseedoutputfile, sizeof (mseedoutputfile)))
+  {
+    fprintf (stderr, "Output file name too long for %s\n", sacfile);
+    return NULL;
+  }
+
+#if defined(S2M_WATCH)
+  /* Output for spool files is renamed to the final name when complete */
+  if (spooling)
+  {
+    char finalname[1024];
+
+    strcpy (finalname, mseedoutputfile);
+    if (stagingname (finalname, mseedoutputfile, sizeof (mseedoutputfile)))
+    {
+      fprintf (stderr, "Output file name too long: %s\n", finalname);
+      return NULL;
+    }
+  }
+#endif
+
+  if ((fp = fopen (mseedoutputfile, "wb")) == NULL)
+  {
+    fprintf (stderr, "Cannot open output file: %s (%s)\n",
+             mseedoutputfile, strerror (errno));
+    return NULL;
+  }
+
+  return fp;
+} /* End of openoutput() */
+
+/***************************************************************************
+ * outputname:
+ *
+ * Determine the output file name for an input file, the input file
+ * name with .sac at the end removed and .mseed added.
+ *
+ * Returns 0 on success, and -1 if the name does not fit in size bytes
+ ***************************************************************************/
+int
+outputname (char *sacfile, char *name, size_t size)
+{
+  size_t namelen;
+
+  namelen = strlen (sacfile);
+
+  /* Truncate file name if .sac is at the end */
+  if (namelen > 4)
+    if ((*(sacfile + namelen - 1) == 'c' || *(sacfile + namelen - 1) == 'C') &&
+        (*(sacfile + namelen - 2) == 'a' || *(sacfile + namelen - 2) == 'A') &&
+        (*(sacfile + namelen - 3) == 's' || *(sacfile + namelen - 3) == 'S') &&
+        (*(sacfile + namelen - 4) == '.'))
+    {
+      namelen -= 4;
+    }
+
+  if (namelen + 7 > size)
+    return -1;
+
+  /* Add .mseed to the file name */
+  memcpy (name, sacfile, namelen);
+  strcpy (name + namelen, ".mseed");
+
+  return 0;
+} /* End of outputname() */
+
+/***************************************************************************
+ * writeoutput:
+ *
+ * Write records to an output file.  When the write-behind writer is
+ * running the records are copied to the buffer being filled, which is
+ * queued for the writer thread when full or when records for a
+ * different file are written.  Otherwise the records are written
+ * directly.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+writeoutput (FILE *fp, const char *data, size_t length)
+{
+#if defined(S2M_THREADS)
+  if (writeractive ())
+    return writebuffered (fp, data, length);
+#endif
+
+  if (fwrite (data, length, 1, fp) != 1)
+  {
+    fprintf (stderr, "Error writing to output file\n");
+    outputerror = 1;
+    return -1;
   }
 
-  if (verbose > 2)
-    fprintf (stderr, "[%s] SAC header version number: %d\n", sacfile, sh->nvhdr);
+  return 0;
+} /* End of writeoutput() */
+
+/***************************************************************************
+ * closeoutput:
+ *
+ * Close an output file.  When the write-behind writer is running the
+ * file is closed by the writer thread after all of its records are
+ * written and is synchronized to storage once the writer stops.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+int
+closeoutput (FILE *fp)
+{
+#if defined(S2M_THREADS)
+  /* Output for spool files is on storage before the input is removed */
+  if (writeractive ())
+    return closebuffered (fp, spooling);
+#endif
+
+#if defined(S2M_WATCH)
+  /* Output for spool files is on storage before the input is removed */
+  if (spooling && (fflush (fp) || fsync (fileno (fp))))
+  {
+    fprintf (stderr, "Error writing to output file (%s)\n", strerror (errno));
+    fclose (fp);
+    outputerror = 1;
+    return -1;
+  }
+#endif
+
+  if (fclose (fp))
+  {
+    fprintf (stderr, "Error closing output file (%s)\n", strerror (errno));
+    outputerror = 1;
+    return -1;
+  }
+
+  return 0;
+} /* End of closeoutput() */
+
+/***************************************************************************
+ * sdsoutput:
+ *
+ * Write a record to the SDS archive day file of the trace being packed,
+ * determined by packtrace().  The day file is found once for all
+ * records packed from the trace at a time.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+sdsoutput (char *record, int reclen)
+{
+  /* Skip remaining records after an output error, already reported */
+  if (outputerror)
+    return -1;
+
+  if (!sdsfp)
+  {
+    if (!sdstrace)
+    {
+      fprintf (stderr, "Cannot determine archive file for packed record\n");
+      outputerror = 1;
+      return -1;
+    }
+
+    if (!(sdsfp = sdsfile (sdstrace)))
+    {
+      outputerror = 1;
+      return -1;
+    }
+  }
+
+  return writeoutput (sdsfp, record, reclen);
+} /* End of sdsoutput() */
+
+static struct sdsentry sdsfiles[SDSMAXOPEN];
+static int sdscount       = 0;  /* Number of open SDS files */
+static int sdslast        = -1; /* Index of the last used file */
+static uint64_t sdsuses   = 0;  /* Use sequence */
+
+/***************************************************************************
+ * sdsfile:
+ *
+ * Find or open the SDS archive day file for the first sample of a
+ * trace, the file path is:
+ *
+ * SDSdir/YEAR/NET/STA/CHAN.D/NET.STA.LOC.CHAN.D.YEAR.DAY
+ *
+ * Files are opened for appending and kept open, when SDSMAXOPEN files
+ * are open the least recently used file is closed.
+ *
+ * Returns an open FILE on success, and NULL on failure
+ ***************************************************************************/
+static FILE *
+sdsfile (MSTrace *mst)
+{
+  char path[1024];
+  BTime btime;
+  int oldest;
+  int idx;
+
+  if (ms_hptime2btime (mst->starttime, &btime))
+  {
+    fprintf (stderr, "Cannot determine archive day for %s.%s.%s.%s\n",
+             mst->network, mst->station, mst->location, mst->channel);
+    return NULL;
+  }
+
+  if (snprintf (path, sizeof (path), "%s/%04d/%s/%s/%s.D/%s.%s.%s.%s.D.%04d.%03d",
+                sdsdir, btime.year, mst->network, mst->station, mst->channel,
+                mst->network, mst->station, mst->location, mst->channel,
+                btime.year, btime.day) >= (int)sizeof (path))
+  {
+    fprintf (stderr, "Archive file path too long: %s/%04d/%s/...\n",
+             sdsdir, btime.year, mst->network);
+    return NULL;
+  }
+
+  sdsuses++;
+
+  /* Consecutive records are usually written to the same file */
+  if (sdslast >= 0 && !strcmp (sdsfiles[sdslast].path, path))
+  {
+    sdsfiles[sdslast].lastuse = sdsuses;
+    return sdsfiles[sdslast].fp;
+  }
+
+  for (idx = 0; idx < sdscount; idx++)
+  {
+    if (!strcmp (sdsfiles[idx].path, path))
+    {
+      sdsfiles[idx].lastuse = sdsuses;
+      sdslast               = idx;
+      return sdsfiles[idx].fp;
+    }
+  }
+
+  /* Close the least recently used file if needed */
+  if (sdscount < SDSMAXOPEN)
+  {
+    idx = sdscount++;
+  }
+  else
+  {
+    for (oldest = 0, idx = 1; idx < sdscount; idx++)
+      if (sdsfiles[idx].lastuse < sdsfiles[oldest].lastuse)
+        oldest = idx;
+
+    idx = oldest;
+
+    if (verbose > 1)
+      fprintf (stderr, "Closing archive file %s\n", sdsfiles[idx].path);
+
+    closeoutput (sdsfiles[idx].fp);
+  }
+
+  if (makedirs (path) || (sdsfiles[idx].fp = fopen (path, "ab")) == NULL)
+  {
+    fprintf (stderr, "Cannot open archive file: %s (%s)\n", path, strerror (errno));
+
+    /* Remove the failed entry */
+    sdsfiles[idx] = sdsfiles[--sdscount];
+    sdslast       = -1;
+    return NULL;
+  }
+
+  if (verbose > 1)
+    fprintf (stderr, "Writing to archive file %s\n", path);
+
+  strcpy (sdsfiles[idx].path, path);
+  sdsfiles[idx].lastuse = sdsuses;
+  sdslast               = idx;
+
+  return sdsfiles[idx].fp;
+} /* End of sdsfile() */
+
+/***************************************************************************
+ * makedirs:
+ *
+ * Create the directories leading to a file path as needed.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+makedirs (char *path)
+{
+  char *cp;
+
+  for (cp = strchr (path + 1, '/'); cp; cp = strchr (cp + 1, '/'))
+  {
+    *cp = '\0';
+
+    if (mkdir (path, 0777) && errno != EEXIST)
+    {
+      *cp = '/';
+      return -1;
+    }
+
+    *cp = '/';
+  }
+
+  return 0;
+} /* End of makedirs() */
+
+/***************************************************************************
+ * closesds:
+ *
+ * Close all open SDS archive files.
+ ***************************************************************************/
+static void
+closesds (void)
+{
+  int idx;
+
+  for (idx = 0; idx < sdscount; idx++)
+    closeoutput (sdsfiles[idx].fp);
+
+  sdscount = 0;
+  sdslast  = -1;
+} /* End of closesds() */
+
+/* Manifest of converted inputs, a hash table keyed by input path */
+static struct manifestentry **manifesttable = 0;
+static size_t manifestbuckets               = 0;
+static size_t manifestcount                 = 0;
+static struct manifestentry *manifestpending = 0; /* Entries waiting for merged data */
+static struct manifestentry *manifestlast    = 0; /* Last pending entry */
+static char manifestoptions[256];                 /* Options affecting output */
+
+/***************************************************************************
+ * loadmanifest:
+ *
+ * Read the manifest file, if it exists, into the manifest table and
+ * open it for appending entries.  Each line of the manifest records the
+ * conversion of an input as tab-separated fields:
+ *
+ * size, mtime, hash, options, output, path
+ *
+ * where hash is a hash of the file contents in hexadecimal, options
+ * are the conversion options affecting the output and output is the
+ * output file or archive directory.  Later lines for the same path
+ * replace earlier lines.  Unparsable lines, e.g. a partial line from an
+ * interrupted run, are ignored.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+loadmanifest (void)
+{
+  struct manifestentry *entry;
+  FILE *fp;
+  char line[8192];
+  char *fields[6];
+  char *cp;
+  size_t length;
+  int64_t lines = 0;
+  flag newline  = 1;
+  int idx;
+
+  snprintf (manifestoptions, sizeof (manifestoptions),
+            "r%d e%d b%d f%d s%lld S%d M%d n%s t%s l%s c%s",
+            packreclen, encoding, byteorder, sacformat, datascaling,
+            srateblkt, mergetraces,
+            (forcenet) ? forcenet : "", (forcesta) ? forcesta : "",
+            (forceloc) ? forceloc : "", (forcechan) ? forcechan : "");
+
+  if ((fp = fopen (manifestfile, "rb")) == NULL && errno != ENOENT)
+  {
+    fprintf (stderr, "Cannot open manifest file: %s (%s)\n",
+             manifestfile, strerror (errno));
+    return -1;
+  }
+
+  while (fp && fgets (line, sizeof (line), fp))
+  {
+    length  = strlen (line);
+    newline = (length > 0 && line[length - 1] == '\n');
+
+    if (!newline || line[0] == '#')
+      continue;
+
+    line[--length] = '\0';
+
+    /* Split the line into fields, the path is the remainder */
+    fields[0] = line;
+    for (idx = 1, cp = line; idx < 6 && (cp = strchr (cp, '\t')); idx++)
+    {
+      *cp++       = '\0';
+      fields[idx] = cp;
+    }
+
+    if (idx < 6)
+      continue;
+
+    if (!(entry = (struct manifestentry *)malloc (sizeof (struct manifestentry) + length + 1)))
+    {
+      fprintf (stderr, "Cannot allocate memory for manifest\n");
+      fclose (fp);
+      return -1;
+    }
+
+    entry->size  = strtoll (fields[0], NULL, 10);
+    entry->mtime = strtoll (fields[1], NULL, 10);
+    entry->hash  = strtoull (fields[2], NULL, 16);
+
+    /* Keep the strings in the same allocation */
+    memcpy (entry + 1, line, length + 1);
+    entry->options = (char *)(entry + 1) + (fields[3] - line);
+    entry->output  = (char *)(entry + 1) + (fields[4] - line);
+    entry->path    = (char *)(entry + 1) + (fields[5] - line);
+
+    addmanifest (entry);
+    lines++;
+  }
+
+  if (fp)
+    fclose (fp);
+
+  if (verbose)
+    fprintf (stderr, "Read %lld entries for %lld inputs from manifest %s\n",
+             (long long int)lines, (long long int)manifestcount, manifestfile);
+
+  if ((manfp = fopen (manifestfile, "ab")) == NULL)
+  {
+    fprintf (stderr, "Cannot open manifest file: %s (%s)\n",
+             manifestfile, strerror (errno));
+    return -1;
+  }
+
+  /* Start a new manifest with a header, or terminate a partial line */
+  if (ftell (manfp) == 0)
+    fprintf (manfp, "# size\tmtime\thash\toptions\toutput\tpath\n");
+  else if (!newline)
+    fprintf (manfp, "\n");
+
+  fflush (manfp);
+
+  return 0;
+} /* End of loadmanifest() */
+
+/***************************************************************************
+ * addmanifest:
+ *
+ * Add an entry to the manifest table, replacing any entry for the same
+ * input path.  The table is grown to keep chains short.
+ ***************************************************************************/
+static void
+addmanifest (struct manifestentry *entry)
+{
+  struct manifestentry **newtable;
+  struct manifestentry **link;
+  struct manifestentry *next;
+  size_t newbuckets;
+  size_t idx;
+
+  /* Grow the table when the number of entries reaches the number of buckets */
+  if (manifestcount >= manifestbuckets)
+  {
+    newbuckets = (manifestbuckets) ? manifestbuckets * 2 : 1024;
+
+    if ((newtable = (struct manifestentry **)calloc (newbuckets, sizeof (struct manifestentry *))))
+    {
+      for (idx = 0; idx < manifestbuckets; idx++)
+      {
+        while ((next = manifesttable[idx]))
+        {
+          manifesttable[idx] = next->next;
+
+          link       = &newtable[hashbytes (FNVBASIS, next->path, strlen (next->path)) & (newbuckets - 1)];
+          next->next = *link;
+          *link      = next;
+        }
+      }
+
+      free (manifesttable);
+      manifesttable   = newtable;
+      manifestbuckets = newbuckets;
+    }
+    else if (!manifestbuckets)
+    {
+      fprintf (stderr, "Cannot allocate memory for manifest\n");
+      free (entry);
+      return;
+    }
+  }
+
+  link = &manifesttable[hashbytes (FNVBASIS, entry->path, strlen (entry->path)) & (manifestbuckets - 1)];
+
+  /* Replace an earlier entry for the same path */
+  for (; *link; link = &(*link)->next)
+  {
+    if (!strcmp ((*link)->path, entry->path))
+    {
+      next        = *link;
+      entry->next = next->next;
+      *link       = entry;
+      free (next);
+      return;
+    }
+  }
+
+  entry->next = 0;
+  *link       = entry;
+  manifestcount++;
+} /* End of addmanifest() */
+
+/***************************************************************************
+ * checkmanifest:
+ *
+ * Check an input file against the manifest.  An input is unchanged if
+ * it was converted with the same options to the same output, the
+ * output file still exists, and its size and modification time are
+ * the same as recorded.  If only the modification time differs the
+ * contents are hashed and compared with the recorded hash.  The details
+ * of the input, including the hash of changed inputs, are set in entry
+ * for recording after conversion.
+ *
+ * Returns MANIFEST_SAME or MANIFEST_TOUCHED if the input is unchanged,
+ * otherwise MANIFEST_CHANGED
+ ***************************************************************************/
+static int
+checkmanifest (char *sacfile, struct manifestentry *entry)
+{
+  struct manifestentry *recorded;
+  struct stat st;
+  char output[1024];
+
+  memset (entry, 0, sizeof (struct manifestentry));
+  entry->path = sacfile;
+
+  /* Inputs that cannot be checked are converted, reporting errors */
+  if (stat (sacfile, &st))
+    return MANIFEST_CHANGED;
+
+  entry->size  = (int64_t)st.st_size;
+  entry->mtime = (int64_t)st.st_mtime;
+
+  if (outputname (sacfile, output, sizeof (output)))
+    return MANIFEST_CHANGED;
+
+  recorded = (manifestbuckets) ? manifesttable[hashbytes (FNVBASIS, sacfile, strlen (sacfile)) & (manifestbuckets - 1)] : 0;
+  for (; recorded; recorded = recorded->next)
+    if (!strcmp (recorded->path, sacfile))
+      break;
+
+  if (recorded && recorded->size == entry->size &&
+      !strcmp (recorded->options, manifestoptions) &&
+      !strcmp (recorded->output, output) &&
+      !stat (output, &st))
+  {
+    if (recorded->mtime == entry->mtime)
+    {
+      entry->hash = recorded->hash;
+      return MANIFEST_SAME;
+    }
+
+    if (!hashfile (sacfile, &entry->hash) && entry->hash == recorded->hash)
+      return MANIFEST_TOUCHED;
+
+    return MANIFEST_CHANGED;
+  }
+
+  hashfile (sacfile, &entry->hash);
+
+  return MANIFEST_CHANGED;
+} /* End of checkmanifest() */
+
+/***************************************************************************
+ * recordmanifest:
+ *
+ * Record an entry for a converted input in the manifest file.  When
+ * merging traces the data of an input may be packed with later inputs,
+ * entries are held until flushmanifest() is called.
+ ***************************************************************************/
+static void
+recordmanifest (struct manifestentry *entry)
+{
+  struct manifestentry *pending;
+
+  if (mergetraces)
+  {
+    if (!(pending = (struct manifestentry *)malloc (sizeof (struct manifestentry))))
+    {
+      fprintf (stderr, "Cannot allocate memory for manifest\n");
+      return;
+    }
+
+    *pending      = *entry;
+    pending->next = 0;
+
+    if (manifestlast)
+      manifestlast->next = pending;
+    else
+      manifestpending = pending;
+
+    manifestlast = pending;
+    return;
+  }
+
+  writemanifest (entry);
+} /* End of recordmanifest() */
+
+/***************************************************************************
+ * writemanifest:
+ *
+ * Append an entry to the manifest file.  The entry is written through
+ * the output writer, after the output data of the input.
+ ***************************************************************************/
+static void
+writemanifest (struct manifestentry *entry)
+{
+  char output[1024];
+  char line[8192];
+  int length;
+
+  if (outputname (entry->path, output, sizeof (output)))
+  {
+    fprintf (stderr, "[%s] Path too long for manifest\n", entry->path);
+    return;
+  }
+
+  length = snprintf (line, sizeof (line), "%lld\t%lld\t%016llx\t%s\t%s\t%s\n",
+                     (long long int)entry->size, (long long int)entry->mtime,
+                     (unsigned long long int)entry->hash, manifestoptions,
+                     output, entry->path);
+
+  if (length <= 0 || length >= (int)sizeof (line))
+  {
+    fprintf (stderr, "[%s] Path too long for manifest\n", entry->path);
+    return;
+  }
+
+  writeoutput (manfp, line, length);
+  fflush (manfp);
+} /* End of writemanifest() */
+
+/***************************************************************************
+ * flushmanifest:
+ *
+ * Record the entries held while merging traces, called when all data
+ * have been packed.
+ ***************************************************************************/
+static void
+flushmanifest (void)
+{
+  struct manifestentry *entry;
+
+  while ((entry = manifestpending))
+  {
+    writemanifest (entry);
+
+    manifestpending = entry->next;
+    free (entry);
+  }
+
+  manifestlast = 0;
+} /* End of flushmanifest() */
+
+/***************************************************************************
+ * hashbytes:
+ *
+ * Continue a 64-bit FNV-1a hash over a sequence of bytes, the hash of
+ * a new sequence starts from FNVBASIS.
+ *
+ * Returns the updated hash
+ ***************************************************************************/
+static uint64_t
+hashbytes (uint64_t hash, const void *data, size_t length)
+{
+  const uint8_t *bytes = (const uint8_t *)data;
+  size_t idx;
+
+  for (idx = 0; idx < length; idx++)
+  {
+    hash ^= bytes[idx];
+    hash *= UINT64_C (1099511628211);
+  }
+
+  return hash;
+} /* End of hashbytes() */
+
+/***************************************************************************
+ * hashfile:
+ *
+ * Hash the contents of a file with hashbytes().
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+hashfile (char *path, uint64_t *hash)
+{
+  FILE *fp;
+  char *buffer;
+  size_t length;
+  int rv = 0;
+
+  *hash = FNVBASIS;
 
-  if (sh->nvhdr != 6)
-  {
-    fprintf (stderr, "[%s] ERROR SAC header version (%d) not supported\n",
-             sacfile, sh->nvhdr);
+  if ((fp = fopen (path, "rb")) == NULL)
     return -1;
-  }
 
-  if (sh->npts <= 0)
+  if (!(buffer = (char *)malloc (1024 * 1024)))
   {
-    fprintf (stderr, "[%s] No data, number of samples: %d\n", sacfile, sh->npts);
+    fclose (fp);
     return -1;
   }
 
-  if (sh->iftype != ITIME)
+  while ((length = fread (buffer, 1, 1024 * 1024, fp)) > 0)
+    *hash = hashbytes (*hash, buffer, length);
+
+  if (ferror (fp))
+    rv = -1;
+
+  free (buffer);
+  fclose (fp);
+
+  return rv;
+} /* End of hashfile() */
+
+#if defined(S2M_THREADS)
+#endif
+
+#if defined(S2M_THREADS)
+/* Shared state for parallel conversion, protected by joblock */
+static pthread_mutex_t joblock    = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t jobcond     = PTHREAD_COND_INITIALIZER;
+static struct convjob *jobs       = 0; /* Ring of in-flight jobs */
+static int jobslots               = 0; /* Number of slots in job ring */
+static flag inputend              = 0; /* All inputs have been claimed */
+static int64_t nextjob            = 0; /* Index of next input to convert */
+static int64_t nextjoin           = 0; /* Index of next job to join the trace group */
+static int64_t nextwrite          = 0; /* Index of next job to write */
+
+/***************************************************************************
+ * convertparallel:
+ *
+ * Convert all input files using a pool of worker threads.  Each worker
+ * reads, scales and packs an input file into a private record buffer,
+ * and this (main) thread writes the records of each input in the
+ * order of the file list.
+ *
+ * Workers join the shared MSTraceGroup in input order to determine the
+ * starting state (start time, compression history and record template)
+ * the input would have when converted serially, then pack with private
+ * copies of that state.  Sequence numbers, which depend on the records
+ * packed for all prior inputs, are set when writing.  The output is
+ * identical to a serial conversion.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+convertparallel (int workers)
+{
+  pthread_t *threads;
+  struct convjob *job;
+  int idx;
+  int rv;
+
+  /* Limit the number of in-flight jobs, bounding buffered records */
+  jobslots = workers * 4;
+
+  if (!(jobs = (struct convjob *)calloc (jobslots, sizeof (struct convjob))))
   {
-    fprintf (stderr, "[%s] Data is not time series (IFTYPE=%d), cannot convert other types\n",
-             sacfile, sh->iftype);
+    fprintf (stderr, "Cannot allocate memory for conversion jobs\n");
     return -1;
   }
 
-  if (!sh->leven)
+  if (!(threads = (pthread_t *)calloc (workers, sizeof (pthread_t))))
   {
-    fprintf (stderr, "[%s] Data is not evenly spaced (LEVEN not true), cannot convert\n", sacfile);
+    fprintf (stderr, "Cannot allocate memory for worker threads\n");
+    free (jobs);
     return -1;
   }
 
-  /* Allocate space for data samples */
-  *data = (float *)malloc (sizeof (float) * sh->npts);
-  memset (*data, 0, (sizeof (float) * sh->npts));
+  inputend = 0;
 
-  /* Read the data samples */
-  if (format == 1) /* Process SAC ALPHA data */
+  if (verbose)
+    fprintf (stderr, "Converting with %d worker threads\n", workers);
+
+  for (idx = 0; idx < workers; idx++)
   {
-    if ((rv = readalphadata (ifp, *data, sh->npts)))
+    if ((rv = pthread_create (&threads[idx], NULL, convworker, NULL)))
     {
-      fprintf (stderr, "[%s] Error parsing SAC ALPHA data at line %d\n",
-               sacfile, rv);
-      return -1;
+      fprintf (stderr, "Cannot create worker thread: %s\n", strerror (rv));
+      exit (1);
     }
   }
-  else if (format >= 2 && format <= 4) /* Process SAC binary data */
+
+  /* Write completed jobs in input order */
+  for (;;)
   {
-    if (readbinarydata (ifp, *data, sh->npts, swapflag, verbose, sacfile))
+    pthread_mutex_lock (&joblock);
+
+    job = &jobs[nextwrite % jobslots];
+    while (!(job->status == JOB_DONE && job->index == nextwrite) &&
+           !(inputend && nextwrite == nextjob))
+      pthread_cond_wait (&jobcond, &joblock);
+
+    if (job->status != JOB_DONE || job->index != nextwrite)
     {
-      fprintf (stderr, "[%s] Error reading SAC data samples\n", sacfile);
-      return -1;
+      pthread_mutex_unlock (&joblock);
+      break;
     }
+
+    pthread_mutex_unlock (&joblock);
+
+    writejob (job);
+
+    pthread_mutex_lock (&joblock);
+    job->status = JOB_FREE;
+    nextwrite++;
+    pthread_cond_broadcast (&jobcond);
+    pthread_mutex_unlock (&joblock);
   }
-  else
+
+  for (idx = 0; idx < workers; idx++)
+    pthread_join (threads[idx], NULL);
+
+  free (threads);
+  free (jobs);
+  jobs = 0;
+
+  return 0;
+} /* End of convertparallel() */
+
+/***************************************************************************
+ * convworker:
+ *
+ * Worker thread for parallel conversion.  Claim inputs in list order,
+ * read and scale the data, join the shared trace group in input order
+ * and pack the data into the job record buffer.
+ ***************************************************************************/
+static void *
+convworker (void *arg)
+{
+  struct convjob *job;
+  char *input;
+  int64_t index;
+
+  for (;;)
   {
-    fprintf (stderr, "[%s] Unrecognized format value: %d\n", sacfile, format);
-    return -1;
+    pthread_mutex_lock (&joblock);
+
+    /* Wait for a free slot in the window of in-flight jobs and for
+     * the next input to be listed */
+    input = 0;
+    while (!inputend)
+    {
+      if (nextjob < nextwrite + jobslots &&
+          ((input = followfile (nextjob, &inputend)) || inputend))
+        break;
+
+      pthread_cond_wait (&jobcond, &joblock);
+    }
+
+    if (!input)
+    {
+      pthread_cond_broadcast (&jobcond);
+      pthread_mutex_unlock (&joblock);
+      break;
+    }
+
+    index = nextjob++;
+
+    job = &jobs[index % jobslots];
+    memset (job, 0, sizeof (struct convjob));
+    job->index   = index;
+    job->sacfile = input;
+    job->status  = JOB_ACTIVE;
+
+    pthread_mutex_unlock (&joblock);
+
+    /* Skip inputs unchanged since recorded in the manifest */
+    if (manifestfile)
+      job->skipped = checkmanifest (job->sacfile, &job->mentry);
+
+    if (job->skipped != MANIFEST_CHANGED)
+    {
+      if (verbose)
+        fprintf (stderr, "Skipping unchanged %s\n", job->sacfile);
+
+      job->rv = -1;
+    }
+    else
+    {
+      if (verbose)
+        fprintf (stderr, "Reading %s\n", job->sacfile);
+
+      job->rv = sac2msr (job->sacfile, &job->sh, &job->msr, NULL);
+    }
+
+    /* Join the shared trace group in input order */
+    pthread_mutex_lock (&joblock);
+
+    while (nextjoin != index)
+      pthread_cond_wait (&jobcond, &joblock);
+
+    if (job->rv == 0)
+      job->rv = jointrace (job);
+
+    nextjoin++;
+    pthread_cond_broadcast (&jobcond);
+    pthread_mutex_unlock (&joblock);
+
+    /* Pack data into the job record buffer */
+    if (job->rv == 0)
+    {
+      job->packedrecords = mst_pack (job->mst, &jobrecord_handler, job, packreclen,
+                                     encoding, byteorder, &job->packedsamples,
+                                     1, verbose - 2, job->mstemplate);
+
+      if (job->packedrecords < 0)
+        fprintf (stderr, "Error packing data\n");
+    }
+
+    if (job->mst)
+      mst_free (&job->mst);
+
+    if (job->mstemplate)
+      msr_free (&job->mstemplate);
+
+    pthread_mutex_lock (&joblock);
+    job->status = JOB_DONE;
+    pthread_cond_broadcast (&jobcond);
+    pthread_mutex_unlock (&joblock);
   }
 
-  return sh->npts;
-} /* End of parsesac() */
+  return NULL;
+} /* End of convworker() */
 
 /***************************************************************************
- * readbinaryheader:
+ * jointrace:
  *
- * Read a binary header from a file and parse into a SAC header
- * struct.  Also determines byte order and sets the swap flag unless
- * already dictated by the format.
+ * Add the time coverage of a job to the shared MSTraceGroup and set up
+ * a private trace and record template for packing the job data from
+ * the state of the matching shared trace.  The shared trace is then
+ * advanced as if the data were packed and flushed, which is what a
+ * serial conversion would do.
  *
- * Returns 0 on sucess or -1 on failure.
+ * Must be called with joblock held and in input order.
+ *
+ * Returns 0 on success, and -1 on failure
  ***************************************************************************/
 static int
-readbinaryheader (FILE *ifp, struct SACHeader *sh, int *format,
-                  int *swapflag, int verbose, char *sacfile)
+jointrace (struct convjob *job)
 {
-  int bigendianhost;
-  int32_t hdrver;
+  MSRecord *msr = job->msr;
+  MSTrace *mst;
+  void *datasamples;
+  int64_t numsamples;
+
+  /* Add coverage, but not samples, to the shared trace group */
+  datasamples      = msr->datasamples;
+  msr->datasamples = 0;
+  mst              = mst_addmsrtogroup (mstg, msr, 0, -1.0, -1.0);
+  msr->datasamples = datasamples;
 
-  /* Read the binary header into memory */
-  if (fread (sh, sizeof (struct SACHeader), 1, ifp) != 1)
+  if (!mst)
   {
-    fprintf (stderr, "[%s] Could not read SAC header from file\n", sacfile);
+    fprintf (stderr, "[%s] Error adding samples to MSTraceGroup\n", job->sacfile);
+    return -1;
+  }
 
-    if (ferror (ifp))
-      fprintf (stderr, "[%s] Error reading from file\n", sacfile);
+  /* Create an MSRecord template for the MSTrace by copying the current holder */
+  if (!mst->prvtptr)
+  {
+    mst->prvtptr = s2m_createtemplate (s2mctx, msr);
+
+    if (!mst->prvtptr)
+    {
+      fprintf (stderr, "[%s] Error duplicate MSRecord for template\n", job->sacfile);
+      return -1;
+    }
+  }
+
+  /* Create private trace with the current state of the shared trace */
+  if (!(job->mst = mst_init (NULL)))
+    return -1;
+
+  strcpy (job->mst->network, mst->network);
+  strcpy (job->mst->station, mst->station);
+  strcpy (job->mst->location, mst->location);
+  strcpy (job->mst->channel, mst->channel);
+  job->mst->dataquality = mst->dataquality;
+  job->mst->type        = mst->type;
+  job->mst->starttime   = mst->starttime;
+  job->mst->endtime     = mst->endtime;
+  job->mst->samprate    = mst->samprate;
+  job->mst->sampletype  = mst->sampletype;
+
+  numsamples            = msr->numsamples;
+  job->mst->datasamples = msr->datasamples;
+  job->mst->numsamples  = numsamples;
+  job->mst->samplecnt   = numsamples;
+  msr->datasamples      = 0;
+
+  if (mst->ststate)
+  {
+    if (!(job->mst->ststate = (StreamState *)malloc (sizeof (StreamState))))
+      return -1;
+    memcpy (job->mst->ststate, mst->ststate, sizeof (StreamState));
+    job->mst->ststate->packcache = NULL;
+  }
 
+  if (!(job->mstemplate = msr_duplicate ((MSRecord *)mst->prvtptr, 0)))
+  {
+    fprintf (stderr, "[%s] Error duplicate MSRecord for template\n", job->sacfile);
     return -1;
   }
 
-  /* Determine if host is big-endian */
-  bigendianhost = ms_bigendianhost ();
+  /* Advance shared trace as mst_pack() would when flushing all samples */
+  if (!mst->ststate)
+  {
+    if (!(mst->ststate = (StreamState *)calloc (1, sizeof (StreamState))))
+      return -1;
+  }
+
+  if (mst->samprate > 0)
+    mst->starttime = mst->starttime + (hptime_t) (numsamples / mst->samprate * HPTMODULUS + 0.5);
+
+  if (encoding == DE_STEIM1 || encoding == DE_STEIM2)
+    mst->ststate->lastintsample = ((int32_t *)job->mst->datasamples)[numsamples - 1];
+
+  mst->ststate->comphistory = 1;
+  mst->samplecnt -= numsamples;
+
+  job->grouptrace = mst;
+  job->numtraces  = mstg->numtraces;
+
+  return 0;
+} /* End of jointrace() */
 
-  *swapflag = 0;
+/***************************************************************************
+ * writejob:
+ *
+ * Write the records and metadata for a completed job.  The record
+ * sequence numbers are set to continue those of the shared trace.
+ ***************************************************************************/
+static void
+writejob (struct convjob *job)
+{
+  MSRecord *mstemplate;
+  char seqnum[7];
+  size_t offset;
+  int32_t sequence;
 
-  /* Test byte order using the header version if unknown */
-  /* Also set the swapflag appropriately */
-  if (*format == 2)
+  if (job->skipped != MANIFEST_CHANGED)
   {
-    memcpy (&hdrver, &sh->nvhdr, 4);
-    if (hdrver < 1 || hdrver > 10)
-    {
-      ms_gswap4 (&hdrver);
-      if (hdrver < 1 || hdrver > 10)
-      {
-        fprintf (stderr, "[%s] Cannot determine byte order (not SAC?)\n", sacfile);
-        return -1;
-      }
+    if (job->skipped == MANIFEST_TOUCHED)
+      recordmanifest (&job->mentry);
+
+    skippedinputs++;
+    return;
+  }
+
+  if (job->rv)
+  {
+    if (job->msr)
+      msr_free (&job->msr);
+    return;
+  }
 
-      *format   = (bigendianhost) ? 3 : 4;
-      *swapflag = 1;
+  /* Open output file if needed */
+  if (!ofp)
+  {
+    if ((ofp = openoutput (job->sacfile)) == NULL)
+    {
+      free (job->records);
+      msr_free (&job->msr);
+      return;
     }
-    else
+  }
+
+  /* Set record sequence numbers continuing from the shared template */
+  pthread_mutex_lock (&joblock);
+
+  mstemplate = (MSRecord *)job->grouptrace->prvtptr;
+  sequence   = mstemplate->sequence_number;
+
+  for (offset = 0; job->reclen > 0 && offset < job->recbytes; offset += job->reclen)
+  {
+    if (sequence <= 0 || sequence > 999999)
+      sequence = 1;
+
+    snprintf (seqnum, sizeof (seqnum), "%06d", sequence);
+    memcpy (job->records + offset, seqnum, 6);
+
+    sequence++;
+  }
+
+  mstemplate->sequence_number = sequence;
+
+  pthread_mutex_unlock (&joblock);
+
+  if (job->recbytes > 0)
+    writeoutput (ofp, job->records, job->recbytes);
+
+  if (job->packedrecords >= 0)
+  {
+    s2mctx->packedrecords += job->packedrecords;
+    s2mctx->packedsamples += job->packedsamples;
+  }
+
+  packedtraces += job->numtraces;
+
+  /* Write metadata to file if requested */
+  if (mfp)
+  {
+    if (verbose)
+      fprintf (stderr, "[%s] Writing metadata to %s\n", job->sacfile, metafile);
+
+    if (writemetadata (&job->sh, job->msr->network, job->msr->station,
+                       job->msr->location, job->msr->channel,
+                       job->msr->starttime, expmeta))
     {
-      *format = (bigendianhost) ? 4 : 3;
+      fprintf (stderr, "Error writing metadata to file '%s'\n", metafile);
     }
   }
-  else if (*format == 3 && bigendianhost)
-    *swapflag = 1;
-  else if (*format == 4 && !bigendianhost)
-    *swapflag = 1;
 
-  if (verbose > 1)
+  if (ofp && !outputfile)
   {
-    if (*swapflag)
-      fprintf (stderr, "[%s] Byte swapping required\n", sacfile);
-    else
-      fprintf (stderr, "[%s] Byte swapping NOT required\n", sacfile);
+    closeoutput (ofp);
+    ofp = 0;
   }
 
-  /* Byte swap all values in header */
-  if (*swapflag)
-    swapsacheader (sh);
+  if (manifestfile && !outputerror)
+    recordmanifest (&job->mentry);
 
-  return 0;
-} /* End of readbinaryheader() */
+  free (job->records);
+  job->records = 0;
+  msr_free (&job->msr);
+} /* End of writejob() */
+
+/***************************************************************************
+ * jobrecord_handler:
+ * Saves passed records to the record buffer of a job.
+ ***************************************************************************/
+static void
+jobrecord_handler (char *record, int reclen, void *handlerdata)
+{
+  struct convjob *job = (struct convjob *)handlerdata;
+  char *newrecords;
+  size_t newalloc;
+
+  if (job->recbytes + reclen > job->recalloc)
+  {
+    newalloc = (job->recalloc) ? job->recalloc * 2 : (size_t)reclen * 16;
+    while (newalloc < job->recbytes + reclen)
+      newalloc *= 2;
 
+    if (!(newrecords = (char *)realloc (job->records, newalloc)))
+    {
+      fprintf (stderr, "[%s] Cannot allocate memory for records\n", job->sacfile);
+      return;
+    }
+
+    job->records  = newrecords;
+    job->recalloc = newalloc;
+  }
+
+  memcpy (job->records + job->recbytes, record, reclen);
+  job->recbytes += reclen;
+  job->reclen = reclen;
+} /* End of jobrecord_handler() */
+
+/***************************************************************************
+ * notifyinput:
+ *
+ * Wake conversion workers waiting for the next input to be listed.
+ * Must be called without the lock of the walker held.
+ ***************************************************************************/
+void
+notifyinput (void)
+{
+  pthread_mutex_lock (&joblock);
+  pthread_cond_broadcast (&jobcond);
+  pthread_mutex_unlock (&joblock);
+} /* End of notifyinput() */
+
+#endif /* S2M_THREADS */
+
+#if defined(S2M_WATCH)
 /***************************************************************************
- * readbinarydata:
+ * syncoutput:
  *
- * Read binary data from a file and add to an array, the array
- * must already be allocated with datacnt floats.
+ * Wait until all records packed so far are written to the output
+ * files, separate output files are synchronized and closed and a
+ * single output file or open archive files are synchronized.
  *
- * Returns 0 on sucess or -1 on failure.
+ * Returns 0 on success, and -1 if any write failed
  ***************************************************************************/
-static int
-readbinarydata (FILE *ifp, float *data, int datacnt, int swapflag,
-                int verbose, char *sacfile)
+int
+syncoutput (void)
 {
-  int samplesread = 0;
-  int dataidx;
+  int idx;
 
-  /* Read in data samples */
-  if ((samplesread = fread (data, sizeof (float), datacnt, ifp)) != datacnt)
+  if (writeractive ())
   {
-    fprintf (stderr, "[%s] Only read %d of %d expected data samples\n",
-             sacfile, samplesread, datacnt);
-    return -1;
+    drainwriter ();
+  }
+  else if (fflush (NULL))
+  {
+    fprintf (stderr, "Error writing to output file (%s)\n", strerror (errno));
+    outputerror = 1;
   }
 
-  /* Swap data samples */
-  if (swapflag)
+  /* A single output file is kept open, synchronize unless a pipe */
+  if (ofp && outputfile && ofp != stdout && !outputerror &&
+      fsync (fileno (ofp)) && errno != EINVAL)
   {
-    for (dataidx = 0; dataidx < datacnt; dataidx++)
+    fprintf (stderr, "Error writing to output file (%s)\n", strerror (errno));
+    outputerror = 1;
+  }
+
+  /* Archive day files are kept open, synchronize the appended records */
+  for (idx = 0; idx < sdscount && !outputerror; idx++)
+  {
+    if (fsync (fileno (sdsfiles[idx].fp)))
     {
-      ms_gswap4 (data + dataidx);
+      fprintf (stderr, "Error writing to archive file %s (%s)\n",
+               sdsfiles[idx].path, strerror (errno));
+      outputerror = 1;
     }
   }
 
-  return 0;
-} /* End of readbinarydata() */
+  return (outputerror) ? -1 : 0;
+} /* End of syncoutput() */
+#endif
 
 /***************************************************************************
- * readalphaheader:
+ * parsesacheader:
  *
- * Read a alphanumeric header from a file and parse into a SAC header
- * struct.
+ * Parse the header of a SAC file for reading the data in blocks with
+ * readsacblock().  ALPHA files are loaded as a whole, as for
+ * sac2msr(), while for binary files only the header is read and the
+ * data section is read with stdio so that only the blocks being
+ * converted are held in memory.
  *
- * Returns 0 on sucess or a positive number indicating line number of
- * parsing failure.
+ * Returns number of data samples in file or -1 on failure.
  ***************************************************************************/
 static int
-readalphaheader (FILE *ifp, struct SACHeader *sh)
+parsesacheader (FILE *ifp, struct SACHeader *sh, struct sacdata *data,
+                char *sacfile)
 {
-  char line[1025];
-  int linecnt = 1; /* The header starts at line 1 */
-  int lineidx;
-  int count;
-  int hvidx = 0;
-  char *cp;
+  char header[sizeof (struct SACHeader)];
+  char *buffer;
+  size_t length;
+  int datacnt;
+
+  memset (data, 0, sizeof (struct sacdata));
 
-  if (!ifp || !sh)
+  /* Read the first 4 characters to determine the format */
+  if ((length = fread (header, 1, 4, ifp)) < 4)
     return -1;
 
-  /* The first 14 lines x 5 values are floats */
-  for (lineidx = 0; lineidx < 14; lineidx++)
+  if (s2m_detectformat (header, length, sacformat) == 1)
+  {
+    rewind (ifp);
+
+    if (loadsacfile (ifp, data, sacfile))
+      return -1;
+
+    buffer = data->buffer;
+    length = data->length;
+  }
+  else
+  {
+    length += fread (header + length, 1, sizeof (header) - length, ifp);
+
+    if (ferror (ifp))
+    {
+      fprintf (stderr, "[%s] Error reading from file\n", sacfile);
+      return -1;
+    }
+
+    buffer = header;
+  }
+
+  datacnt = s2m_parseheader (s2mctx, &data->sac, buffer, length, sh, sacfile);
+
+  /* The header of a binary file is not retained */
+  if (buffer == header)
+  {
+    data->sac.contents = 0;
+    data->sac.length   = 0;
+  }
+
+  return datacnt;
+} /* End of parsesacheader() */
+
+/***************************************************************************
+ * readsacblock:
+ *
+ * Read the next count data samples of a SAC file, following the
+ * header parsed by parsesacheader(), into a block array in host byte
+ * order.  For ALPHA files count must be a multiple of 5 unless the
+ * block ends at the last sample, so that blocks start on a new line.
+ *
+ * Returns 0 on sucess or -1 on failure.
+ ***************************************************************************/
+static int
+readsacblock (FILE *ifp, struct sacdata *data, float *block,
+              int count, char *sacfile)
+{
+  int samplesread;
+
+  if (data->sac.contents)
   {
-    if (!fgets (line, sizeof (line), ifp))
-      return linecnt;
+    if (s2m_readblock (s2mctx, &data->sac, block, count, sacfile))
+      return -1;
+
+#if defined(S2M_MMAP) && defined(MADV_DONTNEED)
+    /* Release mapped pages that have been parsed */
+    if (data->mapped && data->sac.alphanext)
+    {
+      size_t pagesize = (size_t)sysconf (_SC_PAGESIZE);
+      size_t parsed   = (size_t)(data->sac.alphanext - data->buffer) / pagesize * pagesize;
+
+      if (parsed > data->released)
+      {
+        madvise (data->buffer + data->released, parsed - data->released, MADV_DONTNEED);
+        data->released = parsed;
+      }
+    }
+#endif
 
-    count = sscanf (line, " %f %f %f %f %f ", (float *)sh + hvidx,
-                    (float *)sh + hvidx + 1, (float *)sh + hvidx + 2,
-                    (float *)sh + hvidx + 3, (float *)sh + hvidx + 4);
+    return 0;
+  }
 
-    if (count != 5)
-      return linecnt;
+  if (count <= 0 || data->sac.dataidx + count > data->sac.datacnt)
+    return -1;
 
-    hvidx += 5;
-    linecnt++;
+  if ((samplesread = (int)fread (block, sizeof (float), count, ifp)) != count)
+  {
+    fprintf (stderr, "[%s] Only read %d of %d expected data samples\n",
+             sacfile, data->sac.dataidx + samplesread, data->sac.datacnt);
+    fprintf (stderr, "[%s] Error reading SAC data samples\n", sacfile);
+    return -1;
   }
 
-  /* The next 8 lines x 5 values are integers */
-  for (lineidx = 0; lineidx < 8; lineidx++)
+  if (data->sac.swapflag)
+    ms_gswap4n (block, block, count);
+
+  data->sac.dataidx += count;
+
+  return 0;
+} /* End of readsacblock() */
+
+/***************************************************************************
+ * rewindsacdata:
+ *
+ * Reset reading of data samples in blocks to the first sample.
+ *
+ * Returns 0 on sucess or -1 on failure.
+ ***************************************************************************/
+static int
+rewindsacdata (FILE *ifp, struct sacdata *data, char *sacfile)
+{
+  if (data->sac.contents)
   {
-    if (!fgets (line, sizeof (line), ifp))
-      return linecnt;
-
-    count = sscanf (line, " %d %d %d %d %d ", (int32_t *)sh + hvidx,
-                    (int32_t *)sh + hvidx + 1, (int32_t *)sh + hvidx + 2,
-                    (int32_t *)sh + hvidx + 3, (int32_t *)sh + hvidx + 4);
-
-    if (count != 5)
-      return linecnt;
-
-    hvidx += 5;
-    linecnt++;
+    s2m_rewind (&data->sac);
+    data->released = 0;
   }
-
-  /* Set pointer to start of string variables */
-  cp = (char *)sh + (hvidx * 4);
-
-  /* The next 8 lines each contain 24 bytes of string data */
-  for (lineidx = 0; lineidx < 8; lineidx++)
+  else if (fseek (ifp, sizeof (struct SACHeader), SEEK_SET))
   {
-    memset (line, 0, sizeof (line));
-    if (!fgets (line, sizeof (line), ifp))
-      return linecnt;
-
-    memcpy (cp, line, 24);
-    cp += 24;
-
-    linecnt++;
+    fprintf (stderr, "[%s] Cannot seek to data samples (%s)\n",
+             sacfile, strerror (errno));
+    return -1;
   }
 
-  /* Make sure each of the 23 string variables are left justified */
-  cp = (char *)sh + (hvidx * 4);
-  for (count = 0; count < 24; count++)
-  {
-    int ridx, widx, width;
-    char *fcp;
+  data->sac.dataidx = 0;
 
-    /* Each string variable is 8 characters with one exception */
-    if (count != 1)
-    {
-      width = 8;
-    }
-    else
-    {
-      width = 16;
-      count++;
-    }
+  return 0;
+} /* End of rewindsacdata() */
 
-    /* Pointer to field */
-    fcp = cp + (count * 8);
+/***************************************************************************
+ * freesacdata:
+ *
+ * Release the data samples and file contents, if any, populated by
+ * parsesacheader() or loadsacfile().
+ ***************************************************************************/
+void
+freesacdata (struct sacdata *data)
+{
+  if (!data)
+    return;
 
-    /* Find first character that is not a space */
-    ridx = 0;
-    while (*(fcp + ridx) == ' ')
-      ridx++;
+  s2m_freedata (&data->sac);
 
-    /* Remove any leading spaces */
-    if (ridx > 0)
-    {
-      for (widx = 0; widx < width; widx++, ridx++)
-      {
-        if (ridx < width)
-          *(fcp + widx) = *(fcp + ridx);
-        else
-          *(fcp + widx) = ' ';
-      }
-    }
-  }
+#if defined(S2M_MMAP)
+  if (data->buffer && data->mapped)
+    munmap (data->buffer, data->length);
+#endif
+  if (data->buffer && !data->mapped)
+    free (data->buffer);
 
-  return 0;
-} /* End of readalphaheader() */
+  memset (data, 0, sizeof (struct sacdata));
+} /* End of freesacdata() */
 
 /***************************************************************************
- * readalphadata:
+ * loadsacfile:
  *
- * Read a alphanumeric data from a file and add to an array, the array
- * must already be allocated with datacnt floats.
+ * Map the contents of a SAC file into memory where supported, otherwise
+ * read the contents into an allocated buffer.
  *
- * Returns 0 on sucess or a positive number indicating line number of
- * parsing failure.
+ * Returns 0 on sucess or -1 on failure.
  ***************************************************************************/
 static int
-readalphadata (FILE *ifp, float *data, int datacnt)
+loadsacfile (FILE *ifp, struct sacdata *data, char *sacfile)
 {
-  char line[1025];
-  int linecnt     = 31; /* Data samples start on line 31 */
-  int samplesread = 0;
-  int count;
-  int dataidx = 0;
+  char *buffer = 0;
+  char *newbuffer;
+  size_t bufsize = 0;
+  size_t length  = 0;
+  size_t readlen;
+
+#if defined(S2M_MMAP)
+  if (!mapsacfile (ifp, data))
+    return 0;
 
-  if (!ifp || !data || !datacnt)
-    return -1;
+  if (errno && verbose > 1)
+    fprintf (stderr, "[%s] Cannot map file, reading with stdio (%s)\n",
+             sacfile, strerror (errno));
+#endif
 
-  /* Each data line should contain 5 floats unless the last */
+  /* Read the entire file into a growing buffer */
   for (;;)
   {
-    if (!fgets (line, sizeof (line), ifp))
-      return linecnt;
+    if (length == bufsize)
+    {
+      bufsize = (bufsize) ? bufsize * 2 : 1024 * 1024;
+
+      if (!(newbuffer = (char *)realloc (buffer, bufsize)))
+      {
+        fprintf (stderr, "[%s] Cannot allocate memory for file contents\n", sacfile);
+        free (buffer);
+        return -1;
+      }
 
-    count = sscanf (line, " %f %f %f %f %f ", (float *)data + dataidx,
-                    (float *)data + dataidx + 1, (float *)data + dataidx + 2,
-                    (float *)data + dataidx + 3, (float *)data + dataidx + 4);
+      buffer = newbuffer;
+    }
 
-    samplesread += count;
+    readlen = fread (buffer + length, 1, bufsize - length, ifp);
+    length += readlen;
 
-    if (samplesread >= datacnt)
+    if (readlen == 0)
       break;
-    else if (count != 5)
-      return linecnt;
+  }
 
-    dataidx += 5;
-    linecnt++;
+  if (ferror (ifp))
+  {
+    fprintf (stderr, "[%s] Error reading from file\n", sacfile);
+    free (buffer);
+    return -1;
   }
 
+  data->buffer   = buffer;
+  data->length   = length;
+  data->mapped   = 0;
+
   return 0;
-} /* End of readalphadata() */
+} /* End of loadsacfile() */
 
+#if defined(S2M_MMAP)
 /***************************************************************************
- * swapsacheader:
+ * mapsacfile:
  *
- * Byte swap all multi-byte quantities (floats and ints) in SAC header
- * struct.
+ * Map the contents of a regular SAC file into memory.  Nothing is
+ * reported on failure, errno is 0 if the file cannot be mapped or set
+ * by the failed mapping.
  *
- * Returns 0 on sucess and -1 on failure.
+ * Returns 0 on sucess or -1 on failure.
  ***************************************************************************/
 static int
-swapsacheader (struct SACHeader *sh)
+mapsacfile (FILE *ifp, struct sacdata *data)
 {
-  int32_t *ip;
-  int idx;
+  struct stat st;
+  void *map;
 
-  if (!sh)
-    return -1;
+  errno = 0;
 
-  for (idx = 0; idx < (NUMFLOATHDR + NUMINTHDR); idx++)
+  if (fstat (fileno (ifp), &st) || !S_ISREG (st.st_mode) ||
+      st.st_size < (off_t)sizeof (struct SACHeader) ||
+      (uint64_t)st.st_size > (size_t)-1)
   {
-    ip = (int32_t *)sh + idx;
-    ms_gswap4 (ip);
+    errno = 0;
+    return -1;
   }
 
+  map = mmap (NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fileno (ifp), 0);
+
+  if (map == MAP_FAILED)
+    return -1;
+
+  posix_madvise (map, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+  data->buffer = map;
+  data->length = (size_t)st.st_size;
+  data->mapped = 1;
+
   return 0;
-} /* End of swapsacheader() */
+} /* End of mapsacfile() */
+#endif
 
 /***************************************************************************
  * writemetadata:
@@ -1179,6 +2920,70 @@ parameter_proc (int argcount, char **argvec)
     {
       sacformat = strtoul (getoptval (argcount, argvec, optind++), NULL, 10);
     }
+    else if (strcmp (argvec[optind], "-j") == 0)
+    {
+      workers = strtoul (getoptval (argcount, argvec, optind++), NULL, 10);
+    }
+    else if (strcmp (argvec[optind], "-SDS") == 0)
+    {
+      sdsdir = getoptval (argcount, argvec, optind++);
+    }
+    else if (strcmp (argvec[optind], "-M") == 0)
+    {
+      mergetraces = 1;
+    }
+    else if (strcmp (argvec[optind], "-C") == 0)
+    {
+      manifestfile = getoptval (argcount, argvec, optind++);
+    }
+    else if (strcmp (argvec[optind], "-R") == 0)
+    {
+      recursive = 1;
+    }
+    else if (strcmp (argvec[optind], "-g") == 0)
+    {
+      fileglob = getoptval (argcount, argvec, optind++);
+    }
+    else if (strcmp (argvec[optind], "-watch") == 0)
+    {
+      appendpath (&spoollist, getoptval (argcount, argvec, optind++));
+    }
+    else if (strcmp (argvec[optind], "-done") == 0)
+    {
+      donedir = getoptval (argcount, argvec, optind++);
+    }
+    else if (strcmp (argvec[optind], "-sort") == 0)
+    {
+      char *order = getoptval (argcount, argvec, optind++);
+
+      if (strcmp (order, "path") == 0)
+        sortorder = SORT_PATH;
+      else if (strcmp (order, "nslc") == 0)
+        sortorder = SORT_SOURCE;
+      else
+      {
+        fprintf (stderr, "Unknown sort order: %s\n", order);
+        exit (1);
+      }
+    }
+    else if (strcmp (argvec[optind], "-W") == 0)
+    {
+      outbufsize = strtoul (getoptval (argcount, argvec, optind++), NULL, 10);
+    }
+    else if (strcmp (argvec[optind], "-P") == 0)
+    {
+      prefetchfiles = strtoul (getoptval (argcount, argvec, optind++), NULL, 10);
+    }
+    else if (strcmp (argvec[optind], "-B") == 0)
+    {
+      blocksamples = strtoul (getoptval (argcount, argvec, optind++), NULL, 10);
+
+      if (blocksamples <= 0)
+      {
+        fprintf (stderr, "Block size must be at least 1 sample\n");
+        exit (1);
+      }
+    }
     else if (strncmp (argvec[optind], "-", 1) == 0 &&
              strlen (argvec[optind]) > 1)
     {
@@ -1187,12 +2992,12 @@ parameter_proc (int argcount, char **argvec)
     }
     else
     {
-      addnode (&filelist, NULL, argvec[optind]);
+      appendpath (&filelist, argvec[optind]);
     }
   }
 
   /* Make sure an input files were specified */
-  if (filelist == 0)
+  if (filelist.count == 0 && spoollist.count == 0)
   {
     fprintf (stderr, "No input files were specified\n\n");
     fprintf (stderr, "%s version %s\n\n", PACKAGE, VERSION);
@@ -1204,46 +3009,118 @@ parameter_proc (int argcount, char **argvec)
   if (verbose)
     fprintf (stderr, "%s version: %s\n", PACKAGE, VERSION);
 
+  if (workers < 1)
+  {
+    fprintf (stderr, "Number of worker threads must be at least 1\n");
+    exit (1);
+  }
+
+#if !defined(S2M_THREADS)
+  if (workers > 1)
+  {
+    fprintf (stderr, "WARNING Parallel conversion not supported on this platform, using 1 worker\n");
+    workers = 1;
+  }
+#endif
+
+#if !defined(S2M_THREADS)
+  if (recursive || fileglob)
+  {
+    fprintf (stderr, "WARNING Directory input not supported on this platform\n");
+  }
+#endif
+
+#if !defined(S2M_WATCH)
+  if (spoollist.count)
+  {
+    fprintf (stderr, "Watching spool directories (-watch) not supported on this platform\n");
+    exit (1);
+  }
+#endif
+
+  if (donedir && !spoollist.count)
+  {
+    fprintf (stderr, "Done directory (-done) requires a spool directory (-watch)\n");
+    exit (1);
+  }
+
+  if (spoollist.count && workers > 1)
+  {
+    fprintf (stderr, "Watching spool directories (-watch) cannot be combined with parallel conversion (-j)\n");
+    exit (1);
+  }
+
+  if (spoollist.count && mergetraces)
+  {
+    fprintf (stderr, "Watching spool directories (-watch) cannot be combined with merging traces (-M)\n");
+    exit (1);
+  }
+
+  if (mergetraces && workers > 1)
+  {
+    fprintf (stderr, "Merging traces (-M) cannot be combined with parallel conversion (-j)\n");
+    exit (1);
+  }
+
+  if (mergetraces && !outputfile && !sdsdir)
+  {
+    fprintf (stderr, "Merging traces (-M) requires a single output file (-o) or archive (-SDS)\n");
+    exit (1);
+  }
+
+  if (manifestfile && outputfile)
+  {
+    fprintf (stderr, "Manifest (-C) cannot be combined with an output file (-o)\n");
+    exit (1);
+  }
+
+  /* Records of a changed input cannot be replaced in archive day files */
+  if (manifestfile && sdsdir)
+  {
+    fprintf (stderr, "Manifest (-C) cannot be combined with archive output (-SDS)\n");
+    exit (1);
+  }
+
+  if (sdsdir && outputfile)
+  {
+    fprintf (stderr, "Archive output (-SDS) cannot be combined with an output file (-o)\n");
+    exit (1);
+  }
+
+  if (sdsdir && workers > 1)
+  {
+    fprintf (stderr, "Archive output (-SDS) cannot be combined with parallel conversion (-j)\n");
+    exit (1);
+  }
+
+  if (blocksamples && workers > 1)
+  {
+    fprintf (stderr, "Streaming conversion (-B) cannot be combined with parallel conversion (-j)\n");
+    exit (1);
+  }
+
+  /* Round the block size up to whole lines of SAC ALPHA data */
+  if (blocksamples % 5)
+    blocksamples += 5 - blocksamples % 5;
+
   /* Check the input files for any list files, if any are found
-   * remove them from the list and add the contained list */
-  if (filelist)
+   * remove them from the list and add the contained list at the end,
+   * where it is checked in turn */
+  if (filelist.count)
   {
-    struct listnode *prevln, *ln;
-    char *lfname;
+    int64_t index;
+    int64_t kept = 0;
 
-    prevln = ln = filelist;
-    while (ln != 0)
+    for (index = 0; index < filelist.count; index++)
     {
-      lfname = ln->data;
-
-      if (*lfname == '@')
-      {
-        /* Remove this node from the list */
-        if (ln == filelist)
-          filelist = ln->next;
-        else
-          prevln->next = ln->next;
-
-        /* Skip the '@' first character */
-        if (*lfname == '@')
-          lfname++;
-
-        /* Read list file */
-        readlistfile (lfname);
-
-        /* Free memory for this node */
-        if (ln->key)
-          free (ln->key);
-        free (ln->data);
-        free (ln);
-      }
+      /* Read list file, skipping the '@' first character */
+      if (*filelist.paths[index] == '@')
+        readlistfile (filelist.paths[index] + 1);
       else
-      {
-        prevln = ln;
-      }
-
-      ln = ln->next;
+        filelist.paths[kept++] = filelist.paths[index];
     }
+
+    filelist.count = kept;
   }
 
   return 0;
@@ -1374,7 +3251,9 @@ readlistfile (char *listfile)
       if (verbose > 1)
         fprintf (stderr, "Adding '%s' to input file list\n", filename);
 
-      addnode (&filelist, NULL, filename);
+      if (addpath (&filelist, filename))
+        break;
+
       filecnt++;
 
       continue;
@@ -1387,48 +3266,228 @@ readlistfile (char *listfile)
 } /* End readlistfile() */
 
 /***************************************************************************
- * addnode:
+ * sortinputs:
+ *
+ * Sort the complete list of input files, waiting for input directories
+ * to be listed.  Inputs are sorted by path or by the source name
+ * (network, station, location and channel) and start time determined
+ * from the SAC header, so that the files of a channel are converted
+ * together in time order.  Inputs with headers that cannot be read
+ * sort last by path, errors are reported when converting.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+sortinputs (void)
+{
+  struct sourcekey *keys;
+  struct SACHeader sh;
+  struct sacdata data;
+  MSRecord *msr;
+  FILE *ifp;
+  int64_t index;
+
+#if defined(S2M_THREADS)
+  waitwalk ();
+#endif
+
+  if (filelist.count < 2)
+    return 0;
+
+  if (sortorder == SORT_PATH)
+  {
+    qsort (filelist.paths, filelist.count, sizeof (char *), comparepaths);
+    return 0;
+  }
+
+  if (!(keys = (struct sourcekey *)malloc (filelist.count * sizeof (struct sourcekey))) ||
+      !(msr = msr_init (NULL)))
+  {
+    fprintf (stderr, "Cannot allocate memory for sorting input list\n");
+    free (keys);
+    return -1;
+  }
+
+  if (verbose)
+    fprintf (stderr, "Reading headers of %lld input files for sorting\n",
+             (long long int)filelist.count);
+
+  /* Header details and problems are reported when converting */
+  s2mctx->params.verbose = 0;
+  s2mctx->log_print      = quietlog;
+
+  for (index = 0; index < filelist.count; index++)
+  {
+    keys[index].path      = filelist.paths[index];
+    keys[index].source[0] = '\0';
+    keys[index].starttime = HPTERROR;
+
+    if (!(ifp = fopen (keys[index].path, "rb")))
+      continue;
+
+    if (parsesacheader (ifp, &sh, &data, keys[index].path) >= 0)
+    {
+      msr->network[0]  = '\0';
+      msr->station[0]  = '\0';
+      msr->location[0] = '\0';
+      msr->channel[0]  = '\0';
+
+      s2m_populatemsr (s2mctx, msr, &sh);
+      msr_srcname (msr, keys[index].source, 0);
+      keys[index].starttime = msr->starttime;
+    }
+
+    freesacdata (&data);
+    fclose (ifp);
+  }
+
+  s2mctx->params.verbose = verbose;
+  s2mctx->log_print      = 0;
+
+  qsort (keys, filelist.count, sizeof (struct sourcekey), comparesources);
+
+  for (index = 0; index < filelist.count; index++)
+    filelist.paths[index] = keys[index].path;
+
+  msr_free (&msr);
+  free (keys);
+
+  return 0;
+} /* End of sortinputs() */
+
+/***************************************************************************
+ * comparesources:
+ *
+ * Compare the source names and start times of two inputs for qsort(),
+ * inputs with the same source and start time are ordered by path.
+ *
+ * Returns <0, 0 or >0 as the first input sorts before, with or after
+ * the second input.
+ ***************************************************************************/
+static int
+comparesources (const void *a, const void *b)
+{
+  const struct sourcekey *ka = (const struct sourcekey *)a;
+  const struct sourcekey *kb = (const struct sourcekey *)b;
+  int cmp;
+
+  if ((ka->starttime == HPTERROR) != (kb->starttime == HPTERROR))
+    return (ka->starttime == HPTERROR) ? 1 : -1;
+
+  if ((cmp = strcmp (ka->source, kb->source)))
+    return cmp;
+
+  if (ka->starttime != kb->starttime)
+    return (ka->starttime < kb->starttime) ? -1 : 1;
+
+  return strcmp (ka->path, kb->path);
+} /* End of comparesources() */
+
+/***************************************************************************
+ * quietlog:
  *
- * Add node to the specified list.
+ * Discard a diagnostic message of the conversion library.
  ***************************************************************************/
 static void
-addnode (struct listnode **listroot, char *key, char *data)
+quietlog (const char *message, void *logdata)
+{
+} /* End of quietlog() */
+
+/***************************************************************************
+ * addpath:
+ *
+ * Copy a path into the string arena of a path list and add it to the
+ * end of the list.  Paths are packed into large blocks, a new block is
+ * allocated when the current block is full.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+int
+addpath (struct pathlist *list, const char *path)
 {
-  struct listnode *lastlp, *newlp;
+  struct arenablock *block = list->arena;
+  size_t length            = strlen (path) + 1;
+  size_t size;
 
-  if (data == NULL)
+  if (!block || block->size - block->used < length)
   {
-    fprintf (stderr, "addnode(): No file name specified\n");
-    return;
+    size = (length > ARENABLOCKSIZE) ? length : ARENABLOCKSIZE;
+
+    if (!(block = (struct arenablock *)malloc (sizeof (struct arenablock) + size)))
+    {
+      fprintf (stderr, "Cannot allocate memory for input list\n");
+      return -1;
+    }
+
+    block->prev = list->arena;
+    block->used = 0;
+    block->size = size;
+    list->arena = block;
   }
 
-  lastlp = *listroot;
-  while (lastlp != 0)
+  memcpy (block->data + block->used, path, length);
+
+  if (appendpath (list, block->data + block->used))
+    return -1;
+
+  block->used += length;
+
+  return 0;
+} /* End of addpath() */
+
+/***************************************************************************
+ * appendpath:
+ *
+ * Add a path to the end of a path list without copying it, the path
+ * must remain valid for the life of the list.  The array of paths is
+ * grown by doubling its capacity.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+int
+appendpath (struct pathlist *list, char *path)
+{
+  char **paths;
+  int64_t capacity;
+
+  if (list->count == list->capacity)
   {
-    if (lastlp->next == 0)
-      break;
+    capacity = (list->capacity) ? list->capacity * 2 : 256;
+
+    if (!(paths = (char **)realloc (list->paths, capacity * sizeof (char *))))
+    {
+      fprintf (stderr, "Cannot allocate memory for input list\n");
+      return -1;
+    }
 
-    lastlp = lastlp->next;
+    list->paths    = paths;
+    list->capacity = capacity;
   }
 
-  newlp = (struct listnode *)malloc (sizeof (struct listnode));
-  memset (newlp, 0, sizeof (struct listnode));
-  if (key)
-    newlp->key = strdup (key);
-  else
-    newlp->key = key;
-  if (data)
-    newlp->data = strdup (data);
-  else
-    newlp->data = data;
-  newlp->next = 0;
+  list->paths[list->count++] = path;
 
-  if (lastlp == 0)
-    *listroot = newlp;
-  else
-    lastlp->next = newlp;
+  return 0;
+} /* End of appendpath() */
+
+/***************************************************************************
+ * freepaths:
+ *
+ * Free the array of paths and string arena of a path list.
+ ***************************************************************************/
+static void
+freepaths (struct pathlist *list)
+{
+  struct arenablock *block;
+
+  while ((block = list->arena))
+  {
+    list->arena = block->prev;
+    free (block);
+  }
 
-} /* End of addnode() */
+  free (list->paths);
+  memset (list, 0, sizeof (struct pathlist));
+} /* End of freepaths() */
 
 /***************************************************************************
  * record_handler:
@@ -1437,10 +3496,10 @@ addnode (struct listnode **listroot, char *key, char *data)
 static void
 record_handler (char *record, int reclen, void *handlerdata)
 {
-  if (fwrite (record, reclen, 1, ofp) != 1)
-  {
-    fprintf (stderr, "Error writing to output file\n");
-  }
+  if (sdsdir)
+    sdsoutput (record, reclen);
+  else
+    writeoutput (ofp, record, reclen);
 } /* End of record_handler() */
 
 /***************************************************************************
@@ -1467,16 +3526,34 @@ usage (void)
            " -e encoding    Specify SEED encoding format for packing, default: 11 (Steim2)\n"
            " -b byteorder   Specify byte order for packing, MSBF: 1 (default), LSBF: 0\n"
            " -o outfile     Specify the output file, default is <inputfile>.mseed\n"
+           " -SDS dir       Write output to an SDS archive of day files under dir\n"
            " -m metafile    Specify the metadata output file\n"
+           " -C manifest    Record converted inputs in manifest, skip unchanged inputs\n"
            " -me            Write additional fields into the metadata output\n"
            " -s factor      Specify scaling factor for sample values, default is autoscale\n"
            " -f format      Specify input SAC file format (default is autodetect):\n"
            "                  0=autodetect, 1=alpha, 2=binary (detect byte order),\n"
            "                  3=binary (little-endian), 4=binary (big-endian)\n"
+           " -R             Recurse into subdirectories of input directories\n"
+           " -g pattern     Only read files in input directories matching pattern,\n"
+           "                  e.g. '*.SAC'\n"
+           " -j workers     Convert input files in parallel with this many threads\n"
+           " -M             Merge contiguous data across input files into continuous records\n"
+           " -B samples     Stream input in blocks of this many samples, bounding memory\n"
+           " -W megabytes   Size of output buffers written by a background thread,\n"
+           "                  default is 8, 0 writes output directly\n"
+           " -P files       Number of input files read ahead by a background thread,\n"
+           "                  default is 16, 0 reads input when converting\n"
+           " -watch dir     Convert files as they arrive in spool directory dir, until\n"
+           "                  terminated, multiple directories can be watched\n"
+           " -done dir      Move converted spool files to dir, default is to remove them\n"
+           " -sort order    Sort input files before converting, order is 'path' or\n"
+           "                  'nslc' for source name and start time from the headers\n"
            "\n"
            " file(s)        File(s) of SAC input data\n"
            "                  If a file is prefixed with an '@' it is assumed to contain\n"
            "                  a list of data files to be read\n"
+           "                  If a file is a directory the files it contains are read\n"
            "\n"
            "Supported Mini-SEED encoding formats:\n"
            " 3  : 32-bit integers, scaled\n"
@@ -0,0 +1,86 @@
+/***************************************************************************
+ * sac2mseed.h
+ *
+ * Internal interface between the modules of the sac2mseed program.
+ *
+ * The build features shared by the modules are determined here, the
+ * program state and routines used by more than one module are defined
+ * in sac2mseed.c.
+ ***************************************************************************/
+
+#ifndef SAC2MSEED_H
+#define SAC2MSEED_H 1
+
+#include <stdio.h>
+
+#include <libmseed.h>
+
+#include "libsac2mseed.h"
+
+/* Parallel conversion (-j) requires POSIX threads */
+#if !defined(LMP_WIN)
+#include <pthread.h>
+#include <unistd.h>
+#define S2M_THREADS 1
+#endif
+
+/* Spool directories are watched for new files with inotify on Linux */
+#if defined(__linux__) && defined(S2M_THREADS)
+#define S2M_WATCH 1
+#endif
+
+/* Binary SAC files are read through a memory mapping where available */
+#if !defined(LMP_WIN)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define S2M_MMAP 1
+#endif
+
+/* A SAC file loaded and parsed from memory */
+struct sacdata
+{
+  S2MSacData sac;           /* Parsed contents and data samples */
+  char *buffer;             /* File contents, mapped or read into memory */
+  size_t length;            /* Length of the file contents */
+  flag mapped;              /* Contents are a read-only memory mapping */
+  size_t released;          /* Length of mapped contents already released */
+};
+
+/* A growable array of paths, the strings are stored in an arena of
+ * blocks that are never moved so that paths remain valid as the list
+ * grows */
+struct pathlist
+{
+  char **paths;             /* Paths in list order */
+  int64_t count;            /* Number of paths */
+  int64_t capacity;         /* Allocated number of paths */
+  struct arenablock *arena; /* Block being filled, NULL if none */
+};
+
+extern int verbose;               /* Verbosity level */
+extern flag outputerror;          /* Output cannot be written, stop converting */
+extern flag recursive;            /* Descend into subdirectories of input directories */
+extern char *fileglob;            /* Only convert files with names matching this pattern */
+extern struct pathlist filelist;  /* Input files to convert */
+extern struct pathlist spoollist; /* Spool directories to watch */
+extern char *donedir;             /* Directory for converted spool files */
+extern flag spooling;             /* Converting a spool file */
+extern char *outputfile;          /* Single output file, NULL if none */
+extern FILE *ofp;                 /* Open output file */
+extern char *sdsdir;              /* SDS archive directory, NULL if none */
+extern MSTraceGroup *mstg;        /* Traces being packed */
+
+extern int addpath (struct pathlist *list, const char *path);
+extern int appendpath (struct pathlist *list, char *path);
+extern int convertinput (char *sacfile, struct sacdata *loaded);
+extern void freesacdata (struct sacdata *data);
+extern int outputname (char *sacfile, char *name, size_t size);
+extern int closeoutput (FILE *fp);
+#if defined(S2M_THREADS)
+extern void notifyinput (void);
+#endif
+#if defined(S2M_WATCH)
+extern int syncoutput (void);
+#endif
+
+#endif /* SAC2MSEED_H */
@@ -0,0 +1,159 @@
+/***************************************************************************
+ * spscqueue.c
+ *
+ * A bounded single-producer, single-consumer queue of ring slots
+ * connecting two stages of the conversion pipeline, see spscqueue.h.
+ ***************************************************************************/
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "sac2mseed.h"
+
+#if defined(S2M_THREADS)
+#include "spscqueue.h"
+
+static void wakequeue (struct spscqueue *queue);
+
+/***************************************************************************
+ * initqueue:
+ *
+ * Initialize an empty queue of size slots.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+int
+initqueue (struct spscqueue *queue, unsigned int size)
+{
+  memset (queue, 0, sizeof (struct spscqueue));
+  queue->size = size;
+
+  if (pthread_mutex_init (&queue->lock, NULL) ||
+      pthread_cond_init (&queue->cond, NULL))
+  {
+    fprintf (stderr, "Cannot initialize queue: %s\n", strerror (errno));
+    return -1;
+  }
+
+  return 0;
+} /* End of initqueue() */
+
+/***************************************************************************
+ * destroyqueue:
+ *
+ * Release the synchronization of a queue no longer used by either side.
+ ***************************************************************************/
+void
+destroyqueue (struct spscqueue *queue)
+{
+  pthread_mutex_destroy (&queue->lock);
+  pthread_cond_destroy (&queue->cond);
+} /* End of destroyqueue() */
+
+/***************************************************************************
+ * waitspace:
+ *
+ * Producer side, wait until at most maxqueued slots are queued.  With
+ * a maxqueued of size - 1 the slot at the tail is free to be filled,
+ * with 0 all queued slots have been consumed.
+ ***************************************************************************/
+void
+waitspace (struct spscqueue *queue, unsigned int maxqueued)
+{
+  if (queue->tail - __atomic_load_n (&queue->head, __ATOMIC_SEQ_CST) <= maxqueued)
+    return;
+
+  pthread_mutex_lock (&queue->lock);
+  __atomic_add_fetch (&queue->sleepers, 1, __ATOMIC_SEQ_CST);
+
+  while (queue->tail - __atomic_load_n (&queue->head, __ATOMIC_SEQ_CST) > maxqueued)
+    pthread_cond_wait (&queue->cond, &queue->lock);
+
+  __atomic_sub_fetch (&queue->sleepers, 1, __ATOMIC_SEQ_CST);
+  pthread_mutex_unlock (&queue->lock);
+} /* End of waitspace() */
+
+/***************************************************************************
+ * pushqueue:
+ *
+ * Producer side, queue the slot at the tail after filling it.
+ ***************************************************************************/
+void
+pushqueue (struct spscqueue *queue)
+{
+  __atomic_store_n (&queue->tail, queue->tail + 1, __ATOMIC_SEQ_CST);
+  wakequeue (queue);
+} /* End of pushqueue() */
+
+/***************************************************************************
+ * waitqueue:
+ *
+ * Consumer side, wait until the slot at the head is queued or the
+ * queue is closed and empty.
+ *
+ * Returns 0 when a slot is queued, and -1 when the queue is finished.
+ ***************************************************************************/
+int
+waitqueue (struct spscqueue *queue)
+{
+  if (__atomic_load_n (&queue->tail, __ATOMIC_SEQ_CST) != queue->head)
+    return 0;
+
+  pthread_mutex_lock (&queue->lock);
+  __atomic_add_fetch (&queue->sleepers, 1, __ATOMIC_SEQ_CST);
+
+  while (__atomic_load_n (&queue->tail, __ATOMIC_SEQ_CST) == queue->head &&
+         !__atomic_load_n (&queue->closed, __ATOMIC_SEQ_CST))
+    pthread_cond_wait (&queue->cond, &queue->lock);
+
+  __atomic_sub_fetch (&queue->sleepers, 1, __ATOMIC_SEQ_CST);
+  pthread_mutex_unlock (&queue->lock);
+
+  /* Slots queued before closing are consumed first */
+  return (__atomic_load_n (&queue->tail, __ATOMIC_SEQ_CST) != queue->head) ? 0 : -1;
+} /* End of waitqueue() */
+
+/***************************************************************************
+ * popqueue:
+ *
+ * Consumer side, release the slot at the head after consuming it.
+ ***************************************************************************/
+void
+popqueue (struct spscqueue *queue)
+{
+  __atomic_store_n (&queue->head, queue->head + 1, __ATOMIC_SEQ_CST);
+  wakequeue (queue);
+} /* End of popqueue() */
+
+/***************************************************************************
+ * closequeue:
+ *
+ * Producer side, mark the queue finished after the last slot.
+ ***************************************************************************/
+void
+closequeue (struct spscqueue *queue)
+{
+  __atomic_store_n (&queue->closed, 1, __ATOMIC_SEQ_CST);
+  wakequeue (queue);
+} /* End of closequeue() */
+
+/***************************************************************************
+ * wakequeue:
+ *
+ * Wake the other side of a queue if it is sleeping.  A sleeper counts
+ * itself before checking the queue under the lock, so either the
+ * sleeper sees the change or the sleeper is seen here and woken once
+ * it is waiting on the condition.
+ ***************************************************************************/
+static void
+wakequeue (struct spscqueue *queue)
+{
+  if (!__atomic_load_n (&queue->sleepers, __ATOMIC_SEQ_CST))
+    return;
+
+  pthread_mutex_lock (&queue->lock);
+  pthread_cond_broadcast (&queue->cond);
+  pthread_mutex_unlock (&queue->lock);
+} /* End of wakequeue() */
+#endif /* S2M_THREADS */
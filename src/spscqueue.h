@@ -0,0 +1,43 @@
+/***************************************************************************
+ * spscqueue.h
+ *
+ * Bounded single-producer, single-consumer queues connecting the
+ * stages of the conversion pipeline: the input reader, the converter
+ * and the output writer.
+ *
+ * The queue only counts ring slots, the slots themselves are held by
+ * the user of the queue.  The producer fills the slot at the tail and
+ * queues it with pushqueue(), the consumer consumes the slot at the
+ * head and releases it with popqueue().
+ ***************************************************************************/
+
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H 1
+
+#include <pthread.h>
+
+/* A bounded single-producer, single-consumer queue of ring slots
+ * connecting two pipeline stages.  The producer advances the tail and
+ * the consumer advances the head with atomic operations and no lock,
+ * the lock and condition are only used to sleep on a full or empty
+ * queue and to wake a sleeping side. */
+struct spscqueue
+{
+  unsigned int size;        /* Number of slots in the ring */
+  unsigned int head;        /* Count of slots consumed, advanced by the consumer */
+  unsigned int tail;        /* Count of slots produced, advanced by the producer */
+  int closed;               /* Producer finished, set by the producer */
+  int sleepers;             /* Number of sides sleeping on cond */
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+};
+
+extern int initqueue (struct spscqueue *queue, unsigned int size);
+extern void destroyqueue (struct spscqueue *queue);
+extern void waitspace (struct spscqueue *queue, unsigned int maxqueued);
+extern void pushqueue (struct spscqueue *queue);
+extern int waitqueue (struct spscqueue *queue);
+extern void popqueue (struct spscqueue *queue);
+extern void closequeue (struct spscqueue *queue);
+
+#endif /* SPSCQUEUE_H */
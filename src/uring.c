@@ -0,0 +1,217 @@
+/***************************************************************************
+ * uring.c
+ *
+ * Minimal io_uring support for reading input files, see uring.h.
+ ***************************************************************************/
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "uring.h"
+
+#if defined(S2M_URING)
+/***************************************************************************
+ * uringsetup:
+ *
+ * Set up an io_uring instance with entries submission entries and map
+ * its rings.
+ *
+ * Returns 0 on success, and -1 on failure with errno set
+ ***************************************************************************/
+int
+uringsetup (struct uring *ring, unsigned int entries)
+{
+  struct io_uring_params params;
+  char *sq;
+  char *cq;
+  int error;
+
+  memset (ring, 0, sizeof (struct uring));
+  memset (&params, 0, sizeof (params));
+  ring->sqring = MAP_FAILED;
+  ring->cqring = MAP_FAILED;
+  ring->sqes   = MAP_FAILED;
+
+  if ((ring->fd = (int)syscall (__NR_io_uring_setup, entries, &params)) < 0)
+    return -1;
+
+  ring->sqringsize = params.sq_off.array + params.sq_entries * sizeof (unsigned int);
+  ring->cqringsize = params.cq_off.cqes + params.cq_entries * sizeof (struct io_uring_cqe);
+  ring->sqessize   = params.sq_entries * sizeof (struct io_uring_sqe);
+
+  /* Both rings share a mapping on most kernels */
+  if (params.features & IORING_FEAT_SINGLE_MMAP)
+  {
+    if (ring->cqringsize > ring->sqringsize)
+      ring->sqringsize = ring->cqringsize;
+    ring->cqringsize = ring->sqringsize;
+  }
+
+  ring->sqring = mmap (NULL, ring->sqringsize, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+
+  if (ring->sqring != MAP_FAILED)
+  {
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+      ring->cqring = ring->sqring;
+    else
+      ring->cqring = mmap (NULL, ring->cqringsize, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+  }
+
+  if (ring->cqring != MAP_FAILED)
+    ring->sqes = (struct io_uring_sqe *)mmap (NULL, ring->sqessize, PROT_READ | PROT_WRITE,
+                                              MAP_SHARED | MAP_POPULATE, ring->fd,
+                                              IORING_OFF_SQES);
+
+  if (ring->sqes == MAP_FAILED)
+  {
+    error = errno;
+    uringclose (ring);
+    errno = error;
+
+    return -1;
+  }
+
+  sq = (char *)ring->sqring;
+  cq = (char *)ring->cqring;
+
+  ring->sqtail  = (unsigned int *)(sq + params.sq_off.tail);
+  ring->sqmask  = (unsigned int *)(sq + params.sq_off.ring_mask);
+  ring->sqarray = (unsigned int *)(sq + params.sq_off.array);
+  ring->sqlocal = *ring->sqtail;
+  ring->cqhead  = (unsigned int *)(cq + params.cq_off.head);
+  ring->cqtail  = (unsigned int *)(cq + params.cq_off.tail);
+  ring->cqmask  = (unsigned int *)(cq + params.cq_off.ring_mask);
+  ring->cqes    = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+  return 0;
+} /* End of uringsetup() */
+
+/***************************************************************************
+ * uringclose:
+ *
+ * Unmap the rings and close an io_uring instance set up with
+ * uringsetup(), nothing is done if the ring is not set up.
+ ***************************************************************************/
+void
+uringclose (struct uring *ring)
+{
+  if (ring->fd < 0)
+    return;
+
+  if (ring->sqes != MAP_FAILED)
+    munmap (ring->sqes, ring->sqessize);
+  if (ring->cqring != MAP_FAILED && ring->cqring != ring->sqring)
+    munmap (ring->cqring, ring->cqringsize);
+  if (ring->sqring != MAP_FAILED)
+    munmap (ring->sqring, ring->sqringsize);
+
+  close (ring->fd);
+  ring->fd = -1;
+} /* End of uringclose() */
+
+/***************************************************************************
+ * uringsqe:
+ *
+ * Prepare the next submission entry of the ring with an operation on a
+ * file descriptor, the caller sets the remaining fields.  The entry is
+ * submitted by uringrun().  No more entries than the ring holds may be
+ * prepared before they are run.
+ *
+ * Returns a pointer to the cleared submission entry.
+ ***************************************************************************/
+struct io_uring_sqe *
+uringsqe (struct uring *ring, int opcode, int fd, uint64_t user_data)
+{
+  struct io_uring_sqe *sqe;
+  unsigned int index = ring->sqlocal & *ring->sqmask;
+
+  sqe = &ring->sqes[index];
+  memset (sqe, 0, sizeof (struct io_uring_sqe));
+  sqe->opcode    = (uint8_t)opcode;
+  sqe->fd        = fd;
+  sqe->user_data = user_data;
+
+  ring->sqarray[index] = index;
+  ring->sqlocal++;
+
+  return sqe;
+} /* End of uringsqe() */
+
+/***************************************************************************
+ * uringrun:
+ *
+ * Submit the count entries prepared with uringsqe() and wait for all of
+ * them to complete.  The result of each operation is stored in results
+ * indexed by the user data of its entry, results of operations never
+ * submitted are not set.
+ *
+ * If the ring itself fails, e.g. with EAGAIN or EBUSY, no further
+ * entries are submitted.  Operations already submitted may still write
+ * to the input buffers, so their completions are awaited before the
+ * ring is closed, the remaining input is then read without io_uring.
+ *
+ * Returns 0 on success, and -1 if the ring failed
+ ***************************************************************************/
+int
+uringrun (struct uring *ring, unsigned int count, int32_t *results)
+{
+  struct io_uring_cqe *cqe;
+  struct timespec pause = {0, 1000000};
+  unsigned int submit   = count;
+  unsigned int done     = 0;
+  unsigned int head;
+  unsigned int tail;
+  flag failed = 0;
+  long rv;
+
+  /* Entries are visible to the kernel once the tail is stored */
+  __atomic_store_n (ring->sqtail, ring->sqlocal, __ATOMIC_RELEASE);
+
+  while (done < count - ((failed) ? submit : 0))
+  {
+    /* Completions of a failed ring are collected as they are posted */
+    if (failed)
+    {
+      if (*ring->cqhead == __atomic_load_n (ring->cqtail, __ATOMIC_ACQUIRE))
+        nanosleep (&pause, NULL);
+    }
+    else if ((rv = syscall (__NR_io_uring_enter, ring->fd, submit, count - done,
+                            IORING_ENTER_GETEVENTS, NULL, 0)) < 0)
+    {
+      if (errno != EINTR)
+      {
+        fprintf (stderr, "Error reading input with io_uring, continuing without: %s\n",
+                 strerror (errno));
+        failed = 1;
+      }
+    }
+    else if (rv > 0)
+    {
+      submit -= ((unsigned int)rv < submit) ? (unsigned int)rv : submit;
+    }
+
+    head = *ring->cqhead;
+    tail = __atomic_load_n (ring->cqtail, __ATOMIC_ACQUIRE);
+
+    for (; head != tail; head++, done++)
+    {
+      cqe                     = &ring->cqes[head & *ring->cqmask];
+      results[cqe->user_data] = cqe->res;
+    }
+
+    __atomic_store_n (ring->cqhead, head, __ATOMIC_RELEASE);
+  }
+
+  if (failed)
+  {
+    uringclose (ring);
+    return -1;
+  }
+
+  return 0;
+} /* End of uringrun() */
+#endif /* S2M_URING */
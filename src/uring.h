@@ -0,0 +1,62 @@
+/***************************************************************************
+ * uring.h
+ *
+ * Minimal io_uring support for reading input files in batches on Linux,
+ * used without liburing.  S2M_URING is defined when the system headers
+ * support io_uring, whether the running kernel supports it is only
+ * known when a ring is set up.
+ *
+ * Operations are prepared with uringsqe() and submitted together with
+ * uringrun(), which waits for all of them to complete.
+ ***************************************************************************/
+
+#ifndef URING_H
+#define URING_H 1
+
+#include "sac2mseed.h"
+
+/* Input files are opened and read in batches through io_uring on Linux,
+ * used without liburing and only if supported by the running kernel */
+#if defined(__linux__) && defined(S2M_THREADS) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <linux/stat.h>
+#include <sys/syscall.h>
+#if defined(IORING_FEAT_RW_CUR_POS) && defined(__NR_io_uring_setup)
+#define S2M_URING 1
+#endif
+#endif
+#endif
+
+#if defined(S2M_URING)
+/* An io_uring instance, the mapped submission and completion rings */
+struct uring
+{
+  int fd;                   /* Ring descriptor, -1 if not set up */
+  unsigned int sqlocal;     /* Tail of entries prepared, not yet submitted */
+  unsigned int *sqtail;
+  unsigned int *sqmask;
+  unsigned int *sqarray;
+  struct io_uring_sqe *sqes;
+  unsigned int *cqhead;
+  unsigned int *cqtail;
+  unsigned int *cqmask;
+  struct io_uring_cqe *cqes;
+  void *sqring;             /* Mapping of the submission ring */
+  size_t sqringsize;
+  void *cqring;             /* Mapping of the completion ring, may be sqring */
+  size_t cqringsize;
+  size_t sqessize;          /* Size of the mapping of sqes */
+};
+
+/* Result of an operation that was never submitted */
+#define URINGNORESULT INT32_MIN
+
+extern int uringsetup (struct uring *ring, unsigned int entries);
+extern void uringclose (struct uring *ring);
+extern struct io_uring_sqe *uringsqe (struct uring *ring, int opcode, int fd,
+                                      uint64_t user_data);
+extern int uringrun (struct uring *ring, unsigned int count, int32_t *results);
+#endif /* S2M_URING */
+
+#endif /* URING_H */
@@ -0,0 +1,502 @@
+/***************************************************************************
+ * walker.c
+ *
+ * Resolution of the input arguments into the file list, see walker.h.
+ ***************************************************************************/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "walker.h"
+
+#if defined(S2M_THREADS)
+#include <dirent.h>
+#include <fnmatch.h>
+
+/* Number of threads listing input directories */
+#define WALKTHREADS 4
+
+/* An input argument or directory listed by the walker threads */
+struct walkdir
+{
+  char *path;               /* Input path, allocated for subdirectories */
+  flag isdir;               /* Path is a directory */
+  flag listed;              /* Type determined and directory listed */
+  struct walkdir *parent;   /* Containing directory, NULL for input arguments */
+  struct walkdir *nextroot; /* Next input argument */
+  struct walkdir *nextwalk; /* Next entry waiting to be listed */
+  char **files;             /* Sorted paths of files in directory */
+  int filecount;            /* Number of files */
+  struct walkdir **subdirs; /* Sorted subdirectories */
+  int subdircount;          /* Number of subdirectories */
+  int nextsubdir;           /* Next subdirectory to add to the file list */
+};
+
+static void *walkerthread (void *arg);
+static void listdir (struct walkdir *wd);
+static int comparedirs (const void *a, const void *b);
+static void emitinput (void);
+
+/* Shared state for listing input, protected by walklock */
+static pthread_mutex_t walklock  = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t walkcond   = PTHREAD_COND_INITIALIZER;
+static pthread_t walkthreads[WALKTHREADS];
+static struct walkdir *walkqueue = 0; /* Entries waiting to be listed, a stack */
+static struct walkdir *walkemit  = 0; /* Entry being added to the file list */
+static int walkactive            = 0; /* Number of entries being listed */
+static flag walking              = 0; /* File list is still being extended */
+static flag walkstop             = 0; /* Stop listing */
+
+
+/***************************************************************************
+ * startwalk:
+ *
+ * Start the walker threads that resolve the input arguments into the
+ * file list.  Arguments are checked and directories are listed,
+ * recursively if requested, by several threads concurrently.  Files
+ * are added to the file list in argument order, for a directory its
+ * files in name order followed by the contents of its subdirectories
+ * in name order, as soon as all prior entries are listed.  Conversion
+ * starts with the first file instead of waiting for a complete list.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+int
+startwalk (void)
+{
+  struct walkdir *wd;
+  struct walkdir *lastroot = 0;
+  int64_t index;
+  int idx;
+  int rv;
+
+  /* Move the input arguments to the queue of entries to list, the
+   * first argument on top, the file list is refilled as listed */
+  for (index = 0; index < filelist.count; index++)
+  {
+    if (!(wd = (struct walkdir *)calloc (1, sizeof (struct walkdir))))
+    {
+      fprintf (stderr, "Cannot allocate memory for input list\n");
+      return -1;
+    }
+
+    wd->path = filelist.paths[index];
+
+    if (lastroot)
+      lastroot->nextroot = lastroot->nextwalk = wd;
+    else
+      walkemit = walkqueue = wd;
+
+    lastroot = wd;
+  }
+
+  filelist.count = 0;
+
+  walking = (walkemit) ? 1 : 0;
+
+  for (idx = 0; idx < WALKTHREADS; idx++)
+  {
+    if ((rv = pthread_create (&walkthreads[idx], NULL, walkerthread, NULL)))
+    {
+      fprintf (stderr, "Cannot create walker thread: %s\n", strerror (rv));
+      exit (1);
+    }
+  }
+
+  return 0;
+} /* End of startwalk() */
+
+/***************************************************************************
+ * stopwalk:
+ *
+ * Stop listing input and wait for the walker threads to exit.  Entries
+ * not yet listed are abandoned.
+ ***************************************************************************/
+void
+stopwalk (void)
+{
+  int idx;
+
+  pthread_mutex_lock (&walklock);
+  walkstop = 1;
+  pthread_cond_broadcast (&walkcond);
+  pthread_mutex_unlock (&walklock);
+
+  for (idx = 0; idx < WALKTHREADS; idx++)
+    pthread_join (walkthreads[idx], NULL);
+} /* End of stopwalk() */
+
+/***************************************************************************
+ * waitwalk:
+ *
+ * Wait until all input has been added to the file list.
+ ***************************************************************************/
+void
+waitwalk (void)
+{
+  pthread_mutex_lock (&walklock);
+
+  while (walking)
+    pthread_cond_wait (&walkcond, &walklock);
+
+  pthread_mutex_unlock (&walklock);
+} /* End of waitwalk() */
+
+/***************************************************************************
+ * walkerthread:
+ *
+ * Walker thread, list queued entries until all are listed.  Newly
+ * found subdirectories are queued on top so that the walk proceeds
+ * roughly in file list order.
+ ***************************************************************************/
+static void *
+walkerthread (void *arg)
+{
+  struct walkdir *wd;
+  int idx;
+
+  pthread_mutex_lock (&walklock);
+
+  for (;;)
+  {
+    while (!walkqueue && walkactive > 0 && !walkstop)
+      pthread_cond_wait (&walkcond, &walklock);
+
+    if (!walkqueue || walkstop)
+      break;
+
+    wd        = walkqueue;
+    walkqueue = wd->nextwalk;
+    walkactive++;
+
+    pthread_mutex_unlock (&walklock);
+
+    listdir (wd);
+
+    pthread_mutex_lock (&walklock);
+
+    for (idx = wd->subdircount - 1; idx >= 0; idx--)
+    {
+      wd->subdirs[idx]->nextwalk = walkqueue;
+      walkqueue                  = wd->subdirs[idx];
+    }
+
+    wd->listed = 1;
+    walkactive--;
+
+    emitinput ();
+
+    pthread_cond_broadcast (&walkcond);
+    pthread_mutex_unlock (&walklock);
+
+    notifyinput ();
+
+    pthread_mutex_lock (&walklock);
+  }
+
+  pthread_cond_broadcast (&walkcond);
+  pthread_mutex_unlock (&walklock);
+
+  return NULL;
+} /* End of walkerthread() */
+
+/***************************************************************************
+ * listdir:
+ *
+ * Determine if an input argument is a directory and list the files
+ * and, when recursing, subdirectories of a directory.  Names starting
+ * with '.' are skipped, files not matching the file name pattern are
+ * skipped and symbolic links to directories are not followed.
+ ***************************************************************************/
+static void
+listdir (struct walkdir *wd)
+{
+  struct walkdir *subdir;
+  struct dirent *de;
+  struct stat st;
+  DIR *dir;
+  char *path;
+  size_t pathlen;
+  flag isdir;
+  flag isfile;
+
+  /* Input arguments that are not directories are files */
+  if (!wd->parent)
+  {
+    if (stat (wd->path, &st) || !S_ISDIR (st.st_mode))
+      return;
+
+    wd->isdir = 1;
+  }
+
+  if (verbose > 1)
+    fprintf (stderr, "Listing directory %s\n", wd->path);
+
+  if (!(dir = opendir (wd->path)))
+  {
+    fprintf (stderr, "Cannot open directory %s (%s)\n", wd->path, strerror (errno));
+    return;
+  }
+
+  /* Avoid a double separator for paths with a trailing slash */
+  pathlen = strlen (wd->path);
+  if (pathlen > 0 && wd->path[pathlen - 1] == '/')
+    pathlen--;
+
+  while ((de = readdir (dir)))
+  {
+    if (!strcmp (de->d_name, ".") || !strcmp (de->d_name, ".."))
+      continue;
+
+    if (!(path = (char *)malloc (pathlen + strlen (de->d_name) + 2)))
+    {
+      fprintf (stderr, "Cannot allocate memory for input list\n");
+      break;
+    }
+
+    memcpy (path, wd->path, pathlen);
+    path[pathlen] = '/';
+    strcpy (path + pathlen + 1, de->d_name);
+
+    isdir = isfile = 0;
+
+#if defined(DT_UNKNOWN)
+    if (de->d_type == DT_DIR)
+      isdir = 1;
+    else if (de->d_type == DT_REG)
+      isfile = 1;
+    else if (de->d_type == DT_LNK || de->d_type == DT_UNKNOWN)
+#endif
+    {
+      if (!lstat (path, &st))
+      {
+        if (S_ISDIR (st.st_mode))
+          isdir = 1;
+        else if (S_ISREG (st.st_mode))
+          isfile = 1;
+        else if (S_ISLNK (st.st_mode) && !stat (path, &st) && S_ISREG (st.st_mode))
+          isfile = 1;
+      }
+    }
+
+    if (isfile && (!fileglob || !fnmatch (fileglob, de->d_name, 0)))
+    {
+      if (addentry (&wd->files, &wd->filecount, path))
+        break;
+    }
+    else if (isdir && recursive)
+    {
+      if (!(subdir = (struct walkdir *)calloc (1, sizeof (struct walkdir))))
+      {
+        fprintf (stderr, "Cannot allocate memory for input list\n");
+        free (path);
+        break;
+      }
+
+      subdir->path   = path;
+      subdir->isdir  = 1;
+      subdir->parent = wd;
+
+      if (addentry (&wd->subdirs, &wd->subdircount, subdir))
+      {
+        free (subdir);
+        break;
+      }
+    }
+    else
+    {
+      free (path);
+    }
+  }
+
+  closedir (dir);
+
+  if (wd->filecount > 1)
+    qsort (wd->files, wd->filecount, sizeof (char *), comparepaths);
+
+  if (wd->subdircount > 1)
+    qsort (wd->subdirs, wd->subdircount, sizeof (struct walkdir *), comparedirs);
+} /* End of listdir() */
+
+/***************************************************************************
+ * addentry:
+ *
+ * Add a pointer to a growable array of pointers, the array is
+ * reallocated as needed to a capacity of a power of 2.  On failure the
+ * entry is freed.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+int
+addentry (void *listp, int *count, void *entry)
+{
+  void ***list = (void ***)listp;
+  void **newlist;
+
+  /* Grow when the count reaches a power of 2 */
+  if (*count == 0 || (*count & (*count - 1)) == 0)
+  {
+    if (!(newlist = (void **)realloc (*list, (*count ? *count * 2 : 16) * sizeof (void *))))
+    {
+      fprintf (stderr, "Cannot allocate memory for input list\n");
+      free (entry);
+      return -1;
+    }
+
+    *list = newlist;
+  }
+
+  (*list)[(*count)++] = entry;
+
+  return 0;
+} /* End of addentry() */
+
+/***************************************************************************
+ * comparedirs:
+ *
+ * Compare the paths of two directories for qsort().
+ *
+ * Returns <0, 0 or >0 as the first path sorts before, with or after
+ * the second path.
+ ***************************************************************************/
+static int
+comparedirs (const void *a, const void *b)
+{
+  return strcmp ((*(struct walkdir *const *)a)->path,
+                 (*(struct walkdir *const *)b)->path);
+} /* End of comparedirs() */
+
+/***************************************************************************
+ * emitinput:
+ *
+ * Add the files of listed entries to the file list in order, stopping
+ * at the first entry not yet listed.  Emitted entries are freed, the
+ * paths of listed files are copied to the file list.  Must be called
+ * with walklock held.
+ ***************************************************************************/
+static void
+emitinput (void)
+{
+  struct walkdir *wd;
+  int idx;
+
+  while ((wd = walkemit) && wd->listed)
+  {
+    /* Add the files when first reached, an input argument that is not
+     * a directory is itself a file and already stored in the arena */
+    if (wd->path)
+    {
+      if (wd->isdir)
+      {
+        for (idx = 0; idx < wd->filecount; idx++)
+        {
+          addpath (&filelist, wd->files[idx]);
+          free (wd->files[idx]);
+        }
+      }
+      else
+      {
+        appendpath (&filelist, wd->path);
+      }
+
+      if (wd->parent)
+        free (wd->path);
+
+      free (wd->files);
+      wd->files = 0;
+      wd->path  = 0;
+    }
+
+    /* Continue with the next subdirectory, then the parent */
+    if (wd->nextsubdir < wd->subdircount)
+    {
+      walkemit = wd->subdirs[wd->nextsubdir++];
+      continue;
+    }
+
+    walkemit = (wd->parent) ? wd->parent : wd->nextroot;
+
+    free (wd->subdirs);
+    free (wd);
+  }
+
+  if (!walkemit)
+    walking = 0;
+} /* End of emitinput() */
+
+/***************************************************************************
+ * followfile:
+ *
+ * Return the input file at index in the file list without waiting for
+ * the file to be listed.  When all input has been returned end is set
+ * to 1.
+ *
+ * Returns the input file path or NULL if none is listed yet.
+ ***************************************************************************/
+char *
+followfile (int64_t index, flag *end)
+{
+  char *path = 0;
+
+  pthread_mutex_lock (&walklock);
+
+  if (index < filelist.count)
+    path = filelist.paths[index];
+  else if (!walking)
+    *end = 1;
+
+  pthread_mutex_unlock (&walklock);
+
+  return path;
+} /* End of followfile() */
+#endif /* S2M_THREADS */
+
+/***************************************************************************
+ * nextfile:
+ *
+ * Return the input file at index in the file list, waiting for the
+ * file to be listed while input directories are being walked.
+ *
+ * Returns the input file path or NULL when all input has been
+ * returned.
+ ***************************************************************************/
+char *
+nextfile (int64_t index)
+{
+  char *path = 0;
+
+#if defined(S2M_THREADS)
+  pthread_mutex_lock (&walklock);
+
+  while (index >= filelist.count && walking)
+    pthread_cond_wait (&walkcond, &walklock);
+
+  if (index < filelist.count)
+    path = filelist.paths[index];
+
+  pthread_mutex_unlock (&walklock);
+#else
+  if (index < filelist.count)
+    path = filelist.paths[index];
+#endif
+
+  return path;
+} /* End of nextfile() */
+
+/***************************************************************************
+ * comparepaths:
+ *
+ * Compare two file paths for qsort().
+ *
+ * Returns <0, 0 or >0 as the first path sorts before, with or after
+ * the second path.
+ ***************************************************************************/
+int
+comparepaths (const void *a, const void *b)
+{
+  return strcmp (*(char *const *)a, *(char *const *)b);
+} /* End of comparepaths() */
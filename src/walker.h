@@ -0,0 +1,27 @@
+/***************************************************************************
+ * walker.h
+ *
+ * Resolution of the input arguments into the list of files to convert.
+ *
+ * With threads, input directories are listed, recursively if requested,
+ * by walker threads while the files already listed are converted.
+ * Files are returned by their index in the file list with nextfile(),
+ * which waits for the file to be listed.
+ ***************************************************************************/
+
+#ifndef WALKER_H
+#define WALKER_H 1
+
+#include "sac2mseed.h"
+
+#if defined(S2M_THREADS)
+extern int startwalk (void);
+extern void stopwalk (void);
+extern void waitwalk (void);
+extern char *followfile (int64_t index, flag *end);
+extern int addentry (void *listp, int *count, void *entry);
+#endif
+extern char *nextfile (int64_t index);
+extern int comparepaths (const void *a, const void *b);
+
+#endif /* WALKER_H */
@@ -0,0 +1,477 @@
+/***************************************************************************
+ * watch.c
+ *
+ * Conversion of files arriving in spool directories, see watch.h.
+ ***************************************************************************/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "watch.h"
+
+#if defined(S2M_WATCH)
+#include <dirent.h>
+#include <fnmatch.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+
+#include "walker.h"
+
+/* A watched spool directory */
+struct spooldir
+{
+  int wd;                   /* inotify watch descriptor */
+  char *path;               /* Directory path */
+};
+
+static int scanspool (char *dir);
+static int convertspool (char *path);
+static void prunetraces (void);
+static flag spoolfile (const char *name);
+
+static struct spooldir *spooldirs = 0; /* Watched spool directories */
+static int spoolcount             = 0; /* Number of spool directories */
+static int watchfd                = -1; /* inotify instance */
+static int sigfd                  = -1; /* Signals stopping the watch */
+
+/***************************************************************************
+ * startwatch:
+ *
+ * Block the signals that stop watching (SIGTERM, SIGINT and SIGHUP),
+ * to be received through a signal descriptor instead, and start
+ * watching the spool directories for files closed after writing or
+ * moved into them.  Must be called before any threads are started so
+ * that all threads block the signals.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+int
+startwatch (void)
+{
+  sigset_t signals;
+  int idx;
+
+  sigemptyset (&signals);
+  sigaddset (&signals, SIGTERM);
+  sigaddset (&signals, SIGINT);
+  sigaddset (&signals, SIGHUP);
+
+  if (sigprocmask (SIG_BLOCK, &signals, NULL) ||
+      (sigfd = signalfd (-1, &signals, SFD_CLOEXEC)) < 0)
+  {
+    fprintf (stderr, "Cannot set up signal handling: %s\n", strerror (errno));
+    return -1;
+  }
+
+  if ((watchfd = inotify_init1 (IN_CLOEXEC)) < 0)
+  {
+    fprintf (stderr, "Cannot start watching spool directories: %s\n", strerror (errno));
+    return -1;
+  }
+
+  spoolcount = (int)spoollist.count;
+
+  if (!(spooldirs = (struct spooldir *)calloc (spoolcount, sizeof (struct spooldir))))
+  {
+    fprintf (stderr, "Cannot allocate memory for spool directories\n");
+    return -1;
+  }
+
+  for (idx = 0; idx < spoolcount; idx++)
+  {
+    spooldirs[idx].path = spoollist.paths[idx];
+    spooldirs[idx].wd   = inotify_add_watch (watchfd, spooldirs[idx].path,
+                                             IN_CLOSE_WRITE | IN_MOVED_TO |
+                                             IN_DELETE_SELF | IN_MOVE_SELF |
+                                             IN_ONLYDIR);
+
+    if (spooldirs[idx].wd < 0)
+    {
+      fprintf (stderr, "Cannot watch spool directory %s: %s\n", spooldirs[idx].path, strerror (errno));
+      return -1;
+    }
+  }
+
+  return 0;
+} /* End of startwatch() */
+
+/***************************************************************************
+ * watchspool:
+ *
+ * Convert the files already in the spool directories and then each
+ * file as it is closed after writing, or moved, into a spool
+ * directory, until a stop signal is received.  A file being converted
+ * when the signal arrives is completed, any files remaining in the
+ * spool directories are converted when watching is started again.
+ *
+ * Returns 0 when stopped by a signal or output error, and -1 on
+ * failure
+ ***************************************************************************/
+int
+watchspool (void)
+{
+  union
+  {
+    struct inotify_event event; /* Aligns the buffer for events */
+    char buffer[64 * 1024];
+  } events;
+  struct inotify_event *event;
+  struct signalfd_siginfo siginfo;
+  struct pollfd fds[2];
+  char path[1024];
+  ssize_t length;
+  ssize_t offset;
+  flag stop = 0;
+  int rv    = 0;
+  int idx;
+
+  fds[0].fd     = sigfd;
+  fds[0].events = POLLIN;
+  fds[1].fd     = watchfd;
+  fds[1].events = POLLIN;
+
+  /* Files that arrived before watching started */
+  for (idx = 0; idx < spoolcount && !outputerror; idx++)
+    scanspool (spooldirs[idx].path);
+
+  if (verbose)
+    fprintf (stderr, "Watching %d spool director%s\n", spoolcount,
+             (spoolcount == 1) ? "y" : "ies");
+
+  while (!stop && !outputerror)
+  {
+    if (poll (fds, 2, -1) < 0)
+    {
+      if (errno == EINTR)
+        continue;
+
+      fprintf (stderr, "Error waiting for spool files: %s\n", strerror (errno));
+      rv = -1;
+      break;
+    }
+
+    if (fds[0].revents & POLLIN)
+      break;
+
+    if (!(fds[1].revents & POLLIN))
+      continue;
+
+    if ((length = read (watchfd, events.buffer, sizeof (events.buffer))) <= 0)
+    {
+      if (length < 0 && errno == EINTR)
+        continue;
+
+      fprintf (stderr, "Error reading spool events: %s\n", strerror (errno));
+      rv = -1;
+      break;
+    }
+
+    for (offset = 0; offset < length && !stop && !outputerror;
+         offset += sizeof (struct inotify_event) + event->len)
+    {
+      event = (struct inotify_event *)(events.buffer + offset);
+
+      /* Events were lost, convert all files in the spool directories */
+      if (event->mask & IN_Q_OVERFLOW)
+      {
+        for (idx = 0; idx < spoolcount && !outputerror; idx++)
+          scanspool (spooldirs[idx].path);
+        continue;
+      }
+
+      for (idx = 0; idx < spoolcount; idx++)
+        if (spooldirs[idx].wd == event->wd)
+          break;
+
+      if (idx == spoolcount)
+        continue;
+
+      if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF))
+      {
+        fprintf (stderr, "Spool directory %s was removed\n", spooldirs[idx].path);
+        rv   = -1;
+        stop = 1;
+        break;
+      }
+
+      if (!event->len || (event->mask & IN_ISDIR) || !spoolfile (event->name))
+        continue;
+
+      snprintf (path, sizeof (path), "%s/%s", spooldirs[idx].path, event->name);
+
+      convertspool (path);
+
+      /* Stop between files when signalled */
+      if (poll (fds, 1, 0) > 0 && (fds[0].revents & POLLIN))
+        stop = 1;
+    }
+  }
+
+  if (read (sigfd, &siginfo, sizeof (siginfo)) == sizeof (siginfo) && verbose)
+    fprintf (stderr, "Received signal %u, stopped watching\n", siginfo.ssi_signo);
+
+  close (watchfd);
+  close (sigfd);
+  free (spooldirs);
+
+  return rv;
+} /* End of watchspool() */
+
+/***************************************************************************
+ * scanspool:
+ *
+ * Convert the files in a spool directory in name order.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+scanspool (char *dir)
+{
+  DIR *dirp;
+  struct dirent *de;
+  char **files  = 0;
+  int filecount = 0;
+  char *path;
+  size_t length;
+  int idx;
+
+  if (!(dirp = opendir (dir)))
+  {
+    fprintf (stderr, "Cannot open spool directory %s: %s\n", dir, strerror (errno));
+    return -1;
+  }
+
+  while ((de = readdir (dirp)))
+  {
+    if (!spoolfile (de->d_name))
+      continue;
+
+    length = strlen (dir) + strlen (de->d_name) + 2;
+
+    if (!(path = (char *)malloc (length)))
+    {
+      fprintf (stderr, "Cannot allocate memory for input list\n");
+      break;
+    }
+
+    snprintf (path, length, "%s/%s", dir, de->d_name);
+
+    if (addentry (&files, &filecount, path))
+      break;
+  }
+
+  closedir (dirp);
+
+  if (filecount > 1)
+    qsort (files, filecount, sizeof (char *), comparepaths);
+
+  for (idx = 0; idx < filecount; idx++)
+  {
+    if (!outputerror)
+      convertspool (files[idx]);
+
+    free (files[idx]);
+  }
+
+  free (files);
+
+  return 0;
+} /* End of scanspool() */
+
+/***************************************************************************
+ * convertspool:
+ *
+ * Convert a file from a spool directory.  A separate output file is
+ * written under a temporary name and renamed when complete, output to
+ * a single file or archive is written out before continuing.  When
+ * converted the file is moved to the done directory, if specified, or
+ * removed.  Files that fail to convert are left in place.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+convertspool (char *path)
+{
+  char outname[1024];
+  char tmpname[1024];
+  char donename[1024];
+  const char *base;
+  struct stat st;
+  int rv;
+
+  /* Files both present at startup and reported are already gone */
+  if (stat (path, &st) || !S_ISREG (st.st_mode))
+    return 0;
+
+  spooling = 1;
+  rv       = convertinput (path, NULL);
+  spooling = 0;
+
+  /* A separate output file left open by a failure is closed */
+  if (ofp && !outputfile)
+  {
+    closeoutput (ofp);
+    ofp = 0;
+  }
+
+  if (syncoutput ())
+    rv = -1;
+
+  prunetraces ();
+
+  if (!outputfile && !sdsdir)
+  {
+    /* No output was opened under a name that does not fit */
+    if (outputname (path, outname, sizeof (outname)) ||
+        stagingname (outname, tmpname, sizeof (tmpname)))
+    {
+      rv = -1;
+    }
+    else if (rv)
+    {
+      unlink (tmpname);
+    }
+    /* Inputs skipped as unchanged have no output to rename */
+    else if (rename (tmpname, outname) && errno != ENOENT)
+    {
+      fprintf (stderr, "Cannot rename %s to %s: %s\n", tmpname, outname, strerror (errno));
+      rv = -1;
+    }
+  }
+
+  if (rv)
+  {
+    fprintf (stderr, "[%s] Conversion failed, leaving file in spool directory\n", path);
+    return -1;
+  }
+
+  if (donedir)
+  {
+    base = strrchr (path, '/');
+    base = (base) ? base + 1 : path;
+
+    if (snprintf (donename, sizeof (donename), "%s/%s", donedir, base) >= (int)sizeof (donename))
+    {
+      fprintf (stderr, "Cannot move %s to %s: name too long\n", path, donedir);
+      return -1;
+    }
+
+    if (rename (path, donename))
+    {
+      fprintf (stderr, "Cannot move %s to %s: %s\n", path, donename, strerror (errno));
+      return -1;
+    }
+  }
+  else if (unlink (path))
+  {
+    fprintf (stderr, "Cannot remove %s: %s\n", path, strerror (errno));
+    return -1;
+  }
+
+  return 0;
+} /* End of convertspool() */
+
+/***************************************************************************
+ * prunetraces:
+ *
+ * Release the traces of the group superseded by a later trace of the
+ * same channel.  Every trace is fully packed after each spool file,
+ * only the latest trace of a channel is kept, with its template and
+ * record sequence, to be continued by the next file of the channel.
+ ***************************************************************************/
+static void
+prunetraces (void)
+{
+  MSTrace *mst;
+  MSTrace *other;
+  MSTrace **link;
+  int32_t numtraces = mstg->numtraces;
+
+  link = &mstg->traces;
+  while ((mst = *link))
+  {
+    for (other = mstg->traces; other; other = other->next)
+    {
+      if (other != mst && other->endtime > mst->endtime &&
+          !strcmp (other->network, mst->network) &&
+          !strcmp (other->station, mst->station) &&
+          !strcmp (other->location, mst->location) &&
+          !strcmp (other->channel, mst->channel))
+        break;
+    }
+
+    if (!other || mst->numsamples > 0)
+    {
+      link = &mst->next;
+      continue;
+    }
+
+    *link = mst->next;
+    mstg->numtraces--;
+
+    if (mst->prvtptr)
+      msr_free ((MSRecord **)&mst->prvtptr);
+
+    mst_free (&mst);
+  }
+
+  /* Rebuild the trace index without the released traces */
+  if (mstg->numtraces != numtraces)
+    mst_groupindex (mstg, 1);
+} /* End of prunetraces() */
+
+/***************************************************************************
+ * spoolfile:
+ *
+ * Determine if a file in a spool directory should be converted.
+ * Hidden files, which are being written or are temporary output, and
+ * output files are ignored, as are files not matching the file name
+ * pattern if specified.
+ *
+ * Returns 1 if the file should be converted, otherwise 0
+ ***************************************************************************/
+static flag
+spoolfile (const char *name)
+{
+  size_t length = strlen (name);
+
+  if (name[0] == '.')
+    return 0;
+
+  if (length >= 6 && !strcmp (name + length - 6, ".mseed"))
+    return 0;
+
+  if (fileglob && fnmatch (fileglob, name, 0))
+    return 0;
+
+  return 1;
+} /* End of spoolfile() */
+
+/***************************************************************************
+ * stagingname:
+ *
+ * Determine the temporary name of an output file written for a spool
+ * file, the file name made hidden with a leading '.' and ".tmp" added.
+ *
+ * Returns 0 on success, and -1 if the name does not fit in size bytes
+ ***************************************************************************/
+int
+stagingname (const char *name, char *tmpname, size_t size)
+{
+  const char *base;
+  int length;
+
+  base = strrchr (name, '/');
+  base = (base) ? base + 1 : name;
+
+  length = snprintf (tmpname, size, "%.*s.%s.tmp", (int)(base - name), name, base);
+
+  return (length < 0 || (size_t)length >= size) ? -1 : 0;
+} /* End of stagingname() */
+#endif /* S2M_WATCH */
@@ -0,0 +1,23 @@
+/***************************************************************************
+ * watch.h
+ *
+ * Conversion of files arriving in spool directories, watched with
+ * inotify on Linux.
+ *
+ * Files already in the spool directories are converted first, then
+ * each file as it is closed after writing or moved into a spool
+ * directory until a stop signal is received.
+ ***************************************************************************/
+
+#ifndef WATCH_H
+#define WATCH_H 1
+
+#include "sac2mseed.h"
+
+#if defined(S2M_WATCH)
+extern int startwatch (void);
+extern int watchspool (void);
+extern int stagingname (const char *name, char *tmpname, size_t size);
+#endif
+
+#endif /* WATCH_H */